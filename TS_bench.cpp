@@ -0,0 +1,414 @@
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include "tsSynthetic.h"
+#include "tsUdpInput.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Throughput benchmark:
+  Every stage of parser is timed separately on the same deterministic synthetic stream (see xTS_SyntheticGenerator),
+  so results of two builds are directly comparable. Each benchmark is run once for warm-up and then Repeat times,
+  best and median times are reported. Checksum of results is reported too - it keeps compiler from removing measured
+  work and should not change between builds unless parser behavior changes.
+*/
+
+//=============================================================================================================================================================================
+
+struct xBenchResult
+{
+  std::string Name;
+  uint32_t NumRepeats;
+  uint64_t NumPackets;
+  uint64_t NumBytes;
+  double BestTime;   // seconds
+  double MedianTime; // seconds
+  uint64_t Checksum;
+};
+
+static xBenchResult RunBenchmark(const char *Name, uint32_t NumRepeats, uint64_t NumPackets, uint64_t NumBytes, const std::function<uint64_t()> &Body)
+{
+  xBenchResult Result;
+  Result.Name = Name;
+  Result.NumRepeats = NumRepeats;
+  Result.NumPackets = NumPackets;
+  Result.NumBytes = NumBytes;
+  Result.Checksum = Body(); // warm-up
+
+  std::vector<double> Times;
+  for (uint32_t RepeatIdx = 0; RepeatIdx < NumRepeats; RepeatIdx++)
+  {
+    std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+    uint64_t Checksum = Body();
+    Times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count());
+    if (Checksum != Result.Checksum)
+    {
+      fprintf(stderr, "Benchmark '%s' is not deterministic.\n", Name);
+    }
+  }
+  std::sort(Times.begin(), Times.end());
+  Result.BestTime = Times.empty() ? 0.0 : Times.front();
+  Result.MedianTime = Times.empty() ? 0.0 : Times[Times.size() / 2];
+  return Result;
+}
+
+//=============================================================================================================================================================================
+
+// sink which only counts demultiplexed bytes
+class xCountingSink : public xTS_StreamSink
+{
+protected:
+  uint64_t &m_NumBytes;
+
+public:
+  xCountingSink(uint64_t &NumBytes) : m_NumBytes(NumBytes) {}
+  int32_t Write(const uint8_t *Data, uint32_t Size) override
+  {
+    (void)Data;
+    m_NumBytes += Size;
+    return Size;
+  }
+};
+
+//=============================================================================================================================================================================
+
+// paced at stream bitrate, so live receiver sees realistic arrival times (and socket buffers do not overflow)
+static int SendStream(const char *Address, const uint8_t *Data, uint32_t NumPackets, uint32_t Bitrate, uint32_t LossInterval)
+{
+  xTS_UdpSender sender;
+  if (sender.Open(Address) == NOT_VALID)
+  {
+    fprintf(stderr, "The address '%s' cannot be used.\n", Address);
+    return 1;
+  }
+  sender.setLossInterval(LossInterval);
+
+  const uint32_t PacketsPerSend = xTS_UdpSender::PacketsPerDatagram * 8;
+  const double BitsPerPacket = xTS::TS_PacketLength * 8.0;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  for (uint32_t packetIdx = 0; packetIdx < NumPackets; packetIdx += PacketsPerSend)
+  {
+    double sendTime = packetIdx * BitsPerPacket / (Bitrate > 0 ? Bitrate : 1);
+    std::this_thread::sleep_until(startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(sendTime)));
+    uint32_t numSendPackets = NumPackets - packetIdx < PacketsPerSend ? NumPackets - packetIdx : PacketsPerSend;
+    if (sender.Send(Data + (size_t)packetIdx * xTS::TS_PacketLength, numSendPackets, (uint32_t)(sendTime * xTS_RTP::ClockFrequency_Hz)) == NOT_VALID)
+    {
+      fprintf(stderr, "Sending to '%s' failed.\n", Address);
+      return 1;
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  fprintf(stderr, "Sent: Packets=%u Datagrams=%" PRIu64 " Dropped=%" PRIu64 " Time=%.3fs\n", NumPackets, sender.getNumDatagrams(), sender.getNumDropped(), elapsed);
+  return EXIT_SUCCESS;
+}
+
+static void PrintUsage(const char *ProgramName)
+{
+  xTS_SyntheticGenerator::xConfig Default = xTS_SyntheticGenerator::DefaultConfig();
+  printf("Usage: %s [options]\n", ProgramName);
+  printf("  --packets <N>        number of generated packets (default: %u)\n", Default.NumPackets);
+  printf("  --seed <N>           generator seed (default: %" PRIu64 ")\n", Default.Seed);
+  printf("  --stream <spec>      elementary stream <PID>:<v|a|n>:<weight>:<min PES>:<max PES>[:pcr], may be repeated\n");
+  printf("                       (default: 256:v:8:20000:80000:pcr 257:a:1:400:1500 258:a:1:400:1500 8191:n:1)\n");
+  printf("  --af-density <P>     probability of adaptation field on packet (default: %.2f)\n", Default.AFDensity);
+  printf("  --pcr-interval <N>   packets of PCR stream between PCRs, 0 - none (default: %u)\n", Default.PCRInterval);
+  printf("  --cc-error-rate <P>  probability of continuity counter jump (default: %.2f)\n", Default.CCErrorRate);
+  printf("  --psi-interval <N>   packets between PAT/PMT, 0 - none (default: %u)\n", Default.PSIInterval);
+  printf("  --repeat <N>         timed runs of every benchmark (default: 5)\n");
+  printf("  --format json|csv    report format (default: json)\n");
+  printf("  --output <file>      write report to file instead of standard output\n");
+  printf("  --dump <file>        write generated stream to file\n");
+  printf("  --bitrate <bps>      stream bitrate, sets PCR/PTS progression and --send pace (default: %u)\n", Default.Bitrate);
+  printf("  --send <address>     instead of benchmarks, send generated stream to udp://<host>:<port> (rtp://<host>:<port> with RTP header)\n");
+  printf("  --send-loss <N>      with --send, drop every N-th datagram (default: 0 - none)\n");
+}
+
+int main(int argc, char *argv[])
+{
+  xTS_SyntheticGenerator::xConfig config = xTS_SyntheticGenerator::DefaultConfig();
+  std::vector<xTS_SyntheticGenerator::xStreamConfig> streams;
+  uint32_t numRepeats = 5;
+  bool csv = false;
+  const char *outputFileName = nullptr;
+  const char *dumpFileName = nullptr;
+  const char *sendAddress = nullptr;
+  uint32_t sendLossInterval = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--packets") == 0 && i + 1 < argc)
+    {
+      config.NumPackets = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+    {
+      config.Seed = strtoull(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc)
+    {
+      xTS_SyntheticGenerator::xStreamConfig stream;
+      if (xTS_SyntheticGenerator::ParseStreamConfig(argv[++i], stream) == NOT_VALID)
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      streams.push_back(stream);
+    }
+    else if (strcmp(argv[i], "--af-density") == 0 && i + 1 < argc)
+    {
+      config.AFDensity = strtod(argv[++i], nullptr);
+    }
+    else if (strcmp(argv[i], "--pcr-interval") == 0 && i + 1 < argc)
+    {
+      config.PCRInterval = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--cc-error-rate") == 0 && i + 1 < argc)
+    {
+      config.CCErrorRate = strtod(argv[++i], nullptr);
+    }
+    else if (strcmp(argv[i], "--psi-interval") == 0 && i + 1 < argc)
+    {
+      config.PSIInterval = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+    {
+      numRepeats = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (strcmp(argv[i], "json") == 0 || strcmp(argv[i], "csv") == 0)
+      {
+        csv = strcmp(argv[i], "csv") == 0;
+      }
+      else
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+    {
+      outputFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+    {
+      dumpFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--bitrate") == 0 && i + 1 < argc)
+    {
+      config.Bitrate = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--send") == 0 && i + 1 < argc)
+    {
+      sendAddress = argv[++i];
+    }
+    else if (strcmp(argv[i], "--send-loss") == 0 && i + 1 < argc)
+    {
+      sendLossInterval = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else
+    {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (!streams.empty())
+  {
+    config.Streams = streams;
+  }
+
+  // generate input
+  xTS_SyntheticGenerator generator;
+  std::vector<uint8_t> input;
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  generator.Generate(config, input);
+  double generateTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  const uint8_t *data = input.data();
+  const uint32_t numPackets = config.NumPackets;
+  const uint64_t numBytes = input.size();
+
+  if (dumpFileName != nullptr)
+  {
+    FILE *dumpFile = fopen(dumpFileName, "wb");
+    if (dumpFile == nullptr || fwrite(data, 1, input.size(), dumpFile) != input.size())
+    {
+      fprintf(stderr, "The file '%s' cannot be written.\n", dumpFileName);
+      return 1;
+    }
+    fclose(dumpFile);
+  }
+
+  if (sendAddress != nullptr)
+  {
+    return SendStream(sendAddress, data, numPackets, config.Bitrate, sendLossInterval);
+  }
+
+  // headers and adaptation fields decoded up front - later stages are measured without cost of earlier ones
+  std::vector<xTS_PacketHeader> headers(numPackets);
+  std::vector<xTS_AdaptationField> adaptationFields(numPackets);
+  std::vector<uint32_t> payloadOffsets(numPackets);
+  for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx++)
+  {
+    const uint8_t *packet = data + (size_t)packetIdx * xTS::TS_PacketLength;
+    headers[packetIdx].Parse(packet);
+    adaptationFields[packetIdx].Reset();
+    payloadOffsets[packetIdx] = adaptationFields[packetIdx].ParsePacket(packet, headers[packetIdx].getAdaptationFieldControl());
+  }
+
+  std::vector<xBenchResult> results;
+
+  results.push_back(RunBenchmark("header_parse", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   xTS_PacketHeader header;
+                                   uint64_t checksum = 0;
+                                   for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx++)
+                                   {
+                                     header.Parse(data + (size_t)packetIdx * xTS::TS_PacketLength);
+                                     checksum += header.getPID() ^ header.getContinuityCounter();
+                                   }
+                                   return checksum; }));
+
+  results.push_back(RunBenchmark("header_batch", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   xTS_PacketHeaderBatch batch;
+                                   xTS_PacketHeader header;
+                                   uint64_t checksum = 0;
+                                   for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx += xTS_PacketHeaderBatch::MaxPackets)
+                                   {
+                                     batch.Parse(data + (size_t)packetIdx * xTS::TS_PacketLength, numPackets - packetIdx, xTS::TS_PacketLength);
+                                     for (uint32_t groupIdx = 0; groupIdx < batch.getNumPackets(); groupIdx++)
+                                     {
+                                       header.Load(batch, groupIdx);
+                                       checksum += header.getPID() ^ header.getContinuityCounter();
+                                     }
+                                   }
+                                   return checksum; }));
+
+  results.push_back(RunBenchmark("adaptation_field", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   xTS_AdaptationField adaptationField;
+                                   uint64_t checksum = 0;
+                                   for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx++)
+                                   {
+                                     if (headers[packetIdx].hasAdaptationField())
+                                     {
+                                       adaptationField.Reset();
+                                       checksum += adaptationField.Parse(data + (size_t)packetIdx * xTS::TS_PacketLength + xTS::TS_HeaderLength, headers[packetIdx].getAdaptationFieldControl());
+                                       checksum += adaptationField.getProgramClockReference();
+                                     }
+                                   }
+                                   return checksum; }));
+
+  results.push_back(RunBenchmark("packet_shape", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   xTS_AdaptationField adaptationField;
+                                   uint64_t checksum = 0;
+                                   for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx++)
+                                   {
+                                     const uint8_t *packet = data + (size_t)packetIdx * xTS::TS_PacketLength;
+                                     checksum += adaptationField.ParsePacket(packet, headers[packetIdx].getAdaptationFieldControl());
+                                   }
+                                   return checksum; }));
+
+  results.push_back(RunBenchmark("pes_assembly", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   std::vector<std::unique_ptr<xPES_Assembler>> assemblers;
+                                   std::vector<xPES_Assembler *> table(xTS_PID_Router::NumPIDs, nullptr);
+                                   for (const xTS_SyntheticGenerator::xStreamConfig &stream : config.Streams)
+                                   {
+                                     if (stream.Kind != xTS_SyntheticGenerator::eStreamKind::Null && table[stream.PID] == nullptr)
+                                     {
+                                       assemblers.emplace_back(new xPES_Assembler());
+                                       assemblers.back()->Init(stream.PID);
+                                       table[stream.PID] = assemblers.back().get();
+                                     }
+                                   }
+                                   uint64_t checksum = 0;
+                                   for (uint32_t packetIdx = 0; packetIdx < numPackets; packetIdx++)
+                                   {
+                                     xPES_Assembler *assembler = table[headers[packetIdx].getPID()];
+                                     if (assembler != nullptr)
+                                     {
+                                       checksum += (uint64_t)assembler->AbsorbPacket(data + (size_t)packetIdx * xTS::TS_PacketLength + payloadOffsets[packetIdx], &headers[packetIdx], &adaptationFields[packetIdx]);
+                                     }
+                                   }
+                                   for (const std::unique_ptr<xPES_Assembler> &assembler : assemblers)
+                                   {
+                                     checksum += assembler->getNumCompletedPackets();
+                                   }
+                                   return checksum; }));
+
+  // same steps as sequential path of parser, without logging and output files
+  results.push_back(RunBenchmark("demux", numRepeats, numPackets, numBytes, [&]()
+                                 {
+                                   uint64_t numOutputBytes = 0;
+                                   xTS_MemoryReader reader;
+                                   reader.Attach(data, input.size(), 0);
+                                   xTS_PID_Router router;
+                                   xPSI_Scanner psiScanner;
+                                   psiScanner.Init(&router, [&numOutputBytes](uint16_t, uint8_t)
+                                                   { return std::unique_ptr<xTS_StreamSink>(new xCountingSink(numOutputBytes)); });
+                                   xTS_BatchDemuxer demuxer;
+                                   demuxer.Init(&router, &psiScanner);
+                                   xTS_PacketBatch batch;
+                                   while (reader.ReadBatch(batch) > 0)
+                                   {
+                                     demuxer.AbsorbBatch(batch);
+                                   }
+                                   router.Flush();
+                                   reader.Close();
+                                   return numOutputBytes; }));
+
+  // report
+  FILE *output = outputFileName != nullptr ? fopen(outputFileName, "w") : stdout;
+  if (output == nullptr)
+  {
+    fprintf(stderr, "The file '%s' cannot be opened.\n", outputFileName);
+    return 1;
+  }
+  if (csv)
+  {
+    fprintf(output, "name,repeats,packets,bytes,best_s,median_s,packets_per_s,mb_per_s,checksum\n");
+    for (const xBenchResult &result : results)
+    {
+      fprintf(output, "%s,%u,%" PRIu64 ",%" PRIu64 ",%.9f,%.9f,%.0f,%.2f,%" PRIu64 "\n",
+              result.Name.c_str(), result.NumRepeats, result.NumPackets, result.NumBytes, result.BestTime, result.MedianTime,
+              result.BestTime > 0 ? result.NumPackets / result.BestTime : 0.0, result.BestTime > 0 ? result.NumBytes / result.BestTime / 1e6 : 0.0, result.Checksum);
+    }
+  }
+  else
+  {
+    fprintf(output, "{\n  \"generator\": {\"seed\": %" PRIu64 ", \"packets\": %u, \"bytes\": %" PRIu64 ", \"streams\": %u, \"pes_packets\": %" PRIu64
+                    ", \"af_packets\": %" PRIu64 ", \"cc_errors\": %" PRIu64 ", \"time_s\": %.6f},\n",
+            config.Seed, numPackets, numBytes, (uint32_t)config.Streams.size(), generator.getNumPESPackets(), generator.getNumAFPackets(), generator.getNumCCErrors(), generateTime);
+    fprintf(output, "  \"benchmarks\": [\n");
+    for (size_t resultIdx = 0; resultIdx < results.size(); resultIdx++)
+    {
+      const xBenchResult &result = results[resultIdx];
+      fprintf(output, "    {\"name\": \"%s\", \"repeats\": %u, \"packets\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"best_s\": %.9f, \"median_s\": %.9f, \"packets_per_s\": %.0f, \"mb_per_s\": %.2f, \"checksum\": %" PRIu64 "}%s\n",
+              result.Name.c_str(), result.NumRepeats, result.NumPackets, result.NumBytes, result.BestTime, result.MedianTime,
+              result.BestTime > 0 ? result.NumPackets / result.BestTime : 0.0, result.BestTime > 0 ? result.NumBytes / result.BestTime / 1e6 : 0.0, result.Checksum,
+              resultIdx + 1 < results.size() ? "," : "");
+    }
+    fprintf(output, "  ]\n}\n");
+  }
+  if (output != stdout)
+  {
+    fclose(output);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+//=============================================================================================================================================================================
@@ -1,170 +1,1003 @@
 #include "tsCommon.h"
 #include "tsTransportStream.h"
-#include <iostream>
+#include "tsInput.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include "tsPipeline.h"
+#include "tsParallel.h"
+#include "tsEventLog.h"
+#include "tsIndex.h"
+#include "tsSeek.h"
+#include "tsPCRAnalyzer.h"
+#include "tsMonitor.h"
+#include "tsUdpInput.h"
+#include "tsUringInput.h"
+#include "tsVideoIndex.h"
+#include "tsAudioFrames.h"
+#include "tsMP4Mux.h"
+#include "tsFilter.h"
+#include "tsBatch.h"
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 //=============================================================================================================================================================================
 
-int main(int argc, char *argv[], char *envp[])
+static void PrintUsage(const char *ProgramName)
+{
+  printf("Usage: %s [options] [input.ts | - | udp://[<host>]:<port> | rtp://[<host>]:<port>]\n", ProgramName);
+  printf("       %s [options] input1.ts input2.ts ... | --files <list> | --glob <pattern>\n", ProgramName);
+  printf("  input \"-\" is standard input, pipes and FIFOs are read as live streams (output is written after every batch)\n");
+  printf("  --input mmap|block|uring\n");
+  printf("                       input reader: memory mapped file, synchronous block reads or io_uring read-ahead\n");
+  printf("                       (default: mmap, mmap and uring fall back to block)\n");
+  printf("  --block-size <B>     block/uring reader read size in bytes (default: %u)\n", (uint32_t)xTS_InputSource::DefaultBlockSize);
+  printf("  --read-ahead <N>     uring reader blocks in flight (default: %u)\n", xTS_InputSource::DefaultReadAhead);
+  printf("  --batch <N>          packets per batch (default: %u)\n", xTS_InputSource::DefaultBatchSize);
+  printf("  --udp-timeout <ms>   live input ends after no datagram arrived for given time, 0 - never (default: %u)\n", xTS_UdpReader::DefaultTimeout);
+  printf("  --pid <PID>[:<file>] demultiplex PID into file (default file: PID<PID>.es), may be repeated, file \"-\" is standard output\n");
+  printf("                       without --pid, streams are discovered from PAT/PMT and written to PID<PID>.<ext>\n");
+  printf("  --program <N>        with automatic discovery, demultiplex only program N (with --ts-out: keep only program N)\n");
+  printf("  --flush-size <B>     bytes collected per output stream before it is written (default: %u)\n", (uint32_t)xTS_FileSink::DefaultFlushThreshold);
+  printf("  --threads <N>        1 - single thread, 2 - separate reader, N > 2 - separate reader and N-2 output writers (default: 1)\n");
+  printf("  --parallel           parse chunks of mapped input concurrently on --threads workers (default: all cores),\n");
+  printf("                       output files are identical to sequential run, packet dump is not printed\n");
+  printf("  --chunk-size <B>     parallel parsing chunk size in bytes (default: %u)\n", (uint32_t)xTS_ParallelParser::DefaultChunkSize);
+  printf("  --log <format>       packet log: none|text|binary|jsonl|csv (default: text)\n");
+  printf("  --log-file <file>    write binary/jsonl/csv packet log to file instead of standard output\n");
+  printf("  --quiet              same as --log none\n");
+  printf("  --write-index <file> write random access index (PUSI, RAI and PCR positions per PID) of input to file\n");
+  printf("  --index <file>       load random access index written by earlier run\n");
+  printf("  --start <B>          start at byte offset B (with --index: at first random access point at or after B)\n");
+  printf("  --seek <time>        start at first random access point at [[HH:]MM:]SS[.fff] after first PCR (mapped input)\n");
+  printf("  --frame-index <file> write frame index (offset, size, PTS, keyframe) of discovered H.264/HEVC streams to file\n");
+  printf("  --audio-frames <file> write discovered MPEG audio/ADTS streams frame aligned to PID<PID>.frames.<ext>\n");
+  printf("                       (PES headers stripped) and their frame table (offset, size, PTS) to file\n");
+  printf("  --mp4 <file>         remux discovered H.264 video and MPEG audio/ADTS streams into fragmented MP4 file\n");
+  printf("  --ts-out <file>      copy packets of selected programs/PIDs to transport stream file (\"-\" is standard output)\n");
+  printf("                       with PAT/PMT regenerated to match, payload is not demultiplexed\n");
+  printf("  --keep-pid <PID>     with --ts-out, keep only given PID (with its program PSI and PCR), may be repeated\n");
+  printf("  --files <list>       batch mode: demultiplex every file named in list (one per line, \"-\" is standard input)\n");
+  printf("  --glob <pattern>     batch mode: demultiplex every file matching pattern, may be repeated\n");
+  printf("                       (batch mode is used for more than one input too) - files are processed concurrently on\n");
+  printf("                       --threads workers (default: all cores), streams are written to <out-dir>/<name>.PID<PID>.<ext>\n");
+  printf("  --out-dir <dir>      batch mode output directory (default: current directory)\n");
+  printf("  --report <file>      batch mode CSV report, one row per file (default: standard output)\n");
+  printf("  --pcr-analysis       print PCR interval, bitrate, jitter and drift per PID to stderr\n");
+  printf("  --monitor            check ETR 290 priority 1 and 2 indicators of every PID, report to stderr\n");
+  printf("  --stats              print throughput summary to stderr\n");
+}
+
+struct xStreamRequest
+{
+  uint16_t PID;
+  std::string FileName;
+};
+
+// per packet work of sequential parser on top of shared demux loop - index, PCR analysis, monitor and packet log
+class xParserObserver : public xTS_PacketObserver
 {
+public:
+  xTS_IndexBuilder *IndexBuilder = nullptr; // components are nullptr when disabled
+  xTS_PCRAnalyzer *PCRAnalyzer = nullptr;
+  xTS_Monitor *Monitor = nullptr;
+  bool TextLog = false;
+  xTS_EventLog *EventLog = nullptr; // structured log
+  int32_t FirstPacketId = 0;        // id of first packet of batch
+  xTS_PacketEvent PacketEvent;
 
-  const char *fileNamePID136 = "PID136.mp2";
+  bool isActive() const { return IndexBuilder != nullptr || PCRAnalyzer != nullptr || Monitor != nullptr || TextLog || EventLog != nullptr; }
 
-  if (std::remove(fileNamePID136) == 0)
+  void OnPacket(const xTS_PacketBatch &Batch, uint32_t PacketIdx, const xTS_PacketHeader &PacketHeader) override
   {
-    printf("The file '%s' has been deleted.\n", fileNamePID136);
+    const uint8_t *Packet = Batch.getPacket(PacketIdx);
+    if (IndexBuilder != nullptr)
+    {
+      IndexBuilder->AddPacket(Batch.getPacketOffset(PacketIdx), Packet, &PacketHeader);
+    }
+    if (PCRAnalyzer != nullptr)
+    {
+      PCRAnalyzer->AddPacket(Batch.getPacketOffset(PacketIdx), Packet, PacketHeader.getPID());
+    }
+    if (Monitor != nullptr)
+    {
+      Monitor->AddPacket(Batch.getPacketOffset(PacketIdx), Packet, &PacketHeader);
+    }
   }
-  else
+
+  void OnDemuxed(const xTS_PacketBatch &Batch, uint32_t PacketIdx, const xTS_PacketHeader &PacketHeader, const xTS_AdaptationField &AdaptationField,
+                 xTS_DemuxStream *Stream, xPES_Assembler::eResult Result) override
   {
-    perror("Error occurred while deleting the file.\n");
+    if (TextLog)
+    {
+      printf("%010d ", FirstPacketId + (int32_t)PacketIdx);
+      PacketHeader.Print();
+      if (PacketHeader.hasAdaptationField())
+      {
+        AdaptationField.Print();
+      }
+      switch (Result)
+      {
+      case xPES_Assembler::eResult::StreamPackedLost:
+        printf("PcktLost\n");
+        break;
+      case xPES_Assembler::eResult::DuplicatePacket:
+        printf("Duplicate\n");
+        break;
+      case xPES_Assembler::eResult::AssemblingStarted:
+        Stream->getAssembler().getPESH().PrintTimestamps();
+        printf("Started\n");
+        Stream->getAssembler().PrintPESH();
+        break;
+      case xPES_Assembler::eResult::AssemblingContinue:
+        printf("Continue\n");
+        break;
+      case xPES_Assembler::eResult::AssemblingFinished:
+        printf("Finished\n");
+        printf("PES: Len=%d", Stream->getAssembler().getNumPacketBytes());
+        break;
+      default:
+        break;
+      }
+      printf("\n");
+      printf("\n");
+    }
+    else if (EventLog != nullptr)
+    {
+      PacketEvent.Set(FirstPacketId + (int32_t)PacketIdx, Batch.getPacketOffset(PacketIdx), &PacketHeader, &AdaptationField, Result, &Stream->getAssembler());
+      EventLog->Write(PacketEvent);
+    }
   }
+};
+
+int main(int argc, char *argv[], char *envp[])
+{
+  (void)envp;
 
-  const char *fileNamePID174 = "PID174.264";
+  const char *inputFileName = "example_new.ts";
+  xTS_InputSource::eMode inputMode = xTS_InputSource::eMode::Mapped;
+  size_t blockSize = xTS_InputSource::DefaultBlockSize;
+  uint32_t batchSize = xTS_InputSource::DefaultBatchSize;
+  uint32_t udpTimeout = xTS_UdpReader::DefaultTimeout;
+  uint32_t readAhead = xTS_InputSource::DefaultReadAhead;
+  bool printStats = false;
+  std::vector<xStreamRequest> streamRequests;
+  int32_t programFilter = -1;
+  size_t flushSize = xTS_FileSink::DefaultFlushThreshold;
+  uint32_t numThreads = 1;
+  bool parallel = false;
+  size_t chunkSize = xTS_ParallelParser::DefaultChunkSize;
+  xTS_EventLog::eFormat logFormat = xTS_EventLog::eFormat::Text;
+  const char *logFileName = nullptr;
+  const char *writeIndexFileName = nullptr;
+  const char *indexFileName = nullptr;
+  int64_t startOffset = NOT_VALID;
+  bool seek = false;
+  bool pcrAnalysis = false;
+  bool monitorEnabled = false;
+  uint64_t seekTime = 0;
+  const char *frameIndexFileName = nullptr;
+  const char *audioFramesFileName = nullptr;
+  const char *mp4FileName = nullptr;
+  const char *tsOutFileName = nullptr;
+  std::vector<uint16_t> keepPIDs;
+  std::vector<std::string> inputFileNames;
+  bool batchMode = false;
+  const char *outputDirectory = nullptr;
+  const char *reportFileName = nullptr;
 
-  if (std::remove(fileNamePID174) == 0)
+  for (int i = 1; i < argc; i++)
   {
-    printf("The file '%s' has been deleted.\n", fileNamePID174);
+    if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+    {
+      i++;
+      if (strcmp(argv[i], "mmap") == 0)
+      {
+        inputMode = xTS_InputSource::eMode::Mapped;
+      }
+      else if (strcmp(argv[i], "block") == 0)
+      {
+        inputMode = xTS_InputSource::eMode::Block;
+      }
+      else if (strcmp(argv[i], "uring") == 0)
+      {
+        inputMode = xTS_InputSource::eMode::Uring;
+      }
+      else
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc)
+    {
+      readAhead = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--udp-timeout") == 0 && i + 1 < argc)
+    {
+      udpTimeout = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--block-size") == 0 && i + 1 < argc)
+    {
+      blockSize = (size_t)strtoull(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+    {
+      batchSize = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--pid") == 0 && i + 1 < argc)
+    {
+      char *end = nullptr;
+      xStreamRequest request;
+      request.PID = (uint16_t)(strtoul(argv[++i], &end, 0) & xTS_PID_Router::PIDMask);
+      request.FileName = (*end == ':') ? std::string(end + 1) : "PID" + std::to_string(request.PID) + ".es";
+      streamRequests.push_back(request);
+    }
+    else if (strcmp(argv[i], "--program") == 0 && i + 1 < argc)
+    {
+      programFilter = (int32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--flush-size") == 0 && i + 1 < argc)
+    {
+      flushSize = (size_t)strtoull(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      numThreads = (uint32_t)strtoul(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--parallel") == 0)
+    {
+      parallel = true;
+    }
+    else if (strcmp(argv[i], "--chunk-size") == 0 && i + 1 < argc)
+    {
+      chunkSize = (size_t)strtoull(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc)
+    {
+      if (xTS_EventLog::ParseFormat(argv[++i], logFormat) == NOT_VALID)
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--log-file") == 0 && i + 1 < argc)
+    {
+      logFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--quiet") == 0)
+    {
+      logFormat = xTS_EventLog::eFormat::None;
+    }
+    else if (strcmp(argv[i], "--write-index") == 0 && i + 1 < argc)
+    {
+      writeIndexFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc)
+    {
+      indexFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--start") == 0 && i + 1 < argc)
+    {
+      startOffset = (int64_t)strtoull(argv[++i], nullptr, 0);
+    }
+    else if (strcmp(argv[i], "--seek") == 0 && i + 1 < argc)
+    {
+      if (xTS_SeekEngine::ParseTime(argv[++i], seekTime) == NOT_VALID)
+      {
+        PrintUsage(argv[0]);
+        return 1;
+      }
+      seek = true;
+    }
+    else if (strcmp(argv[i], "--frame-index") == 0 && i + 1 < argc)
+    {
+      frameIndexFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--audio-frames") == 0 && i + 1 < argc)
+    {
+      audioFramesFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--mp4") == 0 && i + 1 < argc)
+    {
+      mp4FileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--ts-out") == 0 && i + 1 < argc)
+    {
+      tsOutFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--keep-pid") == 0 && i + 1 < argc)
+    {
+      keepPIDs.push_back((uint16_t)(strtoul(argv[++i], nullptr, 0) & xTS_PID_Router::PIDMask));
+    }
+    else if (strcmp(argv[i], "--files") == 0 && i + 1 < argc)
+    {
+      if (xTS_BatchProcessor::ReadFileList(argv[++i], inputFileNames) == NOT_VALID)
+      {
+        fprintf(stderr, "The list '%s' cannot be read.\n", argv[i]);
+        return 1;
+      }
+      batchMode = true;
+    }
+    else if (strcmp(argv[i], "--glob") == 0 && i + 1 < argc)
+    {
+      if (xTS_BatchProcessor::ExpandPattern(argv[++i], inputFileNames) == NOT_VALID)
+      {
+        fprintf(stderr, "No file matches '%s'.\n", argv[i]);
+      }
+      batchMode = true;
+    }
+    else if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc)
+    {
+      outputDirectory = argv[++i];
+    }
+    else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc)
+    {
+      reportFileName = argv[++i];
+    }
+    else if (strcmp(argv[i], "--pcr-analysis") == 0)
+    {
+      pcrAnalysis = true;
+    }
+    else if (strcmp(argv[i], "--monitor") == 0)
+    {
+      monitorEnabled = true;
+    }
+    else if (strcmp(argv[i], "--stats") == 0)
+    {
+      printStats = true;
+    }
+    else if (argv[i][0] == '-' && argv[i][1] == '-')
+    {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    else
+    {
+      inputFileName = argv[i];
+      inputFileNames.push_back(argv[i]);
+    }
   }
-  else
+  batchMode |= inputFileNames.size() > 1;
+
+  // stream data on standard output must not be mixed with anything else
+  uint32_t numStandardOutputs = 0;
+  for (const xStreamRequest &request : streamRequests)
+  {
+    numStandardOutputs += request.FileName == "-" ? 1 : 0;
+  }
+  numStandardOutputs += mp4FileName != nullptr && strcmp(mp4FileName, "-") == 0 ? 1 : 0;
+  numStandardOutputs += tsOutFileName != nullptr && strcmp(tsOutFileName, "-") == 0 ? 1 : 0;
+  if (numStandardOutputs > 1)
+  {
+    fprintf(stderr, "Only one stream can be written to standard output.\n");
+    return 1;
+  }
+  if (tsOutFileName != nullptr && (!streamRequests.empty() || frameIndexFileName != nullptr || audioFramesFileName != nullptr || mp4FileName != nullptr ||
+                                   writeIndexFileName != nullptr || pcrAnalysis || monitorEnabled))
+  {
+    fprintf(stderr, "--ts-out cannot be combined with --pid, --frame-index, --audio-frames, --mp4, --write-index, --pcr-analysis and --monitor.\n");
+    return 1;
+  }
+  if (!keepPIDs.empty() && tsOutFileName == nullptr)
+  {
+    fprintf(stderr, "--keep-pid needs --ts-out.\n");
+    return 1;
+  }
+  if (numStandardOutputs > 0 && logFormat != xTS_EventLog::eFormat::None && logFileName == nullptr)
   {
-    perror("Error occurred while deleting the file.\n");
+    logFormat = xTS_EventLog::eFormat::None;
   }
 
-  // TODO - open file | done
-  FILE *fp;
-  fp = fopen("example_new.ts", "rb");
+  // batch mode - many files demultiplexed concurrently, one report for all of them
+  if (batchMode)
+  {
+    if (!streamRequests.empty() || parallel || writeIndexFileName != nullptr || indexFileName != nullptr || startOffset != NOT_VALID || seek || pcrAnalysis ||
+        monitorEnabled || frameIndexFileName != nullptr || audioFramesFileName != nullptr || mp4FileName != nullptr || tsOutFileName != nullptr)
+    {
+      fprintf(stderr, "Batch mode cannot be combined with --pid, --parallel, --write-index, --index, --start, --seek, --pcr-analysis, --monitor, "
+                      "--frame-index, --audio-frames, --mp4 and --ts-out.\n");
+      return 1;
+    }
+    FILE *reportFile = reportFileName != nullptr ? fopen(reportFileName, "w") : stdout;
+    if (reportFile == nullptr)
+    {
+      fprintf(stderr, "The file '%s' cannot be opened.\n", reportFileName);
+      return 1;
+    }
+    xTS_BatchProcessor batchProcessor;
+    batchProcessor.Init(numThreads > 1 ? numThreads : 0, inputMode, blockSize, readAhead, batchSize, flushSize, programFilter,
+                        outputDirectory != nullptr ? outputDirectory : "");
+    for (const std::string &fileName : inputFileNames)
+    {
+      batchProcessor.AddJob(fileName);
+    }
+    batchProcessor.Run();
+    batchProcessor.WriteReport(reportFile);
+    if (reportFile != stdout)
+    {
+      fclose(reportFile);
+    }
+    // summary is printed always, failed files are listed in report
+    batchProcessor.PrintStatistics(stderr, printStats);
+    return batchProcessor.getNumFailed() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
 
-  FILE *
-      filePID136 = fopen("PID136.mp2", "ab");
+  // TODO - open file | done
+  std::unique_ptr<xTS_InputSource> input;
+  xTS_UdpReader *udpInput = nullptr;
+  xTS_UringReader *uringInput = nullptr;
+  if (xTS_UdpAddress::isUdpAddress(inputFileName))
+  {
+    // live stream - received datagrams are parsed as they arrive
+    udpInput = new xTS_UdpReader();
+    udpInput->setTimeout(udpTimeout);
+    input.reset(udpInput);
+  }
+  else
+  {
+    input = xTS_InputSource::Create(inputMode, blockSize, readAhead);
+    if (inputMode == xTS_InputSource::eMode::Uring)
+    {
+      uringInput = static_cast<xTS_UringReader *>(input.get());
+    }
+  }
+  int32_t openResult = input->Open(inputFileName);
+  if (openResult == NOT_VALID && inputMode != xTS_InputSource::eMode::Block && udpInput == nullptr)
+  {
+    // not mappable (e.g. pipe or device) or no io_uring in kernel - read it in blocks
+    input = xTS_InputSource::Create(xTS_InputSource::eMode::Block, blockSize);
+    openResult = input->Open(inputFileName);
+    if (uringInput != nullptr && openResult != NOT_VALID)
+    {
+      fprintf(stderr, "Input cannot be read with io_uring, reading blocks.\n");
+    }
+    uringInput = nullptr;
+  }
+  input->setBatchSize(batchSize);
+  const bool liveInput = input->isLive();
 
-  FILE *
-      filePID174 = fopen("PID174.264", "ab");
+  // human readable dump goes to standard output, other formats through buffered event log
+  const bool textLog = logFormat == xTS_EventLog::eFormat::Text;
+  xTS_EventLog eventLog;
+  if (eventLog.Open(logFormat, logFileName) == NOT_VALID)
+  {
+    fprintf(stderr, "The file '%s' cannot be opened.\n", logFileName);
+    return 1;
+  }
 
   // TODO - check if file if opened | done
-  if (fp != NULL)
+  if (openResult != NOT_VALID)
   {
-    printf("File exists\n\n");
+    if (textLog)
+    {
+      printf("File exists\n\n");
+    }
   }
   else
   {
-    printf("File does not exists\n\n");
+    if (textLog)
+    {
+      printf("File does not exists\n\n");
+    }
+    else
+    {
+      fprintf(stderr, "File does not exists\n");
+    }
     return 0;
   }
 
-  if (filePID136 == nullptr || filePID174 == nullptr)
+  // payload of mapped input stays valid for whole run, so outputs can gather it straight from input memory
+  bool referenceInput = input->hasStableBuffers();
+  // with writer threads, file sinks only receive chunks that stay valid until they are written
+  xTS_Pipeline pipeline;
+  pipeline.Init(parallel ? 1 : numThreads, flushSize);
+  bool sinkReferenceInput = referenceInput || pipeline.getNumWriters() > 0;
+  std::vector<xTS_FileSink *> fileSinks;
+  std::vector<xTS_FileSink *> remuxSinks; // frame aligned audio and MP4 outputs
+  // failed write (e.g. full disk) cuts output, run then ends with error
+  auto countFailedOutputs = [](const std::vector<xTS_FileSink *> &sinks)
+  {
+    uint32_t numFailed = 0;
+    for (const xTS_FileSink *sink : sinks)
+    {
+      if (sink->hasFailed())
+      {
+        fprintf(stderr, "The file '%s' cannot be written: %s\n", sink->getFileName().c_str(), strerror(sink->getWriteError()));
+        numFailed++;
+      }
+    }
+    return numFailed;
+  };
+  std::vector<std::unique_ptr<xES_VideoIndexer>> videoIndexers;
+  std::vector<std::unique_ptr<xES_AudioFramer>> audioFramers;
+  xMP4_Muxer mp4Muxer;
+  if (mp4FileName != nullptr && mp4Muxer.Open(mp4FileName) == NOT_VALID)
   {
-    std::cout << "The file cannot be opened.\n\n";
+    fprintf(stderr, "The file '%s' cannot be opened.\n", mp4FileName);
     return 1;
   }
-
-  xTS_PacketHeader TS_PacketHeader;
-  xTS_AdaptationField TS_PacketAdaptationField;
-  xPES_PacketHeader PES_PacketHeader;
-  xPES_Assembler PES_Assembler_PID136;
-  xPES_Assembler PES_Assembler_PID174;
-  xTS packet;
-
-  int32_t TS_PacketId = 0;
-  while (!feof(fp))
+  if (mp4FileName != nullptr)
   {
-    int offset = 0;
-
-    // TODO - read from file | done
-    // const int iRozmiarBufora = 188; //po 188 bajtow
-    uint8_t bufor[packet.TS_PacketLength]; // rzutowanie char-a na uint8_t
-    // int iOdczytanoBajtow = fread(bufor, sizeof(char), packet.TS_PacketLength, fp);
-    // printf( "Odczytano %d bajtow.\n", iOdczytanoBajtow );
-
-    size_t NumRead = fread(bufor, 1, packet.TS_PacketLength, fp);
-    if (NumRead != packet.TS_PacketLength)
+    remuxSinks.push_back(&mp4Muxer.getOutput());
+  }
+  // filter output is written on parsing thread, so it gathers input memory only when that stays valid
+  xTS_PIDFilter pidFilter;
+  if (tsOutFileName != nullptr)
+  {
+    pidFilter.Init(programFilter, keepPIDs);
+    if (pidFilter.Open(tsOutFileName, referenceInput, flushSize) == NOT_VALID)
     {
-      break;
+      fprintf(stderr, "The file '%s' cannot be opened.\n", tsOutFileName);
+      return 1;
     }
+    fileSinks.push_back(&pidFilter.getOutput());
+  }
 
-    TS_PacketHeader.Reset();
-    offset += TS_PacketHeader.Parse(bufor);
+  auto setupStreams = [&](xTS_PID_Router &router, xPSI_Scanner &psiScanner)
+  {
+    // one stream (assembler + output file) per requested PID
+    for (const xStreamRequest &request : streamRequests)
+    {
+      std::unique_ptr<xTS_FileSink> sink(new xTS_FileSink());
+      if (sink->Open(request.FileName.c_str(), sinkReferenceInput, flushSize) == NOT_VALID)
+      {
+        fprintf(stderr, "The file '%s' cannot be opened.\n", request.FileName.c_str());
+        return false;
+      }
+      fileSinks.push_back(sink.get());
+      router.Register(request.PID, pipeline.WrapSink(std::move(sink), referenceInput));
+    }
 
-    if (TS_PacketHeader.getSyncByte() == 'G' && (TS_PacketHeader.getPID() == 136 || TS_PacketHeader.getPID() == 174))
+    // without explicit PIDs, elementary streams are found in PAT/PMT while demultiplexing
+    if (streamRequests.empty())
     {
-      if (TS_PacketHeader.hasAdaptationField())
+      psiScanner.Init(
+          &router, [&fileSinks, &pipeline, referenceInput, sinkReferenceInput, flushSize](uint16_t PID, uint8_t StreamType)
+          {
+            std::string fileName = "PID" + std::to_string(PID) + "." + xPSI_PMT::getFileExtension(StreamType);
+            std::unique_ptr<xTS_FileSink> sink(new xTS_FileSink());
+            if (sink->Open(fileName.c_str(), sinkReferenceInput, flushSize) == NOT_VALID)
+            {
+              fprintf(stderr, "The file '%s' cannot be opened.\n", fileName.c_str());
+              return std::unique_ptr<xTS_StreamSink>();
+            }
+            fileSinks.push_back(sink.get());
+            return pipeline.WrapSink(std::move(sink), referenceInput);
+          },
+          programFilter);
+      psiScanner.setVerbose(textLog);
+      if (frameIndexFileName != nullptr || audioFramesFileName != nullptr || mp4FileName != nullptr)
       {
-        TS_PacketAdaptationField.Reset();
-        offset += TS_PacketAdaptationField.Parse(bufor + offset, TS_PacketHeader.getAdaptationFieldControl());
+        // video frames are indexed, audio frames split and both remuxed while their payload is demultiplexed
+        psiScanner.setStreamCallback(
+            [&videoIndexers, &audioFramers, &remuxSinks, &mp4Muxer, frameIndexFileName, audioFramesFileName, mp4FileName, flushSize](xTS_DemuxStream *Stream, uint8_t StreamType)
+            {
+              xES_VideoIndexer::eCodec videoCodec;
+              xES_AudioFramer::eCodec audioCodec;
+              // every stage is one more consumer of the same PES packets
+              if (mp4FileName != nullptr)
+              {
+                xPES_Consumer *consumer = nullptr;
+                if (StreamType == xPSI_PMT::eStreamType_H264)
+                {
+                  consumer = mp4Muxer.AddVideoTrack(Stream->getPID());
+                }
+                else if (xES_AudioFramer::isAudioStreamType(StreamType, audioCodec))
+                {
+                  consumer = mp4Muxer.AddAudioTrack(Stream->getPID(), audioCodec);
+                }
+                if (consumer != nullptr)
+                {
+                  Stream->getAssembler().AddConsumer(consumer);
+                }
+              }
+              if (frameIndexFileName != nullptr && xES_VideoIndexer::isVideoStreamType(StreamType, videoCodec))
+              {
+                std::unique_ptr<xES_VideoIndexer> indexer(new xES_VideoIndexer(Stream->getPID(), videoCodec));
+                Stream->getAssembler().AddConsumer(indexer.get());
+                videoIndexers.push_back(std::move(indexer));
+              }
+              if (audioFramesFileName != nullptr && xES_AudioFramer::isAudioStreamType(StreamType, audioCodec))
+              {
+                // frames are written from framer buffer as well, so sink copies them
+                std::string fileName = "PID" + std::to_string(Stream->getPID()) + ".frames." + xPSI_PMT::getFileExtension(StreamType);
+                std::unique_ptr<xTS_FileSink> sink(new xTS_FileSink());
+                if (sink->Open(fileName.c_str(), false, flushSize) == NOT_VALID)
+                {
+                  fprintf(stderr, "The file '%s' cannot be opened.\n", fileName.c_str());
+                  return;
+                }
+                remuxSinks.push_back(sink.get());
+                std::unique_ptr<xES_AudioFramer> framer(new xES_AudioFramer(Stream->getPID(), audioCodec, std::move(sink)));
+                Stream->getAssembler().AddConsumer(framer.get());
+                audioFramers.push_back(std::move(framer));
+              }
+            });
       }
+    }
+    else if (frameIndexFileName != nullptr || audioFramesFileName != nullptr || mp4FileName != nullptr)
+    {
+      fprintf(stderr, "Stream types of --pid streams are unknown, frame index, audio frames and MP4 are not written.\n");
+    }
+    return true;
+  };
 
-      printf("%010d ", TS_PacketId);
-      TS_PacketHeader.Print();
+  if (parallel && !referenceInput)
+  {
+    fprintf(stderr, "Parallel parsing needs mapped input, parsing sequentially.\n");
+  }
+  else if (parallel && (writeIndexFileName != nullptr || startOffset != NOT_VALID || seek || pcrAnalysis || monitorEnabled || frameIndexFileName != nullptr ||
+                       audioFramesFileName != nullptr || mp4FileName != nullptr || tsOutFileName != nullptr))
+  {
+    fprintf(stderr, "Parallel parsing does not support --write-index, --start, --seek, --pcr-analysis, --monitor, --frame-index, --audio-frames, --mp4 and --ts-out, parsing sequentially.\n");
+  }
+  else if (parallel)
+  {
+    const xTS_MappedFileReader &mappedInput = static_cast<const xTS_MappedFileReader &>(*input);
+    uint32_t numWorkers = numThreads > 1 ? numThreads : std::thread::hardware_concurrency();
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-      if (TS_PacketHeader.hasAdaptationField())
+    xTS_ParallelParser parallelParser;
+    parallelParser.Init(numWorkers, chunkSize);
+    int32_t parallelResult = NOT_VALID;
+    uint32_t numFailedOutputs = 0;
+    {
+      xTS_PID_Router router;
+      xPSI_Scanner psiScanner;
+      if (!setupStreams(router, psiScanner))
       {
-        TS_PacketAdaptationField.Print();
+        return 1;
       }
+      parallelResult = parallelParser.Run(mappedInput.getMappedData(), mappedInput.getMappedSize(), router, streamRequests.empty() ? &psiScanner : nullptr, programFilter);
+      router.Flush();
+      numFailedOutputs = countFailedOutputs(fileSinks);
 
-      if (TS_PacketHeader.getPID() == 136)
+      if (parallelResult != NOT_VALID && printStats)
       {
-        xPES_Assembler::eResult Result = PES_Assembler_PID136.AbsorbPacket(bufor + offset, &TS_PacketHeader, &TS_PacketAdaptationField);
-        switch (Result)
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        uint64_t numBytes = mappedInput.getMappedSize();
+        fprintf(stderr, "Packets=%" PRIu64 " Bytes=%" PRIu64 " Time=%.6fs Throughput=%.2fMB/s\n",
+                parallelParser.getNumPackets(), numBytes, elapsed, elapsed > 0 ? numBytes / elapsed / 1e6 : 0.0);
+        uint64_t numBytesWritten = 0;
+        uint64_t numWriteCalls = 0;
+        for (const xTS_FileSink *sink : fileSinks)
+        {
+          numBytesWritten += sink->getNumBytesWritten();
+          numWriteCalls += sink->getNumWriteCalls();
+        }
+        fprintf(stderr, "Output: Streams=%u Bytes=%" PRIu64 " WriteCalls=%" PRIu64 " ZeroCopy=1 Failed=%u\n",
+                (uint32_t)fileSinks.size(), numBytesWritten, numWriteCalls, numFailedOutputs);
+        fprintf(stderr, "Parallel: Workers=%u Chunks=%u\n", parallelParser.getNumWorkers(), parallelParser.getNumChunks());
+        for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
         {
-        case xPES_Assembler::eResult::StreamPackedLost:
-          printf("PcktLost\n");
-          break;
-        case xPES_Assembler::eResult::AssemblingStarted:
-          printf("Started\n");
-          PES_Assembler_PID136.PrintPESH();
-          fwrite(PES_Assembler_PID136.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID136);
-          break;
-        case xPES_Assembler::eResult::AssemblingContinue:
-          printf("Continue\n");
-          fwrite(PES_Assembler_PID136.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID136);
-          break;
-        case xPES_Assembler::eResult::AssemblingFinished:
-          printf("Finished\n");
-          printf("PES: Len=%d", PES_Assembler_PID136.getNumPacketBytes());
-          fwrite(PES_Assembler_PID136.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID136);
-          break;
-        default:
-          break;
+          uint64_t lastPCR = 0;
+          if (parallelParser.getLastPCR((uint16_t)PID, lastPCR))
+          {
+            fprintf(stderr, "PCR: PID=%u Last=%" PRIu64 " (Time=%.6fs)\n", PID, lastPCR, (double)lastPCR / xTS::ExtendedClockFrequency_Hz);
+          }
         }
       }
-      else if (TS_PacketHeader.getPID() == 174)
+      if (parallelResult != NOT_VALID && (printStats || parallelParser.getNumDroppedBytes() != 0))
       {
-        xPES_Assembler::eResult Result = PES_Assembler_PID174.AbsorbPacket(bufor + offset, &TS_PacketHeader, &TS_PacketAdaptationField);
-        switch (Result)
+        fprintf(stderr, "Sync: PacketSize=%u DroppedBytes=%" PRIu64 "\n", parallelParser.getPacketStride(), parallelParser.getNumDroppedBytes());
+      }
+      fileSinks.clear();
+    }
+    if (parallelResult != NOT_VALID)
+    {
+      input->Close();
+      return numFailedOutputs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    fprintf(stderr, "Chunk seams cannot be stitched exactly, parsing sequentially.\n");
+  }
+
+  xTS_PID_Router router;
+  xPSI_Scanner psiScanner;
+  if (tsOutFileName == nullptr && !setupStreams(router, psiScanner))
+  {
+    return 1;
+  }
+
+  // discovery mode - streams are registered from last PAT/PMT preceding start position, so output begins right at it
+  auto primeStreams = [&](int64_t offset)
+  {
+    if (tsOutFileName == nullptr && streamRequests.empty() && psiScanner.AbsorbInput(*input, (uint64_t)offset) == NOT_VALID)
+    {
+      fprintf(stderr, "Input ends before offset %" PRId64 ".\n", offset);
+    }
+  };
+
+  // time based seek - mapped input is bisected by PCR, demultiplexing starts at next random access point
+  if (seek)
+  {
+    if (!referenceInput)
+    {
+      fprintf(stderr, "Seeking by time needs mapped input.\n");
+      return 1;
+    }
+    const xTS_MappedFileReader &mappedInput = static_cast<const xTS_MappedFileReader &>(*input);
+    xTS_SeekEngine seekEngine;
+    if (seekEngine.Init(mappedInput.getMappedData(), mappedInput.getMappedSize()) == NOT_VALID)
+    {
+      fprintf(stderr, "Input has no PCR, it cannot be seeked by time.\n");
+      return 1;
+    }
+    std::vector<uint16_t> seekPIDs;
+    for (const xStreamRequest &request : streamRequests)
+    {
+      seekPIDs.push_back(request.PID);
+    }
+    int64_t seekOffset = seekEngine.Seek(seekTime, seekPIDs);
+    if (printStats)
+    {
+      fprintf(stderr, "Seek: PCR_PID=%u Duration=%.6fs PCR=%.6fs PCROffset=%" PRIu64 " Offset=%" PRId64 " Probes=%u\n",
+              seekEngine.getPCR_PID(), (double)seekEngine.getDuration() / xTS::ExtendedClockFrequency_Hz,
+              (double)seekEngine.getLanding().Delta / xTS::ExtendedClockFrequency_Hz, seekEngine.getLanding().Offset, seekOffset, seekEngine.getNumProbes());
+    }
+    if (seekOffset == NOT_VALID)
+    {
+      fprintf(stderr, "No random access point after requested time.\n");
+      return 1;
+    }
+    primeStreams(seekOffset);
+    if (input->Seek((uint64_t)seekOffset) == NOT_VALID)
+    {
+      fprintf(stderr, "Input cannot be positioned at offset %" PRId64 ".\n", seekOffset);
+      return 1;
+    }
+  }
+  // random access - start at requested position, snapped to random access point when index is available
+  else if (startOffset != NOT_VALID)
+  {
+    if (indexFileName != nullptr)
+    {
+      xTS_PacketIndex packetIndex;
+      if (packetIndex.Open(indexFileName) == NOT_VALID)
+      {
+        fprintf(stderr, "The index '%s' cannot be loaded.\n", indexFileName);
+        return 1;
+      }
+      if (referenceInput && packetIndex.getSourceSize() != static_cast<const xTS_MappedFileReader &>(*input).getMappedSize())
+      {
+        fprintf(stderr, "The index '%s' does not match input.\n", indexFileName);
+        return 1;
+      }
+      int64_t randomAccessOffset = NOT_VALID;
+      for (const xStreamRequest &request : streamRequests)
+      {
+        const xTS_IndexEntry *entry = packetIndex.FindNext(request.PID, (uint64_t)startOffset, xTS_IndexEntry::eFlags_RandomAccess);
+        if (entry != nullptr && (randomAccessOffset == NOT_VALID || (int64_t)entry->getOffset() < randomAccessOffset))
         {
-        case xPES_Assembler::eResult::StreamPackedLost:
-          printf("PcktLost\n");
-          break;
-        case xPES_Assembler::eResult::AssemblingStarted:
-          printf("Started\n");
-          PES_Assembler_PID174.PrintPESH();
-          fwrite(PES_Assembler_PID174.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID174);
-          break;
-        case xPES_Assembler::eResult::AssemblingContinue:
-          printf("Continue\n");
-          fwrite(PES_Assembler_PID174.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID174);
-          break;
-        case xPES_Assembler::eResult::AssemblingFinished:
-          printf("Finished\n");
-          printf("PES: Len=%d", PES_Assembler_PID174.getNumPacketBytes());
-          fwrite(PES_Assembler_PID174.getPacket(), sizeof(uint8_t), (packet.TS_PacketLength - offset), filePID174);
-          break;
-        default:
-          break;
+          randomAccessOffset = (int64_t)entry->getOffset();
         }
       }
+      if (streamRequests.empty())
+      {
+        randomAccessOffset = packetIndex.FindNextOffset((uint64_t)startOffset, xTS_IndexEntry::eFlags_RandomAccess);
+      }
+      if (randomAccessOffset != NOT_VALID)
+      {
+        startOffset = randomAccessOffset;
+      }
+      else
+      {
+        fprintf(stderr, "No random access point after offset %" PRId64 ".\n", startOffset);
+      }
+    }
+    primeStreams(startOffset);
+    if (input->Seek((uint64_t)startOffset) == NOT_VALID)
+    {
+      fprintf(stderr, "Input cannot be positioned at offset %" PRId64 ".\n", startOffset);
+      return 1;
+    }
+  }
 
-      printf("\n");
-      printf("\n");
+  xTS_IndexBuilder indexBuilder;
+  const bool writeIndex = writeIndexFileName != nullptr;
+  xTS_PCRAnalyzer pcrAnalyzer;
+  std::unique_ptr<xTS_Monitor> monitor(monitorEnabled ? new xTS_Monitor() : nullptr);
+
+  // index, PCR analysis, monitor and log see packets only when enabled, otherwise demux loop does nothing else
+  xParserObserver observer;
+  observer.IndexBuilder = writeIndex ? &indexBuilder : nullptr;
+  observer.PCRAnalyzer = pcrAnalysis ? &pcrAnalyzer : nullptr;
+  observer.Monitor = monitor.get();
+  observer.TextLog = textLog;
+  observer.EventLog = eventLog.isStructured() ? &eventLog : nullptr;
+  xTS_BatchDemuxer demuxer;
+  demuxer.Init(&router, &psiScanner, observer.isActive() ? &observer : nullptr);
+
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+  uint64_t numBatches = 0;
+
+  int32_t TS_PacketId = 0;
+  // TODO - read from file | done
+  // parse/demux stage - runs on this thread, input is read ahead by reader thread when pipeline has one
+  auto processBatch = [&](const xTS_PacketBatch &batch)
+  {
+    numBatches++;
+    if (writeIndex)
+    {
+      indexBuilder.setPacketStride(batch.getPacketStride());
+    }
+    observer.FirstPacketId = TS_PacketId;
+    demuxer.AbsorbBatch(batch);
+    TS_PacketId += (int32_t)batch.getNumPackets();
+    if (liveInput)
+    {
+      // downstream tools get data as it arrives instead of once per flush size
+      router.FlushSinks();
+    }
+  };
+  // filter mode - packets are only looked up by PID and copied, nothing is demultiplexed or logged
+  auto filterBatch = [&](const xTS_PacketBatch &batch)
+  {
+    numBatches++;
+    pidFilter.AbsorbBatch(batch);
+    TS_PacketId += (int32_t)batch.getNumPackets();
+    if (liveInput)
+    {
+      pidFilter.Flush();
+    }
+  };
+  if (tsOutFileName != nullptr)
+  {
+    pipeline.Run(*input, filterBatch);
+  }
+  else
+  {
+    pipeline.Run(*input, processBatch);
+  }
+
+  // pending output may still point into input memory - write it before input is released
+  router.Flush();
+  pidFilter.Close();
+  pipeline.StopWriters();
+  eventLog.Close();
+
+  uint32_t numFailedOutputs = 0;
+  if (writeIndex && indexBuilder.Write(writeIndexFileName, input->getStreamOffset()) == NOT_VALID)
+  {
+    fprintf(stderr, "The index '%s' cannot be written.\n", writeIndexFileName);
+    numFailedOutputs++;
+  }
+
+  if (frameIndexFileName != nullptr && streamRequests.empty())
+  {
+    FILE *frameIndexFile = fopen(frameIndexFileName, "w");
+    if (frameIndexFile != nullptr)
+    {
+      xES_VideoIndexer::WriteIndexHeader(frameIndexFile);
+    }
+    else
+    {
+      fprintf(stderr, "The frame index '%s' cannot be written.\n", frameIndexFileName);
+    }
+    if (frameIndexFile != nullptr)
+    {
+      for (std::unique_ptr<xES_VideoIndexer> &videoIndexer : videoIndexers)
+      {
+        videoIndexer->WriteIndex(frameIndexFile);
+      }
+      fclose(frameIndexFile);
+    }
+  }
+
+  if (mp4FileName != nullptr && streamRequests.empty())
+  {
+    mp4Muxer.Finish();
+    if (mp4Muxer.getNumBytesWritten() == 0)
+    {
+      fprintf(stderr, "No stream could be remuxed into '%s'.\n", mp4FileName);
+    }
+  }
+
+  if (audioFramesFileName != nullptr && streamRequests.empty())
+  {
+    FILE *frameTableFile = fopen(audioFramesFileName, "w");
+    if (frameTableFile != nullptr)
+    {
+      xES_AudioFramer::WriteFrameTableHeader(frameTableFile);
     }
-    TS_PacketId++;
+    else
+    {
+      fprintf(stderr, "The frame table '%s' cannot be written.\n", audioFramesFileName);
+    }
+    if (frameTableFile != nullptr)
+    {
+      for (std::unique_ptr<xES_AudioFramer> &audioFramer : audioFramers)
+      {
+        audioFramer->WriteFrameTable(frameTableFile);
+      }
+      fclose(frameTableFile);
+    }
+  }
+
+  if (pcrAnalysis)
+  {
+    pcrAnalyzer.Print(stderr);
+  }
+
+  numFailedOutputs += countFailedOutputs(fileSinks) + countFailedOutputs(remuxSinks);
+  // failed read ends stream early, outputs are cut like by failed write
+  if (input->getReadError() != 0)
+  {
+    fprintf(stderr, "The file '%s' cannot be read: %s\n", inputFileName, strerror(-input->getReadError()));
+    numFailedOutputs++;
+  }
+
+  const xTS_SyncScanner &syncScanner = input->getSyncScanner();
+  if (monitor)
+  {
+    monitor->Finish(input->getStreamOffset(), syncScanner.getNumResyncs(), syncScanner.getNumDroppedBytes());
+    monitor->Print(stderr);
+  }
+  if (printStats)
+  {
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    uint64_t numBytes = input->getStreamOffset();
+    fprintf(stderr, "Packets=%d Batches=%" PRIu64 " Bytes=%" PRIu64 " Time=%.6fs Throughput=%.2fMB/s\n",
+            TS_PacketId, numBatches, numBytes, elapsed, elapsed > 0 ? numBytes / elapsed / 1e6 : 0.0);
+
+    uint64_t numBytesWritten = 0;
+    uint64_t numWriteCalls = 0;
+    for (const xTS_FileSink *sink : fileSinks)
+    {
+      numBytesWritten += sink->getNumBytesWritten();
+      numWriteCalls += sink->getNumWriteCalls();
+    }
+    fprintf(stderr, "Output: Streams=%u Bytes=%" PRIu64 " WriteCalls=%" PRIu64 " ZeroCopy=%d Failed=%u\n",
+            (uint32_t)fileSinks.size(), numBytesWritten, numWriteCalls, referenceInput ? 1 : 0, numFailedOutputs);
+    if (writeIndex)
+    {
+      fprintf(stderr, "Index: Packets=%" PRIu64 " Entries=%" PRIu64 "\n", indexBuilder.getNumPackets(), indexBuilder.getNumEntries());
+    }
+    for (const std::unique_ptr<xES_VideoIndexer> &videoIndexer : videoIndexers)
+    {
+      videoIndexer->PrintStatistics(stderr);
+    }
+    for (const std::unique_ptr<xES_AudioFramer> &audioFramer : audioFramers)
+    {
+      audioFramer->PrintStatistics(stderr);
+    }
+    if (mp4FileName != nullptr && streamRequests.empty())
+    {
+      mp4Muxer.PrintStatistics(stderr);
+    }
+    if (tsOutFileName != nullptr)
+    {
+      pidFilter.PrintStatistics(stderr);
+    }
+    if (pipeline.getNumThreads() > 1)
+    {
+      fprintf(stderr, "Pipeline: Threads=%u Writers=%u ReaderStalls=%" PRIu64 " ParserStalls=%" PRIu64 " WriterStalls=%" PRIu64 "\n",
+              pipeline.getNumThreads(), pipeline.getNumWriters(), pipeline.getNumReaderStalls(), pipeline.getNumParserStalls(), pipeline.getNumWriterStalls());
+    }
+    if (uringInput != nullptr)
+    {
+      uringInput->PrintStatistics(stderr);
+    }
+  }
+  if (printStats || syncScanner.getNumDroppedBytes() != 0)
+  {
+    fprintf(stderr, "Sync: PacketSize=%u DroppedBytes=%" PRIu64 " Resyncs=%" PRIu64 "\n",
+            syncScanner.getPacketStride(), syncScanner.getNumDroppedBytes(), syncScanner.getNumResyncs());
+  }
+  if (udpInput != nullptr)
+  {
+    // datagram loss is reported always, like lost sync
+    udpInput->PrintStatistics(stderr);
   }
 
   // TODO - close file | done
-  fclose(fp);
-  fclose(filePID136);
-  fclose(filePID174);
+  input->Close();
 
-  return EXIT_SUCCESS;
+  return numFailedOutputs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 //=============================================================================================================================================================================
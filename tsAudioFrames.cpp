@@ -0,0 +1,404 @@
+#include "tsAudioFrames.h"
+#include "tsPSI.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// header tables
+//=============================================================================================================================================================================
+
+// kbit/s, [MPEG-1 / MPEG-2 and 2.5][layer I, II, III][bitrate_index], free format (0) and 15 are not valid
+static const uint16_t xMPEG_Bitrates[2][3][15] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    },
+};
+
+// Hz, [MPEG-1, MPEG-2, MPEG-2.5][sampling_frequency]
+static const uint32_t xMPEG_SampleRates[3][3] = {
+    {44100, 48000, 32000},
+    {22050, 24000, 16000},
+    {11025, 12000, 8000},
+};
+
+// Hz, [sampling_frequency_index]
+static const uint32_t xADTS_SampleRates[13] = {96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350};
+
+//=============================================================================================================================================================================
+// xES_AudioFramer
+//=============================================================================================================================================================================
+
+xES_AudioFramer::xES_AudioFramer(uint16_t PID, eCodec Codec, std::unique_ptr<xTS_StreamSink> Sink)
+{
+  this->m_PID = PID;
+  this->m_Codec = Codec;
+  this->m_HeaderLength = Codec == eCodec::ADTS ? 7 : 4;
+  this->m_Sink = std::move(Sink);
+  this->m_Locked = false;
+  this->m_FixedBits = 0;
+  this->m_ESOffset = 0;
+  this->m_NumBufferedBytes = 0;
+  this->m_BufferESOffset = 0;
+  this->m_Header = {};
+  this->m_PTSPending = false;
+  this->m_PTS = 0;
+  this->m_PTSESOffset = 0;
+  this->m_AnchorValid = false;
+  this->m_AnchorPTS = 0;
+  this->m_AnchorNumSamples = 0;
+  this->m_AnchorSampleRate = 0;
+  this->m_Statistics = {};
+}
+
+bool xES_AudioFramer::isAudioStreamType(uint8_t StreamType, eCodec &Codec)
+{
+  switch (StreamType)
+  {
+  case xPSI_PMT::eStreamType_MPEG1_Audio:
+  case xPSI_PMT::eStreamType_MPEG2_Audio:
+    Codec = eCodec::MPEG;
+    return true;
+  case xPSI_PMT::eStreamType_AAC_ADTS:
+    Codec = eCodec::ADTS;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+  @brief Parse frame header
+  @param Header is pointer to at least 4 (MPEG audio) or 7 (ADTS) bytes
+  @param Codec selects header syntax
+  @param FrameHeader receives frame length and timing
+  @return Frame length or NOT_VALID when bytes are not valid header
+*/
+int32_t xES_AudioFramer::ParseHeader(const uint8_t *Header, eCodec Codec, xFrameHeader &FrameHeader)
+{
+  if (Codec == eCodec::ADTS)
+  {
+    if (Header[0] != 0xFF || (Header[1] & 0xF6) != 0xF0)
+    {
+      return NOT_VALID; // syncword or layer
+    }
+    uint32_t SampleRateIdx = (Header[2] >> 2) & 0x0F;
+    uint32_t HeaderLength = (Header[1] & 0x01) ? 7 : 9;
+    uint32_t FrameLength = ((uint32_t)(Header[3] & 0x03) << 11) | ((uint32_t)Header[4] << 3) | (Header[5] >> 5);
+    if (SampleRateIdx >= 13 || FrameLength < HeaderLength)
+    {
+      return NOT_VALID;
+    }
+    FrameHeader.FrameLength = FrameLength;
+    FrameHeader.SampleRate = xADTS_SampleRates[SampleRateIdx];
+    FrameHeader.NumSamples = (uint16_t)(1024 * ((Header[6] & 0x03) + 1));
+    FrameHeader.FixedBits = (uint16_t)((Header[1] & 0x0E) << 8 | (Header[2] & 0xFC));
+    return (int32_t)FrameLength;
+  }
+
+  if (Header[0] != 0xFF || (Header[1] & 0xE0) != 0xE0)
+  {
+    return NOT_VALID;
+  }
+  uint32_t Version = (Header[1] >> 3) & 0x03; // 0 - MPEG-2.5, 1 - reserved, 2 - MPEG-2, 3 - MPEG-1
+  uint32_t Layer = (Header[1] >> 1) & 0x03;   // 0 - reserved, 1 - layer III, 2 - layer II, 3 - layer I
+  uint32_t BitrateIdx = Header[2] >> 4;
+  uint32_t SampleRateIdx = (Header[2] >> 2) & 0x03;
+  uint32_t Padding = (Header[2] >> 1) & 0x01;
+  if (Version == 1 || Layer == 0 || BitrateIdx == 0 || BitrateIdx == 15 || SampleRateIdx == 3)
+  {
+    return NOT_VALID;
+  }
+  bool MPEG1 = Version == 3;
+  uint32_t LayerIdx = 3 - Layer;
+  uint32_t Bitrate = xMPEG_Bitrates[MPEG1 ? 0 : 1][LayerIdx][BitrateIdx] * 1000;
+  uint32_t SampleRate = xMPEG_SampleRates[Version == 3 ? 0 : Version == 2 ? 1 : 2][SampleRateIdx];
+  uint32_t FrameLength;
+  uint32_t NumSamples;
+  if (LayerIdx == 0)
+  {
+    FrameLength = (12 * Bitrate / SampleRate + Padding) * 4;
+    NumSamples = 384;
+  }
+  else if (LayerIdx == 1 || MPEG1)
+  {
+    FrameLength = 144 * Bitrate / SampleRate + Padding;
+    NumSamples = 1152;
+  }
+  else
+  {
+    FrameLength = 72 * Bitrate / SampleRate + Padding;
+    NumSamples = 576;
+  }
+  FrameHeader.FrameLength = FrameLength;
+  FrameHeader.SampleRate = SampleRate;
+  FrameHeader.NumSamples = (uint16_t)NumSamples;
+  FrameHeader.FixedBits = (uint16_t)((Header[1] & 0x1E) << 8 | (Header[2] & 0x0C));
+  return (int32_t)FrameLength;
+}
+
+/**
+  @brief Split elementary stream data of complete PES packet into frames
+  @param PID is packet identifier of stream (framer serves one PID)
+  @param Packet is PES packet, frames are placed in frame aligned output, so its stream offset is not used
+*/
+void xES_AudioFramer::OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet)
+{
+  (void)PID;
+  xPES_PacketHeader PESH;
+  PESH.Parse(Packet.getData(), Packet.getSize());
+  if (PESH.getPTS_DTS_Flags() & xPES_PacketHeader::ePTS_DTS_Flags_PTS)
+  {
+    this->m_PTSPending = true;
+    this->m_PTS = PESH.getPTS();
+    this->m_PTSESOffset = m_ESOffset;
+  }
+  uint32_t HeaderLength = std::min(PESH.getHeaderLength(), Packet.getSize());
+  xSplit(Packet.getData() + HeaderLength, Packet.getSize() - HeaderLength);
+}
+
+/**
+  @brief Split elementary stream data into frames
+  @param Data is pointer to elementary stream bytes (PES header stripped)
+  @param Size is number of bytes
+*/
+void xES_AudioFramer::xSplit(const uint8_t *Data, uint32_t Size)
+{
+  const uint8_t *Ptr = Data;
+  const uint8_t *End = Data + Size;
+  while (Ptr < End)
+  {
+    if (m_NumBufferedBytes == 0)
+    {
+      // locked stream - frames contained in data are written without copy
+      xFrameHeader Header;
+      if (m_Locked && (uint32_t)(End - Ptr) >= m_HeaderLength && ParseHeader(Ptr, m_Codec, Header) != NOT_VALID && Header.FixedBits == m_FixedBits &&
+          Header.FrameLength <= (uint32_t)(End - Ptr))
+      {
+        xEmitFrame(Ptr, Header, m_ESOffset);
+        Ptr += Header.FrameLength;
+        this->m_ESOffset += Header.FrameLength;
+        continue;
+      }
+      // searching for sync - frame can start only at 0xFF
+      if (!m_Locked)
+      {
+        const uint8_t *Sync = (const uint8_t *)std::memchr(Ptr, 0xFF, End - Ptr);
+        uint32_t NumSkipped = (uint32_t)((Sync != nullptr ? Sync : End) - Ptr);
+        this->m_Statistics.NumSkippedBytes += NumSkipped;
+        this->m_ESOffset += NumSkipped;
+        if (Sync == nullptr)
+        {
+          return;
+        }
+        Ptr = Sync;
+      }
+      this->m_BufferESOffset = m_ESOffset;
+    }
+    uint32_t NumAppended = xAppend(Ptr, (uint32_t)(End - Ptr));
+    Ptr += NumAppended;
+    this->m_ESOffset += NumAppended;
+    xProcessBuffer();
+  }
+}
+
+void xES_AudioFramer::OnDiscontinuity(uint16_t PID)
+{
+  (void)PID;
+  this->m_Statistics.NumDiscontinuities++;
+  xCloseBuffer();
+  // extrapolated PTS would not account for lost frames
+  this->m_AnchorValid = false;
+  if (m_Locked)
+  {
+    this->m_Locked = false;
+    this->m_Statistics.NumResyncs++;
+  }
+}
+
+void xES_AudioFramer::OnEndOfStream(uint16_t PID, uint64_t StreamSize)
+{
+  (void)PID;
+  (void)StreamSize;
+  xCloseBuffer();
+  if (m_Sink)
+  {
+    m_Sink->Flush();
+  }
+}
+
+// frame waiting for next header is complete, anything shorter is cut
+void xES_AudioFramer::xCloseBuffer()
+{
+  if (m_Header.FrameLength != 0 && m_NumBufferedBytes >= m_Header.FrameLength)
+  {
+    xEmitFrame(m_Buffer, m_Header, m_BufferESOffset);
+  }
+  else if (m_Header.FrameLength != 0)
+  {
+    this->m_Statistics.NumDroppedFrames++;
+  }
+  else
+  {
+    this->m_Statistics.NumSkippedBytes += m_NumBufferedBytes;
+  }
+  this->m_NumBufferedBytes = 0;
+  this->m_Header.FrameLength = 0;
+}
+
+// appends bytes needed for next step - header, rest of frame or (while not locked) header of next frame
+uint32_t xES_AudioFramer::xAppend(const uint8_t *Data, uint32_t Size)
+{
+  uint32_t Needed = m_HeaderLength;
+  if (m_Header.FrameLength != 0)
+  {
+    Needed = m_Header.FrameLength + (m_Locked ? 0 : m_HeaderLength);
+  }
+  uint32_t NumBytes = std::min(Needed - m_NumBufferedBytes, Size);
+  std::memcpy(m_Buffer + m_NumBufferedBytes, Data, NumBytes);
+  this->m_NumBufferedBytes += NumBytes;
+  return NumBytes;
+}
+
+void xES_AudioFramer::xProcessBuffer()
+{
+  while (true)
+  {
+    if (m_Header.FrameLength == 0)
+    {
+      if (m_NumBufferedBytes < m_HeaderLength)
+      {
+        return;
+      }
+      xFrameHeader Header;
+      if (ParseHeader(m_Buffer, m_Codec, Header) == NOT_VALID || (m_Locked && Header.FixedBits != m_FixedBits))
+      {
+        if (m_Locked)
+        {
+          this->m_Locked = false;
+          this->m_Statistics.NumResyncs++;
+        }
+        xSkipBufferedBytes(1);
+        continue;
+      }
+      this->m_Header = Header;
+    }
+    if (m_NumBufferedBytes < m_Header.FrameLength)
+    {
+      return;
+    }
+    if (!m_Locked)
+    {
+      // sync is confirmed by matching header right after frame
+      if (m_NumBufferedBytes < m_Header.FrameLength + m_HeaderLength)
+      {
+        return;
+      }
+      xFrameHeader NextHeader;
+      if (ParseHeader(m_Buffer + m_Header.FrameLength, m_Codec, NextHeader) == NOT_VALID || NextHeader.FixedBits != m_Header.FixedBits)
+      {
+        xSkipBufferedBytes(1);
+        continue;
+      }
+      this->m_Locked = true;
+      this->m_FixedBits = m_Header.FixedBits;
+    }
+    xEmitFrame(m_Buffer, m_Header, m_BufferESOffset);
+    uint32_t FrameLength = m_Header.FrameLength;
+    this->m_Header.FrameLength = 0;
+    this->m_NumBufferedBytes -= FrameLength;
+    this->m_BufferESOffset += FrameLength;
+    std::memmove(m_Buffer, m_Buffer + FrameLength, m_NumBufferedBytes);
+  }
+}
+
+// drops at least NumBytes from buffer, up to next possible sync byte
+void xES_AudioFramer::xSkipBufferedBytes(uint32_t NumBytes)
+{
+  const uint8_t *Sync = (const uint8_t *)std::memchr(m_Buffer + NumBytes, 0xFF, m_NumBufferedBytes - NumBytes);
+  uint32_t NumSkipped = Sync != nullptr ? (uint32_t)(Sync - m_Buffer) : m_NumBufferedBytes;
+  this->m_Statistics.NumSkippedBytes += NumSkipped;
+  this->m_Header.FrameLength = 0;
+  this->m_NumBufferedBytes -= NumSkipped;
+  this->m_BufferESOffset += NumSkipped;
+  std::memmove(m_Buffer, m_Buffer + NumSkipped, m_NumBufferedBytes);
+}
+
+void xES_AudioFramer::xEmitFrame(const uint8_t *Frame, const xFrameHeader &Header, uint64_t ESOffset)
+{
+  xFrame Entry = {};
+  Entry.Offset = m_Statistics.NumOutputBytes;
+  Entry.Size = Header.FrameLength;
+  Entry.SampleRate = Header.SampleRate;
+  Entry.NumSamples = Header.NumSamples;
+
+  // PES PTS belongs to first frame starting in its PES packet, following frames are extrapolated
+  if (m_PTSPending && ESOffset >= m_PTSESOffset)
+  {
+    this->m_PTSPending = false;
+    this->m_AnchorValid = true;
+    this->m_AnchorPTS = m_PTS;
+    this->m_AnchorNumSamples = 0;
+    this->m_AnchorSampleRate = Header.SampleRate;
+    Entry.Flags |= eFlags_PES_PTS;
+  }
+  if (m_AnchorValid)
+  {
+    if (Header.SampleRate != m_AnchorSampleRate)
+    {
+      this->m_AnchorPTS += m_AnchorNumSamples * xTS::BaseClockFrequency_Hz / m_AnchorSampleRate;
+      this->m_AnchorNumSamples = 0;
+      this->m_AnchorSampleRate = Header.SampleRate;
+    }
+    Entry.PTS = (m_AnchorPTS + m_AnchorNumSamples * xTS::BaseClockFrequency_Hz / m_AnchorSampleRate) % PTSModulus;
+    Entry.Flags |= eFlags_PTS;
+    this->m_AnchorNumSamples += Header.NumSamples;
+  }
+
+  xOnFrame(Frame, Entry);
+  this->m_Statistics.NumFrames++;
+  this->m_Statistics.NumOutputBytes += Header.FrameLength;
+}
+
+void xES_AudioFramer::xOnFrame(const uint8_t *Frame, const xFrame &Entry)
+{
+  if (m_Sink)
+  {
+    m_Sink->Write(Frame, Entry.Size);
+  }
+  m_Frames.push_back(Entry);
+}
+
+void xES_AudioFramer::WriteFrameTableHeader(FILE *File)
+{
+  fprintf(File, "pid,offset,size,pts,samples,sample_rate,pes_pts\n");
+}
+
+void xES_AudioFramer::WriteFrameTable(FILE *File) const
+{
+  for (const xFrame &Frame : m_Frames)
+  {
+    fprintf(File, "%u,%" PRIu64 ",%u,", m_PID, Frame.Offset, Frame.Size);
+    if (Frame.Flags & eFlags_PTS)
+    {
+      fprintf(File, "%" PRIu64, Frame.PTS);
+    }
+    fprintf(File, ",%u,%u,%u\n", Frame.NumSamples, Frame.SampleRate, (Frame.Flags & eFlags_PES_PTS) ? 1 : 0);
+  }
+}
+
+void xES_AudioFramer::PrintStatistics(FILE *File) const
+{
+  fprintf(File, "Audio: PID=%u Codec=%s Frames=%" PRIu64 " Bytes=%" PRIu64 " SkippedBytes=%" PRIu64 " DroppedFrames=%" PRIu64 " Resyncs=%" PRIu64 " Discontinuities=%" PRIu64 "\n",
+          m_PID, m_Codec == eCodec::ADTS ? "ADTS" : "MPEG", m_Statistics.NumFrames, m_Statistics.NumOutputBytes, m_Statistics.NumSkippedBytes,
+          m_Statistics.NumDroppedFrames, m_Statistics.NumResyncs, m_Statistics.NumDiscontinuities);
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,138 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+Audio framer (MPEG audio / AAC ADTS):
+  Runs as PES consumer of demultiplexed audio PID (registered with its assembler). PES headers are stripped, frame
+  headers are parsed in pooled PES buffers (frames split across PES packets are collected in frame buffer, frames
+  contained in one PES packet are passed through without copy) and only whole frames are written to output - result is frame aligned
+  elementary stream (PID<PID>.frames.<ext>) that can be cut at any frame boundary.
+
+  MPEG audio (ISO/IEC 11172-3 2.4.2.3, ISO/IEC 13818-3, MPEG 2.5)
+    `syncword(11) version(2) layer(2) protection_absent(1) | bitrate_index(4) sampling_frequency(2) padding(1) ...`
+    frame length from bitrate and sampling frequency, free format bitrate is not supported
+  AAC ADTS (ISO/IEC 13818-7 6.2)
+    `syncword(12) ID(1) layer(2)=0 protection_absent(1) | profile(2) sampling_frequency_index(4) ... frame_length(13)`
+    frame length is coded in header (header included), 1024 samples per raw data block
+
+  Sync is acquired when two consecutive headers agree (version, layer / profile and sampling frequency), while
+  locked frames are written as soon as they are complete. Invalid header or dropped PES packet drop sync, bytes skipped
+  while searching for it and incomplete frames are counted.
+
+  Frame table entry: offset and size in frame aligned output, PTS in 90 kHz. PTS of PES packet belongs to first
+  frame starting in that PES packet, PTS of other frames is extrapolated by number of samples since then.
+*/
+
+//=============================================================================================================================================================================
+
+class xES_AudioFramer : public xPES_Consumer
+{
+public:
+  enum class eCodec : uint8_t
+  {
+    MPEG,
+    ADTS,
+  };
+
+  enum eFlags : uint8_t
+  {
+    eFlags_PTS = 0x01,     // PTS is known
+    eFlags_PES_PTS = 0x02, // PTS comes from PES header (not extrapolated)
+  };
+
+  static constexpr uint32_t MaxHeaderLength = 7;   // bytes needed to know frame length (ADTS, MPEG audio needs 4)
+  static constexpr uint32_t MaxFrameLength = 8191; // 13 bit ADTS frame_length, MPEG audio frames are shorter
+  static constexpr uint64_t PTSModulus = 1ULL << 33;
+
+  struct xFrameHeader
+  {
+    uint32_t FrameLength; // header included
+    uint32_t SampleRate;
+    uint16_t NumSamples;
+    uint16_t FixedBits; // fields that do not change between frames of one stream
+  };
+
+  struct xFrame
+  {
+    uint64_t Offset; // in frame aligned output
+    uint64_t PTS;
+    uint32_t Size;
+    uint32_t SampleRate;
+    uint16_t NumSamples;
+    uint8_t Flags;
+  };
+
+  struct xStatistics
+  {
+    uint64_t NumFrames;
+    uint64_t NumOutputBytes;
+    uint64_t NumSkippedBytes;  // bytes dropped while searching for sync
+    uint64_t NumDroppedFrames; // incomplete frames cut by lost packets or end of stream
+    uint64_t NumResyncs;
+    uint64_t NumDiscontinuities;
+  };
+
+protected:
+  // setup
+  uint16_t m_PID;
+  eCodec m_Codec;
+  uint32_t m_HeaderLength;
+  std::unique_ptr<xTS_StreamSink> m_Sink;
+  // sync
+  bool m_Locked;
+  uint16_t m_FixedBits;
+  uint64_t m_ESOffset; // number of elementary stream bytes (PES headers excluded) passed so far
+  // frame buffer - frame being collected, while not locked followed by header of next frame
+  uint8_t m_Buffer[MaxFrameLength + MaxHeaderLength];
+  uint32_t m_NumBufferedBytes;
+  uint64_t m_BufferESOffset; // elementary stream offset of m_Buffer[0]
+  xFrameHeader m_Header;     // header of buffered frame, FrameLength is 0 when not parsed yet
+  // timing
+  bool m_PTSPending; // PTS of last PES packet waits for first frame starting at or after m_PTSESOffset
+  uint64_t m_PTS;
+  uint64_t m_PTSESOffset;
+  bool m_AnchorValid; // extrapolation base - last PES PTS and samples since then
+  uint64_t m_AnchorPTS;
+  uint64_t m_AnchorNumSamples;
+  uint32_t m_AnchorSampleRate;
+  // results
+  std::vector<xFrame> m_Frames;
+  xStatistics m_Statistics;
+
+public:
+  xES_AudioFramer(uint16_t PID, eCodec Codec, std::unique_ptr<xTS_StreamSink> Sink);
+
+  void OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet) override;
+  void OnDiscontinuity(uint16_t PID) override;
+  void OnEndOfStream(uint16_t PID, uint64_t StreamSize) override;
+
+  void WriteFrameTable(FILE *File) const;
+  void PrintStatistics(FILE *File) const;
+  static void WriteFrameTableHeader(FILE *File);
+
+  static int32_t ParseHeader(const uint8_t *Header, eCodec Codec, xFrameHeader &FrameHeader);
+  static bool isAudioStreamType(uint8_t StreamType, eCodec &Codec);
+
+public:
+  uint16_t getPID() const { return m_PID; }
+  eCodec getCodec() const { return m_Codec; }
+  const std::vector<xFrame> &getFrames() const { return m_Frames; }
+  const xStatistics &getStatistics() const { return m_Statistics; }
+
+protected:
+  void xSplit(const uint8_t *Data, uint32_t Size);
+  uint32_t xAppend(const uint8_t *Data, uint32_t Size);
+  void xProcessBuffer();
+  void xSkipBufferedBytes(uint32_t NumBytes);
+  void xCloseBuffer();
+  void xEmitFrame(const uint8_t *Frame, const xFrameHeader &Header, uint64_t ESOffset);
+  // whole frame with its timing - written to sink and frame table, derived framers may take it elsewhere
+  virtual void xOnFrame(const uint8_t *Frame, const xFrame &Entry);
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,362 @@
+#include "tsBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstring>
+#include <thread>
+#include <sys/stat.h>
+
+#if !defined(_WIN32)
+#include <glob.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_BatchProcessor
+//=============================================================================================================================================================================
+
+xTS_BatchProcessor::xTS_BatchProcessor()
+{
+  this->m_NumWorkers = 1;
+  this->m_InputMode = xTS_InputSource::eMode::Mapped;
+  this->m_BlockSize = xTS_InputSource::DefaultBlockSize;
+  this->m_ReadAhead = xTS_InputSource::DefaultReadAhead;
+  this->m_BatchSize = xTS_InputSource::DefaultBatchSize;
+  this->m_FlushThreshold = xTS_FileSink::DefaultFlushThreshold;
+  this->m_ProgramFilter = -1;
+  this->m_Time = 0;
+}
+
+/**
+  @brief Set up workers
+  @param NumWorkers is number of worker threads including calling one (0 - number of cores)
+  @param InputMode selects input reader of every worker (mapped and uring readers fall back to block reads)
+  @param ProgramFilter is program number to demultiplex (-1 for all programs)
+  @param OutputDirectory receives output streams of all files
+*/
+void xTS_BatchProcessor::Init(uint32_t NumWorkers, xTS_InputSource::eMode InputMode, size_t BlockSize, uint32_t ReadAhead, uint32_t BatchSize, size_t FlushThreshold,
+                              int32_t ProgramFilter, const std::string &OutputDirectory)
+{
+  this->m_NumWorkers = NumWorkers > 0 ? NumWorkers : std::max(1u, std::thread::hardware_concurrency());
+  this->m_InputMode = InputMode;
+  this->m_BlockSize = BlockSize;
+  this->m_ReadAhead = ReadAhead;
+  this->m_BatchSize = BatchSize;
+  this->m_FlushThreshold = FlushThreshold;
+  this->m_ProgramFilter = ProgramFilter;
+  this->m_OutputDirectory = OutputDirectory;
+}
+
+void xTS_BatchProcessor::AddJob(const std::string &FileName)
+{
+  xJob Job;
+  Job.FileName = FileName;
+
+  struct stat FileStat;
+  Job.Size = stat(FileName.c_str(), &FileStat) == 0 ? (uint64_t)FileStat.st_size : 0;
+
+  // file name without directory and extension, made unique within batch
+  size_t NameBegin = FileName.find_last_of("/\\");
+  std::string Stem = FileName.substr(NameBegin == std::string::npos ? 0 : NameBegin + 1);
+  size_t Extension = Stem.find_last_of('.');
+  if (Extension != std::string::npos && Extension > 0)
+  {
+    Stem.resize(Extension);
+  }
+  uint32_t NumUses = m_StemUses[Stem]++;
+  if (NumUses > 0)
+  {
+    Stem += "_" + std::to_string(NumUses);
+  }
+  Job.OutputPrefix = (m_OutputDirectory.empty() ? std::string() : m_OutputDirectory + "/") + Stem + ".";
+  m_Jobs.push_back(Job);
+}
+
+void xTS_BatchProcessor::Run()
+{
+  std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+
+  m_Results.assign(m_Jobs.size(), xResult());
+  uint32_t NumWorkers = std::max(1u, std::min(m_NumWorkers, (uint32_t)m_Jobs.size()));
+  m_Workers.clear();
+  for (uint32_t WorkerIdx = 0; WorkerIdx < NumWorkers; WorkerIdx++)
+  {
+    m_Workers.emplace_back(new xWorker());
+    xWorker &Worker = *m_Workers.back();
+    Worker.Input = xTS_InputSource::Create(m_InputMode, m_BlockSize, m_ReadAhead);
+    Worker.NumJobs = 0;
+    Worker.NumSteals = 0;
+    Worker.BusyTime = 0;
+  }
+
+  // largest files first, dealt round robin
+  std::vector<uint32_t> Order(m_Jobs.size());
+  for (uint32_t JobIdx = 0; JobIdx < (uint32_t)Order.size(); JobIdx++)
+  {
+    Order[JobIdx] = JobIdx;
+  }
+  std::stable_sort(Order.begin(), Order.end(), [this](uint32_t A, uint32_t B) { return m_Jobs[A].Size > m_Jobs[B].Size; });
+  for (uint32_t OrderIdx = 0; OrderIdx < (uint32_t)Order.size(); OrderIdx++)
+  {
+    m_Workers[OrderIdx % NumWorkers]->Queue.push_back(Order[OrderIdx]);
+  }
+
+  std::vector<std::thread> Threads;
+  for (uint32_t WorkerIdx = 1; WorkerIdx < NumWorkers; WorkerIdx++)
+  {
+    Threads.emplace_back(&xTS_BatchProcessor::xWorkerMain, this, WorkerIdx);
+  }
+  xWorkerMain(0);
+  for (std::thread &Thread : Threads)
+  {
+    Thread.join();
+  }
+
+  this->m_Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+/// @brief One CSV row per file, in order files were added
+void xTS_BatchProcessor::WriteReport(FILE *File) const
+{
+  fprintf(File, "file,status,packets,bytes,streams,output_bytes,lost_packets,dropped_bytes,resyncs,time_s,worker\n");
+  for (uint32_t JobIdx = 0; JobIdx < (uint32_t)m_Jobs.size(); JobIdx++)
+  {
+    const xResult &Result = m_Results[JobIdx];
+    // file name quoted, embedded quotes doubled
+    std::string FileName;
+    for (char Character : m_Jobs[JobIdx].FileName)
+    {
+      FileName += Character == '"' ? "\"\"" : std::string(1, Character);
+    }
+    fprintf(File, "\"%s\",%s,%" PRIu64 ",%" PRIu64 ",%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.6f,%u\n", FileName.c_str(),
+            Result.Status == NOT_VALID ? "failed" : "ok", Result.NumPackets, Result.NumBytes, Result.NumStreams, Result.NumOutputBytes,
+            Result.NumLostPackets, Result.NumDroppedBytes, Result.NumResyncs, Result.Time, Result.WorkerIdx);
+  }
+}
+
+void xTS_BatchProcessor::PrintStatistics(FILE *File, bool PerWorker) const
+{
+  uint64_t NumPackets = 0;
+  uint64_t NumBytes = 0;
+  uint64_t NumOutputBytes = 0;
+  uint32_t NumSteals = 0;
+  for (const xResult &Result : m_Results)
+  {
+    NumPackets += Result.NumPackets;
+    NumBytes += Result.NumBytes;
+    NumOutputBytes += Result.NumOutputBytes;
+  }
+  for (const std::unique_ptr<xWorker> &Worker : m_Workers)
+  {
+    NumSteals += Worker->NumSteals;
+  }
+  fprintf(File, "Batch: Files=%u Failed=%u Packets=%" PRIu64 " Bytes=%" PRIu64 " OutputBytes=%" PRIu64 " Time=%.6fs Throughput=%.2fMB/s Workers=%u Steals=%u\n",
+          getNumJobs(), getNumFailed(), NumPackets, NumBytes, NumOutputBytes, m_Time, m_Time > 0 ? NumBytes / m_Time / 1e6 : 0.0,
+          (uint32_t)m_Workers.size(), NumSteals);
+  if (!PerWorker)
+  {
+    return;
+  }
+  for (uint32_t WorkerIdx = 0; WorkerIdx < (uint32_t)m_Workers.size(); WorkerIdx++)
+  {
+    const xWorker &Worker = *m_Workers[WorkerIdx];
+    fprintf(File, "Worker: Idx=%u Files=%u Steals=%u Busy=%.6fs\n", WorkerIdx, Worker.NumJobs, Worker.NumSteals, Worker.BusyTime);
+  }
+}
+
+uint32_t xTS_BatchProcessor::getNumFailed() const
+{
+  return (uint32_t)std::count_if(m_Results.begin(), m_Results.end(), [](const xResult &Result) { return Result.Status == NOT_VALID; });
+}
+
+/**
+  @brief Read input file names, one per line (empty lines and lines starting with # are skipped)
+  @param ListFileName is path to list ("-" for standard input)
+  @return Number of added names, -1 when list cannot be read
+*/
+int32_t xTS_BatchProcessor::ReadFileList(const char *ListFileName, std::vector<std::string> &FileNames)
+{
+  bool StandardInput = strcmp(ListFileName, "-") == 0;
+  FILE *File = StandardInput ? stdin : fopen(ListFileName, "r");
+  if (File == nullptr)
+  {
+    return NOT_VALID;
+  }
+  int32_t NumAdded = 0;
+  char Line[4096];
+  while (fgets(Line, sizeof(Line), File) != nullptr)
+  {
+    size_t Length = strlen(Line);
+    while (Length > 0 && (Line[Length - 1] == '\n' || Line[Length - 1] == '\r'))
+    {
+      Length--;
+    }
+    if (Length == 0 || Line[0] == '#')
+    {
+      continue;
+    }
+    FileNames.emplace_back(Line, Length);
+    NumAdded++;
+  }
+  if (!StandardInput)
+  {
+    fclose(File);
+  }
+  return NumAdded;
+}
+
+/**
+  @brief Add files matching shell wildcard pattern (*, ? and [...]), sorted by name
+  @return Number of added names, -1 when pattern cannot be expanded (no match or not supported on platform)
+*/
+int32_t xTS_BatchProcessor::ExpandPattern(const char *Pattern, std::vector<std::string> &FileNames)
+{
+#if defined(_WIN32)
+  (void)Pattern;
+  (void)FileNames;
+  return NOT_VALID;
+#else
+  glob_t Matches;
+  if (glob(Pattern, 0, nullptr, &Matches) != 0)
+  {
+    globfree(&Matches);
+    return NOT_VALID;
+  }
+  for (size_t MatchIdx = 0; MatchIdx < Matches.gl_pathc; MatchIdx++)
+  {
+    FileNames.emplace_back(Matches.gl_pathv[MatchIdx]);
+  }
+  globfree(&Matches);
+  return (int32_t)Matches.gl_pathc;
+#endif
+}
+
+void xTS_BatchProcessor::xWorkerMain(uint32_t WorkerIdx)
+{
+  xWorker &Worker = *m_Workers[WorkerIdx];
+  uint32_t JobIdx = 0;
+  while (xTakeJob(WorkerIdx, JobIdx))
+  {
+    xProcessJob(Worker, WorkerIdx, JobIdx);
+    Worker.NumJobs++;
+    Worker.BusyTime += m_Results[JobIdx].Time;
+  }
+}
+
+// own queue from front, other queues from back
+bool xTS_BatchProcessor::xTakeJob(uint32_t WorkerIdx, uint32_t &JobIdx)
+{
+  xWorker &Worker = *m_Workers[WorkerIdx];
+  {
+    std::lock_guard<std::mutex> Lock(Worker.Mutex);
+    if (!Worker.Queue.empty())
+    {
+      JobIdx = Worker.Queue.front();
+      Worker.Queue.pop_front();
+      return true;
+    }
+  }
+  uint32_t NumWorkers = (uint32_t)m_Workers.size();
+  for (uint32_t VictimOffset = 1; VictimOffset < NumWorkers; VictimOffset++)
+  {
+    xWorker &Victim = *m_Workers[(WorkerIdx + VictimOffset) % NumWorkers];
+    std::lock_guard<std::mutex> Lock(Victim.Mutex);
+    if (!Victim.Queue.empty())
+    {
+      JobIdx = Victim.Queue.back();
+      Victim.Queue.pop_back();
+      Worker.NumSteals++;
+      return true;
+    }
+  }
+  return false;
+}
+
+// same demultiplexing as sequential run of single file, without packet log
+void xTS_BatchProcessor::xProcessJob(xWorker &Worker, uint32_t WorkerIdx, uint32_t JobIdx)
+{
+  std::chrono::steady_clock::time_point StartTime = std::chrono::steady_clock::now();
+  const xJob &Job = m_Jobs[JobIdx];
+  xResult &Result = m_Results[JobIdx];
+  Result = xResult();
+  Result.WorkerIdx = WorkerIdx;
+
+  xTS_InputSource *Input = Worker.Input.get();
+  int32_t OpenResult = Input->Open(Job.FileName.c_str());
+  if (OpenResult == NOT_VALID && m_InputMode != xTS_InputSource::eMode::Block)
+  {
+    if (!Worker.BlockInput)
+    {
+      Worker.BlockInput = xTS_InputSource::Create(xTS_InputSource::eMode::Block, m_BlockSize);
+    }
+    Input = Worker.BlockInput.get();
+    OpenResult = Input->Open(Job.FileName.c_str());
+  }
+  if (OpenResult == NOT_VALID)
+  {
+    Result.Status = NOT_VALID;
+    Result.Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+    return;
+  }
+  Input->setBatchSize(m_BatchSize);
+
+  // outputs of mapped input are gathered from input memory, they are written before input is closed
+  bool ReferenceInput = Input->hasStableBuffers();
+  size_t FlushThreshold = m_FlushThreshold;
+  std::string OutputPrefix = Job.OutputPrefix;
+  std::vector<xTS_FileSink *> &Sinks = Worker.Sinks;
+  Sinks.clear();
+  Worker.Router.Reset();
+  Worker.Scanner.Init(
+      &Worker.Router, [&Sinks, &OutputPrefix, ReferenceInput, FlushThreshold](uint16_t PID, uint8_t StreamType)
+      {
+        std::string FileName = OutputPrefix + "PID" + std::to_string(PID) + "." + xPSI_PMT::getFileExtension(StreamType);
+        std::unique_ptr<xTS_FileSink> Sink(new xTS_FileSink());
+        if (Sink->Open(FileName.c_str(), ReferenceInput, FlushThreshold) == NOT_VALID)
+        {
+          fprintf(stderr, "The file '%s' cannot be opened.\n", FileName.c_str());
+          return std::unique_ptr<xTS_StreamSink>();
+        }
+        Sinks.push_back(Sink.get());
+        return std::unique_ptr<xTS_StreamSink>(std::move(Sink));
+      },
+      m_ProgramFilter);
+
+  xTS_PacketBatch Batch;
+  Worker.Demuxer.Init(&Worker.Router, &Worker.Scanner);
+  while (Input->ReadBatch(Batch) > 0)
+  {
+    Worker.Demuxer.AbsorbBatch(Batch);
+  }
+  Result.NumPackets = Worker.Demuxer.getNumPackets();
+  Result.NumLostPackets = Worker.Demuxer.getNumLostPackets();
+
+  // pending output may still point into input memory - write it before input is released
+  Worker.Router.Flush();
+  Result.NumStreams = Worker.Router.getNumStreams();
+  bool OutputFailed = false;
+  for (const xTS_FileSink *Sink : Sinks)
+  {
+    Result.NumOutputBytes += Sink->getNumBytesWritten();
+    if (Sink->hasFailed())
+    {
+      fprintf(stderr, "The file '%s' cannot be written: %s\n", Sink->getFileName().c_str(), strerror(Sink->getWriteError()));
+      OutputFailed = true;
+    }
+  }
+  // failed read ends stream early, outputs are cut like by failed write
+  if (Input->getReadError() != 0)
+  {
+    fprintf(stderr, "The file '%s' cannot be read: %s\n", Job.FileName.c_str(), strerror(-Input->getReadError()));
+    OutputFailed = true;
+  }
+  Result.NumBytes = Input->getStreamOffset();
+  Result.NumDroppedBytes = Input->getSyncScanner().getNumDroppedBytes();
+  Result.NumResyncs = Input->getSyncScanner().getNumResyncs();
+  Worker.Router.Reset(); // closes output files
+  Sinks.clear();
+  Input->Close();
+  Result.Status = OutputFailed ? NOT_VALID : 0;
+  Result.Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,115 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+Batch processor - demultiplexes many input files in one process:
+  Every file is one job - streams are discovered from PAT/PMT and written to <output directory>/<file name
+  stem>.PID<PID>.<ext> (stems used more than once get _<N> suffix). Jobs run on worker threads (calling thread is
+  worker 0), each worker keeps its own input reader, PID router, PSI scanner and batch demuxer for all of its jobs,
+  so demux streams (with their PES buffer pools) and reader buffers are reused instead of being built per file.
+
+  Scheduling (work stealing) - jobs are sorted by file size, largest first, and dealt round robin into per worker
+  queues. Worker takes jobs from front of its own queue (largest first), worker with empty queue steals from back of
+  other queues (smallest remaining), so big files start early and small ones fill the gaps at the end. No job is
+  created while running, so worker finishes when all queues are empty.
+
+  Results are kept per job and reported in input order: one CSV row per file and summary of the whole batch.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_BatchProcessor
+{
+public:
+  struct xJob
+  {
+    std::string FileName;
+    std::string OutputPrefix; // output directory and file name stem
+    uint64_t Size;            // bytes, 0 when unknown
+  };
+
+  struct xResult
+  {
+    int32_t Status; // 0 - done, -1 - input cannot be opened or output cannot be written
+    uint32_t WorkerIdx;
+    uint32_t NumStreams;
+    uint64_t NumPackets;
+    uint64_t NumBytes;
+    uint64_t NumOutputBytes;
+    uint64_t NumLostPackets; // continuity errors seen by assemblers
+    uint64_t NumDroppedBytes;
+    uint64_t NumResyncs;
+    double Time; // seconds
+  };
+
+protected:
+  struct xWorker
+  {
+    // queue of job indices, protected by mutex
+    std::mutex Mutex;
+    std::deque<uint32_t> Queue;
+    // per file state reused for all jobs of worker
+    std::unique_ptr<xTS_InputSource> Input;
+    std::unique_ptr<xTS_InputSource> BlockInput; // fallback for inputs that cannot be mapped
+    xTS_PID_Router Router;
+    xPSI_Scanner Scanner;
+    xTS_BatchDemuxer Demuxer;
+    std::vector<xTS_FileSink *> Sinks;
+    // statistics
+    uint32_t NumJobs;
+    uint32_t NumSteals;
+    double BusyTime;
+  };
+
+  // setup
+  uint32_t m_NumWorkers;
+  xTS_InputSource::eMode m_InputMode;
+  size_t m_BlockSize;
+  uint32_t m_ReadAhead;
+  uint32_t m_BatchSize;
+  size_t m_FlushThreshold;
+  int32_t m_ProgramFilter;
+  std::string m_OutputDirectory;
+  // jobs
+  std::vector<xJob> m_Jobs;
+  std::unordered_map<std::string, uint32_t> m_StemUses;
+  std::vector<xResult> m_Results;
+  std::vector<std::unique_ptr<xWorker>> m_Workers;
+  double m_Time;
+
+public:
+  xTS_BatchProcessor();
+
+  void Init(uint32_t NumWorkers, xTS_InputSource::eMode InputMode, size_t BlockSize, uint32_t ReadAhead, uint32_t BatchSize, size_t FlushThreshold,
+            int32_t ProgramFilter, const std::string &OutputDirectory);
+  void AddJob(const std::string &FileName);
+  void Run();
+  void WriteReport(FILE *File) const;
+  void PrintStatistics(FILE *File, bool PerWorker) const;
+
+  static int32_t ReadFileList(const char *ListFileName, std::vector<std::string> &FileNames);
+  static int32_t ExpandPattern(const char *Pattern, std::vector<std::string> &FileNames);
+
+public:
+  uint32_t getNumJobs() const { return (uint32_t)m_Jobs.size(); }
+  uint32_t getNumFailed() const;
+  const xResult &getResult(uint32_t JobIdx) const { return m_Results[JobIdx]; }
+
+protected:
+  void xWorkerMain(uint32_t WorkerIdx);
+  bool xTakeJob(uint32_t WorkerIdx, uint32_t &JobIdx);
+  void xProcessJob(xWorker &Worker, uint32_t WorkerIdx, uint32_t JobIdx);
+};
+
+//=============================================================================================================================================================================
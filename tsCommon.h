@@ -33,3 +33,44 @@ static inline  int64_t xSwapBytes64( int64_t Value) { return __builtin_bswap64(V
 #else
 #error Unrecognized compiler
 #endif
+
+//=============================================================================================================================================================================
+// Bit scan
+//=============================================================================================================================================================================
+#if defined(_MSC_VER)
+static inline uint32_t xCountTrailingZeros32(uint32_t Value) { unsigned long Index; _BitScanForward(&Index, Value); return Index; }
+#elif defined (__GNUC__)
+static inline uint32_t xCountTrailingZeros32(uint32_t Value) { return __builtin_ctz(Value); }
+#endif
+
+//=============================================================================================================================================================================
+// SIMD support - SSE2 is assumed on x86, AVX2 code paths are compiled per function and selected at runtime
+//=============================================================================================================================================================================
+#if defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define X_SIMD_X86 1
+#else
+#define X_SIMD_X86 0
+#endif
+
+#if X_SIMD_X86 && defined(__GNUC__)
+#define X_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define X_TARGET_AVX2
+#endif
+
+static inline bool xCpuSupportsAVX2()
+{
+#if X_SIMD_X86 && defined(_MSC_VER)
+  int CpuInfo[4];
+  __cpuid(CpuInfo, 0);
+  if (CpuInfo[0] < 7) { return false; }
+  __cpuid(CpuInfo, 1);
+  bool OsSavesYMM = (CpuInfo[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+  __cpuidex(CpuInfo, 7, 0);
+  return OsSavesYMM && (CpuInfo[1] & (1 << 5));
+#elif X_SIMD_X86 && defined(__GNUC__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
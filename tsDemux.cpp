@@ -0,0 +1,442 @@
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_FileSink
+//=============================================================================================================================================================================
+
+xTS_FileSink::xTS_FileSink()
+{
+#if defined(_WIN32)
+  this->m_File = nullptr;
+#else
+  this->m_FileDescriptor = -1;
+#endif
+  this->m_ReferenceInput = false;
+  this->m_FlushThreshold = DefaultFlushThreshold;
+  this->m_PendingBytes = 0;
+  this->m_NumBytesWritten = 0;
+  this->m_NumWriteCalls = 0;
+  this->m_WriteError = 0;
+}
+
+/**
+  @brief Create (truncate) output file
+  @param FileName is path to output file
+  @param ReferenceInput tells that data passed to Write() stays valid until Close(), so it does not have to be copied
+  @param FlushThreshold is number of pending bytes that triggers write to file
+  @return 0 on success, -1 on failure
+*/
+int32_t xTS_FileSink::Open(const char *FileName, bool ReferenceInput, size_t FlushThreshold)
+{
+  Close();
+  // "-" is standard output, own descriptor of it is closed by Close()
+  bool StandardOutput = strcmp(FileName, "-") == 0;
+#if defined(_WIN32)
+  if (StandardOutput)
+  {
+    _setmode(_fileno(stdout), _O_BINARY);
+    this->m_File = _fdopen(_dup(_fileno(stdout)), "wb");
+  }
+  else
+  {
+    this->m_File = fopen(FileName, "wb");
+  }
+  ReferenceInput = false; // no gathering write available
+#else
+  this->m_FileDescriptor = StandardOutput ? dup(STDOUT_FILENO) : open(FileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+  if (!isOpen())
+  {
+    return NOT_VALID;
+  }
+
+  this->m_FileName = FileName;
+  this->m_ReferenceInput = ReferenceInput;
+  this->m_FlushThreshold = FlushThreshold > 0 ? FlushThreshold : 1;
+  this->m_PendingBytes = 0;
+  this->m_WriteError = 0;
+  m_Slices.clear();
+  if (ReferenceInput)
+  {
+    m_Slices.reserve(MaxSlices);
+    m_Buffer.reset();
+  }
+  else
+  {
+    m_Buffer.reset(new uint8_t[m_FlushThreshold]);
+  }
+  return 0;
+}
+
+void xTS_FileSink::Close()
+{
+  if (!isOpen())
+  {
+    return;
+  }
+  Flush();
+#if defined(_WIN32)
+  fclose(m_File);
+  this->m_File = nullptr;
+#else
+  close(m_FileDescriptor);
+  this->m_FileDescriptor = -1;
+#endif
+}
+
+bool xTS_FileSink::isOpen() const
+{
+#if defined(_WIN32)
+  return m_File != nullptr;
+#else
+  return m_FileDescriptor >= 0;
+#endif
+}
+
+int32_t xTS_FileSink::Write(const uint8_t *Data, uint32_t Size)
+{
+  if (m_WriteError != 0)
+  {
+    return NOT_VALID; // output is already cut, nothing after it is written
+  }
+  if (m_ReferenceInput)
+  {
+    if (!m_Slices.empty() && m_Slices.back().Data + m_Slices.back().Size == Data)
+    {
+      m_Slices.back().Size += Size; // continues previous slice
+    }
+    else
+    {
+      m_Slices.push_back({Data, Size});
+    }
+    this->m_PendingBytes += Size;
+    if (m_PendingBytes >= m_FlushThreshold || m_Slices.size() >= MaxSlices)
+    {
+      Flush();
+    }
+    return m_WriteError == 0 ? (int32_t)Size : NOT_VALID;
+  }
+
+  if (m_PendingBytes + Size > m_FlushThreshold)
+  {
+    Flush();
+    if (m_WriteError != 0)
+    {
+      return NOT_VALID;
+    }
+    if (Size >= m_FlushThreshold)
+    {
+      return xWriteBuffer(Data, Size);
+    }
+  }
+  std::memcpy(m_Buffer.get() + m_PendingBytes, Data, Size);
+  this->m_PendingBytes += Size;
+  return (int32_t)Size;
+}
+
+void xTS_FileSink::Flush()
+{
+  if (!isOpen() || m_PendingBytes == 0)
+  {
+    return;
+  }
+
+#if !defined(_WIN32)
+  if (m_ReferenceInput)
+  {
+    struct iovec Vectors[MaxSlices];
+    uint32_t NumVectors = 0;
+    for (const xSlice &Slice : m_Slices)
+    {
+      Vectors[NumVectors].iov_base = const_cast<uint8_t *>(Slice.Data);
+      Vectors[NumVectors].iov_len = Slice.Size;
+      NumVectors++;
+    }
+
+    uint32_t FirstVector = 0;
+    while (FirstVector < NumVectors)
+    {
+      ssize_t NumWritten = writev(m_FileDescriptor, Vectors + FirstVector, (int)(NumVectors - FirstVector));
+      this->m_NumWriteCalls++;
+      if (NumWritten < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        this->m_WriteError = errno;
+        break;
+      }
+      this->m_NumBytesWritten += NumWritten;
+      // partial write - skip fully written vectors and advance into first unfinished one
+      while (FirstVector < NumVectors && (size_t)NumWritten >= Vectors[FirstVector].iov_len)
+      {
+        NumWritten -= Vectors[FirstVector].iov_len;
+        FirstVector++;
+      }
+      if (FirstVector < NumVectors)
+      {
+        Vectors[FirstVector].iov_base = (uint8_t *)Vectors[FirstVector].iov_base + NumWritten;
+        Vectors[FirstVector].iov_len -= NumWritten;
+      }
+    }
+    m_Slices.clear();
+    this->m_PendingBytes = 0;
+    return;
+  }
+#endif
+
+  xWriteBuffer(m_Buffer.get(), m_PendingBytes);
+  this->m_PendingBytes = 0;
+}
+
+int32_t xTS_FileSink::xWriteBuffer(const uint8_t *Data, size_t Size)
+{
+#if defined(_WIN32)
+  size_t NumWritten = fwrite(Data, sizeof(uint8_t), Size, m_File);
+  this->m_NumWriteCalls++;
+  this->m_NumBytesWritten += NumWritten;
+  if (NumWritten != Size)
+  {
+    this->m_WriteError = errno != 0 ? errno : EIO;
+    return NOT_VALID;
+  }
+  return (int32_t)Size;
+#else
+  size_t Remaining = Size;
+  while (Remaining > 0)
+  {
+    ssize_t NumWritten = write(m_FileDescriptor, Data, Remaining);
+    this->m_NumWriteCalls++;
+    if (NumWritten < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      this->m_WriteError = errno;
+      return NOT_VALID;
+    }
+    this->m_NumBytesWritten += NumWritten;
+    Data += NumWritten;
+    Remaining -= NumWritten;
+  }
+  return (int32_t)Size;
+#endif
+}
+
+//=============================================================================================================================================================================
+// xTS_DemuxStream
+//=============================================================================================================================================================================
+
+xTS_DemuxStream::xTS_DemuxStream(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink)
+{
+  Reset(PID, std::move(Sink));
+}
+
+/// @brief Start over as new stream, buffers of assembler are kept
+void xTS_DemuxStream::Reset(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink)
+{
+  this->m_PID = PID;
+  this->m_Sink = std::move(Sink);
+  this->m_NumOutputBytes = 0;
+  m_Assembler.Init(PID);
+}
+
+/**
+  @brief Pass packet to PES assembler and forward its payload to output sink
+  @param Payload is pointer to TS packet payload
+  @param PayloadLength is number of payload bytes
+  @return Assembler result for this packet
+*/
+xPES_Assembler::eResult xTS_DemuxStream::AbsorbPacket(const uint8_t *Payload, uint32_t PayloadLength, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField)
+{
+  xPES_Assembler::eResult Result = m_Assembler.AbsorbPacket(Payload, PacketHeader, AdaptationField);
+  switch (Result)
+  {
+  case xPES_Assembler::eResult::AssemblingStarted:
+  case xPES_Assembler::eResult::AssemblingContinue:
+  case xPES_Assembler::eResult::AssemblingFinished:
+    // adaptation field only packet leaves nothing to write
+    if (m_Sink && PayloadLength != 0)
+    {
+      m_Sink->Write(Payload, PayloadLength);
+    }
+    this->m_NumOutputBytes += PayloadLength;
+    break;
+  default:
+    break;
+  }
+  return Result;
+}
+
+//=============================================================================================================================================================================
+// xTS_PID_Router
+//=============================================================================================================================================================================
+
+xTS_PID_Router::xTS_PID_Router()
+{
+  std::fill(m_Table, m_Table + NumPIDs, nullptr);
+}
+
+/**
+  @brief Register elementary stream PID
+  @param PID is packet identifier to demultiplex
+  @param Sink receives payload of absorbed packets (may be empty)
+  @return Created stream (existing one is replaced)
+*/
+xTS_DemuxStream *xTS_PID_Router::Register(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink)
+{
+  PID &= PIDMask;
+  Unregister(PID);
+  if (!m_FreeStreams.empty())
+  {
+    m_Streams.push_back(std::move(m_FreeStreams.back()));
+    m_FreeStreams.pop_back();
+    m_Streams.back()->Reset(PID, std::move(Sink));
+  }
+  else
+  {
+    m_Streams.emplace_back(new xTS_DemuxStream(PID, std::move(Sink)));
+  }
+  this->m_Table[PID] = m_Streams.back().get();
+  return m_Table[PID];
+}
+
+void xTS_PID_Router::Unregister(uint16_t PID)
+{
+  PID &= PIDMask;
+  if (m_Table[PID] == nullptr)
+  {
+    return;
+  }
+  xTS_DemuxStream *Stream = m_Table[PID];
+  this->m_Table[PID] = nullptr;
+  m_Streams.erase(std::remove_if(m_Streams.begin(), m_Streams.end(), [Stream](const std::unique_ptr<xTS_DemuxStream> &S) { return S.get() == Stream; }), m_Streams.end());
+}
+
+/// @brief Unregister all streams (their sinks are released), stream objects are kept for next registrations
+void xTS_PID_Router::Reset()
+{
+  for (std::unique_ptr<xTS_DemuxStream> &Stream : m_Streams)
+  {
+    this->m_Table[Stream->getPID()] = nullptr;
+    Stream->Reset(Stream->getPID(), nullptr);
+    m_FreeStreams.push_back(std::move(Stream));
+  }
+  m_Streams.clear();
+}
+
+/// @brief Pass pending output of all streams to their sinks, PES packets in progress are kept
+void xTS_PID_Router::FlushSinks()
+{
+  for (std::unique_ptr<xTS_DemuxStream> &Stream : m_Streams)
+  {
+    if (Stream->getSink() != nullptr)
+    {
+      Stream->getSink()->Flush();
+    }
+  }
+}
+
+void xTS_PID_Router::Flush()
+{
+  for (std::unique_ptr<xTS_DemuxStream> &Stream : m_Streams)
+  {
+    Stream->getAssembler().Flush();
+    if (Stream->getSink() != nullptr)
+    {
+      Stream->getSink()->Flush();
+    }
+  }
+}
+
+//=============================================================================================================================================================================
+// xTS_BatchDemuxer
+//=============================================================================================================================================================================
+
+xTS_BatchDemuxer::xTS_BatchDemuxer()
+{
+  Init(nullptr, nullptr);
+}
+
+/**
+  @brief Prepare demultiplexer for new input, statistics are cleared
+  @param Router maps PIDs to demux streams
+  @param Scanner gets packets of PSI PIDs and registers discovered streams
+  @param Observer sees every packet (may be nullptr)
+*/
+void xTS_BatchDemuxer::Init(xTS_PID_Router *Router, xPSI_Scanner *Scanner, xTS_PacketObserver *Observer)
+{
+  this->m_Router = Router;
+  this->m_Scanner = Scanner;
+  this->m_Observer = Observer;
+  this->m_NumPackets = 0;
+  this->m_NumLostPackets = 0;
+}
+
+/**
+  @brief Demultiplex all packets of batch, packets are parsed in place (directly from reader memory)
+  @param Batch is batch of packets read from input
+*/
+void xTS_BatchDemuxer::AbsorbBatch(const xTS_PacketBatch &Batch)
+{
+  // members are kept in locals - stores to decoded header must not force reloads
+  xTS_PID_Router *Router = m_Router;
+  xPSI_Scanner *Scanner = m_Scanner;
+  xTS_PacketObserver *Observer = m_Observer;
+  uint64_t NumLostPackets = 0;
+  const uint32_t NumPackets = Batch.getNumPackets();
+  for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++)
+  {
+    const uint8_t *Packet = Batch.getPacket(PacketIdx);
+    uint32_t GroupIdx = PacketIdx % xTS_PacketHeaderBatch::MaxPackets;
+    if (GroupIdx == 0)
+    {
+      m_HeaderBatch.Parse(Packet, NumPackets - PacketIdx, Batch.getPacketStride());
+    }
+    m_PacketHeader.Load(m_HeaderBatch, GroupIdx);
+    uint16_t PID = m_PacketHeader.getPID();
+    if (Observer != nullptr)
+    {
+      Observer->OnPacket(Batch, PacketIdx, m_PacketHeader);
+    }
+
+    if (Scanner->isPSIPID(PID))
+    {
+      Scanner->AbsorbPacket(Packet, &m_PacketHeader);
+    }
+    xTS_DemuxStream *Stream = Router->Lookup(PID);
+    if (m_PacketHeader.getSyncByte() == xTS_SyncScanner::SyncByte && Stream != nullptr)
+    {
+      // payload-only, AF+payload and AF-only packets take separate paths
+      int32_t Offset = m_AdaptationField.ParsePacket(Packet, m_PacketHeader.getAdaptationFieldControl());
+      xPES_Assembler::eResult Result = Stream->AbsorbPacket(Packet + Offset, xTS::TS_PacketLength - Offset, &m_PacketHeader, &m_AdaptationField);
+      if (Result == xPES_Assembler::eResult::StreamPackedLost)
+      {
+        NumLostPackets++;
+      }
+      if (Observer != nullptr)
+      {
+        Observer->OnDemuxed(Batch, PacketIdx, m_PacketHeader, m_AdaptationField, Stream, Result);
+      }
+    }
+  }
+  this->m_NumPackets += NumPackets;
+  this->m_NumLostPackets += NumLostPackets;
+}
+
+//=============================================================================================================================================================================
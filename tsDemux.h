@@ -0,0 +1,204 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+Demultiplexer:
+  xTS_PID_Router maps every one of 8192 PIDs directly to its xTS_DemuxStream (or nullptr), so dispatching a packet
+  costs one table load regardless of how many streams are registered.
+  Each xTS_DemuxStream owns its PES assembler and output sink. Stages that need whole PES packets (frame index,
+  audio framer, MP4 remux) register as xPES_Consumer with assembler of stream, any number of them per PID.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_StreamSink
+{
+public:
+  virtual ~xTS_StreamSink() {}
+  virtual int32_t Write(const uint8_t *Data, uint32_t Size) = 0;
+  virtual void Flush() {}
+};
+
+//=============================================================================================================================================================================
+
+/*
+File sink with batched output:
+  ReferenceInput = true  - input memory stays valid until end of run (mapped file), so only slice pointers are collected
+                           and handed to kernel with one writev() per flush (zero-copy from input)
+  ReferenceInput = false - slices are copied into one large buffer which is written with single call per flush
+  First failed write (e.g. disk full) is latched - pending and following data is dropped and owner checks hasFailed()
+  after Close(), so output that was cut is never taken for complete one.
+*/
+class xTS_FileSink : public xTS_StreamSink
+{
+public:
+  static constexpr size_t DefaultFlushThreshold = 1024 * 1024; // bytes
+  static constexpr uint32_t MaxSlices = 1024;                  // IOV_MAX on Linux
+
+  struct xSlice
+  {
+    const uint8_t *Data;
+    size_t Size;
+  };
+
+protected:
+#if defined(_WIN32)
+  FILE *m_File;
+#else
+  int m_FileDescriptor;
+#endif
+  // setup
+  std::string m_FileName;
+  bool m_ReferenceInput;
+  size_t m_FlushThreshold;
+  // pending data
+  std::vector<xSlice> m_Slices;
+  std::unique_ptr<uint8_t[]> m_Buffer;
+  size_t m_PendingBytes;
+  // statistics
+  uint64_t m_NumBytesWritten;
+  uint64_t m_NumWriteCalls;
+  int m_WriteError; // errno of first failed write, 0 when all writes succeeded
+
+public:
+  xTS_FileSink();
+  ~xTS_FileSink() override { Close(); }
+
+  int32_t Open(const char *FileName, bool ReferenceInput = false, size_t FlushThreshold = DefaultFlushThreshold);
+  void Close();
+  int32_t Write(const uint8_t *Data, uint32_t Size) override;
+  void Flush() override;
+
+public:
+  uint64_t getNumBytesWritten() const { return m_NumBytesWritten; }
+  uint64_t getNumWriteCalls() const { return m_NumWriteCalls; }
+  bool hasFailed() const { return m_WriteError != 0; }
+  int getWriteError() const { return m_WriteError; }
+  const std::string &getFileName() const { return m_FileName; }
+
+protected:
+  bool isOpen() const;
+  int32_t xWriteBuffer(const uint8_t *Data, size_t Size);
+};
+
+//=============================================================================================================================================================================
+
+class xTS_DemuxStream
+{
+protected:
+  uint16_t m_PID;
+  xPES_Assembler m_Assembler;
+  std::unique_ptr<xTS_StreamSink> m_Sink;
+  uint64_t m_NumOutputBytes;
+
+public:
+  xTS_DemuxStream(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink);
+
+  void Reset(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink);
+  xPES_Assembler::eResult AbsorbPacket(const uint8_t *Payload, uint32_t PayloadLength, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField);
+
+public:
+  uint16_t getPID() const { return m_PID; }
+  xPES_Assembler &getAssembler() { return m_Assembler; }
+  xTS_StreamSink *getSink() { return m_Sink.get(); }
+  uint64_t getNumOutputBytes() const { return m_NumOutputBytes; }
+};
+
+//=============================================================================================================================================================================
+
+class xTS_PID_Router
+{
+public:
+  static constexpr uint32_t NumPIDs = 8192;
+  static constexpr uint16_t PIDMask = NumPIDs - 1;
+
+protected:
+  xTS_DemuxStream *m_Table[NumPIDs];
+  std::vector<std::unique_ptr<xTS_DemuxStream>> m_Streams;
+  std::vector<std::unique_ptr<xTS_DemuxStream>> m_FreeStreams; // released by Reset(), reused with their assembler buffers
+
+public:
+  xTS_PID_Router();
+
+  xTS_DemuxStream *Register(uint16_t PID, std::unique_ptr<xTS_StreamSink> Sink);
+  void Unregister(uint16_t PID);
+  void Reset();
+  void Flush();
+  void FlushSinks();
+
+  xTS_DemuxStream *Lookup(uint16_t PID) const { return m_Table[PID & PIDMask]; }
+
+public:
+  uint32_t getNumStreams() const { return (uint32_t)m_Streams.size(); }
+  xTS_DemuxStream *getStream(uint32_t StreamIdx) { return m_Streams[StreamIdx].get(); }
+};
+
+//=============================================================================================================================================================================
+
+class xPSI_Scanner;
+
+/*
+Packet observer - sees packets passed through xTS_BatchDemuxer (index, PCR analysis, monitor, event log):
+  OnPacket   - every packet, after its header is decoded and before PSI and PES processing
+  OnDemuxed  - packet of registered stream, after its payload was absorbed by demux stream
+*/
+class xTS_PacketObserver
+{
+public:
+  virtual ~xTS_PacketObserver() {}
+  virtual void OnPacket(const xTS_PacketBatch &Batch, uint32_t PacketIdx, const xTS_PacketHeader &PacketHeader)
+  {
+    (void)Batch;
+    (void)PacketIdx;
+    (void)PacketHeader;
+  }
+  virtual void OnDemuxed(const xTS_PacketBatch &Batch, uint32_t PacketIdx, const xTS_PacketHeader &PacketHeader, const xTS_AdaptationField &AdaptationField,
+                         xTS_DemuxStream *Stream, xPES_Assembler::eResult Result)
+  {
+    (void)Batch;
+    (void)PacketIdx;
+    (void)PacketHeader;
+    (void)AdaptationField;
+    (void)Stream;
+    (void)Result;
+  }
+};
+
+/*
+Batch demultiplexer - per batch demux loop shared by parser, batch processor and benchmark:
+  headers are decoded in groups of xTS_PacketHeaderBatch::MaxPackets and per packet view is loaded from decoded group,
+  packets of PSI PIDs go to scanner (which registers discovered streams with router), packets of registered PIDs with
+  valid sync byte go through adaptation field parser to their demux stream. Observer is optional, without it loop does
+  nothing else.
+*/
+class xTS_BatchDemuxer
+{
+protected:
+  xTS_PID_Router *m_Router;
+  xPSI_Scanner *m_Scanner;
+  xTS_PacketObserver *m_Observer;
+  xTS_PacketHeaderBatch m_HeaderBatch;
+  xTS_PacketHeader m_PacketHeader;
+  xTS_AdaptationField m_AdaptationField;
+  // statistics
+  uint64_t m_NumPackets;
+  uint64_t m_NumLostPackets; // continuity errors seen by assemblers
+
+public:
+  xTS_BatchDemuxer();
+
+  void Init(xTS_PID_Router *Router, xPSI_Scanner *Scanner, xTS_PacketObserver *Observer = nullptr);
+  void AbsorbBatch(const xTS_PacketBatch &Batch);
+
+public:
+  uint64_t getNumPackets() const { return m_NumPackets; }
+  uint64_t getNumLostPackets() const { return m_NumLostPackets; }
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,420 @@
+#include "tsEventLog.h"
+
+//=============================================================================================================================================================================
+// xTS_PacketEvent
+//=============================================================================================================================================================================
+
+/**
+  @brief Collect logged fields of one demultiplexed packet
+  @param PacketIdx is index of packet in input
+  @param StreamOffset is position of packet in input
+  @param PacketHeader is parsed header of packet
+  @param AdaptationField is parsed adaptation field (ignored when packet has none)
+  @param Result is assembler result for this packet
+  @param Assembler is assembler of packet PID (used for PES header and length)
+*/
+void xTS_PacketEvent::Set(uint64_t PacketIdx, uint64_t StreamOffset, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField,
+                          xPES_Assembler::eResult Result, const xPES_Assembler *Assembler)
+{
+  this->m_PacketIdx = PacketIdx;
+  this->m_StreamOffset = StreamOffset;
+  this->m_PID = PacketHeader->getPID();
+  this->m_Flags = (PacketHeader->getError() ? eFlags_TransportError : 0) |
+                  (PacketHeader->getStart() ? eFlags_PayloadUnitStart : 0) |
+                  (PacketHeader->getTransport() ? eFlags_TransportPriority : 0);
+  this->m_CC = PacketHeader->getContinuityCounter();
+  this->m_TSC = PacketHeader->getTransportScramblingControl();
+  this->m_AFC = PacketHeader->getAdaptationFieldControl();
+  this->m_AFLength = 0;
+  this->m_PCR = 0;
+  if (PacketHeader->hasAdaptationField())
+  {
+    this->m_AFLength = AdaptationField->getAdaptationFieldLength();
+    if (AdaptationField->getRandomAccessIndicator())
+    {
+      this->m_Flags |= eFlags_RandomAccess;
+    }
+    if (AdaptationField->getDiscontinuityIndicator())
+    {
+      this->m_Flags |= eFlags_Discontinuity;
+    }
+    if (AdaptationField->getPCRFlag())
+    {
+      this->m_Flags |= eFlags_PCR;
+      this->m_PCR = AdaptationField->getProgramClockReference();
+    }
+  }
+
+  this->m_Result = (uint8_t)Result;
+  this->m_StreamId = 0;
+  this->m_PESPacketLength = 0;
+  this->m_PESBytes = 0;
+  this->m_PTS = 0;
+  this->m_DTS = 0;
+  if (Result == xPES_Assembler::eResult::AssemblingStarted)
+  {
+    const xPES_PacketHeader &PESH = Assembler->getPESH();
+    this->m_StreamId = PESH.getStreamId();
+    this->m_PESPacketLength = PESH.getPacketLength();
+    if (PESH.hasOptionalHeader() && (PESH.getPTS_DTS_Flags() & xPES_PacketHeader::ePTS_DTS_Flags_PTS))
+    {
+      this->m_Flags |= eFlags_PTS;
+      this->m_PTS = PESH.getPTS();
+    }
+    if (PESH.hasOptionalHeader() && PESH.getPTS_DTS_Flags() == xPES_PacketHeader::ePTS_DTS_Flags_PTS_DTS)
+    {
+      this->m_Flags |= eFlags_DTS;
+      this->m_DTS = PESH.getDTS();
+    }
+  }
+  else if (Result == xPES_Assembler::eResult::AssemblingFinished)
+  {
+    this->m_PESBytes = (uint32_t)Assembler->getNumPacketBytes();
+  }
+}
+
+//=============================================================================================================================================================================
+// xTS_EventLog
+//=============================================================================================================================================================================
+
+static const char *xResultName(uint8_t Result)
+{
+  switch ((xPES_Assembler::eResult)Result)
+  {
+  case xPES_Assembler::eResult::UnexpectedPID:
+    return "unexpected_pid";
+  case xPES_Assembler::eResult::StreamPackedLost:
+    return "lost";
+  case xPES_Assembler::eResult::AssemblingStarted:
+    return "started";
+  case xPES_Assembler::eResult::AssemblingContinue:
+    return "continue";
+  case xPES_Assembler::eResult::AssemblingFinished:
+    return "finished";
+  case xPES_Assembler::eResult::StreamNotStarted:
+    return "not_started";
+  case xPES_Assembler::eResult::DuplicatePacket:
+    return "duplicate";
+  default:
+    return "unknown";
+  }
+}
+
+xTS_EventLog::xTS_EventLog()
+{
+  this->m_Format = eFormat::None;
+  this->m_File = nullptr;
+  this->m_OwnsFile = false;
+  this->m_NumPending = 0;
+  this->m_NumEvents = 0;
+}
+
+int32_t xTS_EventLog::ParseFormat(const char *Name, eFormat &Format)
+{
+  static const struct
+  {
+    const char *Name;
+    eFormat Format;
+  } Formats[] = {{"none", eFormat::None}, {"text", eFormat::Text}, {"binary", eFormat::Binary}, {"jsonl", eFormat::JSONL}, {"csv", eFormat::CSV}};
+
+  for (const auto &Entry : Formats)
+  {
+    if (strcmp(Name, Entry.Name) == 0)
+    {
+      Format = Entry.Format;
+      return 0;
+    }
+  }
+  return NOT_VALID;
+}
+
+/**
+  @brief Start log
+  @param Format is record format (None and Text do not use log at all)
+  @param FileName is path to log file, nullptr for standard output
+  @return 0 on success, -1 when file cannot be created
+*/
+int32_t xTS_EventLog::Open(eFormat Format, const char *FileName)
+{
+  Close();
+  this->m_Format = Format;
+  this->m_NumEvents = 0;
+  if (!isStructured())
+  {
+    return 0;
+  }
+
+  if (FileName != nullptr)
+  {
+    this->m_File = fopen(FileName, Format == eFormat::Binary ? "wb" : "w");
+    this->m_OwnsFile = true;
+  }
+  else
+  {
+    this->m_File = stdout;
+    this->m_OwnsFile = false;
+  }
+  if (m_File == nullptr)
+  {
+    this->m_Format = eFormat::None;
+    return NOT_VALID;
+  }
+
+  m_Buffer.reset(new char[BufferSize]);
+  this->m_NumPending = 0;
+  if (Format == eFormat::Binary)
+  {
+    xAppend("TSEV");
+    xAppendLE(BinaryVersion, 2);
+    xAppendLE(BinaryRecordSize, 2);
+  }
+  else if (Format == eFormat::CSV)
+  {
+    xAppend("idx,offset,pid,tei,pusi,tp,tsc,afc,cc,af_len,rai,di,pcr,result,stream_id,pes_len,pts,dts,pes_bytes\n");
+  }
+  return 0;
+}
+
+void xTS_EventLog::Close()
+{
+  if (m_File == nullptr)
+  {
+    return;
+  }
+  Flush();
+  if (m_OwnsFile)
+  {
+    fclose(m_File);
+  }
+  else
+  {
+    fflush(m_File);
+  }
+  this->m_File = nullptr;
+  this->m_OwnsFile = false;
+  m_Buffer.reset();
+}
+
+void xTS_EventLog::Flush()
+{
+  if (m_File != nullptr && m_NumPending > 0)
+  {
+    fwrite(m_Buffer.get(), 1, m_NumPending, m_File);
+  }
+  this->m_NumPending = 0;
+}
+
+void xTS_EventLog::Write(const xTS_PacketEvent &Event)
+{
+  if (m_File == nullptr)
+  {
+    return;
+  }
+  if (m_NumPending + MaxRecordLength > BufferSize)
+  {
+    Flush();
+  }
+  switch (m_Format)
+  {
+  case eFormat::Binary:
+    xWriteBinary(Event);
+    break;
+  case eFormat::JSONL:
+    xWriteJSON(Event);
+    break;
+  case eFormat::CSV:
+    xWriteCSV(Event);
+    break;
+  default:
+    return;
+  }
+  this->m_NumEvents++;
+}
+
+void xTS_EventLog::xAppendUInt(uint64_t Value)
+{
+  char Digits[20];
+  uint32_t NumDigits = 0;
+  do
+  {
+    Digits[NumDigits++] = (char)('0' + Value % 10);
+    Value /= 10;
+  } while (Value != 0);
+
+  char *Out = m_Buffer.get() + m_NumPending;
+  for (uint32_t DigitIdx = 0; DigitIdx < NumDigits; DigitIdx++)
+  {
+    Out[DigitIdx] = Digits[NumDigits - 1 - DigitIdx];
+  }
+  this->m_NumPending += NumDigits;
+}
+
+void xTS_EventLog::xAppendLE(uint64_t Value, uint32_t NumBytes)
+{
+  char *Out = m_Buffer.get() + m_NumPending;
+  for (uint32_t ByteIdx = 0; ByteIdx < NumBytes; ByteIdx++)
+  {
+    Out[ByteIdx] = (char)(Value >> (8 * ByteIdx));
+  }
+  this->m_NumPending += NumBytes;
+}
+
+void xTS_EventLog::xWriteBinary(const xTS_PacketEvent &Event)
+{
+  xAppendLE(Event.m_PacketIdx, 8);
+  xAppendLE(Event.m_StreamOffset, 8);
+  xAppendLE(Event.m_PID, 2);
+  xAppendLE(Event.m_Flags, 1);
+  xAppendLE(Event.m_CC, 1);
+  xAppendLE((uint32_t)(Event.m_TSC << 4) | Event.m_AFC, 1);
+  xAppendLE(Event.m_AFLength, 1);
+  xAppendLE(Event.m_Result, 1);
+  xAppendLE(Event.m_StreamId, 1);
+  xAppendLE(Event.m_PESPacketLength, 2);
+  xAppendLE(0, 2);
+  xAppendLE(Event.m_PESBytes, 4);
+  xAppendLE(Event.m_PCR, 8);
+  xAppendLE(Event.m_PTS, 8);
+  xAppendLE(Event.m_DTS, 8);
+}
+
+void xTS_EventLog::xWriteJSON(const xTS_PacketEvent &Event)
+{
+  const uint8_t Flags = Event.m_Flags;
+
+  xAppend("{\"idx\":");
+  xAppendUInt(Event.m_PacketIdx);
+  xAppend(",\"offset\":");
+  xAppendUInt(Event.m_StreamOffset);
+  xAppend(",\"pid\":");
+  xAppendUInt(Event.m_PID);
+  xAppend(",\"tei\":");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_TransportError) != 0);
+  xAppend(",\"pusi\":");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_PayloadUnitStart) != 0);
+  xAppend(",\"tp\":");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_TransportPriority) != 0);
+  xAppend(",\"tsc\":");
+  xAppendUInt(Event.m_TSC);
+  xAppend(",\"afc\":");
+  xAppendUInt(Event.m_AFC);
+  xAppend(",\"cc\":");
+  xAppendUInt(Event.m_CC);
+  if (Event.m_AFC == 2 || Event.m_AFC == 3)
+  {
+    xAppend(",\"af_len\":");
+    xAppendUInt(Event.m_AFLength);
+    xAppend(",\"rai\":");
+    xAppendUInt((Flags & xTS_PacketEvent::eFlags_RandomAccess) != 0);
+    xAppend(",\"di\":");
+    xAppendUInt((Flags & xTS_PacketEvent::eFlags_Discontinuity) != 0);
+  }
+  if (Flags & xTS_PacketEvent::eFlags_PCR)
+  {
+    xAppend(",\"pcr\":");
+    xAppendUInt(Event.m_PCR);
+  }
+  xAppend(",\"result\":\"");
+  const char *Result = xResultName(Event.m_Result);
+  xAppend(Result, strlen(Result));
+  xAppend("\"");
+  if (Event.m_Result == (uint8_t)xPES_Assembler::eResult::AssemblingStarted)
+  {
+    xAppend(",\"stream_id\":");
+    xAppendUInt(Event.m_StreamId);
+    xAppend(",\"pes_len\":");
+    xAppendUInt(Event.m_PESPacketLength);
+  }
+  if (Flags & xTS_PacketEvent::eFlags_PTS)
+  {
+    xAppend(",\"pts\":");
+    xAppendUInt(Event.m_PTS);
+  }
+  if (Flags & xTS_PacketEvent::eFlags_DTS)
+  {
+    xAppend(",\"dts\":");
+    xAppendUInt(Event.m_DTS);
+  }
+  if (Event.m_Result == (uint8_t)xPES_Assembler::eResult::AssemblingFinished)
+  {
+    xAppend(",\"pes_bytes\":");
+    xAppendUInt(Event.m_PESBytes);
+  }
+  xAppend("}\n");
+}
+
+void xTS_EventLog::xWriteCSV(const xTS_PacketEvent &Event)
+{
+  const uint8_t Flags = Event.m_Flags;
+  const bool HasAF = Event.m_AFC == 2 || Event.m_AFC == 3;
+  const bool Started = Event.m_Result == (uint8_t)xPES_Assembler::eResult::AssemblingStarted;
+
+  xAppendUInt(Event.m_PacketIdx);
+  xAppend(",");
+  xAppendUInt(Event.m_StreamOffset);
+  xAppend(",");
+  xAppendUInt(Event.m_PID);
+  xAppend(",");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_TransportError) != 0);
+  xAppend(",");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_PayloadUnitStart) != 0);
+  xAppend(",");
+  xAppendUInt((Flags & xTS_PacketEvent::eFlags_TransportPriority) != 0);
+  xAppend(",");
+  xAppendUInt(Event.m_TSC);
+  xAppend(",");
+  xAppendUInt(Event.m_AFC);
+  xAppend(",");
+  xAppendUInt(Event.m_CC);
+  xAppend(",");
+  // optional columns are left empty when not present
+  if (HasAF)
+  {
+    xAppendUInt(Event.m_AFLength);
+    xAppend(",");
+    xAppendUInt((Flags & xTS_PacketEvent::eFlags_RandomAccess) != 0);
+    xAppend(",");
+    xAppendUInt((Flags & xTS_PacketEvent::eFlags_Discontinuity) != 0);
+    xAppend(",");
+  }
+  else
+  {
+    xAppend(",,,");
+  }
+  if (Flags & xTS_PacketEvent::eFlags_PCR)
+  {
+    xAppendUInt(Event.m_PCR);
+  }
+  xAppend(",");
+  const char *Result = xResultName(Event.m_Result);
+  xAppend(Result, strlen(Result));
+  xAppend(",");
+  if (Started)
+  {
+    xAppendUInt(Event.m_StreamId);
+    xAppend(",");
+    xAppendUInt(Event.m_PESPacketLength);
+  }
+  else
+  {
+    xAppend(",");
+  }
+  xAppend(",");
+  if (Flags & xTS_PacketEvent::eFlags_PTS)
+  {
+    xAppendUInt(Event.m_PTS);
+  }
+  xAppend(",");
+  if (Flags & xTS_PacketEvent::eFlags_DTS)
+  {
+    xAppendUInt(Event.m_DTS);
+  }
+  xAppend(",");
+  if (Event.m_Result == (uint8_t)xPES_Assembler::eResult::AssemblingFinished)
+  {
+    xAppendUInt(Event.m_PESBytes);
+  }
+  xAppend("\n");
+}
+
+//=============================================================================================================================================================================
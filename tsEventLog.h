@@ -0,0 +1,117 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+/*
+Structured packet log:
+  One xTS_PacketEvent per demultiplexed packet, written by xTS_EventLog into its own large buffer which goes to file
+  with a single fwrite() when full - no iostream, no locale and no flush per line, so logging cost does not depend
+  on verbosity of human readable dump.
+
+  Binary record (little-endian, BinaryRecordSize bytes, file starts with "TSEV" + uint16 version + uint16 record size):
+`   0 | u64 PacketIdx | u64 StreamOffset | u16 PID | u8 Flags | u8 CC | u8 TSC<<4|AFC | u8 AFLength | u8 Result | u8 StreamId | `
+`  24 | u16 PESPacketLength | u16 reserved | u32 PESBytes | u64 PCR | u64 PTS | u64 DTS |                                         `
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_PacketEvent
+{
+public:
+  enum eFlags : uint8_t
+  {
+    eFlags_TransportError = 0x01,
+    eFlags_PayloadUnitStart = 0x02,
+    eFlags_TransportPriority = 0x04,
+    eFlags_RandomAccess = 0x08,
+    eFlags_Discontinuity = 0x10,
+    eFlags_PCR = 0x20,
+    eFlags_PTS = 0x40,
+    eFlags_DTS = 0x80,
+  };
+
+public:
+  uint64_t m_PacketIdx;
+  uint64_t m_StreamOffset;
+  uint16_t m_PID;
+  uint8_t m_Flags;
+  uint8_t m_CC;
+  uint8_t m_TSC;
+  uint8_t m_AFC;
+  uint8_t m_AFLength;
+  uint8_t m_Result;          // xPES_Assembler::eResult
+  uint8_t m_StreamId;        // valid for AssemblingStarted
+  uint16_t m_PESPacketLength; // announced length, valid for AssemblingStarted
+  uint32_t m_PESBytes;        // assembled bytes, valid for AssemblingFinished
+  uint64_t m_PCR;            // 27 MHz
+  uint64_t m_PTS;            // 90 kHz
+  uint64_t m_DTS;            // 90 kHz
+
+public:
+  void Set(uint64_t PacketIdx, uint64_t StreamOffset, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField,
+           xPES_Assembler::eResult Result, const xPES_Assembler *Assembler);
+};
+
+//=============================================================================================================================================================================
+
+class xTS_EventLog
+{
+public:
+  enum class eFormat : int32_t
+  {
+    None,   // nothing is printed
+    Text,   // human readable dump (Print() methods)
+    Binary, // fixed size records
+    JSONL,  // one JSON object per line
+    CSV,    // header line + one line per packet
+  };
+
+  static constexpr size_t BufferSize = 1024 * 1024;
+  static constexpr uint32_t BinaryRecordSize = 56;
+  static constexpr uint16_t BinaryVersion = 1;
+  static constexpr size_t MaxRecordLength = 512; // longest formatted record
+
+protected:
+  eFormat m_Format;
+  FILE *m_File;
+  bool m_OwnsFile;
+  std::unique_ptr<char[]> m_Buffer;
+  size_t m_NumPending;
+  uint64_t m_NumEvents;
+
+public:
+  xTS_EventLog();
+  ~xTS_EventLog() { Close(); }
+
+  int32_t Open(eFormat Format, const char *FileName);
+  void Close();
+  void Write(const xTS_PacketEvent &Event);
+  void Flush();
+
+  static int32_t ParseFormat(const char *Name, eFormat &Format);
+
+public:
+  eFormat getFormat() const { return m_Format; }
+  bool isStructured() const { return m_Format == eFormat::Binary || m_Format == eFormat::JSONL || m_Format == eFormat::CSV; }
+  uint64_t getNumEvents() const { return m_NumEvents; }
+
+protected:
+  void xAppend(const char *Text, size_t Length)
+  {
+    std::memcpy(m_Buffer.get() + m_NumPending, Text, Length);
+    m_NumPending += Length;
+  }
+  template <size_t N>
+  void xAppend(const char (&Text)[N]) { xAppend(Text, N - 1); }
+  void xAppendUInt(uint64_t Value);
+  void xAppendLE(uint64_t Value, uint32_t NumBytes);
+
+  void xWriteBinary(const xTS_PacketEvent &Event);
+  void xWriteJSON(const xTS_PacketEvent &Event);
+  void xWriteCSV(const xTS_PacketEvent &Event);
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,290 @@
+#pragma once
+#include "tsCommon.h"
+#include <type_traits>
+
+/*
+Field layout descriptors:
+  Every bit field of TS, PES and PSI headers is described once, by its position - offset of first byte, offset of first
+  (most significant) bit within that byte and width in bits. xField<> turns description into extractor at compile time:
+  bytes spanned by field are loaded big-endian into unsigned integer wide enough for whole span, then shifted down and
+  masked. Widening happens before any shift, so wide fields (33 bit PCR base, PTS) cannot be truncated or sign extended
+  by int promotion of uint8_t. After inlining extractor is straight-line code - no branches, no loops - and its result
+  type is smallest unsigned type holding the field. Set() is its inverse for writers of headers and sections - same
+  span is loaded, field bits are replaced and span is stored back, so neighbouring fields sharing its bytes are kept.
+
+  Layouts follow ISO/IEC 13818-1 tables 2-2 (packet header), 2-6 (adaptation field), 2-21 (PES packet), 2-30 (PAT)
+  and 2-33 (PMT). Offsets are relative to start of described structure.
+*/
+
+//=============================================================================================================================================================================
+
+// smallest unsigned type holding NumBits
+template <uint32_t NumBits>
+using xFieldType = std::conditional_t<NumBits <= 8, uint8_t, std::conditional_t<NumBits <= 16, uint16_t, std::conditional_t<NumBits <= 32, uint32_t, uint64_t>>>;
+
+// big-endian load of NumBytes bytes, accumulated in type wide enough for all of them
+template <uint32_t NumBytes>
+static inline xFieldType<NumBytes * 8> xLoadBigEndian(const uint8_t *Data)
+{
+  static_assert(NumBytes >= 1 && NumBytes <= 8, "unsupported load width");
+  using tLoad = xFieldType<NumBytes * 8>;
+  tLoad Value = Data[0];
+  for (uint32_t ByteIdx = 1; ByteIdx < NumBytes; ByteIdx++)
+  {
+    Value = (tLoad)((Value << 8) | Data[ByteIdx]);
+  }
+  return Value;
+}
+
+// big-endian store of NumBytes lowest bytes of Value
+template <uint32_t NumBytes>
+static inline void xStoreBigEndian(uint8_t *Data, xFieldType<NumBytes * 8> Value)
+{
+  static_assert(NumBytes >= 1 && NumBytes <= 8, "unsupported store width");
+  for (uint32_t ByteIdx = NumBytes; ByteIdx-- > 0;)
+  {
+    Data[ByteIdx] = (uint8_t)Value;
+    Value = (xFieldType<NumBytes * 8>)(Value >> 8);
+  }
+}
+
+template <uint32_t ByteOffset, uint32_t BitOffset, uint32_t NumBits>
+class xField
+{
+public:
+  static_assert(BitOffset < 8, "bit offset is counted within first byte of field");
+  static_assert(NumBits >= 1 && BitOffset + NumBits <= 64, "field must span at most 8 bytes");
+
+  using tValue = xFieldType<NumBits>;
+
+  static constexpr uint32_t Offset = ByteOffset;
+  static constexpr uint32_t Width = NumBits;
+  static constexpr uint32_t NumBytes = (BitOffset + NumBits + 7) / 8;
+  static constexpr uint32_t EndOffset = ByteOffset + NumBytes; // first byte after field
+  static constexpr uint32_t Shift = NumBytes * 8 - BitOffset - NumBits;
+  static constexpr uint64_t Mask = NumBits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << NumBits) - 1;
+
+  static tValue Get(const uint8_t *Data)
+  {
+    return (tValue)((xLoadBigEndian<NumBytes>(Data + ByteOffset) >> Shift) & (xFieldType<NumBytes * 8>)Mask);
+  }
+
+  static void Set(uint8_t *Data, tValue Value)
+  {
+    using tSpan = xFieldType<NumBytes * 8>;
+    constexpr tSpan SpanMask = (tSpan)((tSpan)Mask << Shift);
+    tSpan Span = xLoadBigEndian<NumBytes>(Data + ByteOffset);
+    Span = (tSpan)((Span & (tSpan)~SpanMask) | (((tSpan)Value << Shift) & SpanMask));
+    xStoreBigEndian<NumBytes>(Data + ByteOffset, Span);
+  }
+};
+
+/*
+33 bit timestamp (PTS, DTS) spread over 5 bytes:
+  '00xx' prefix (4 bits) | TS[32..30] | marker | TS[29..15] | marker | TS[14..0] | marker
+*/
+template <uint32_t ByteOffset>
+class xTimestampField
+{
+public:
+  using High = xField<ByteOffset + 0, 4, 3>;
+  using Middle = xField<ByteOffset + 1, 0, 15>;
+  using Low = xField<ByteOffset + 3, 0, 15>;
+
+  static constexpr uint32_t Offset = ByteOffset;
+  static constexpr uint32_t Length = 5;
+  static constexpr uint32_t EndOffset = ByteOffset + Length;
+
+  static uint64_t Get(const uint8_t *Data)
+  {
+    return (uint64_t)High::Get(Data) << 30 | (uint64_t)Middle::Get(Data) << 15 | (uint64_t)Low::Get(Data);
+  }
+};
+
+//=============================================================================================================================================================================
+
+// TS packet header - relative to sync byte
+class xTS_HeaderLayout
+{
+public:
+  using SB = xField<0, 0, 8>;
+  using E = xField<1, 0, 1>;
+  using S = xField<1, 1, 1>;
+  using T = xField<1, 2, 1>;
+  using PID = xField<1, 3, 13>;
+  using TSC = xField<3, 0, 2>;
+  using AFC = xField<3, 2, 2>;
+  using CC = xField<3, 4, 4>;
+};
+
+// adaptation field - relative to adaptation_field_length byte
+class xTS_AdaptationFieldLayout
+{
+public:
+  using Length = xField<0, 0, 8>;
+  using DiscontinuityIndicator = xField<1, 0, 1>;
+  using RandomAccessIndicator = xField<1, 1, 1>;
+  using ElementaryStreamPriorityIndicator = xField<1, 2, 1>;
+  using PCRFlag = xField<1, 3, 1>;
+  using OPCRFlag = xField<1, 4, 1>;
+  using SplicingPointFlag = xField<1, 5, 1>;
+  using TransportPrivateDataFlag = xField<1, 6, 1>;
+  using AdaptationFieldExtensionFlag = xField<1, 7, 1>;
+
+  // PCR (when PCR_flag is set) and OPCR (when OPCR_flag is set) follow flags in this order, both in same layout
+  static constexpr uint32_t ClockReferencesOffset = 2;
+  static constexpr uint32_t ClockReferenceLength = 6;
+};
+
+// PCR / OPCR - relative to first byte of clock reference
+class xTS_ClockReferenceLayout
+{
+public:
+  using Base = xField<0, 0, 33>;
+  using Extension = xField<4, 7, 9>;
+};
+
+// PES packet - relative to first byte of packet_start_code_prefix
+class xPES_HeaderLayout
+{
+public:
+  using PacketStartCodePrefix = xField<0, 0, 24>;
+  using StreamId = xField<3, 0, 8>;
+  using PacketLength = xField<4, 0, 16>;
+  // optional PES header
+  using ScramblingControl = xField<6, 2, 2>;
+  using Priority = xField<6, 4, 1>;
+  using DataAlignmentIndicator = xField<6, 5, 1>;
+  using Copyright = xField<6, 6, 1>;
+  using OriginalOrCopy = xField<6, 7, 1>;
+  using PTS_DTS_Flags = xField<7, 0, 2>;
+  using ESCRFlag = xField<7, 2, 1>;
+  using ESRateFlag = xField<7, 3, 1>;
+  using DSMTrickModeFlag = xField<7, 4, 1>;
+  using AdditionalCopyInfoFlag = xField<7, 5, 1>;
+  using CRCFlag = xField<7, 6, 1>;
+  using ExtensionFlag = xField<7, 7, 1>;
+  using HeaderDataLength = xField<8, 0, 8>;
+  // optional fields follow in this order, each only when its flag is set, then stuffing up to end of header
+  static constexpr uint32_t OptionalFieldsOffset = 9;
+  using PTS = xTimestampField<9>;
+  using DTS = xTimestampField<14>;
+};
+
+// PES optional fields - relative to first byte of field
+class xPES_ESCRLayout
+{
+public:
+  static constexpr uint32_t Length = 6;
+  using BaseHigh = xField<0, 2, 3>;
+  using BaseMiddle = xField<0, 6, 15>;
+  using BaseLow = xField<2, 6, 15>;
+  using Extension = xField<4, 6, 9>;
+};
+
+class xPES_ESRateLayout
+{
+public:
+  static constexpr uint32_t Length = 3;
+  using Rate = xField<0, 1, 22>; // units of 50 bytes/s
+};
+
+class xPES_TrickModeLayout
+{
+public:
+  static constexpr uint32_t Length = 1;
+  using Control = xField<0, 0, 3>;
+  using Mode = xField<0, 3, 5>; // field_id/intra_slice_refresh/frequency_truncation or rep_cntrl, depends on control
+};
+
+class xPES_AdditionalCopyInfoLayout
+{
+public:
+  static constexpr uint32_t Length = 1;
+  using Info = xField<0, 1, 7>;
+};
+
+class xPES_CRCLayout
+{
+public:
+  static constexpr uint32_t Length = 2;
+  using PreviousPacketCRC = xField<0, 0, 16>;
+};
+
+// PES extension - flags byte, then optional parts in this order
+class xPES_ExtensionLayout
+{
+public:
+  static constexpr uint32_t Length = 1;
+  using PrivateDataFlag = xField<0, 0, 1>;
+  using PackHeaderFieldFlag = xField<0, 1, 1>;
+  using SequenceCounterFlag = xField<0, 2, 1>;
+  using P_STD_BufferFlag = xField<0, 3, 1>;
+  using Extension2Flag = xField<0, 7, 1>;
+
+  static constexpr uint32_t PrivateDataLength = 16;
+  using PackFieldLength = xField<0, 0, 8>; // followed by pack header
+
+  static constexpr uint32_t SequenceCounterLength = 2;
+  using SequenceCounter = xField<0, 1, 7>;
+  using MPEG1_MPEG2_Identifier = xField<1, 1, 1>;
+  using OriginalStuffLength = xField<1, 2, 6>;
+
+  static constexpr uint32_t P_STD_BufferLength = 2;
+  using P_STD_BufferScale = xField<0, 2, 1>;
+  using P_STD_BufferSize = xField<0, 3, 13>;
+
+  using Extension2FieldLength = xField<0, 1, 7>; // followed by extension field data
+  using StreamIdExtensionFlag = xField<1, 0, 1>;
+  using StreamIdExtension = xField<1, 1, 7>;
+};
+
+// long form PSI section header - relative to table_id
+class xPSI_SectionLayout
+{
+public:
+  using TableId = xField<0, 0, 8>;
+  using SectionSyntaxIndicator = xField<1, 0, 1>;
+  using SectionLength = xField<1, 4, 12>;
+  using TableIdExtension = xField<3, 0, 16>;
+  using VersionNumber = xField<5, 2, 5>;
+  using CurrentNextIndicator = xField<5, 7, 1>;
+  using SectionNumber = xField<6, 0, 8>;
+  using LastSectionNumber = xField<7, 0, 8>;
+};
+
+// PAT program loop entry
+class xPSI_PAT_EntryLayout
+{
+public:
+  static constexpr uint32_t Length = 4;
+  using ProgramNumber = xField<0, 0, 16>;
+  using PID = xField<2, 3, 13>;
+};
+
+// PMT fixed part - relative to table_id
+class xPSI_PMT_Layout
+{
+public:
+  using PCR_PID = xField<8, 3, 13>;
+  using ProgramInfoLength = xField<10, 4, 12>;
+};
+
+// PMT elementary stream loop entry
+class xPSI_PMT_EntryLayout
+{
+public:
+  static constexpr uint32_t Length = 5;
+  using StreamType = xField<0, 0, 8>;
+  using ElementaryPID = xField<1, 3, 13>;
+  using ESInfoLength = xField<3, 4, 12>;
+};
+
+//=============================================================================================================================================================================
+
+static_assert(xTS_HeaderLayout::CC::EndOffset == 4, "TS header is 4 bytes");
+static_assert(xTS_ClockReferenceLayout::Extension::EndOffset == xTS_AdaptationFieldLayout::ClockReferenceLength, "PCR is 6 bytes");
+static_assert(xTS_ClockReferenceLayout::Base::Shift == 7, "PCR base is followed by 6 reserved bits and extension");
+static_assert(xPES_HeaderLayout::PTS::Offset == xPES_HeaderLayout::OptionalFieldsOffset, "PTS is first optional PES field");
+static_assert(xPES_ESCRLayout::Extension::EndOffset == xPES_ESCRLayout::Length, "ESCR is 6 bytes");
+static_assert(xPSI_SectionLayout::LastSectionNumber::EndOffset == 8, "long form section header is 8 bytes");
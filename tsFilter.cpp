@@ -0,0 +1,444 @@
+#include "tsFilter.h"
+#include "tsFields.h"
+#include "tsSyncScanner.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_PIDFilter
+//=============================================================================================================================================================================
+
+xTS_PIDFilter::xTS_PIDFilter()
+{
+  this->m_ProgramFilter = -1;
+  this->m_HasRequestedPIDs = false;
+  std::fill(m_Requested, m_Requested + NumPIDs, false);
+  std::fill(m_Action, m_Action + NumPIDs, eAction::Drop);
+  std::fill(m_Assemblers, m_Assemblers + NumPIDs, nullptr);
+  std::fill(m_ContinuityCounter, m_ContinuityCounter + NumPIDs, 0);
+  m_PSIPackets.reset(new uint8_t[MaxPSIPackets * xTS::TS_PacketLength]);
+  this->m_NumPSIPackets = 0;
+  this->m_Statistics = {};
+}
+
+/**
+  @brief Select packets to keep
+  @param ProgramFilter is program number to keep (-1 for all programs)
+  @param RequestedPIDs are PIDs to keep (empty - all streams of selected programs)
+*/
+void xTS_PIDFilter::Init(int32_t ProgramFilter, const std::vector<uint16_t> &RequestedPIDs)
+{
+  this->m_ProgramFilter = ProgramFilter;
+  for (uint16_t PID : RequestedPIDs)
+  {
+    this->m_Requested[PID & xTS_PID_Router::PIDMask] = true;
+  }
+  this->m_HasRequestedPIDs = !RequestedPIDs.empty();
+  xUpdateActions();
+}
+
+/**
+  @brief Create (truncate) output transport stream
+  @param FileName is path to output file ("-" for standard output)
+  @param ReferenceInput tells that input packets stay valid until Close(), so they are not copied
+  @param FlushThreshold is number of pending bytes that triggers write to file
+  @return 0 on success, -1 on failure
+*/
+int32_t xTS_PIDFilter::Open(const char *FileName, bool ReferenceInput, size_t FlushThreshold)
+{
+  this->m_NumPSIPackets = 0;
+  return m_Output.Open(FileName, ReferenceInput, FlushThreshold);
+}
+
+void xTS_PIDFilter::AbsorbBatch(const xTS_PacketBatch &Batch)
+{
+  // consecutive passed packets (only with 188 byte stride) are written as one run
+  const uint8_t *RunStart = nullptr;
+  uint32_t RunLength = 0;
+  for (uint32_t PacketIdx = 0; PacketIdx < Batch.getNumPackets(); PacketIdx++)
+  {
+    const uint8_t *Packet = Batch.getPacket(PacketIdx);
+    eAction Action = m_Action[xTS_HeaderLayout::PID::Get(Packet)];
+    if (Action == eAction::Pass)
+    {
+      if (RunStart + RunLength != Packet)
+      {
+        if (RunLength != 0)
+        {
+          m_Output.Write(RunStart, RunLength);
+        }
+        RunStart = Packet;
+        RunLength = 0;
+      }
+      RunLength += xTS::TS_PacketLength;
+      this->m_Statistics.NumPassedPackets++;
+    }
+    else if (Action == eAction::Section)
+    {
+      // regenerated sections go between passed packets, in place of original
+      if (RunLength != 0)
+      {
+        m_Output.Write(RunStart, RunLength);
+        RunLength = 0;
+      }
+      xAbsorbSectionPacket(Packet);
+    }
+  }
+  if (RunLength != 0)
+  {
+    m_Output.Write(RunStart, RunLength);
+  }
+  this->m_Statistics.NumPackets += Batch.getNumPackets();
+}
+
+void xTS_PIDFilter::PrintStatistics(FILE *File) const
+{
+  uint32_t NumPassedPIDs = (uint32_t)std::count(m_Action, m_Action + NumPIDs, eAction::Pass);
+  fprintf(File, "Filter: Packets=%" PRIu64 " Passed=%" PRIu64 " PIDs=%u Sections=%" PRIu64 " PSIPackets=%" PRIu64 "\n",
+          m_Statistics.NumPackets, m_Statistics.NumPassedPackets, NumPassedPIDs, m_Statistics.NumSections, m_Statistics.NumPSIPackets);
+}
+
+void xTS_PIDFilter::OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length)
+{
+  // damaged or not yet applicable sections are not regenerated
+  if (Length < xPSI::LongSectionHeaderLength + xPSI::CRCLength || !xPSI_SectionLayout::SectionSyntaxIndicator::Get(Section) ||
+      !xPSI_SectionLayout::CurrentNextIndicator::Get(Section) || xPSI::CRC32(Section, Length) != 0)
+  {
+    return;
+  }
+
+  uint8_t TableId = xPSI_SectionLayout::TableId::Get(Section);
+  if (PID == (uint16_t)xTS_PacketHeader::ePID::PAT && TableId == xPSI::eTableId_PAT)
+  {
+    xOnPAT(Section, Length);
+    return;
+  }
+  if (TableId != xPSI::eTableId_PMT)
+  {
+    return;
+  }
+  uint16_t ProgramNumber = xPSI_SectionLayout::TableIdExtension::Get(Section);
+  for (xProgramInfo &Program : m_Programs)
+  {
+    if (Program.PMT_PID == PID && Program.ProgramNumber == ProgramNumber)
+    {
+      xOnPMT(Program, Section, Length);
+      return;
+    }
+  }
+}
+
+void xTS_PIDFilter::xAbsorbSectionPacket(const uint8_t *Packet)
+{
+  xTS_PacketHeader PacketHeader;
+  PacketHeader.Parse(Packet);
+  xPSI_SectionAssembler *Assembler = m_Assemblers[PacketHeader.getPID()];
+  if (Assembler == nullptr || !PacketHeader.hasPayload())
+  {
+    return;
+  }
+
+  uint32_t Offset = xTS::TS_HeaderLength;
+  if (PacketHeader.hasAdaptationField())
+  {
+    Offset += Packet[xTS::TS_HeaderLength] + 1;
+  }
+  if (Offset >= xTS::TS_PacketLength)
+  {
+    return;
+  }
+  Assembler->AbsorbPacket(Packet + Offset, xTS::TS_PacketLength - Offset, &PacketHeader, this);
+}
+
+void xTS_PIDFilter::xOnPAT(const uint8_t *Section, uint32_t Length)
+{
+  if (!m_PATVersion.isUnchanged(Section, Length))
+  {
+    if (m_PAT.Parse(Section, Length) == NOT_VALID)
+    {
+      return;
+    }
+    m_PATVersion.Update(Section, Length);
+
+    // programs that keep their PMT PID keep their PMT too
+    std::vector<xProgramInfo> Programs;
+    for (const xPSI_PAT::xProgram &Entry : m_PAT.getPrograms())
+    {
+      xProgramInfo Program;
+      Program.ProgramNumber = Entry.ProgramNumber;
+      Program.PMT_PID = Entry.PID;
+      Program.PMTValid = false;
+      for (const xProgramInfo &Known : m_Programs)
+      {
+        if (Known.ProgramNumber == Entry.ProgramNumber && Known.PMT_PID == Entry.PID)
+        {
+          Program = Known;
+          break;
+        }
+      }
+      Programs.push_back(Program);
+    }
+    m_Programs.swap(Programs);
+    xUpdateActions();
+  }
+  m_PATSection.assign(Section, Section + Length);
+  xWritePAT();
+}
+
+// regenerates last original PAT section - on its repetition and when PMT makes its first program kept
+void xTS_PIDFilter::xWritePAT()
+{
+  if (m_PATSection.empty())
+  {
+    return;
+  }
+  const uint8_t *Section = m_PATSection.data();
+  uint32_t Length = (uint32_t)m_PATSection.size();
+
+  // header as it is, program loop without programs that are not kept
+  std::memcpy(m_Section, Section, xPSI::LongSectionHeaderLength);
+  uint32_t SectionLength = xPSI::LongSectionHeaderLength;
+  const uint8_t *End = Section + Length - xPSI::CRCLength;
+  for (const uint8_t *Entry = Section + xPSI::LongSectionHeaderLength; Entry + xPSI_PAT_EntryLayout::Length <= End; Entry += xPSI_PAT_EntryLayout::Length)
+  {
+    uint16_t ProgramNumber = xPSI_PAT_EntryLayout::ProgramNumber::Get(Entry);
+    uint16_t PID = xPSI_PAT_EntryLayout::PID::Get(Entry);
+    bool Kept = false;
+    if (ProgramNumber == 0)
+    {
+      Kept = m_Requested[PID]; // network PID
+    }
+    for (const xProgramInfo &Program : m_Programs)
+    {
+      if (ProgramNumber != 0 && Program.ProgramNumber == ProgramNumber && Program.PMT_PID == PID)
+      {
+        Kept = xIsProgramKept(Program);
+        break;
+      }
+    }
+    if (Kept)
+    {
+      std::memcpy(m_Section + SectionLength, Entry, xPSI_PAT_EntryLayout::Length);
+      SectionLength += xPSI_PAT_EntryLayout::Length;
+    }
+  }
+
+  // nothing selected yet (PMTs of requested PIDs are not known) - no PAT rather than empty one
+  if (SectionLength == xPSI::LongSectionHeaderLength && m_OutputTables.empty())
+  {
+    return;
+  }
+  xWriteSection((uint16_t)xTS_PacketHeader::ePID::PAT, SectionLength);
+}
+
+void xTS_PIDFilter::xOnPMT(xProgramInfo &Program, const uint8_t *Section, uint32_t Length)
+{
+  if (!Program.Version.isUnchanged(Section, Length))
+  {
+    if (Program.PMT.Parse(Section, Length) == NOT_VALID)
+    {
+      return;
+    }
+    Program.Version.Update(Section, Length);
+    Program.PMTValid = true;
+    xUpdateActions();
+  }
+  if (!xIsProgramKept(Program))
+  {
+    return;
+  }
+  if (!xIsPATWritten())
+  {
+    // PAT seen before this PMT listed nothing kept (PMT was not known) - it goes to output first, so stream never
+    // starts without PAT
+    xWritePAT();
+  }
+
+  // fixed part and program descriptors as they are, stream loop without streams that are not kept
+  const uint8_t *End = Section + Length - xPSI::CRCLength;
+  uint32_t FixedLength = xPSI_PMT_Layout::ProgramInfoLength::EndOffset + xPSI_PMT_Layout::ProgramInfoLength::Get(Section);
+  if (Section + FixedLength > End)
+  {
+    return;
+  }
+  std::memcpy(m_Section, Section, FixedLength);
+  uint32_t SectionLength = FixedLength;
+  const uint8_t *Entry = Section + FixedLength;
+  while (Entry + xPSI_PMT_EntryLayout::Length <= End)
+  {
+    uint32_t EntryLength = xPSI_PMT_EntryLayout::Length + xPSI_PMT_EntryLayout::ESInfoLength::Get(Entry);
+    if (Entry + EntryLength > End)
+    {
+      break;
+    }
+    if (xIsStreamKept(xPSI_PMT_EntryLayout::ElementaryPID::Get(Entry)))
+    {
+      std::memcpy(m_Section + SectionLength, Entry, EntryLength);
+      SectionLength += EntryLength;
+    }
+    Entry += EntryLength;
+  }
+  xWriteSection(Program.PMT_PID, SectionLength);
+}
+
+bool xTS_PIDFilter::xIsPATWritten() const
+{
+  return std::any_of(m_OutputTables.begin(), m_OutputTables.end(), [](const xOutputTable &Table) { return Table.PID == (uint16_t)xTS_PacketHeader::ePID::PAT; });
+}
+
+// action table from requested PIDs, PAT and known PMTs
+void xTS_PIDFilter::xUpdateActions()
+{
+  for (uint32_t PID = 0; PID < NumPIDs; PID++)
+  {
+    this->m_Action[PID] = m_Requested[PID] ? eAction::Pass : eAction::Drop;
+  }
+
+  for (const xProgramInfo &Program : m_Programs)
+  {
+    if (Program.ProgramNumber == 0 || !Program.PMTValid || !xIsProgramKept(Program))
+    {
+      continue;
+    }
+    for (const xPSI_PMT::xElementaryStream &Stream : Program.PMT.getStreams())
+    {
+      if (xIsStreamKept(Stream.PID))
+      {
+        this->m_Action[Stream.PID] = eAction::Pass;
+      }
+    }
+    if (Program.PMT.getPCR_PID() != (uint16_t)xTS_PacketHeader::ePID::NuLL)
+    {
+      this->m_Action[Program.PMT.getPCR_PID()] = eAction::Pass;
+    }
+  }
+
+  // PSI of matching programs is followed even before they are known to be kept, PID carrying PCR stays passed
+  std::vector<uint16_t> SectionPIDs(1, (uint16_t)xTS_PacketHeader::ePID::PAT);
+  for (const xProgramInfo &Program : m_Programs)
+  {
+    if (Program.ProgramNumber != 0 && xIsProgramMatching(Program.ProgramNumber) && m_Action[Program.PMT_PID] != eAction::Pass)
+    {
+      SectionPIDs.push_back(Program.PMT_PID);
+    }
+  }
+  for (uint16_t PID : SectionPIDs)
+  {
+    this->m_Action[PID] = eAction::Section;
+    if (m_Assemblers[PID] == nullptr)
+    {
+      m_AssemblerPool.emplace_back(new xPSI_SectionAssembler());
+      m_AssemblerPool.back()->Init(PID);
+      this->m_Assemblers[PID] = m_AssemblerPool.back().get();
+    }
+  }
+}
+
+bool xTS_PIDFilter::xIsProgramKept(const xProgramInfo &Program) const
+{
+  if (!xIsProgramMatching(Program.ProgramNumber))
+  {
+    return false;
+  }
+  if (!m_HasRequestedPIDs)
+  {
+    return true;
+  }
+  if (!Program.PMTValid)
+  {
+    return false;
+  }
+  for (const xPSI_PMT::xElementaryStream &Stream : Program.PMT.getStreams())
+  {
+    if (m_Requested[Stream.PID])
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+  @brief Finish section in m_Section (length, version, CRC) and write it in packets of PID
+  @param PID is output PID
+  @param Length is number of section bytes in m_Section, without CRC
+*/
+void xTS_PIDFilter::xWriteSection(uint16_t PID, uint32_t Length)
+{
+  static constexpr uint8_t PayloadOnly = 0x01; // adaptation_field_control - no adaptation field, payload only
+
+  xPSI_SectionLayout::SectionLength::Set(m_Section, (uint16_t)(Length + xPSI::CRCLength - xPSI::SectionHeaderLength));
+
+  // version follows changes of regenerated content, not of original one (content is compared with version cleared)
+  uint8_t OriginalVersion = xPSI_SectionLayout::VersionNumber::Get(m_Section);
+  xPSI_SectionLayout::VersionNumber::Set(m_Section, 0);
+  uint8_t TableId = xPSI_SectionLayout::TableId::Get(m_Section);
+  uint16_t TableIdExtension = xPSI_SectionLayout::TableIdExtension::Get(m_Section);
+  uint8_t SectionNumber = xPSI_SectionLayout::SectionNumber::Get(m_Section);
+  xOutputTable *Table = nullptr;
+  for (xOutputTable &OutputTable : m_OutputTables)
+  {
+    if (OutputTable.PID == PID && OutputTable.TableId == TableId && OutputTable.TableIdExtension == TableIdExtension && OutputTable.SectionNumber == SectionNumber)
+    {
+      Table = &OutputTable;
+      break;
+    }
+  }
+  if (Table == nullptr)
+  {
+    m_OutputTables.push_back({PID, TableId, TableIdExtension, SectionNumber, OriginalVersion, std::vector<uint8_t>(m_Section, m_Section + Length)});
+    Table = &m_OutputTables.back();
+  }
+  else if (Table->Content.size() != Length || std::memcmp(Table->Content.data(), m_Section, Length) != 0)
+  {
+    Table->VersionNumber = (uint8_t)((Table->VersionNumber + 1) & xPSI_SectionLayout::VersionNumber::Mask);
+    Table->Content.assign(m_Section, m_Section + Length);
+  }
+  xPSI_SectionLayout::VersionNumber::Set(m_Section, Table->VersionNumber);
+
+  xStoreBigEndian<xPSI::CRCLength>(m_Section + Length, xPSI::CRC32(m_Section, Length));
+  uint32_t TotalLength = Length + xPSI::CRCLength;
+
+  // payload only packets, first one starts section right after pointer_field
+  uint32_t Offset = 0;
+  while (Offset < TotalLength)
+  {
+    if (m_NumPSIPackets == MaxPSIPackets)
+    {
+      m_Output.Flush(); // output may still reference earlier packets
+      this->m_NumPSIPackets = 0;
+    }
+    uint8_t *Packet = m_PSIPackets.get() + (size_t)m_NumPSIPackets * xTS::TS_PacketLength;
+    this->m_NumPSIPackets++;
+
+    bool Start = Offset == 0;
+    std::memset(Packet, 0, xTS::TS_HeaderLength); // no error, normal priority, not scrambled
+    xTS_HeaderLayout::SB::Set(Packet, xTS_SyncScanner::SyncByte);
+    xTS_HeaderLayout::S::Set(Packet, Start ? 1 : 0);
+    xTS_HeaderLayout::PID::Set(Packet, PID);
+    xTS_HeaderLayout::AFC::Set(Packet, PayloadOnly);
+    xTS_HeaderLayout::CC::Set(Packet, m_ContinuityCounter[PID]);
+    this->m_ContinuityCounter[PID] = (uint8_t)((m_ContinuityCounter[PID] + 1) & 0xF);
+    uint32_t PacketOffset = xTS::TS_HeaderLength;
+    if (Start)
+    {
+      Packet[PacketOffset++] = 0; // pointer_field
+    }
+    uint32_t NumBytes = std::min(xTS::TS_PacketLength - PacketOffset, TotalLength - Offset);
+    std::memcpy(Packet + PacketOffset, m_Section + Offset, NumBytes);
+    std::memset(Packet + PacketOffset + NumBytes, 0xFF, xTS::TS_PacketLength - PacketOffset - NumBytes);
+    Offset += NumBytes;
+
+    xWritePacket(Packet);
+    this->m_Statistics.NumPSIPackets++;
+  }
+  this->m_Statistics.NumSections++;
+}
+
+void xTS_PIDFilter::xWritePacket(const uint8_t *Packet)
+{
+  m_Output.Write(Packet, xTS::TS_PacketLength);
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,129 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+PID filter - writes selected 188 byte packets of input to output transport stream without touching their payload:
+  Every packet costs one lookup of its PID in action table:
+    Drop    - not selected
+    Pass    - copied as it is, runs of consecutive packets go to output as one write (with mapped input output is
+              gathered straight from input memory, other inputs are copied once)
+    Section - PAT and PMT PIDs of selected programs, sections are assembled and regenerated
+  M2TS timestamps and RS parity bytes are not copied, output is always plain 188 byte packets.
+
+  Selection - programs (one program with ProgramFilter, all programs otherwise) and explicitly requested PIDs:
+    elementary stream of selected program is kept when no PIDs are requested or it is requested itself, program is
+    kept when it has kept streams (PMT not known yet counts as kept when no PIDs are requested), PCR PID of kept
+    program is kept always. Requested PIDs that are not PSI (e.g. SDT) are passed as they are.
+    Table is rebuilt whenever PAT or PMT changes, before that only requested PIDs pass.
+
+  PSI regeneration - original PAT/PMT packets are dropped, every original section is replaced (at position of packet
+  that completed it) by section with entries of not kept programs/streams removed. PAT that lists nothing kept yet
+  (PMTs are not known) is held back and written right before first PMT that makes its program kept. Regenerated
+  sections are carried in own packets (pointer_field 0, stuffed with 0xFF) with own continuity counters, so CC of PSI
+  PIDs stays continuous while CC of passed PIDs is untouched. Version of regenerated table starts at original version and is incremented
+  whenever regenerated content changes. PMT on its program's PCR PID is passed unchanged (packets carry PCR).
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_PIDFilter : public xPSI_SectionHandler
+{
+public:
+  static constexpr uint32_t NumPIDs = xTS_PID_Router::NumPIDs;
+  static constexpr uint32_t MaxPSIPackets = 256; // regenerated packets kept until output is flushed
+
+  enum class eAction : uint8_t
+  {
+    Drop,
+    Pass,
+    Section,
+  };
+
+  struct xProgramInfo
+  {
+    uint16_t ProgramNumber;
+    uint16_t PMT_PID;
+    bool PMTValid;
+    xPSI_TableVersion Version;
+    xPSI_PMT PMT;
+  };
+
+  struct xStatistics
+  {
+    uint64_t NumPackets;
+    uint64_t NumPassedPackets;
+    uint64_t NumSections;   // regenerated PSI sections
+    uint64_t NumPSIPackets; // packets of regenerated sections
+  };
+
+protected:
+  // setup
+  int32_t m_ProgramFilter; // program number to keep, -1 for all programs
+  bool m_Requested[NumPIDs];
+  bool m_HasRequestedPIDs;
+  xTS_FileSink m_Output;
+  // selection
+  eAction m_Action[NumPIDs];
+  xPSI_SectionAssembler *m_Assemblers[NumPIDs];
+  std::vector<std::unique_ptr<xPSI_SectionAssembler>> m_AssemblerPool;
+  xPSI_TableVersion m_PATVersion;
+  xPSI_PAT m_PAT;
+  std::vector<uint8_t> m_PATSection; // last original PAT section
+  std::vector<xProgramInfo> m_Programs;
+  // regenerated PSI
+  struct xOutputTable
+  {
+    uint16_t PID;
+    uint8_t TableId;
+    uint16_t TableIdExtension;
+    uint8_t SectionNumber;
+    uint8_t VersionNumber;
+    std::vector<uint8_t> Content; // section without CRC, version bits cleared
+  };
+  std::vector<xOutputTable> m_OutputTables;
+  uint8_t m_ContinuityCounter[NumPIDs];
+  uint8_t m_Section[xPSI::MaxSectionLength];
+  std::unique_ptr<uint8_t[]> m_PSIPackets;
+  uint32_t m_NumPSIPackets;
+  // statistics
+  xStatistics m_Statistics;
+
+public:
+  xTS_PIDFilter();
+
+  void Init(int32_t ProgramFilter, const std::vector<uint16_t> &RequestedPIDs);
+  int32_t Open(const char *FileName, bool ReferenceInput, size_t FlushThreshold);
+  void AbsorbBatch(const xTS_PacketBatch &Batch);
+  void Flush() { m_Output.Flush(); }
+  void Close() { m_Output.Close(); }
+  void PrintStatistics(FILE *File) const;
+
+  void OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length) override;
+
+public:
+  eAction getAction(uint16_t PID) const { return m_Action[PID & xTS_PID_Router::PIDMask]; }
+  xTS_FileSink &getOutput() { return m_Output; }
+  const xStatistics &getStatistics() const { return m_Statistics; }
+
+protected:
+  void xAbsorbSectionPacket(const uint8_t *Packet);
+  void xOnPAT(const uint8_t *Section, uint32_t Length);
+  void xOnPMT(xProgramInfo &Program, const uint8_t *Section, uint32_t Length);
+  void xWritePAT();
+  bool xIsPATWritten() const;
+  void xUpdateActions();
+  bool xIsProgramMatching(uint16_t ProgramNumber) const { return m_ProgramFilter < 0 || ProgramNumber == (uint32_t)m_ProgramFilter; }
+  bool xIsStreamKept(uint16_t PID) const { return !m_HasRequestedPIDs || m_Requested[PID]; }
+  bool xIsProgramKept(const xProgramInfo &Program) const;
+  void xWriteSection(uint16_t PID, uint32_t Length);
+  void xWritePacket(const uint8_t *Packet);
+};
+
+//=============================================================================================================================================================================
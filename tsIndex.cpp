@@ -0,0 +1,244 @@
+#include "tsIndex.h"
+#include "tsFields.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_IndexBuilder
+//=============================================================================================================================================================================
+
+xTS_IndexBuilder::xTS_IndexBuilder()
+{
+  Reset();
+}
+
+void xTS_IndexBuilder::Reset()
+{
+  m_Entries.clear();
+  m_Entries.resize(xTS_PID_Router::NumPIDs);
+  this->m_NumPackets = 0;
+  this->m_PacketStride = xTS::TS_PacketLength;
+}
+
+/**
+  @brief Record packet if it is interesting for random access
+  @param StreamOffset is position of packet sync byte in input
+  @param Packet is pointer to packet (sync byte)
+  @param PacketHeader is parsed header of packet
+*/
+void xTS_IndexBuilder::AddPacket(uint64_t StreamOffset, const uint8_t *Packet, const xTS_PacketHeader *PacketHeader)
+{
+  this->m_NumPackets++;
+
+  uint8_t Flags = PacketHeader->getStart() ? xTS_IndexEntry::eFlags_PayloadUnitStart : 0;
+  uint64_t PCR = 0;
+  // adaptation field flags are read straight from packet - most packets have nothing to record
+  const uint8_t *AdaptationField = Packet + xTS::TS_HeaderLength;
+  if (PacketHeader->hasAdaptationField() && xTS_AdaptationFieldLayout::Length::Get(AdaptationField) > 0)
+  {
+    if (xTS_AdaptationFieldLayout::RandomAccessIndicator::Get(AdaptationField))
+    {
+      Flags |= xTS_IndexEntry::eFlags_RandomAccess;
+    }
+    if (xTS_AdaptationFieldLayout::DiscontinuityIndicator::Get(AdaptationField))
+    {
+      Flags |= xTS_IndexEntry::eFlags_Discontinuity;
+    }
+    if (xTS_AdaptationField::PeekPCR(Packet, PCR))
+    {
+      Flags |= xTS_IndexEntry::eFlags_PCR;
+    }
+  }
+  if (Flags == 0)
+  {
+    return;
+  }
+
+  xTS_IndexEntry Entry;
+  Entry.m_OffsetAndFlags = (StreamOffset & xTS_IndexEntry::OffsetMask) | ((uint64_t)Flags << xTS_IndexEntry::FlagsShift);
+  Entry.m_PCR = PCR;
+  m_Entries[PacketHeader->getPID()].push_back(Entry);
+}
+
+uint64_t xTS_IndexBuilder::getNumEntries() const
+{
+  uint64_t NumEntries = 0;
+  for (const std::vector<xTS_IndexEntry> &Entries : m_Entries)
+  {
+    NumEntries += Entries.size();
+  }
+  return NumEntries;
+}
+
+/**
+  @brief Write index file
+  @param FileName is path to index file
+  @param SourceSize is size of indexed input (lets reader detect stale index)
+  @return 0 on success, -1 on failure
+*/
+int32_t xTS_IndexBuilder::Write(const char *FileName, uint64_t SourceSize) const
+{
+  std::vector<xTS_IndexPID> PIDs;
+  uint64_t FirstEntry = 0;
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    if (!m_Entries[PID].empty())
+    {
+      xTS_IndexPID Record;
+      Record.m_PID = (uint16_t)PID;
+      Record.m_Reserved = 0;
+      Record.m_NumEntries = (uint32_t)m_Entries[PID].size();
+      Record.m_FirstEntry = FirstEntry;
+      PIDs.push_back(Record);
+      FirstEntry += Record.m_NumEntries;
+    }
+  }
+
+  xTS_IndexHeader Header;
+  std::memcpy(Header.m_Magic, "TSIX", 4);
+  Header.m_Version = Version;
+  Header.m_PacketStride = (uint16_t)m_PacketStride;
+  Header.m_NumPIDs = (uint32_t)PIDs.size();
+  Header.m_Reserved = 0;
+  Header.m_SourceSize = SourceSize;
+  Header.m_NumPackets = m_NumPackets;
+
+  FILE *File = fopen(FileName, "wb");
+  if (File == nullptr)
+  {
+    return NOT_VALID;
+  }
+  bool Ok = fwrite(&Header, sizeof(Header), 1, File) == 1;
+  Ok = Ok && (PIDs.empty() || fwrite(PIDs.data(), sizeof(xTS_IndexPID), PIDs.size(), File) == PIDs.size());
+  for (const xTS_IndexPID &Record : PIDs)
+  {
+    const std::vector<xTS_IndexEntry> &Entries = m_Entries[Record.m_PID];
+    Ok = Ok && fwrite(Entries.data(), sizeof(xTS_IndexEntry), Entries.size(), File) == Entries.size();
+  }
+  Ok = (fclose(File) == 0) && Ok;
+  return Ok ? 0 : NOT_VALID;
+}
+
+//=============================================================================================================================================================================
+// xTS_PacketIndex
+//=============================================================================================================================================================================
+
+xTS_PacketIndex::xTS_PacketIndex()
+{
+  this->m_Header = nullptr;
+  this->m_PIDs = nullptr;
+  this->m_Entries = nullptr;
+  this->m_NumEntries = 0;
+}
+
+/**
+  @brief Map index file and check its consistency
+  @param FileName is path to index file
+  @return 0 on success, -1 when file cannot be mapped or is not valid index
+*/
+int32_t xTS_PacketIndex::Open(const char *FileName)
+{
+  Close();
+  if (m_File.Open(FileName) == NOT_VALID)
+  {
+    return NOT_VALID;
+  }
+
+  const uint8_t *Data = m_File.getMappedData();
+  size_t Size = m_File.getMappedSize();
+  const xTS_IndexHeader *Header = (const xTS_IndexHeader *)Data;
+  if (Size < sizeof(xTS_IndexHeader) || std::memcmp(Header->m_Magic, "TSIX", 4) != 0 || Header->m_Version != xTS_IndexBuilder::Version ||
+      (Size - sizeof(xTS_IndexHeader)) / sizeof(xTS_IndexPID) < Header->m_NumPIDs)
+  {
+    Close();
+    return NOT_VALID;
+  }
+  size_t EntriesOffset = sizeof(xTS_IndexHeader) + (size_t)Header->m_NumPIDs * sizeof(xTS_IndexPID);
+  if ((Size - EntriesOffset) % sizeof(xTS_IndexEntry) != 0)
+  {
+    Close();
+    return NOT_VALID;
+  }
+  uint64_t NumEntries = (Size - EntriesOffset) / sizeof(xTS_IndexEntry);
+
+  // PID records have to be sorted and point inside entry array
+  const xTS_IndexPID *PIDs = (const xTS_IndexPID *)(Data + sizeof(xTS_IndexHeader));
+  for (uint32_t PIDIdx = 0; PIDIdx < Header->m_NumPIDs; PIDIdx++)
+  {
+    if ((PIDIdx > 0 && PIDs[PIDIdx].m_PID <= PIDs[PIDIdx - 1].m_PID) || PIDs[PIDIdx].m_FirstEntry > NumEntries ||
+        PIDs[PIDIdx].m_NumEntries > NumEntries - PIDs[PIDIdx].m_FirstEntry)
+    {
+      Close();
+      return NOT_VALID;
+    }
+  }
+
+  this->m_Header = Header;
+  this->m_PIDs = PIDs;
+  this->m_Entries = (const xTS_IndexEntry *)(Data + EntriesOffset);
+  this->m_NumEntries = NumEntries;
+  return 0;
+}
+
+void xTS_PacketIndex::Close()
+{
+  m_File.Close();
+  this->m_Header = nullptr;
+  this->m_PIDs = nullptr;
+  this->m_Entries = nullptr;
+  this->m_NumEntries = 0;
+}
+
+const xTS_IndexPID *xTS_PacketIndex::xFindPID(uint16_t PID) const
+{
+  if (m_Header == nullptr)
+  {
+    return nullptr;
+  }
+  const xTS_IndexPID *End = m_PIDs + m_Header->m_NumPIDs;
+  const xTS_IndexPID *Record = std::lower_bound(m_PIDs, End, PID, [](const xTS_IndexPID &Record, uint16_t PID)
+                                                { return Record.m_PID < PID; });
+  return (Record != End && Record->m_PID == PID) ? Record : nullptr;
+}
+
+const xTS_IndexEntry *xTS_PacketIndex::getEntries(uint16_t PID, uint32_t &NumEntries) const
+{
+  const xTS_IndexPID *Record = xFindPID(PID);
+  NumEntries = Record != nullptr ? Record->m_NumEntries : 0;
+  return Record != nullptr ? m_Entries + Record->m_FirstEntry : nullptr;
+}
+
+const xTS_IndexEntry *xTS_PacketIndex::FindNext(uint16_t PID, uint64_t Offset, uint8_t Flags) const
+{
+  uint32_t NumEntries = 0;
+  const xTS_IndexEntry *Entries = getEntries(PID, NumEntries);
+  if (Entries == nullptr)
+  {
+    return nullptr;
+  }
+  const xTS_IndexEntry *End = Entries + NumEntries;
+  const xTS_IndexEntry *Entry = std::lower_bound(Entries, End, Offset, [](const xTS_IndexEntry &Entry, uint64_t Offset)
+                                                 { return Entry.getOffset() < Offset; });
+  while (Entry != End && (Entry->getFlags() & Flags) == 0)
+  {
+    Entry++;
+  }
+  return Entry != End ? Entry : nullptr;
+}
+
+int64_t xTS_PacketIndex::FindNextOffset(uint64_t Offset, uint8_t Flags) const
+{
+  int64_t Best = NOT_VALID;
+  for (uint32_t PIDIdx = 0; m_Header != nullptr && PIDIdx < m_Header->m_NumPIDs; PIDIdx++)
+  {
+    const xTS_IndexEntry *Entry = FindNext(m_PIDs[PIDIdx].m_PID, Offset, Flags);
+    if (Entry != nullptr && (Best == NOT_VALID || (int64_t)Entry->getOffset() < Best))
+    {
+      Best = (int64_t)Entry->getOffset();
+    }
+  }
+  return Best;
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,128 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include <vector>
+
+/*
+Packet index (sidecar file for random access):
+  For every PID, positions (sync byte offsets) of packets which start payload unit, carry random access indicator
+  or carry PCR are recorded together with PCR value. Entries of each PID are sorted by offset, so position lookup
+  is a binary search directly in mapped file - nothing is parsed or copied when index is loaded.
+
+  File layout (little-endian, all records 8 byte aligned):
+`   0 | char[4] "TSIX" | u16 version | u16 packet stride | u32 NumPIDs | u32 reserved | u64 source size | u64 NumPackets |`
+`  32 | NumPIDs x {u16 PID | u16 reserved | u32 NumEntries | u64 FirstEntry}                                             |`
+`     | entries x {u64 Flags<<56 | Offset | u64 PCR}                                                                   |`
+*/
+
+//=============================================================================================================================================================================
+
+struct xTS_IndexEntry
+{
+  enum eFlags : uint8_t
+  {
+    eFlags_PayloadUnitStart = 0x01,
+    eFlags_RandomAccess = 0x02,
+    eFlags_PCR = 0x04,
+    eFlags_Discontinuity = 0x08,
+  };
+
+  static constexpr uint32_t FlagsShift = 56;
+  static constexpr uint64_t OffsetMask = (1ULL << FlagsShift) - 1;
+
+  uint64_t m_OffsetAndFlags;
+  uint64_t m_PCR; // 27 MHz, valid with eFlags_PCR
+
+  uint64_t getOffset() const { return m_OffsetAndFlags & OffsetMask; }
+  uint8_t getFlags() const { return (uint8_t)(m_OffsetAndFlags >> FlagsShift); }
+  uint64_t getPCR() const { return m_PCR; }
+};
+
+struct xTS_IndexPID
+{
+  uint16_t m_PID;
+  uint16_t m_Reserved;
+  uint32_t m_NumEntries;
+  uint64_t m_FirstEntry;
+};
+
+struct xTS_IndexHeader
+{
+  char m_Magic[4];
+  uint16_t m_Version;
+  uint16_t m_PacketStride;
+  uint32_t m_NumPIDs;
+  uint32_t m_Reserved;
+  uint64_t m_SourceSize;
+  uint64_t m_NumPackets;
+};
+
+static_assert(sizeof(xTS_IndexEntry) == 16, "unexpected index entry layout");
+static_assert(sizeof(xTS_IndexPID) == 16, "unexpected index PID record layout");
+static_assert(sizeof(xTS_IndexHeader) == 32, "unexpected index header layout");
+
+//=============================================================================================================================================================================
+
+class xTS_IndexBuilder
+{
+public:
+  static constexpr uint16_t Version = 1;
+
+protected:
+  std::vector<std::vector<xTS_IndexEntry>> m_Entries; // per PID
+  uint64_t m_NumPackets;
+  uint32_t m_PacketStride;
+
+public:
+  xTS_IndexBuilder();
+
+  void Reset();
+  void AddPacket(uint64_t StreamOffset, const uint8_t *Packet, const xTS_PacketHeader *PacketHeader);
+  int32_t Write(const char *FileName, uint64_t SourceSize) const;
+
+public:
+  void setPacketStride(uint32_t PacketStride) { m_PacketStride = PacketStride; }
+  uint64_t getNumPackets() const { return m_NumPackets; }
+  uint64_t getNumEntries() const;
+};
+
+//=============================================================================================================================================================================
+
+class xTS_PacketIndex
+{
+protected:
+  xTS_MappedFileReader m_File; // used only to map index file
+  const xTS_IndexHeader *m_Header;
+  const xTS_IndexPID *m_PIDs;
+  const xTS_IndexEntry *m_Entries;
+  uint64_t m_NumEntries;
+
+public:
+  xTS_PacketIndex();
+
+  int32_t Open(const char *FileName);
+  void Close();
+
+  // entries of PID (nullptr when PID is not indexed)
+  const xTS_IndexEntry *getEntries(uint16_t PID, uint32_t &NumEntries) const;
+  // first entry of PID at or after Offset having any of Flags, nullptr if there is none
+  const xTS_IndexEntry *FindNext(uint16_t PID, uint64_t Offset, uint8_t Flags) const;
+  // offset of first entry of any PID at or after Offset having any of Flags, -1 if there is none
+  int64_t FindNextOffset(uint64_t Offset, uint8_t Flags) const;
+
+public:
+  bool isOpen() const { return m_Header != nullptr; }
+  uint32_t getNumPIDs() const { return m_Header->m_NumPIDs; }
+  const xTS_IndexPID &getPID(uint32_t PIDIdx) const { return m_PIDs[PIDIdx]; }
+  uint32_t getPacketStride() const { return m_Header->m_PacketStride; }
+  uint64_t getSourceSize() const { return m_Header->m_SourceSize; }
+  uint64_t getNumPackets() const { return m_Header->m_NumPackets; }
+  uint64_t getNumEntries() const { return m_NumEntries; }
+
+protected:
+  const xTS_IndexPID *xFindPID(uint16_t PID) const;
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,445 @@
+#include "tsInput.h"
+#include "tsUringInput.h"
+#include <cstring>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_InputSource
+//=============================================================================================================================================================================
+
+xTS_InputSource::xTS_InputSource()
+{
+  this->m_Window = nullptr;
+  this->m_WindowSize = 0;
+  this->m_WindowOffset = 0;
+  this->m_EndOfStream = false;
+  this->m_BatchSize = DefaultBatchSize;
+}
+
+/**
+  @brief Read next batch of TS packets
+  @param Batch receives packets pointing into reader memory (no copy is made)
+  @return Number of packets in batch (0 at end of stream)
+*/
+int32_t xTS_InputSource::ReadBatch(xTS_PacketBatch &Batch)
+{
+  Batch.Reset();
+
+  while (true)
+  {
+    if (!m_SyncScanner.isLocked())
+    {
+      size_t Available = m_WindowSize >= xTS_SyncScanner::LockLookahead ? m_WindowSize : xRefill(xTS_SyncScanner::LockLookahead);
+      if (Available == 0)
+      {
+        return 0;
+      }
+      size_t NumSkipped = m_SyncScanner.Lock(m_Window, Available, m_EndOfStream);
+      if (m_SyncScanner.isLocked() && m_SyncScanner.getPacketStride() == xTS_SyncScanner::PacketLength_M2TS && NumSkipped >= 4)
+      {
+        // TP_extra_header of first M2TS packet is part of framing, not lost data
+        xConsume(4);
+        NumSkipped -= 4;
+      }
+      xDrop(NumSkipped);
+      continue;
+    }
+
+    uint32_t PacketStride = m_SyncScanner.getPacketStride();
+    size_t Available = m_WindowSize >= PacketStride ? m_WindowSize : xRefill(PacketStride);
+    if (Available < xTS::TS_PacketLength)
+    {
+      // truncated packet at end of stream
+      xDrop(Available);
+      return 0;
+    }
+
+    // only whole strides are consumed, so next batch starts on sync byte - except for last packet of stream
+    size_t NumPackets = Available / PacketStride;
+    if (m_EndOfStream && Available - NumPackets * PacketStride >= xTS::TS_PacketLength)
+    {
+      NumPackets++;
+    }
+    if (NumPackets > m_BatchSize)
+    {
+      NumPackets = m_BatchSize;
+    }
+
+    uint32_t NumLocked = m_SyncScanner.CountLockedPackets(m_Window, (uint32_t)NumPackets);
+    if (NumLocked == 0)
+    {
+      // lattice broken - skip this byte and search for new one
+      m_SyncScanner.LoseLock();
+      xDrop(1);
+      continue;
+    }
+
+    Batch.Set(m_Window, NumLocked, PacketStride, m_WindowOffset);
+    size_t NumConsumed = (size_t)NumLocked * PacketStride;
+    xConsume(NumConsumed < m_WindowSize ? NumConsumed : m_WindowSize);
+    return (int32_t)NumLocked;
+  }
+}
+
+std::unique_ptr<xTS_InputSource> xTS_InputSource::Create(eMode Mode, size_t BlockSize, uint32_t ReadAhead)
+{
+  switch (Mode)
+  {
+  case eMode::Mapped:
+    return std::unique_ptr<xTS_InputSource>(new xTS_MappedFileReader());
+  case eMode::Block:
+    return std::unique_ptr<xTS_InputSource>(new xTS_BlockReader(BlockSize));
+  case eMode::Uring:
+    return std::unique_ptr<xTS_InputSource>(new xTS_UringReader(BlockSize, ReadAhead));
+  default:
+    return nullptr;
+  }
+}
+
+//=============================================================================================================================================================================
+// xTS_MappedFileReader
+//=============================================================================================================================================================================
+
+xTS_MappedFileReader::xTS_MappedFileReader()
+{
+  this->m_MappedData = nullptr;
+  this->m_MappedSize = 0;
+#if defined(_WIN32)
+  this->m_FileHandle = INVALID_HANDLE_VALUE;
+  this->m_MappingHandle = nullptr;
+#else
+  this->m_FileDescriptor = -1;
+#endif
+}
+
+/**
+  @brief Map whole input file into memory
+  @param FileName is path to input file
+  @return 0 on success, -1 when file cannot be opened or mapped (e.g. pipe)
+*/
+int32_t xTS_MappedFileReader::Open(const char *FileName)
+{
+  Close();
+
+#if defined(_WIN32)
+  HANDLE File = CreateFileA(FileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (File == INVALID_HANDLE_VALUE)
+  {
+    return NOT_VALID;
+  }
+  this->m_FileHandle = File;
+
+  LARGE_INTEGER FileSize;
+  if (!GetFileSizeEx(File, &FileSize))
+  {
+    Close();
+    return NOT_VALID;
+  }
+  this->m_MappedSize = (size_t)FileSize.QuadPart;
+
+  if (m_MappedSize > 0)
+  {
+    this->m_MappingHandle = CreateFileMappingA(File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (m_MappingHandle == nullptr)
+    {
+      Close();
+      return NOT_VALID;
+    }
+    this->m_MappedData = (uint8_t *)MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if (m_MappedData == nullptr)
+    {
+      Close();
+      return NOT_VALID;
+    }
+  }
+#else
+  this->m_FileDescriptor = open(FileName, O_RDONLY);
+  if (m_FileDescriptor < 0)
+  {
+    return NOT_VALID;
+  }
+
+  struct stat FileStat;
+  if (fstat(m_FileDescriptor, &FileStat) != 0 || !S_ISREG(FileStat.st_mode))
+  {
+    Close();
+    return NOT_VALID;
+  }
+  this->m_MappedSize = (size_t)FileStat.st_size;
+
+  if (m_MappedSize > 0)
+  {
+    void *Data = mmap(nullptr, m_MappedSize, PROT_READ, MAP_PRIVATE, m_FileDescriptor, 0);
+    if (Data == MAP_FAILED)
+    {
+      this->m_MappedSize = 0;
+      Close();
+      return NOT_VALID;
+    }
+    madvise(Data, m_MappedSize, MADV_SEQUENTIAL);
+    this->m_MappedData = (uint8_t *)Data;
+  }
+#endif
+
+  this->m_Window = m_MappedData;
+  this->m_WindowSize = m_MappedSize;
+  this->m_WindowOffset = 0;
+  this->m_EndOfStream = true;
+  m_SyncScanner.Reset(); // reader may be reused for another file
+  return 0;
+}
+
+void xTS_MappedFileReader::Close()
+{
+#if defined(_WIN32)
+  if (m_MappedData != nullptr)
+  {
+    UnmapViewOfFile(m_MappedData);
+  }
+  if (m_MappingHandle != nullptr)
+  {
+    CloseHandle(m_MappingHandle);
+  }
+  if (m_FileHandle != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_FileHandle);
+  }
+  this->m_FileHandle = INVALID_HANDLE_VALUE;
+  this->m_MappingHandle = nullptr;
+#else
+  if (m_MappedData != nullptr)
+  {
+    munmap(m_MappedData, m_MappedSize);
+  }
+  if (m_FileDescriptor >= 0)
+  {
+    close(m_FileDescriptor);
+  }
+  this->m_FileDescriptor = -1;
+#endif
+  this->m_MappedData = nullptr;
+  this->m_MappedSize = 0;
+  this->m_Window = nullptr;
+  this->m_WindowSize = 0;
+}
+
+int32_t xTS_MappedFileReader::Seek(uint64_t Offset)
+{
+  if (m_MappedData == nullptr || Offset > m_MappedSize)
+  {
+    return NOT_VALID;
+  }
+  this->m_Window = m_MappedData + Offset;
+  this->m_WindowSize = m_MappedSize - (size_t)Offset;
+  this->m_WindowOffset = Offset;
+  m_SyncScanner.Reset();
+  return 0;
+}
+
+size_t xTS_MappedFileReader::xRefill(size_t /*MinBytes*/)
+{
+  // whole file is always visible
+  return m_WindowSize;
+}
+
+//=============================================================================================================================================================================
+// xTS_BlockReader
+//=============================================================================================================================================================================
+
+xTS_BlockReader::xTS_BlockReader(size_t BlockSize)
+{
+  // block must be able to hold whole carry area, keep it multiple of alignment for unbuffered reads
+  if (BlockSize < MaxCarryBytes)
+  {
+    BlockSize = MaxCarryBytes;
+  }
+  BlockSize = (BlockSize + BlockAlignment - 1) & ~(BlockAlignment - 1);
+
+  this->m_File = nullptr;
+  this->m_OwnsFile = false;
+  this->m_Streaming = false;
+  this->m_ReadError = 0;
+  this->m_BlockSize = BlockSize;
+  this->m_Allocation = new uint8_t[MaxCarryBytes + BlockSize + BlockAlignment];
+  uintptr_t BlockAddr = (uintptr_t)(m_Allocation + MaxCarryBytes);
+  BlockAddr = (BlockAddr + BlockAlignment - 1) & ~(uintptr_t)(BlockAlignment - 1);
+  this->m_Block = (uint8_t *)BlockAddr;
+}
+
+xTS_BlockReader::~xTS_BlockReader()
+{
+  Close();
+  delete[] m_Allocation;
+}
+
+int32_t xTS_BlockReader::Open(const char *FileName)
+{
+  Close();
+  if (strcmp(FileName, "-") == 0)
+  {
+#if defined(_WIN32)
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    return Attach(stdin);
+  }
+  FILE *File = fopen(FileName, "rb");
+  if (File == nullptr)
+  {
+    return NOT_VALID;
+  }
+  Attach(File);
+  this->m_OwnsFile = true;
+  return 0;
+}
+
+int32_t xTS_BlockReader::Attach(FILE *File)
+{
+  Close();
+  if (File == nullptr)
+  {
+    return NOT_VALID;
+  }
+  // whole blocks are read directly into our buffer - stdio buffering would only add a copy
+  setvbuf(File, nullptr, _IONBF, 0);
+  this->m_File = File;
+  this->m_OwnsFile = false;
+#if defined(_WIN32)
+  this->m_Streaming = false;
+#else
+  struct stat FileStat;
+  this->m_Streaming = fstat(fileno(File), &FileStat) == 0 && !S_ISREG(FileStat.st_mode);
+#endif
+  this->m_Window = m_Block;
+  this->m_WindowSize = 0;
+  this->m_WindowOffset = 0;
+  this->m_EndOfStream = false;
+  this->m_ReadError = 0;
+  m_SyncScanner.Reset(); // reader may be reused for another file
+  return 0;
+}
+
+void xTS_BlockReader::Close()
+{
+  if (m_File != nullptr && m_OwnsFile)
+  {
+    fclose(m_File);
+  }
+  this->m_File = nullptr;
+  this->m_OwnsFile = false;
+  this->m_Streaming = false;
+  this->m_Window = m_Block;
+  this->m_WindowSize = 0;
+  this->m_EndOfStream = true;
+}
+
+int32_t xTS_BlockReader::Seek(uint64_t Offset)
+{
+  if (m_File == nullptr)
+  {
+    return NOT_VALID;
+  }
+#if defined(_WIN32)
+  int Result = _fseeki64(m_File, (int64_t)Offset, SEEK_SET);
+#else
+  int Result = fseeko(m_File, (off_t)Offset, SEEK_SET);
+#endif
+  if (Result != 0)
+  {
+    return NOT_VALID; // pipe or device
+  }
+  this->m_Window = m_Block;
+  this->m_WindowSize = 0;
+  this->m_WindowOffset = Offset;
+  this->m_EndOfStream = false;
+  m_SyncScanner.Reset();
+  return 0;
+}
+
+size_t xTS_BlockReader::xRefill(size_t MinBytes)
+{
+  while (m_WindowSize < MinBytes && !m_EndOfStream)
+  {
+    // move unconsumed tail in front of block, so new data follows it contiguously
+    size_t Carry = m_WindowSize;
+    if (Carry > MaxCarryBytes)
+    {
+      break;
+    }
+    std::memmove(m_Block - Carry, m_Window, Carry);
+
+    size_t NumRead;
+#if !defined(_WIN32)
+    if (m_Streaming)
+    {
+      // pipe delivers data as writer produces it - take what is there, block only when nothing is
+      ssize_t Result = read(fileno(m_File), m_Block, m_BlockSize);
+      if (Result < 0 && errno == EINTR)
+      {
+        this->m_Window = m_Block - Carry;
+        continue;
+      }
+      if (Result < 0 && m_ReadError == 0)
+      {
+        this->m_ReadError = -errno;
+      }
+      NumRead = Result > 0 ? (size_t)Result : 0;
+      this->m_EndOfStream = Result <= 0;
+    }
+    else
+#endif
+    {
+      NumRead = fread(m_Block, 1, m_BlockSize, m_File);
+      if (NumRead < m_BlockSize)
+      {
+        this->m_EndOfStream = true;
+        if (ferror(m_File) && m_ReadError == 0)
+        {
+          this->m_ReadError = errno != 0 ? -errno : -EIO;
+        }
+      }
+    }
+    this->m_Window = m_Block - Carry;
+    this->m_WindowSize = Carry + NumRead;
+  }
+  return m_WindowSize;
+}
+
+//=============================================================================================================================================================================
+// xTS_MemoryReader
+//=============================================================================================================================================================================
+
+/**
+  @brief Read packets from memory owned by caller
+  @param Data is pointer to first byte, it has to stay valid until Close()
+  @param Size is number of bytes
+  @param StreamOffset is position of Data[0] in whole stream (reported in batches)
+*/
+void xTS_MemoryReader::Attach(const uint8_t *Data, size_t Size, uint64_t StreamOffset)
+{
+  this->m_Window = Data;
+  this->m_WindowSize = Size;
+  this->m_WindowOffset = StreamOffset;
+  this->m_EndOfStream = true;
+  m_SyncScanner.Reset();
+}
+
+void xTS_MemoryReader::Close()
+{
+  this->m_Window = nullptr;
+  this->m_WindowSize = 0;
+}
+
+//=============================================================================================================================================================================
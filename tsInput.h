@@ -0,0 +1,205 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsSyncScanner.h"
+#include <cstdio>
+#include <memory>
+
+/*
+Input layer:
+  xTS_InputSource hands out whole batches of TS packets (xTS_PacketBatch) that point directly into the
+  reader's memory, so xTS_PacketHeader::Parse can work on them without any intermediate copy.
+  Packet framing (188/192/204) and alignment are found by xTS_SyncScanner, which also resynchronizes after corruption.
+
+  xTS_MappedFileReader  - whole file mapped into memory (mmap / MapViewOfFile), batches stay valid until Close()
+  xTS_BlockReader       - large aligned blocks read with a single fread() each, batches stay valid until next ReadBatch()
+                          pipes, FIFOs and standard input ("-") are read with read(), which returns whatever has arrived,
+                          so live stream is parsed without waiting for whole block - memory is one block regardless of
+                          stream length
+  xTS_MemoryReader      - range of memory owned by caller (e.g. one chunk of mapped file)
+  xTS_UringReader       - blocks read ahead asynchronously with io_uring (tsUringInput.h), batches stay valid until next ReadBatch()
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_PacketBatch
+{
+protected:
+  const uint8_t *m_Data;    // first byte (sync byte) of first packet
+  uint32_t m_NumPackets;
+  uint32_t m_PacketStride;  // distance between consecutive sync bytes
+  uint64_t m_StreamOffset;  // position of first packet in input stream
+
+public:
+  void Reset()
+  {
+    m_Data = nullptr;
+    m_NumPackets = 0;
+    m_PacketStride = xTS::TS_PacketLength;
+    m_StreamOffset = 0;
+  }
+  void Set(const uint8_t *Data, uint32_t NumPackets, uint32_t PacketStride, uint64_t StreamOffset)
+  {
+    m_Data = Data;
+    m_NumPackets = NumPackets;
+    m_PacketStride = PacketStride;
+    m_StreamOffset = StreamOffset;
+  }
+
+public:
+  const uint8_t *getData() const { return m_Data; }
+  uint32_t getNumPackets() const { return m_NumPackets; }
+  uint32_t getPacketStride() const { return m_PacketStride; }
+  uint64_t getStreamOffset() const { return m_StreamOffset; }
+
+  const uint8_t *getPacket(uint32_t PacketIdx) const { return m_Data + (size_t)PacketIdx * m_PacketStride; }
+  uint64_t getPacketOffset(uint32_t PacketIdx) const { return m_StreamOffset + (uint64_t)PacketIdx * m_PacketStride; }
+};
+
+//=============================================================================================================================================================================
+
+class xTS_InputSource
+{
+public:
+  enum class eMode : int32_t
+  {
+    Mapped,
+    Block,
+    Uring, // Linux io_uring read-ahead, see tsUringInput.h
+  };
+
+  static constexpr uint32_t DefaultBatchSize = 512;             // packets
+  static constexpr size_t DefaultBlockSize = 4 * 1024 * 1024;   // bytes
+  static constexpr size_t MaxCarryBytes = 4096;                 // unconsumed bytes that may be carried between blocks
+  static constexpr uint32_t DefaultReadAhead = 8;               // blocks in flight (io_uring input)
+
+protected:
+  // window of unconsumed input bytes
+  const uint8_t *m_Window;
+  size_t m_WindowSize;
+  uint64_t m_WindowOffset; // position of m_Window[0] in input stream
+  bool m_EndOfStream;
+  // setup
+  uint32_t m_BatchSize;
+  // framing
+  xTS_SyncScanner m_SyncScanner;
+
+public:
+  xTS_InputSource();
+  virtual ~xTS_InputSource() {}
+
+  virtual int32_t Open(const char *FileName) = 0;
+  virtual void Close() = 0;
+  // true if batches remain valid until Close() (not only until next ReadBatch())
+  virtual bool hasStableBuffers() const = 0;
+  // true if input is live stream (pipe, socket) - output should be passed on as soon as it is produced
+  virtual bool isLive() const { return false; }
+
+  int32_t ReadBatch(xTS_PacketBatch &Batch);
+  // continue reading at given position of input (sync is acquired again), -1 if input is not seekable
+  virtual int32_t Seek(uint64_t /*Offset*/) { return NOT_VALID; }
+  // negative errno of first failed read (stream ended there, not at end of file), 0 when none
+  virtual int32_t getReadError() const { return 0; }
+
+  void setBatchSize(uint32_t BatchSize) { m_BatchSize = BatchSize > 0 ? BatchSize : 1; }
+  uint32_t getBatchSize() const { return m_BatchSize; }
+  uint64_t getStreamOffset() const { return m_WindowOffset; }
+  const xTS_SyncScanner &getSyncScanner() const { return m_SyncScanner; }
+
+  static std::unique_ptr<xTS_InputSource> Create(eMode Mode, size_t BlockSize = DefaultBlockSize, uint32_t ReadAhead = DefaultReadAhead);
+
+protected:
+  // make at least MinBytes (<= MaxCarryBytes) available in window, returns number of available bytes (less than MinBytes only at end of stream)
+  virtual size_t xRefill(size_t MinBytes) = 0;
+  void xDrop(size_t NumBytes)
+  {
+    m_SyncScanner.AccountDropped(NumBytes);
+    xConsume(NumBytes);
+  }
+  void xConsume(size_t NumBytes)
+  {
+    m_Window += NumBytes;
+    m_WindowSize -= NumBytes;
+    m_WindowOffset += NumBytes;
+  }
+};
+
+//=============================================================================================================================================================================
+
+class xTS_MappedFileReader : public xTS_InputSource
+{
+protected:
+  uint8_t *m_MappedData;
+  size_t m_MappedSize;
+#if defined(_WIN32)
+  void *m_FileHandle;
+  void *m_MappingHandle;
+#else
+  int m_FileDescriptor;
+#endif
+
+public:
+  xTS_MappedFileReader();
+  ~xTS_MappedFileReader() override { Close(); }
+
+  int32_t Open(const char *FileName) override;
+  void Close() override;
+  bool hasStableBuffers() const override { return true; }
+  int32_t Seek(uint64_t Offset) override;
+
+  const uint8_t *getMappedData() const { return m_MappedData; }
+  size_t getMappedSize() const { return m_MappedSize; }
+
+protected:
+  size_t xRefill(size_t MinBytes) override;
+};
+
+//=============================================================================================================================================================================
+
+class xTS_BlockReader : public xTS_InputSource
+{
+public:
+  static constexpr size_t BlockAlignment = 4096;
+
+protected:
+  FILE *m_File;
+  bool m_OwnsFile;
+  bool m_Streaming; // pipe or device - read what is available instead of whole blocks
+  int32_t m_ReadError; // negative errno of first failed read, 0 when none
+  uint8_t *m_Allocation;
+  uint8_t *m_Block; // aligned, preceded by MaxCarryBytes of carry area
+  size_t m_BlockSize;
+
+public:
+  xTS_BlockReader(size_t BlockSize = DefaultBlockSize);
+  ~xTS_BlockReader() override;
+
+  int32_t Open(const char *FileName) override; // "-" reads standard input
+  int32_t Attach(FILE *File); // reads from already opened stream, which is not closed by Close()
+  void Close() override;
+  bool hasStableBuffers() const override { return false; }
+  bool isLive() const override { return m_Streaming; }
+  int32_t Seek(uint64_t Offset) override;
+  int32_t getReadError() const override { return m_ReadError; }
+
+  size_t getBlockSize() const { return m_BlockSize; }
+
+protected:
+  size_t xRefill(size_t MinBytes) override;
+};
+
+//=============================================================================================================================================================================
+
+class xTS_MemoryReader : public xTS_InputSource
+{
+public:
+  int32_t Open(const char * /*FileName*/) override { return NOT_VALID; }
+  void Attach(const uint8_t *Data, size_t Size, uint64_t StreamOffset);
+  void Close() override;
+  bool hasStableBuffers() const override { return true; }
+
+protected:
+  size_t xRefill(size_t /*MinBytes*/) override { return m_WindowSize; }
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,973 @@
+#include "tsMP4Mux.h"
+#include "tsVideoIndex.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// helpers
+//=============================================================================================================================================================================
+
+namespace
+{
+enum eNALType : uint8_t
+{
+  eNALType_IDR = 5,
+  eNALType_SPS = 7,
+  eNALType_PPS = 8,
+  eNALType_AUD = 9,
+  eNALType_Filler = 12,
+};
+
+// trun sample_flags
+constexpr uint32_t SampleFlags_Sync = 0x02000000;    // sample_depends_on = 2 (does not depend on others)
+constexpr uint32_t SampleFlags_NonSync = 0x01010000; // sample_depends_on = 1, sample_is_non_sync_sample
+
+// Exp-Golomb reader of RBSP (emulation prevention bytes removed)
+class xBitReader
+{
+protected:
+  std::vector<uint8_t> m_Data;
+  size_t m_BitPos;
+
+public:
+  xBitReader(const uint8_t *NAL, uint32_t Size)
+  {
+    m_BitPos = 0;
+    uint32_t NumZeros = 0;
+    for (uint32_t Idx = 0; Idx < Size; Idx++)
+    {
+      if (NumZeros >= 2 && NAL[Idx] == 3)
+      {
+        NumZeros = 0;
+        continue;
+      }
+      NumZeros = NAL[Idx] == 0 ? NumZeros + 1 : 0;
+      m_Data.push_back(NAL[Idx]);
+    }
+  }
+  bool isValid() const { return m_BitPos <= m_Data.size() * 8; }
+  uint32_t ReadBit()
+  {
+    size_t Pos = m_BitPos++;
+    return Pos < m_Data.size() * 8 ? (m_Data[Pos >> 3] >> (7 - (Pos & 7))) & 1 : 0;
+  }
+  uint32_t ReadBits(uint32_t NumBits)
+  {
+    uint32_t Value = 0;
+    for (uint32_t Idx = 0; Idx < NumBits; Idx++)
+    {
+      Value = (Value << 1) | ReadBit();
+    }
+    return Value;
+  }
+  uint32_t ReadUE()
+  {
+    uint32_t NumLeadingZeros = 0;
+    while (ReadBit() == 0 && isValid() && NumLeadingZeros < 32)
+    {
+      NumLeadingZeros++;
+    }
+    return NumLeadingZeros >= 32 ? 0 : (1u << NumLeadingZeros) - 1 + ReadBits(NumLeadingZeros);
+  }
+  int32_t ReadSE()
+  {
+    uint32_t Value = ReadUE();
+    return (Value & 1) ? (int32_t)((Value + 1) / 2) : -(int32_t)(Value / 2);
+  }
+};
+
+int64_t xSigned33(uint64_t Delta)
+{
+  int64_t Value = (int64_t)(Delta & (xMP4_Muxer::TimestampModulus - 1));
+  return Value >= (int64_t)(xMP4_Muxer::TimestampModulus / 2) ? Value - (int64_t)xMP4_Muxer::TimestampModulus : Value;
+}
+} // namespace
+
+//=============================================================================================================================================================================
+// xMP4_VideoInput
+//=============================================================================================================================================================================
+
+xMP4_VideoInput::xMP4_VideoInput(xMP4_Muxer *Muxer, uint32_t TrackIdx)
+{
+  this->m_Muxer = Muxer;
+  this->m_TrackIdx = TrackIdx;
+  this->m_TimestampsValid = false;
+  this->m_PTS = 0;
+  this->m_DTS = 0;
+}
+
+/**
+  @brief Collect PES packet into access unit
+  @param PID is packet identifier of video track
+  @param Packet is PES packet, PES packet with PTS starts access unit (others continue it)
+*/
+void xMP4_VideoInput::OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet)
+{
+  (void)PID;
+  xPES_PacketHeader PESH;
+  PESH.Parse(Packet.getData(), Packet.getSize());
+  uint8_t PTS_DTS_Flags = PESH.getPTS_DTS_Flags();
+  if (PTS_DTS_Flags & xPES_PacketHeader::ePTS_DTS_Flags_PTS)
+  {
+    xFlushAccessUnit();
+    this->m_TimestampsValid = true;
+    this->m_PTS = PESH.getPTS();
+    this->m_DTS = PTS_DTS_Flags == xPES_PacketHeader::ePTS_DTS_Flags_PTS_DTS ? PESH.getDTS() : m_PTS;
+  }
+  uint32_t HeaderLength = std::min(PESH.getHeaderLength(), Packet.getSize());
+  if (m_TimestampsValid && HeaderLength < Packet.getSize())
+  {
+    m_AccessUnit.push_back({Packet, HeaderLength});
+  }
+}
+
+void xMP4_VideoInput::OnDiscontinuity(uint16_t PID)
+{
+  (void)PID;
+  // held PES packets are undamaged - their access unit is passed, next one starts with next PES packet with PTS
+  xFlushAccessUnit();
+  this->m_TimestampsValid = false;
+}
+
+/// @brief Last access unit ends with stream, held PES packets go back to pool of assembler
+void xMP4_VideoInput::OnEndOfStream(uint16_t PID, uint64_t StreamSize)
+{
+  (void)PID;
+  (void)StreamSize;
+  xFlushAccessUnit();
+  this->m_TimestampsValid = false;
+}
+
+void xMP4_VideoInput::xFlushAccessUnit()
+{
+  if (!m_TimestampsValid || m_AccessUnit.empty())
+  {
+    m_AccessUnit.clear();
+    return;
+  }
+
+  // access unit in single PES packet is scanned in place, otherwise payloads are joined
+  const uint8_t *Begin;
+  const uint8_t *End;
+  if (m_AccessUnit.size() == 1)
+  {
+    Begin = m_AccessUnit[0].Packet.getData() + m_AccessUnit[0].HeaderLength;
+    End = m_AccessUnit[0].Packet.getData() + m_AccessUnit[0].Packet.getSize();
+  }
+  else
+  {
+    m_Joined.clear();
+    for (const xPayload &Payload : m_AccessUnit)
+    {
+      m_Joined.insert(m_Joined.end(), Payload.Packet.getData() + Payload.HeaderLength, Payload.Packet.getData() + Payload.Packet.getSize());
+    }
+    Begin = m_Joined.data();
+    End = m_Joined.data() + m_Joined.size();
+  }
+
+  xMP4_Muxer::xTrack &Track = m_Muxer->getTrack(m_TrackIdx);
+  m_Sample.clear();
+  bool Sync = false;
+  const uint8_t *StartCode = xES_VideoIndexer::FindStartCode(Begin, End);
+  while (StartCode < End)
+  {
+    const uint8_t *NAL = StartCode + 3;
+    const uint8_t *NextStartCode = xES_VideoIndexer::FindStartCode(NAL, End);
+    const uint8_t *NALEnd = NextStartCode;
+    while (NALEnd > NAL && NALEnd[-1] == 0)
+    {
+      NALEnd--; // zero_byte of next start code or trailing_zero_8bits
+    }
+    StartCode = NextStartCode;
+    if (NALEnd == NAL)
+    {
+      continue;
+    }
+
+    uint32_t NALSize = (uint32_t)(NALEnd - NAL);
+    uint8_t Type = NAL[0] & 0x1F;
+    if (Type == eNALType_AUD || Type == eNALType_Filler)
+    {
+      continue;
+    }
+    if ((Type == eNALType_SPS && Track.SPS.empty()) || (Type == eNALType_PPS && Track.PPS.empty()))
+    {
+      (Type == eNALType_SPS ? Track.SPS : Track.PPS).assign(NAL, NALEnd);
+      if (!Track.SPS.empty() && !Track.PPS.empty())
+      {
+        Track.Configured = xMP4_Muxer::ParseSPS(Track.SPS.data(), (uint32_t)Track.SPS.size(), Track.Width, Track.Height) != NOT_VALID;
+      }
+      continue;
+    }
+    if (Type == eNALType_IDR)
+    {
+      Sync = true;
+    }
+    uint8_t Length[4] = {(uint8_t)(NALSize >> 24), (uint8_t)(NALSize >> 16), (uint8_t)(NALSize >> 8), (uint8_t)NALSize};
+    m_Sample.insert(m_Sample.end(), Length, Length + 4);
+    m_Sample.insert(m_Sample.end(), NAL, NALEnd);
+  }
+  m_AccessUnit.clear();
+
+  if (!m_Sample.empty())
+  {
+    m_Muxer->AddSample(m_TrackIdx, m_Sample.data(), (uint32_t)m_Sample.size(), m_DTS, m_PTS, Sync, 0);
+  }
+}
+
+//=============================================================================================================================================================================
+// xMP4_AudioInput
+//=============================================================================================================================================================================
+
+xMP4_AudioInput::xMP4_AudioInput(xMP4_Muxer *Muxer, uint32_t TrackIdx, uint16_t PID, eCodec Codec) : xES_AudioFramer(PID, Codec, nullptr)
+{
+  this->m_Muxer = Muxer;
+  this->m_TrackIdx = TrackIdx;
+}
+
+void xMP4_AudioInput::xOnFrame(const uint8_t *Frame, const xFrame &Entry)
+{
+  xMP4_Muxer::xTrack &Track = m_Muxer->getTrack(m_TrackIdx);
+  uint32_t HeaderLength = 0;
+  if (m_Codec == eCodec::ADTS)
+  {
+    HeaderLength = (Frame[1] & 0x01) ? 7 : 9;
+    if ((Frame[6] & 0x03) != 0 || Entry.Size <= HeaderLength)
+    {
+      Track.NumDroppedSamples++; // more raw data blocks in one ADTS frame are not split
+      return;
+    }
+  }
+  if ((Entry.Flags & eFlags_PTS) == 0)
+  {
+    Track.NumDroppedSamples++;
+    return;
+  }
+
+  if (!Track.Configured)
+  {
+    Track.SampleRate = Entry.SampleRate;
+    if (m_Codec == eCodec::ADTS)
+    {
+      uint8_t AudioObjectType = (uint8_t)((Frame[2] >> 6) + 1);
+      uint8_t SampleRateIdx = (Frame[2] >> 2) & 0x0F;
+      uint8_t ChannelConfiguration = (uint8_t)(((Frame[2] & 0x01) << 2) | (Frame[3] >> 6));
+      Track.ObjectType = 0x40; // MPEG-4 audio
+      Track.NumChannels = ChannelConfiguration != 0 ? ChannelConfiguration : 2;
+      Track.DecoderSpecificInfo = {(uint8_t)((AudioObjectType << 3) | (SampleRateIdx >> 1)), (uint8_t)(((SampleRateIdx & 0x01) << 7) | (ChannelConfiguration << 3))};
+    }
+    else
+    {
+      bool MPEG1 = ((Frame[1] >> 3) & 0x03) == 3;
+      Track.ObjectType = MPEG1 ? 0x6B : 0x69; // MPEG-1 / MPEG-2 audio
+      Track.NumChannels = (Frame[3] >> 6) == 3 ? 1 : 2;
+    }
+    Track.Configured = true;
+  }
+
+  uint32_t NominalDuration = (uint32_t)((uint64_t)Entry.NumSamples * xMP4_Muxer::Timescale / Entry.SampleRate);
+  m_Muxer->AddSample(m_TrackIdx, Frame + HeaderLength, Entry.Size - HeaderLength, Entry.PTS, Entry.PTS, true, NominalDuration);
+}
+
+//=============================================================================================================================================================================
+// xMP4_Muxer
+//=============================================================================================================================================================================
+
+xMP4_Muxer::xMP4_Muxer()
+{
+  this->m_FragmentDuration = DefaultFragmentDuration;
+  this->m_VideoTrackIdx = -1;
+  this->m_ReferenceValid = false;
+  this->m_ReferenceDTS = 0;
+  this->m_Started = false;
+  this->m_StartDTS = 0;
+  this->m_FragmentStartDTS = 0;
+  this->m_NumQueuedBytes = 0;
+  this->m_SequenceNumber = 0;
+  this->m_NumBytesWritten = 0;
+}
+
+int32_t xMP4_Muxer::Open(const char *FileName, uint32_t FragmentDuration)
+{
+  this->m_FragmentDuration = FragmentDuration;
+  return m_Output.Open(FileName);
+}
+
+xPES_Consumer *xMP4_Muxer::AddVideoTrack(uint16_t PID)
+{
+  if (m_Started || m_VideoTrackIdx >= 0)
+  {
+    return nullptr; // one video track, all tracks must be known before header is written
+  }
+  std::unique_ptr<xTrack> Track(new xTrack());
+  Track->Type = eTrackType::Video;
+  Track->PID = PID;
+  Track->NominalDuration = Timescale / 25;
+  Track->Input.reset(new xMP4_VideoInput(this, (uint32_t)m_Tracks.size()));
+  this->m_VideoTrackIdx = (int32_t)m_Tracks.size();
+  m_Tracks.push_back(std::move(Track));
+  return m_Tracks.back()->Input.get();
+}
+
+xPES_Consumer *xMP4_Muxer::AddAudioTrack(uint16_t PID, xES_AudioFramer::eCodec Codec)
+{
+  if (m_Started)
+  {
+    return nullptr;
+  }
+  std::unique_ptr<xTrack> Track(new xTrack());
+  Track->Type = eTrackType::Audio;
+  Track->PID = PID;
+  Track->Input.reset(new xMP4_AudioInput(this, (uint32_t)m_Tracks.size(), PID, Codec));
+  m_Tracks.push_back(std::move(Track));
+  return m_Tracks.back()->Input.get();
+}
+
+/**
+  @brief Queue sample of track and write header or fragment when it is due
+  @param TrackIdx is index of track
+  @param Data is pointer to sample in MP4 form
+  @param Size is sample size
+  @param DTS is 33 bit decode timestamp
+  @param PTS is 33 bit presentation timestamp
+  @param Sync tells that sample is random access point
+  @param NominalDuration is duration known from sample itself (0 when unknown)
+*/
+void xMP4_Muxer::AddSample(uint32_t TrackIdx, const uint8_t *Data, uint32_t Size, uint64_t DTS, uint64_t PTS, bool Sync, uint32_t NominalDuration)
+{
+  xTrack &Track = *m_Tracks[TrackIdx];
+  int64_t SampleDTS = xUnwrap(Track, DTS);
+  bool OutputTrack = !m_Started || Track.TrackId != 0;
+  bool WaitsForSync = Track.Type == eTrackType::Video && Track.Samples.empty() && !m_Started;
+  bool OutOfOrder = Track.NumSamples != 0 && SampleDTS <= Track.LastSampleDTS; // e.g. access unit repeated after lost packets
+  if (!OutputTrack || OutOfOrder || (WaitsForSync && (!Sync || !Track.Configured)) || (m_Started && SampleDTS < m_StartDTS))
+  {
+    Track.NumDroppedSamples++;
+    return;
+  }
+
+  // duration of previous sample is distance to this one
+  if (!Track.Samples.empty() && Track.Samples.back().Duration == 0)
+  {
+    int64_t Duration = SampleDTS - Track.Samples.back().DTS;
+    Track.Samples.back().Duration = Duration > 0 && Duration < 10 * (int64_t)Timescale ? (uint32_t)Duration : Track.NominalDuration;
+    if (NominalDuration == 0 && Duration > 0 && Duration < 10 * (int64_t)Timescale)
+    {
+      Track.NominalDuration = (uint32_t)Duration;
+    }
+  }
+  if (NominalDuration != 0)
+  {
+    Track.NominalDuration = NominalDuration;
+  }
+
+  // fragment ends before first keyframe after fragment duration (any sample for audio only output)
+  bool CutsFragment = (int32_t)TrackIdx == m_VideoTrackIdx ? Sync : m_VideoTrackIdx < 0;
+  if (m_Started && ((CutsFragment && SampleDTS - m_FragmentStartDTS >= (int64_t)m_FragmentDuration) || m_NumQueuedBytes + Size > MaxQueuedBytes))
+  {
+    xWriteFragment(SampleDTS);
+  }
+
+  xSample Sample = {};
+  Sample.DTS = SampleDTS;
+  Sample.Size = Size;
+  Sample.CompositionOffset = (int32_t)xSigned33(PTS - DTS);
+  Sample.Sync = Sync;
+  Track.Samples.push_back(Sample);
+  Track.LastSampleDTS = SampleDTS;
+  Track.Data.insert(Track.Data.end(), Data, Data + Size);
+  Track.NumSamples++;
+  this->m_NumQueuedBytes += Size;
+
+  if (!m_Started)
+  {
+    xTryStart(m_NumQueuedBytes > MaxQueuedBytes);
+  }
+}
+
+/// @brief Write remaining samples - called after end of all streams, so inputs passed their last samples already
+void xMP4_Muxer::Finish()
+{
+  if (!m_Started)
+  {
+    xTryStart(true);
+  }
+  if (m_Started)
+  {
+    for (std::unique_ptr<xTrack> &Track : m_Tracks)
+    {
+      if (!Track->Samples.empty() && Track->Samples.back().Duration == 0)
+      {
+        Track->Samples.back().Duration = Track->NominalDuration;
+      }
+    }
+    xWriteFragment(INT64_MAX);
+  }
+  m_Output.Flush();
+}
+
+void xMP4_Muxer::PrintStatistics(FILE *File) const
+{
+  fprintf(File, "MP4: Tracks=%u Fragments=%u Bytes=%" PRIu64 "\n", (uint32_t)m_Tracks.size(), m_SequenceNumber, m_NumBytesWritten);
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    fprintf(File, "MP4: PID=%u TrackId=%u Type=%s Samples=%" PRIu64 " DroppedSamples=%" PRIu64 "\n", Track->PID, Track->TrackId,
+            Track->Type == eTrackType::Video ? "video" : "audio", Track->NumSamples, Track->NumDroppedSamples);
+  }
+}
+
+// timestamps relative to first one seen by muxer, wrap of 33 bit counter is followed per track
+int64_t xMP4_Muxer::xUnwrap(xTrack &Track, uint64_t Timestamp)
+{
+  if (!m_ReferenceValid)
+  {
+    this->m_ReferenceValid = true;
+    this->m_ReferenceDTS = Timestamp;
+  }
+  if (!Track.TimeValid)
+  {
+    Track.TimeValid = true;
+    Track.LastDTS = xSigned33(Timestamp - m_ReferenceDTS);
+  }
+  else
+  {
+    Track.LastDTS += xSigned33(Timestamp - (m_ReferenceDTS + (uint64_t)Track.LastDTS));
+  }
+  return Track.LastDTS;
+}
+
+// header is written when every track is configured, Force drops tracks that are not (queue limit, end of stream)
+void xMP4_Muxer::xTryStart(bool Force)
+{
+  bool VideoReady = m_VideoTrackIdx < 0 || !m_Tracks[m_VideoTrackIdx]->Samples.empty();
+  bool AllConfigured = true;
+  bool AnyConfigured = false;
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    bool Ready = Track->Configured && !Track->Samples.empty();
+    AllConfigured &= Ready;
+    AnyConfigured |= Ready;
+  }
+  if (!((AllConfigured && VideoReady) || (Force && AnyConfigured)))
+  {
+    return;
+  }
+
+  uint32_t NextTrackId = 1;
+  for (std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    if (Track->Configured && !Track->Samples.empty())
+    {
+      Track->TrackId = NextTrackId++;
+    }
+  }
+  if (m_VideoTrackIdx >= 0 && m_Tracks[m_VideoTrackIdx]->TrackId == 0)
+  {
+    this->m_VideoTrackIdx = -1;
+  }
+
+  // time zero is first video sample (keyframe) or earliest audio sample
+  this->m_StartDTS = INT64_MAX;
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    if (Track->TrackId != 0 && (m_VideoTrackIdx < 0 || Track->Type == eTrackType::Video))
+    {
+      this->m_StartDTS = std::min(m_StartDTS, Track->Samples.front().DTS);
+    }
+  }
+  for (std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    uint32_t NumEarly = 0;
+    while (NumEarly < Track->Samples.size() && (Track->TrackId == 0 || Track->Samples[NumEarly].DTS < m_StartDTS))
+    {
+      NumEarly++;
+    }
+    Track->NumDroppedSamples += NumEarly;
+    Track->NumSamples -= NumEarly;
+    xDropQueuedSamples(*Track, NumEarly);
+  }
+  this->m_FragmentStartDTS = m_StartDTS;
+  this->m_Started = true;
+  xWriteHeader();
+}
+
+void xMP4_Muxer::xDropQueuedSamples(xTrack &Track, uint32_t NumSamples)
+{
+  size_t NumBytes = 0;
+  for (uint32_t SampleIdx = 0; SampleIdx < NumSamples; SampleIdx++)
+  {
+    NumBytes += Track.Samples[SampleIdx].Size;
+  }
+  Track.Samples.erase(Track.Samples.begin(), Track.Samples.begin() + NumSamples);
+  Track.Data.erase(Track.Data.begin(), Track.Data.begin() + NumBytes);
+  this->m_NumQueuedBytes -= NumBytes;
+}
+
+//=============================================================================================================================================================================
+// boxes
+//=============================================================================================================================================================================
+
+void xMP4_Muxer::xPut16(uint16_t Value)
+{
+  xPut8((uint8_t)(Value >> 8));
+  xPut8((uint8_t)Value);
+}
+
+void xMP4_Muxer::xPut32(uint32_t Value)
+{
+  xPut16((uint16_t)(Value >> 16));
+  xPut16((uint16_t)Value);
+}
+
+void xMP4_Muxer::xPut64(uint64_t Value)
+{
+  xPut32((uint32_t)(Value >> 32));
+  xPut32((uint32_t)Value);
+}
+
+void xMP4_Muxer::xPutMatrix()
+{
+  static const uint32_t Unity[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+  for (uint32_t Value : Unity)
+  {
+    xPut32(Value);
+  }
+}
+
+size_t xMP4_Muxer::xBeginBox(const char *Type)
+{
+  size_t BoxOffset = m_Box.size();
+  xPut32(0);
+  xPutBytes((const uint8_t *)Type, 4);
+  return BoxOffset;
+}
+
+size_t xMP4_Muxer::xBeginFullBox(const char *Type, uint8_t Version, uint32_t Flags)
+{
+  size_t BoxOffset = xBeginBox(Type);
+  xPut32((uint32_t)Version << 24 | Flags);
+  return BoxOffset;
+}
+
+void xMP4_Muxer::xEndBox(size_t BoxOffset)
+{
+  xPatch32(BoxOffset, (uint32_t)(m_Box.size() - BoxOffset));
+}
+
+void xMP4_Muxer::xPatch32(size_t Offset, uint32_t Value)
+{
+  m_Box[Offset + 0] = (uint8_t)(Value >> 24);
+  m_Box[Offset + 1] = (uint8_t)(Value >> 16);
+  m_Box[Offset + 2] = (uint8_t)(Value >> 8);
+  m_Box[Offset + 3] = (uint8_t)Value;
+}
+
+void xMP4_Muxer::xWriteHeader()
+{
+  m_Box.clear();
+  size_t Ftyp = xBeginBox("ftyp");
+  xPutBytes((const uint8_t *)"iso6", 4); // major_brand
+  xPut32(0);                             // minor_version
+  xPutBytes((const uint8_t *)"iso6isommp41", 12);
+  xEndBox(Ftyp);
+
+  uint32_t NumOutputTracks = 0;
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    NumOutputTracks += Track->TrackId != 0 ? 1 : 0;
+  }
+
+  size_t Moov = xBeginBox("moov");
+  size_t Mvhd = xBeginFullBox("mvhd", 0, 0);
+  xPut32(0); // creation_time
+  xPut32(0); // modification_time
+  xPut32(Timescale);
+  xPut32(0); // duration - given by fragments
+  xPut32(0x00010000); // rate
+  xPut16(0x0100);     // volume
+  xPutZeros(2 + 8);
+  xPutMatrix();
+  xPutZeros(24); // pre_defined
+  xPut32(NumOutputTracks + 1);
+  xEndBox(Mvhd);
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    if (Track->TrackId != 0)
+    {
+      xPutTrack(*Track);
+    }
+  }
+  size_t Mvex = xBeginBox("mvex");
+  for (const std::unique_ptr<xTrack> &Track : m_Tracks)
+  {
+    if (Track->TrackId != 0)
+    {
+      size_t Trex = xBeginFullBox("trex", 0, 0);
+      xPut32(Track->TrackId);
+      xPut32(1); // default_sample_description_index
+      xPut32(0); // default_sample_duration
+      xPut32(0); // default_sample_size
+      xPut32(0); // default_sample_flags
+      xEndBox(Trex);
+    }
+  }
+  xEndBox(Mvex);
+  xEndBox(Moov);
+
+  m_Output.Write(m_Box.data(), (uint32_t)m_Box.size());
+  this->m_NumBytesWritten += m_Box.size();
+}
+
+void xMP4_Muxer::xPutTrack(const xTrack &Track)
+{
+  bool Video = Track.Type == eTrackType::Video;
+  size_t Trak = xBeginBox("trak");
+  size_t Tkhd = xBeginFullBox("tkhd", 0, 0x000003); // enabled, in movie
+  xPut32(0); // creation_time
+  xPut32(0); // modification_time
+  xPut32(Track.TrackId);
+  xPut32(0); // reserved
+  xPut32(0); // duration
+  xPutZeros(8);
+  xPut16(0); // layer
+  xPut16(0); // alternate_group
+  xPut16(Video ? 0 : 0x0100);
+  xPut16(0);
+  xPutMatrix();
+  xPut32(Video ? (uint32_t)Track.Width << 16 : 0);
+  xPut32(Video ? (uint32_t)Track.Height << 16 : 0);
+  xEndBox(Tkhd);
+
+  size_t Mdia = xBeginBox("mdia");
+  size_t Mdhd = xBeginFullBox("mdhd", 0, 0);
+  xPut32(0); // creation_time
+  xPut32(0); // modification_time
+  xPut32(Timescale);
+  xPut32(0);      // duration
+  xPut16(0x55C4); // language "und"
+  xPut16(0);
+  xEndBox(Mdhd);
+  size_t Hdlr = xBeginFullBox("hdlr", 0, 0);
+  xPut32(0);
+  xPutBytes((const uint8_t *)(Video ? "vide" : "soun"), 4);
+  xPutZeros(12);
+  const char *Name = Video ? "VideoHandler" : "SoundHandler";
+  xPutBytes((const uint8_t *)Name, strlen(Name) + 1);
+  xEndBox(Hdlr);
+
+  size_t Minf = xBeginBox("minf");
+  if (Video)
+  {
+    size_t Vmhd = xBeginFullBox("vmhd", 0, 0x000001);
+    xPutZeros(8); // graphicsmode, opcolor
+    xEndBox(Vmhd);
+  }
+  else
+  {
+    size_t Smhd = xBeginFullBox("smhd", 0, 0);
+    xPutZeros(4); // balance, reserved
+    xEndBox(Smhd);
+  }
+  size_t Dinf = xBeginBox("dinf");
+  size_t Dref = xBeginFullBox("dref", 0, 0);
+  xPut32(1);
+  xEndBox(xBeginFullBox("url ", 0, 0x000001)); // media data in same file
+  xEndBox(Dref);
+  xEndBox(Dinf);
+
+  // sample tables are empty, samples are in fragments
+  size_t Stbl = xBeginBox("stbl");
+  size_t Stsd = xBeginFullBox("stsd", 0, 0);
+  xPut32(1);
+  xPutSampleEntry(Track);
+  xEndBox(Stsd);
+  size_t Stts = xBeginFullBox("stts", 0, 0);
+  xPut32(0);
+  xEndBox(Stts);
+  size_t Stsc = xBeginFullBox("stsc", 0, 0);
+  xPut32(0);
+  xEndBox(Stsc);
+  size_t Stsz = xBeginFullBox("stsz", 0, 0);
+  xPut32(0);
+  xPut32(0);
+  xEndBox(Stsz);
+  size_t Stco = xBeginFullBox("stco", 0, 0);
+  xPut32(0);
+  xEndBox(Stco);
+  xEndBox(Stbl);
+  xEndBox(Minf);
+  xEndBox(Mdia);
+  xEndBox(Trak);
+}
+
+void xMP4_Muxer::xPutSampleEntry(const xTrack &Track)
+{
+  if (Track.Type == eTrackType::Video)
+  {
+    size_t Avc1 = xBeginBox("avc1");
+    xPutZeros(6);
+    xPut16(1); // data_reference_index
+    xPutZeros(16);
+    xPut16(Track.Width);
+    xPut16(Track.Height);
+    xPut32(0x00480000); // 72 dpi
+    xPut32(0x00480000);
+    xPut32(0);
+    xPut16(1); // frame_count
+    xPutZeros(32); // compressorname
+    xPut16(0x0018); // depth
+    xPut16(0xFFFF);
+    size_t AvcC = xBeginBox("avcC");
+    xPut8(1);           // configurationVersion
+    xPut8(Track.SPS[1]); // AVCProfileIndication
+    xPut8(Track.SPS[2]); // profile_compatibility
+    xPut8(Track.SPS[3]); // AVCLevelIndication
+    xPut8(0xFF);        // lengthSizeMinusOne = 3
+    xPut8(0xE1);        // one SPS
+    xPut16((uint16_t)Track.SPS.size());
+    xPutBytes(Track.SPS.data(), Track.SPS.size());
+    xPut8(1); // one PPS
+    xPut16((uint16_t)Track.PPS.size());
+    xPutBytes(Track.PPS.data(), Track.PPS.size());
+    xEndBox(AvcC);
+    xEndBox(Avc1);
+    return;
+  }
+
+  size_t Mp4a = xBeginBox("mp4a");
+  xPutZeros(6);
+  xPut16(1); // data_reference_index
+  xPutZeros(8);
+  xPut16(Track.NumChannels);
+  xPut16(16); // samplesize
+  xPutZeros(4);
+  xPut32(Track.SampleRate <= 0xFFFF ? Track.SampleRate << 16 : 0);
+  // ES_Descriptor(DecoderConfigDescriptor(DecoderSpecificInfo) SLConfigDescriptor), all sizes fit in one byte
+  uint8_t NumInfoBytes = (uint8_t)Track.DecoderSpecificInfo.size();
+  uint8_t NumConfigBytes = (uint8_t)(13 + (NumInfoBytes != 0 ? 2 + NumInfoBytes : 0));
+  size_t Esds = xBeginFullBox("esds", 0, 0);
+  xPut8(0x03); // ES_DescrTag
+  xPut8((uint8_t)(3 + 2 + NumConfigBytes + 3));
+  xPut16((uint16_t)Track.TrackId); // ES_ID
+  xPut8(0);
+  xPut8(0x04); // DecoderConfigDescrTag
+  xPut8(NumConfigBytes);
+  xPut8(Track.ObjectType);
+  xPut8(0x15); // streamType = audio, upStream = 0, reserved = 1
+  xPut8(0);    // bufferSizeDB
+  xPut16(0);
+  xPut32(0); // maxBitrate
+  xPut32(0); // avgBitrate
+  if (NumInfoBytes != 0)
+  {
+    xPut8(0x05); // DecSpecificInfoTag
+    xPut8(NumInfoBytes);
+    xPutBytes(Track.DecoderSpecificInfo.data(), NumInfoBytes);
+  }
+  xPut8(0x06); // SLConfigDescrTag
+  xPut8(1);
+  xPut8(0x02); // predefined = MP4
+  xEndBox(Esds);
+  xEndBox(Mp4a);
+}
+
+// writes moof + mdat with samples decoded before CutDTS whose duration is known
+void xMP4_Muxer::xWriteFragment(int64_t CutDTS)
+{
+  std::vector<uint32_t> NumSamples(m_Tracks.size(), 0);
+  std::vector<size_t> DataOffsetFields(m_Tracks.size(), 0);
+  bool Empty = true;
+  for (size_t TrackIdx = 0; TrackIdx < m_Tracks.size(); TrackIdx++)
+  {
+    const xTrack &Track = *m_Tracks[TrackIdx];
+    while (NumSamples[TrackIdx] < Track.Samples.size() && Track.Samples[NumSamples[TrackIdx]].DTS < CutDTS && Track.Samples[NumSamples[TrackIdx]].Duration != 0)
+    {
+      NumSamples[TrackIdx]++;
+    }
+    Empty &= NumSamples[TrackIdx] == 0;
+  }
+  this->m_FragmentStartDTS = CutDTS;
+  if (Empty)
+  {
+    return;
+  }
+
+  m_Box.clear();
+  size_t Moof = xBeginBox("moof");
+  size_t Mfhd = xBeginFullBox("mfhd", 0, 0);
+  xPut32(++m_SequenceNumber);
+  xEndBox(Mfhd);
+  for (size_t TrackIdx = 0; TrackIdx < m_Tracks.size(); TrackIdx++)
+  {
+    const xTrack &Track = *m_Tracks[TrackIdx];
+    if (NumSamples[TrackIdx] == 0)
+    {
+      continue;
+    }
+    bool Video = Track.Type == eTrackType::Video;
+    size_t Traf = xBeginBox("traf");
+    size_t Tfhd = xBeginFullBox("tfhd", 0, 0x020000); // default-base-is-moof
+    xPut32(Track.TrackId);
+    xEndBox(Tfhd);
+    size_t Tfdt = xBeginFullBox("tfdt", 1, 0);
+    xPut64((uint64_t)(Track.Samples.front().DTS - m_StartDTS));
+    xEndBox(Tfdt);
+    // data-offset, sample-duration, sample-size, sample-flags (, sample-composition-time-offset)
+    size_t Trun = xBeginFullBox("trun", 1, 0x000701 | (Video ? 0x000800 : 0));
+    xPut32(NumSamples[TrackIdx]);
+    DataOffsetFields[TrackIdx] = m_Box.size();
+    xPut32(0);
+    for (uint32_t SampleIdx = 0; SampleIdx < NumSamples[TrackIdx]; SampleIdx++)
+    {
+      const xSample &Sample = Track.Samples[SampleIdx];
+      xPut32(Sample.Duration);
+      xPut32(Sample.Size);
+      xPut32(Sample.Sync ? SampleFlags_Sync : SampleFlags_NonSync);
+      if (Video)
+      {
+        xPut32((uint32_t)Sample.CompositionOffset);
+      }
+    }
+    xEndBox(Trun);
+    xEndBox(Traf);
+  }
+  xEndBox(Moof);
+
+  // data offsets are relative to moof, track data follow each other in mdat
+  size_t DataOffset = m_Box.size() + 8;
+  std::vector<size_t> NumBytes(m_Tracks.size(), 0);
+  for (size_t TrackIdx = 0; TrackIdx < m_Tracks.size(); TrackIdx++)
+  {
+    for (uint32_t SampleIdx = 0; SampleIdx < NumSamples[TrackIdx]; SampleIdx++)
+    {
+      NumBytes[TrackIdx] += m_Tracks[TrackIdx]->Samples[SampleIdx].Size;
+    }
+    if (NumSamples[TrackIdx] != 0)
+    {
+      xPatch32(DataOffsetFields[TrackIdx], (uint32_t)DataOffset);
+      DataOffset += NumBytes[TrackIdx];
+    }
+  }
+  size_t Mdat = xBeginBox("mdat");
+  xPatch32(Mdat, (uint32_t)(DataOffset - Mdat));
+  m_Output.Write(m_Box.data(), (uint32_t)m_Box.size());
+  this->m_NumBytesWritten += m_Box.size();
+  for (size_t TrackIdx = 0; TrackIdx < m_Tracks.size(); TrackIdx++)
+  {
+    if (NumBytes[TrackIdx] != 0)
+    {
+      m_Output.Write(m_Tracks[TrackIdx]->Data.data(), (uint32_t)NumBytes[TrackIdx]);
+      this->m_NumBytesWritten += NumBytes[TrackIdx];
+    }
+    xDropQueuedSamples(*m_Tracks[TrackIdx], NumSamples[TrackIdx]);
+  }
+}
+
+//=============================================================================================================================================================================
+// SPS
+//=============================================================================================================================================================================
+
+/**
+  @brief Get picture size from H.264 sequence parameter set (ISO/IEC 14496-10 7.3.2.1.1)
+  @param SPS is pointer to SPS NAL unit (with NAL header)
+  @param Size is NAL unit size
+  @param Width receives cropped picture width
+  @param Height receives cropped picture height
+  @return 0 or NOT_VALID when SPS cannot be parsed
+*/
+int32_t xMP4_Muxer::ParseSPS(const uint8_t *SPS, uint32_t Size, uint16_t &Width, uint16_t &Height)
+{
+  if (Size < 4)
+  {
+    return NOT_VALID;
+  }
+  xBitReader Reader(SPS + 1, Size - 1);
+  uint32_t ProfileIdc = Reader.ReadBits(8);
+  Reader.ReadBits(16); // constraint flags, level_idc
+  Reader.ReadUE();     // seq_parameter_set_id
+  uint32_t ChromaFormatIdc = 1;
+  static const uint32_t HighProfiles[] = {100, 110, 122, 244, 44, 83, 86, 118, 128, 138, 139, 134, 135};
+  if (std::find(std::begin(HighProfiles), std::end(HighProfiles), ProfileIdc) != std::end(HighProfiles))
+  {
+    ChromaFormatIdc = Reader.ReadUE();
+    if (ChromaFormatIdc == 3 && Reader.ReadBit())
+    {
+      ChromaFormatIdc = 0; // separate_colour_plane_flag - ChromaArrayType 0
+    }
+    Reader.ReadUE();  // bit_depth_luma_minus8
+    Reader.ReadUE();  // bit_depth_chroma_minus8
+    Reader.ReadBit(); // qpprime_y_zero_transform_bypass_flag
+    if (Reader.ReadBit()) // seq_scaling_matrix_present_flag
+    {
+      uint32_t NumLists = ChromaFormatIdc == 3 ? 12 : 8;
+      for (uint32_t ListIdx = 0; ListIdx < NumLists; ListIdx++)
+      {
+        if (!Reader.ReadBit())
+        {
+          continue;
+        }
+        int32_t LastScale = 8;
+        int32_t NextScale = 8;
+        for (uint32_t Idx = 0; Idx < (ListIdx < 6 ? 16u : 64u) && NextScale != 0; Idx++)
+        {
+          NextScale = (LastScale + Reader.ReadSE() + 256) % 256;
+          LastScale = NextScale != 0 ? NextScale : LastScale;
+        }
+      }
+    }
+  }
+  Reader.ReadUE(); // log2_max_frame_num_minus4
+  uint32_t PicOrderCntType = Reader.ReadUE();
+  if (PicOrderCntType == 0)
+  {
+    Reader.ReadUE(); // log2_max_pic_order_cnt_lsb_minus4
+  }
+  else if (PicOrderCntType == 1)
+  {
+    Reader.ReadBit(); // delta_pic_order_always_zero_flag
+    Reader.ReadSE();  // offset_for_non_ref_pic
+    Reader.ReadSE();  // offset_for_top_to_bottom_field
+    uint32_t NumRefFramesInCycle = Reader.ReadUE();
+    for (uint32_t Idx = 0; Idx < NumRefFramesInCycle && Reader.isValid(); Idx++)
+    {
+      Reader.ReadSE();
+    }
+  }
+  Reader.ReadUE();  // max_num_ref_frames
+  Reader.ReadBit(); // gaps_in_frame_num_value_allowed_flag
+  uint32_t WidthInMbs = Reader.ReadUE() + 1;
+  uint32_t HeightInMapUnits = Reader.ReadUE() + 1;
+  uint32_t FrameMbsOnly = Reader.ReadBit();
+  if (!FrameMbsOnly)
+  {
+    Reader.ReadBit(); // mb_adaptive_frame_field_flag
+  }
+  Reader.ReadBit(); // direct_8x8_inference_flag
+  uint32_t CropLeft = 0, CropRight = 0, CropTop = 0, CropBottom = 0;
+  if (Reader.ReadBit()) // frame_cropping_flag
+  {
+    CropLeft = Reader.ReadUE();
+    CropRight = Reader.ReadUE();
+    CropTop = Reader.ReadUE();
+    CropBottom = Reader.ReadUE();
+  }
+  if (!Reader.isValid())
+  {
+    return NOT_VALID;
+  }
+
+  uint32_t CropUnitX = ChromaFormatIdc == 1 || ChromaFormatIdc == 2 ? 2 : 1;
+  uint32_t CropUnitY = (ChromaFormatIdc == 1 ? 2 : 1) * (2 - FrameMbsOnly);
+  int64_t PictureWidth = (int64_t)WidthInMbs * 16 - (int64_t)CropUnitX * (CropLeft + CropRight);
+  int64_t PictureHeight = (int64_t)(2 - FrameMbsOnly) * HeightInMapUnits * 16 - (int64_t)CropUnitY * (CropTop + CropBottom);
+  if (PictureWidth <= 0 || PictureHeight <= 0 || PictureWidth > 0xFFFF || PictureHeight > 0xFFFF)
+  {
+    return NOT_VALID;
+  }
+  Width = (uint16_t)PictureWidth;
+  Height = (uint16_t)PictureHeight;
+  return 0;
+}
+
+//=============================================================================================================================================================================
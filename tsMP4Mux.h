@@ -0,0 +1,194 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include "tsAudioFrames.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+Fragmented MP4 muxer (ISO/IEC 14496-12 movie fragments, H.264 per ISO/IEC 14496-15, audio per ISO/IEC 14496-14):
+  Tracks are fed by PES consumers of demultiplexed PIDs, so remuxing happens in the same pass as demultiplexing
+  (alongside frame index and audio framer of the same PIDs) and output is written as it goes:
+    ftyp moov(mvhd trak... mvex(trex...)) | moof(mfhd traf(tfhd tfdt trun)...) mdat | moof mdat | ...
+  moov carries sample entries only (no samples), so it is written as soon as every track knows its configuration
+  (SPS/PPS of video, first frame of audio). Samples are queued until fragment is cut - at first video keyframe after
+  fragment duration (audio only output: after fragment duration), or earlier when queued data exceeds MaxQueuedBytes -
+  so memory is bounded by one fragment.
+
+  Video (H.264) - PES packet with PTS starts access unit (PES packets without PTS continue it), Annex B start codes
+    are replaced by 4 byte lengths, AUD and filler NAL units are dropped, first SPS and PPS go to avcC
+    (later parameter sets stay in samples), IDR access unit is sync sample. Output starts at first IDR.
+  Audio (MPEG audio, AAC ADTS) - split into frames by xES_AudioFramer, one frame per sample, ADTS header is moved
+    to AudioSpecificConfig.
+
+  Timescale of all tracks is 90 kHz, so PES timestamps are used as they are: DTS (PTS when DTS is absent) gives
+  decode time, PTS - DTS composition offset (trun version 1), duration is distance to next sample of track.
+  33 bit timestamps are unwrapped, time zero is decode time of first output video sample (first audio sample).
+*/
+
+//=============================================================================================================================================================================
+
+class xMP4_Muxer;
+
+// H.264 access units from PES packets - pooled PES buffers are held (not copied) until access unit is complete
+class xMP4_VideoInput : public xPES_Consumer
+{
+protected:
+  struct xPayload
+  {
+    xPES_PacketRef Packet;
+    uint32_t HeaderLength; // PES header bytes in front of elementary stream data
+  };
+
+  xMP4_Muxer *m_Muxer;
+  uint32_t m_TrackIdx;
+  bool m_TimestampsValid;
+  uint64_t m_PTS;
+  uint64_t m_DTS;
+  std::vector<xPayload> m_AccessUnit; // PES packets of current access unit
+  std::vector<uint8_t> m_Joined;      // Annex B bytes of access unit spread over more PES packets
+  std::vector<uint8_t> m_Sample;      // length prefixed NAL units
+
+public:
+  xMP4_VideoInput(xMP4_Muxer *Muxer, uint32_t TrackIdx);
+
+  void OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet) override;
+  void OnDiscontinuity(uint16_t PID) override;
+  void OnEndOfStream(uint16_t PID, uint64_t StreamSize) override;
+
+protected:
+  void xFlushAccessUnit();
+};
+
+// audio frames from framer
+class xMP4_AudioInput : public xES_AudioFramer
+{
+protected:
+  xMP4_Muxer *m_Muxer;
+  uint32_t m_TrackIdx;
+
+public:
+  xMP4_AudioInput(xMP4_Muxer *Muxer, uint32_t TrackIdx, uint16_t PID, eCodec Codec);
+
+protected:
+  void xOnFrame(const uint8_t *Frame, const xFrame &Entry) override;
+};
+
+//=============================================================================================================================================================================
+
+class xMP4_Muxer
+{
+public:
+  static constexpr uint32_t Timescale = xTS::BaseClockFrequency_Hz;
+  static constexpr uint32_t DefaultFragmentDuration = 2 * Timescale;
+  static constexpr size_t MaxQueuedBytes = 32 * 1024 * 1024;
+  static constexpr uint64_t TimestampModulus = 1ULL << 33;
+
+  enum class eTrackType : uint8_t
+  {
+    Video,
+    Audio,
+  };
+
+  struct xSample
+  {
+    int64_t DTS;               // unwrapped, 90 kHz
+    uint32_t Size;
+    uint32_t Duration;         // 0 until next sample of track is known
+    int32_t CompositionOffset; // PTS - DTS
+    bool Sync;
+  };
+
+  struct xTrack
+  {
+    eTrackType Type;
+    uint16_t PID;
+    uint32_t TrackId; // assigned when header is written, 0 - track is not in output
+    std::unique_ptr<xPES_Consumer> Input; // registered with assembler of PID
+    // sample entry
+    bool Configured;
+    std::vector<uint8_t> SPS;
+    std::vector<uint8_t> PPS;
+    uint16_t Width;
+    uint16_t Height;
+    uint8_t ObjectType; // MPEG-4 objectTypeIndication
+    uint32_t SampleRate;
+    uint16_t NumChannels;
+    std::vector<uint8_t> DecoderSpecificInfo;
+    // timeline
+    bool TimeValid;
+    int64_t LastDTS;          // last unwrapped timestamp
+    int64_t LastSampleDTS;    // decode time of last accepted sample, samples must follow it
+    uint32_t NominalDuration; // used when next sample never comes
+    // samples of next fragment
+    std::vector<xSample> Samples;
+    std::vector<uint8_t> Data;
+    // statistics
+    uint64_t NumSamples;
+    uint64_t NumDroppedSamples;
+  };
+
+protected:
+  // setup
+  xTS_FileSink m_Output;
+  uint32_t m_FragmentDuration;
+  std::vector<std::unique_ptr<xTrack>> m_Tracks;
+  int32_t m_VideoTrackIdx; // cuts fragments at keyframes, -1 when there is no video
+  // timeline
+  bool m_ReferenceValid;
+  uint64_t m_ReferenceDTS; // first timestamp seen, unwrapped time 0
+  bool m_Started;          // header is written
+  int64_t m_StartDTS;
+  int64_t m_FragmentStartDTS;
+  // output
+  size_t m_NumQueuedBytes;
+  uint32_t m_SequenceNumber;
+  std::vector<uint8_t> m_Box;
+  uint64_t m_NumBytesWritten;
+
+public:
+  xMP4_Muxer();
+
+  int32_t Open(const char *FileName, uint32_t FragmentDuration = DefaultFragmentDuration);
+  xPES_Consumer *AddVideoTrack(uint16_t PID);
+  xPES_Consumer *AddAudioTrack(uint16_t PID, xES_AudioFramer::eCodec Codec);
+  void Finish();
+  void PrintStatistics(FILE *File) const;
+
+  // called by track inputs
+  void AddSample(uint32_t TrackIdx, const uint8_t *Data, uint32_t Size, uint64_t DTS, uint64_t PTS, bool Sync, uint32_t NominalDuration);
+  static int32_t ParseSPS(const uint8_t *SPS, uint32_t Size, uint16_t &Width, uint16_t &Height);
+
+public:
+  uint32_t getNumTracks() const { return (uint32_t)m_Tracks.size(); }
+  xTrack &getTrack(uint32_t TrackIdx) { return *m_Tracks[TrackIdx]; }
+  uint32_t getNumFragments() const { return m_SequenceNumber; }
+  uint64_t getNumBytesWritten() const { return m_NumBytesWritten; }
+  xTS_FileSink &getOutput() { return m_Output; }
+
+protected:
+  int64_t xUnwrap(xTrack &Track, uint64_t Timestamp);
+  void xTryStart(bool Force);
+  void xWriteHeader();
+  void xWriteFragment(int64_t CutDTS);
+  void xDropQueuedSamples(xTrack &Track, uint32_t NumSamples);
+
+  // box building in m_Box
+  void xPut8(uint8_t Value) { m_Box.push_back(Value); }
+  void xPut16(uint16_t Value);
+  void xPut32(uint32_t Value);
+  void xPut64(uint64_t Value);
+  void xPutBytes(const uint8_t *Data, size_t Size) { m_Box.insert(m_Box.end(), Data, Data + Size); }
+  void xPutZeros(size_t Size) { m_Box.insert(m_Box.end(), Size, 0); }
+  void xPutMatrix();
+  size_t xBeginBox(const char *Type);
+  size_t xBeginFullBox(const char *Type, uint8_t Version, uint32_t Flags);
+  void xEndBox(size_t BoxOffset);
+  void xPatch32(size_t Offset, uint32_t Value);
+  void xPutTrack(const xTrack &Track);
+  void xPutSampleEntry(const xTrack &Track);
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,339 @@
+#include "tsMonitor.h"
+#include "tsFields.h"
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_Monitor
+//=============================================================================================================================================================================
+
+xTS_Monitor::xTS_Monitor()
+{
+  Reset();
+}
+
+void xTS_Monitor::Reset()
+{
+  memset(m_PIDs, 0, sizeof(m_PIDs));
+  m_Counters.assign(xTS_PID_Router::NumPIDs, xPIDCounters{});
+  for (xPIDCounters &Counters : m_Counters)
+  {
+    Counters.LastTableTime = NOT_VALID;
+  }
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    m_Assemblers[PID] = nullptr;
+  }
+  m_AssemblerStorage.clear();
+  m_PATVersion.Reset();
+
+  this->m_ClockPID = NOT_VALID;
+  this->m_ClockTime = 0;
+  this->m_ClockOffset = 0;
+  this->m_ClockPCR = 0;
+  this->m_ClockTicks = 0;
+  this->m_ClockBytes = 0;
+  this->m_CurrentOffset = 0;
+
+  this->m_NumPackets = 0;
+  m_Totals = xTotals{};
+
+  xAddTablePID((uint16_t)xTS_PacketHeader::ePID::PAT);
+}
+
+/**
+  @brief Check TS packet
+  @param StreamOffset is position of packet in input
+  @param Packet is whole TS packet (sync byte first)
+  @param PacketHeader is parsed header of packet
+*/
+void xTS_Monitor::AddPacket(uint64_t StreamOffset, const uint8_t *Packet, const xTS_PacketHeader *PacketHeader)
+{
+  uint16_t PID = PacketHeader->getPID() & xTS_PID_Router::PIDMask;
+  xPIDState &State = m_PIDs[PID];
+  this->m_NumPackets++;
+  this->m_CurrentOffset = StreamOffset;
+  State.NumPackets++;
+
+  if (PacketHeader->getError())
+  {
+    m_Counters[PID].TransportErrors++;
+    this->m_Totals.TransportErrors++;
+  }
+  if (PID == (uint16_t)xTS_PacketHeader::ePID::NuLL)
+  {
+    // continuity counter of null packets is undefined
+    return;
+  }
+
+  const uint8_t *AdaptationField = Packet + xTS::TS_HeaderLength;
+  bool HasAdaptationField = PacketHeader->hasAdaptationField() && xTS_AdaptationFieldLayout::Length::Get(AdaptationField) > 0;
+  bool Discontinuity = HasAdaptationField && xTS_AdaptationFieldLayout::DiscontinuityIndicator::Get(AdaptationField) != 0;
+  xCheckContinuity(State, PID, PacketHeader->getContinuityCounter(), PacketHeader->hasPayload(), Discontinuity);
+
+  uint64_t PCR;
+  if (HasAdaptationField && xTS_AdaptationField::PeekPCR(Packet, PCR))
+  {
+    xCheckPCR(State, PID, StreamOffset, PCR, Discontinuity);
+  }
+
+  if ((State.Flags & eFlags_PSI) == 0 || !PacketHeader->hasPayload())
+  {
+    return;
+  }
+  if (PacketHeader->getTransportScramblingControl() != 0)
+  {
+    // PAT and PMT are never scrambled
+    m_Counters[PID].TableErrors++;
+    (PID == (uint16_t)xTS_PacketHeader::ePID::PAT ? m_Totals.PATErrors : m_Totals.PMTErrors)++;
+    return;
+  }
+  uint32_t Offset = xTS::TS_HeaderLength;
+  if (PacketHeader->hasAdaptationField())
+  {
+    Offset += Packet[xTS::TS_HeaderLength] + 1;
+  }
+  if (Offset < xTS::TS_PacketLength)
+  {
+    m_Assemblers[PID]->AbsorbPacket(Packet + Offset, xTS::TS_PacketLength - Offset, PacketHeader, this);
+  }
+}
+
+/**
+  @brief Account end of input - tables which stopped being repeated and sync losses
+  @param EndOffset is input size
+  @param NumResyncs is number of times sync scanner lost and regained packet lattice
+  @param NumDroppedBytes is number of bytes skipped by sync scanner
+*/
+void xTS_Monitor::Finish(uint64_t EndOffset, uint64_t NumResyncs, uint64_t NumDroppedBytes)
+{
+  this->m_Totals.SyncLoss = NumResyncs;
+  this->m_Totals.DroppedBytes = NumDroppedBytes;
+
+  int64_t Time = xTimeAt(EndOffset);
+  if (Time == NOT_VALID)
+  {
+    return;
+  }
+  for (const std::unique_ptr<xPSI_SectionAssembler> &Assembler : m_AssemblerStorage)
+  {
+    uint16_t PID = Assembler->getPID();
+    int64_t LastTime = m_Counters[PID].LastTableTime;
+    // table never received is reported as well
+    if (Time - (LastTime == NOT_VALID ? 0 : LastTime) > (int64_t)TableRepetitionLimit)
+    {
+      m_Counters[PID].TableErrors++;
+      (PID == (uint16_t)xTS_PacketHeader::ePID::PAT ? m_Totals.PATErrors : m_Totals.PMTErrors)++;
+    }
+  }
+}
+
+void xTS_Monitor::Print(FILE *File) const
+{
+  fprintf(File, "Monitor: Packets=%" PRIu64 " Time=%.3fs\n", m_NumPackets,
+          m_ClockPID == NOT_VALID ? 0.0 : (double)m_ClockTime / xTS::ExtendedClockFrequency_Hz);
+  fprintf(File, "  Priority 1: TS_sync_loss=%" PRIu64 " (DroppedBytes=%" PRIu64 ") PAT_error=%" PRIu64 " Continuity_count_error=%" PRIu64 " PMT_error=%" PRIu64 "\n",
+          m_Totals.SyncLoss, m_Totals.DroppedBytes, m_Totals.PATErrors, m_Totals.ContinuityErrors, m_Totals.PMTErrors);
+  fprintf(File, "  Priority 2: Transport_error=%" PRIu64 " CRC_error=%" PRIu64 " PCR_repetition_error=%" PRIu64 " PCR_discontinuity_error=%" PRIu64 "\n",
+          m_Totals.TransportErrors, m_Totals.CRCErrors, m_Totals.PCRRepetitionErrors, m_Totals.PCRDiscontinuityErrors);
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    const xPIDState &State = m_PIDs[PID];
+    if (State.NumPackets == 0)
+    {
+      continue;
+    }
+    const xPIDCounters &Counters = m_Counters[PID];
+    fprintf(File, "  PID=%4u Packets=%u CC=%" PRIu64 " TEI=%" PRIu64, PID, State.NumPackets, Counters.ContinuityErrors, Counters.TransportErrors);
+    if (State.Flags & eFlags_PCR)
+    {
+      fprintf(File, " PCR_repetition=%" PRIu64 " PCR_discontinuity=%" PRIu64, Counters.PCRRepetitionErrors, Counters.PCRDiscontinuityErrors);
+    }
+    if (State.Flags & eFlags_PSI)
+    {
+      fprintf(File, " Table=%" PRIu64 " CRC=%" PRIu64, Counters.TableErrors, Counters.CRCErrors);
+    }
+    fprintf(File, "\n");
+  }
+}
+
+void xTS_Monitor::OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length)
+{
+  bool PAT = PID == (uint16_t)xTS_PacketHeader::ePID::PAT;
+  if (PAT && Section[0] != xPSI::eTableId_PAT)
+  {
+    m_Counters[PID].TableErrors++;
+    this->m_Totals.PATErrors++;
+    return;
+  }
+  if (!PAT && Section[0] != xPSI::eTableId_PMT)
+  {
+    // other sections may share PMT PID
+    return;
+  }
+  if (Length < xPSI::LongSectionHeaderLength + xPSI::CRCLength || xPSI::CRC32(Section, Length) != 0)
+  {
+    m_Counters[PID].CRCErrors++;
+    this->m_Totals.CRCErrors++;
+    return;
+  }
+
+  xCheckTableRepetition(PID, xTimeAt(m_CurrentOffset));
+
+  if (!PAT || m_PATVersion.isUnchanged(Section, Length))
+  {
+    return;
+  }
+  xPSI_PAT PAT_Table;
+  if (PAT_Table.Parse(Section, Length) == NOT_VALID)
+  {
+    return;
+  }
+  m_PATVersion.Update(Section, Length);
+  for (const xPSI_PAT::xProgram &Program : PAT_Table.getPrograms())
+  {
+    if (Program.ProgramNumber != 0)
+    {
+      xAddTablePID(Program.PID);
+    }
+  }
+}
+
+/**
+  @brief Check continuity counter of packet
+  Packets without payload must keep counter, packet with payload may be repeated MaxDuplicates times, otherwise
+  counter has to be incremented modulo 16. Discontinuity indicator allows any value.
+*/
+void xTS_Monitor::xCheckContinuity(xPIDState &State, uint16_t PID, uint8_t ContinuityCounter, bool HasPayload, bool Discontinuity)
+{
+  if ((State.Flags & eFlags_Seen) == 0 || Discontinuity)
+  {
+    State.Flags |= eFlags_Seen;
+    State.LastCC = ContinuityCounter;
+    State.NumDuplicates = 0;
+    return;
+  }
+
+  bool Error;
+  if (!HasPayload)
+  {
+    Error = ContinuityCounter != State.LastCC;
+  }
+  else if (ContinuityCounter == State.LastCC)
+  {
+    State.NumDuplicates++;
+    Error = State.NumDuplicates > MaxDuplicates;
+  }
+  else
+  {
+    Error = ContinuityCounter != ((State.LastCC + 1) & 0xF);
+    State.NumDuplicates = 0;
+  }
+  State.LastCC = ContinuityCounter;
+
+  if (Error)
+  {
+    m_Counters[PID].ContinuityErrors++;
+    this->m_Totals.ContinuityErrors++;
+  }
+}
+
+/**
+  @brief Check PCR interval of PID and advance clock used for repetition checks
+*/
+void xTS_Monitor::xCheckPCR(xPIDState &State, uint16_t PID, uint64_t Offset, uint64_t PCR, bool Discontinuity)
+{
+  xPIDCounters &Counters = m_Counters[PID];
+  if ((State.Flags & eFlags_PCR) && !Discontinuity)
+  {
+    // PCR going back wraps to huge distance
+    uint64_t Ticks = (PCR + PCRModulus - Counters.LastPCR) % PCRModulus;
+    if (Ticks > PCRDiscontinuityLimit)
+    {
+      Counters.PCRDiscontinuityErrors++;
+      this->m_Totals.PCRDiscontinuityErrors++;
+    }
+    // next PCR came too late also when its value jumped forward, only going back says nothing about interval
+    if (Ticks > PCRRepetitionLimit && Ticks < PCRModulus / 2)
+    {
+      Counters.PCRRepetitionErrors++;
+      this->m_Totals.PCRRepetitionErrors++;
+    }
+  }
+  State.Flags |= eFlags_PCR;
+  Counters.LastPCR = PCR;
+
+  if (m_ClockPID == NOT_VALID)
+  {
+    this->m_ClockPID = PID;
+    this->m_ClockOffset = Offset;
+    this->m_ClockPCR = PCR;
+    return;
+  }
+  if (PID != m_ClockPID || Offset <= m_ClockOffset)
+  {
+    return;
+  }
+  uint64_t Bytes = Offset - m_ClockOffset;
+  uint64_t Ticks = (PCR + PCRModulus - m_ClockPCR) % PCRModulus;
+  if (Discontinuity || Ticks > PCRDiscontinuityLimit)
+  {
+    // new time base - time keeps running at last known rate
+    Ticks = m_ClockBytes > 0 ? Bytes * m_ClockTicks / m_ClockBytes : 0;
+  }
+  else
+  {
+    this->m_ClockTicks = Ticks;
+    this->m_ClockBytes = Bytes;
+  }
+  this->m_ClockTime += Ticks;
+  this->m_ClockOffset = Offset;
+  this->m_ClockPCR = PCR;
+}
+
+void xTS_Monitor::xCheckTableRepetition(uint16_t PID, int64_t Time)
+{
+  if (Time == NOT_VALID)
+  {
+    // no time base yet
+    return;
+  }
+  // first section is measured from announcement of PID (PMT) or start of time base (PAT)
+  xPIDCounters &Counters = m_Counters[PID];
+  if (Time - (Counters.LastTableTime == NOT_VALID ? 0 : Counters.LastTableTime) > (int64_t)TableRepetitionLimit)
+  {
+    Counters.TableErrors++;
+    (PID == (uint16_t)xTS_PacketHeader::ePID::PAT ? m_Totals.PATErrors : m_Totals.PMTErrors)++;
+  }
+  Counters.LastTableTime = Time;
+}
+
+void xTS_Monitor::xAddTablePID(uint16_t PID)
+{
+  PID &= xTS_PID_Router::PIDMask;
+  if (m_Assemblers[PID] != nullptr)
+  {
+    return;
+  }
+  m_AssemblerStorage.emplace_back(new xPSI_SectionAssembler());
+  m_AssemblerStorage.back()->Init(PID);
+  m_Assemblers[PID] = m_AssemblerStorage.back().get();
+  m_PIDs[PID].Flags |= eFlags_PSI;
+  m_Counters[PID].LastTableTime = xTimeAt(m_CurrentOffset);
+}
+
+/// @brief Time of input position in 27 MHz ticks since first PCR of clock PID, NOT_VALID before first PCR
+int64_t xTS_Monitor::xTimeAt(uint64_t Offset) const
+{
+  if (m_ClockPID == NOT_VALID)
+  {
+    return NOT_VALID;
+  }
+  uint64_t Time = m_ClockTime;
+  if (Offset > m_ClockOffset && m_ClockBytes > 0)
+  {
+    Time += (Offset - m_ClockOffset) * m_ClockTicks / m_ClockBytes;
+  }
+  return (int64_t)Time;
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,123 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+Stream health monitor (ETR 290 priority 1 and 2 indicators):
+  1.1 TS_sync_loss            - lattice of sync bytes lost (taken from sync scanner)
+  1.3 PAT_error               - PAT not repeated within 0.5 s, wrong table_id on PID 0, scrambled PID 0
+  1.4 Continuity_count_error  - wrong packet order, lost packet, packet repeated more than twice
+  1.5 PMT_error               - PMT not repeated within 0.5 s, scrambled PMT PID
+  2.1 Transport_error         - transport_error_indicator set
+  2.2 CRC_error               - PAT or PMT section with wrong CRC
+  2.3 PCR_repetition_error    - PCRs of PID more than 40 ms apart (forward jump over 100 ms counts as both errors)
+      PCR_discontinuity_error - PCR jump over 100 ms (or backwards) without discontinuity_indicator
+  Every PID is checked, whether it is demultiplexed or not.
+
+  Time for repetition checks is PCR of first PID carrying PCR, interpolated between PCRs by byte position.
+
+  Per packet state of every PID is 8 bytes (64 KiB for all PIDs - stays in L1/L2 cache), counters and PCR state
+  are kept in separate table which is touched only on errors and PCR packets.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_Monitor : public xPSI_SectionHandler
+{
+public:
+  static constexpr uint64_t PCRModulus = (1ULL << 33) * xTS::BaseToExtendedClockMultiplier;
+  static constexpr uint64_t TableRepetitionLimit = xTS::ExtendedClockFrequency_Hz / 2;      // 0.5 s
+  static constexpr uint64_t PCRRepetitionLimit = xTS::ExtendedClockFrequency_kHz * 40;       // 40 ms
+  static constexpr uint64_t PCRDiscontinuityLimit = xTS::ExtendedClockFrequency_kHz * 100;   // 100 ms
+  static constexpr uint8_t MaxDuplicates = 1; // packet may be sent twice
+
+  enum eFlags : uint8_t
+  {
+    eFlags_Seen = 0x01,
+    eFlags_PSI = 0x02, // PAT or PMT PID
+    eFlags_PCR = 0x04, // PCR seen
+  };
+
+  struct xPIDState
+  {
+    uint32_t NumPackets;
+    uint8_t LastCC;
+    uint8_t NumDuplicates;
+    uint8_t Flags;
+    uint8_t Reserved;
+  };
+
+  struct xPIDCounters
+  {
+    uint64_t ContinuityErrors;
+    uint64_t TransportErrors;
+    uint64_t PCRRepetitionErrors;
+    uint64_t PCRDiscontinuityErrors;
+    uint64_t TableErrors; // PAT/PMT repetition, table_id and scrambling errors
+    uint64_t CRCErrors;
+    uint64_t LastPCR;
+    int64_t LastTableTime; // time of last section (or of PMT PID announcement), -1 before time base
+  };
+
+  struct xTotals
+  {
+    uint64_t SyncLoss;
+    uint64_t DroppedBytes;
+    uint64_t PATErrors;
+    uint64_t ContinuityErrors;
+    uint64_t PMTErrors;
+    uint64_t TransportErrors;
+    uint64_t CRCErrors;
+    uint64_t PCRRepetitionErrors;
+    uint64_t PCRDiscontinuityErrors;
+  };
+
+protected:
+  // per PID
+  xPIDState m_PIDs[xTS_PID_Router::NumPIDs];
+  std::vector<xPIDCounters> m_Counters;
+  xPSI_SectionAssembler *m_Assemblers[xTS_PID_Router::NumPIDs];
+  std::vector<std::unique_ptr<xPSI_SectionAssembler>> m_AssemblerStorage;
+  xPSI_TableVersion m_PATVersion;
+  // clock
+  int32_t m_ClockPID;
+  uint64_t m_ClockTime;   // unwrapped 27 MHz ticks at m_ClockOffset
+  uint64_t m_ClockOffset;
+  uint64_t m_ClockPCR;
+  uint64_t m_ClockTicks;  // last PCR interval of clock PID, rate used for interpolation
+  uint64_t m_ClockBytes;
+  uint64_t m_CurrentOffset;
+  // statistics
+  uint64_t m_NumPackets;
+  xTotals m_Totals;
+
+public:
+  xTS_Monitor();
+
+  void Reset();
+  void AddPacket(uint64_t StreamOffset, const uint8_t *Packet, const xTS_PacketHeader *PacketHeader);
+  void Finish(uint64_t EndOffset, uint64_t NumResyncs, uint64_t NumDroppedBytes);
+  void Print(FILE *File) const;
+
+  void OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length) override;
+
+public:
+  uint64_t getNumPackets() const { return m_NumPackets; }
+  const xTotals &getTotals() const { return m_Totals; }
+  const xPIDState &getPIDState(uint16_t PID) const { return m_PIDs[PID & xTS_PID_Router::PIDMask]; }
+  const xPIDCounters &getPIDCounters(uint16_t PID) const { return m_Counters[PID & xTS_PID_Router::PIDMask]; }
+
+protected:
+  void xCheckContinuity(xPIDState &State, uint16_t PID, uint8_t ContinuityCounter, bool HasPayload, bool Discontinuity);
+  void xCheckPCR(xPIDState &State, uint16_t PID, uint64_t Offset, uint64_t PCR, bool Discontinuity);
+  void xCheckTableRepetition(uint16_t PID, int64_t Time);
+  void xAddTablePID(uint16_t PID);
+  int64_t xTimeAt(uint64_t Offset) const;
+};
+
+//=============================================================================================================================================================================
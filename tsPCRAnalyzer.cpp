@@ -0,0 +1,173 @@
+#include "tsPCRAnalyzer.h"
+#include <cmath>
+#include <cstdlib>
+
+//=============================================================================================================================================================================
+// xTS_PCRAnalyzer::xStream
+//=============================================================================================================================================================================
+
+void xTS_PCRAnalyzer::xStream::Reset(uint16_t PID)
+{
+  this->m_PID = PID;
+  this->m_WindowBegin = 0;
+  this->m_WindowCount = 0;
+  this->m_SpanBytes = 0;
+  this->m_SpanTicks = 0;
+  this->m_NumPCRs = 0;
+  this->m_NumDiscontinuities = 0;
+  this->m_NumIntervals = 0;
+  this->m_MinInterval = UINT64_MAX;
+  this->m_MaxInterval = 0;
+  this->m_SumInterval = 0;
+  this->m_MinBitrate = UINT64_MAX;
+  this->m_MaxBitrate = 0;
+  this->m_WindowBitrate = 0;
+  this->m_NumJitterSamples = 0;
+  this->m_MinJitter = INT64_MAX;
+  this->m_MaxJitter = INT64_MIN;
+  this->m_SumJitterSquared = 0;
+  this->m_NumAccuracyErrors = 0;
+  this->m_Drift = 0;
+  this->m_MaxDrift = 0;
+}
+
+/**
+  @brief Account PCR sample
+  @param Offset is position of packet carrying PCR in input
+  @param PCR is PCR value in 27 MHz ticks
+  @param Discontinuity is discontinuity indicator of packet
+*/
+void xTS_PCRAnalyzer::xStream::AddSample(uint64_t Offset, uint64_t PCR, bool Discontinuity)
+{
+  this->m_NumPCRs++;
+
+  if (m_WindowCount > 0)
+  {
+    const xSample &Prev = m_Window[(m_WindowBegin + m_WindowCount - 1) % WindowSize];
+    uint64_t Ticks = (PCR + PCRModulus - Prev.PCR) % PCRModulus;
+    uint64_t Bytes = Offset - Prev.Offset;
+    if (Discontinuity || Ticks == 0 || Ticks > MaxPCRGap || Offset <= Prev.Offset)
+    {
+      // new time base - measurement starts again
+      this->m_NumDiscontinuities++;
+      this->m_WindowBegin = 0;
+      this->m_WindowCount = 0;
+    }
+    else
+    {
+      this->m_NumIntervals++;
+      this->m_SumInterval += Ticks;
+      this->m_MinInterval = Ticks < m_MinInterval ? Ticks : m_MinInterval;
+      this->m_MaxInterval = Ticks > m_MaxInterval ? Ticks : m_MaxInterval;
+
+      uint64_t Bitrate = xBitrate(Bytes, Ticks);
+      this->m_MinBitrate = Bitrate < m_MinBitrate ? Bitrate : m_MinBitrate;
+      this->m_MaxBitrate = Bitrate > m_MaxBitrate ? Bitrate : m_MaxBitrate;
+
+      // expected PCR distance at bitrate of preceding window
+      if (m_WindowCount >= 2)
+      {
+        const xSample &Oldest = m_Window[m_WindowBegin];
+        uint64_t WindowTicks = (Prev.PCR + PCRModulus - Oldest.PCR) % PCRModulus;
+        uint64_t WindowBytes = Prev.Offset - Oldest.Offset;
+        int64_t Jitter = (int64_t)Ticks - (int64_t)(Bytes * WindowTicks / WindowBytes);
+        this->m_NumJitterSamples++;
+        this->m_MinJitter = Jitter < m_MinJitter ? Jitter : m_MinJitter;
+        this->m_MaxJitter = Jitter > m_MaxJitter ? Jitter : m_MaxJitter;
+        this->m_SumJitterSquared += (double)Jitter * (double)Jitter;
+        if (std::abs(Jitter) * AccuracyLimit_Hz > (int64_t)xTS::ExtendedClockFrequency_Hz)
+        {
+          this->m_NumAccuracyErrors++;
+        }
+      }
+
+      this->m_SpanBytes += Bytes;
+      this->m_SpanTicks += Ticks;
+    }
+  }
+
+  // window keeps last WindowSize samples
+  if (m_WindowCount < WindowSize)
+  {
+    m_Window[(m_WindowBegin + m_WindowCount) % WindowSize] = {Offset, PCR};
+    this->m_WindowCount++;
+  }
+  else
+  {
+    m_Window[m_WindowBegin] = {Offset, PCR};
+    this->m_WindowBegin = (m_WindowBegin + 1) % WindowSize;
+  }
+
+  if (m_WindowCount >= 2)
+  {
+    const xSample &Oldest = m_Window[m_WindowBegin];
+    this->m_WindowBitrate = xBitrate(Offset - Oldest.Offset, (PCR + PCRModulus - Oldest.PCR) % PCRModulus);
+    uint64_t AverageBitrate = getAverageBitrate();
+    if (AverageBitrate > 0)
+    {
+      this->m_Drift = ((double)m_WindowBitrate - (double)AverageBitrate) * 1e6 / (double)AverageBitrate;
+      this->m_MaxDrift = std::fabs(m_Drift) > std::fabs(m_MaxDrift) ? m_Drift : m_MaxDrift;
+    }
+  }
+}
+
+double xTS_PCRAnalyzer::xStream::getRMSJitter() const
+{
+  return m_NumJitterSamples > 0 ? std::sqrt(m_SumJitterSquared / (double)m_NumJitterSamples) : 0.0;
+}
+
+//=============================================================================================================================================================================
+// xTS_PCRAnalyzer
+//=============================================================================================================================================================================
+
+xTS_PCRAnalyzer::xTS_PCRAnalyzer()
+{
+  Reset();
+}
+
+void xTS_PCRAnalyzer::Reset()
+{
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    m_StreamIdx[PID] = NOT_VALID;
+  }
+  m_Streams.clear();
+}
+
+void xTS_PCRAnalyzer::AddSample(uint16_t PID, uint64_t Offset, uint64_t PCR, bool Discontinuity)
+{
+  PID &= xTS_PID_Router::PIDMask;
+  if (m_StreamIdx[PID] == NOT_VALID)
+  {
+    m_StreamIdx[PID] = (int32_t)m_Streams.size();
+    m_Streams.emplace_back();
+    m_Streams.back().Reset(PID);
+  }
+  m_Streams[m_StreamIdx[PID]].AddSample(Offset, PCR, Discontinuity);
+}
+
+void xTS_PCRAnalyzer::Print(FILE *File) const
+{
+  const double TicksPerMs = xTS::ExtendedClockFrequency_kHz;
+  const double TicksPerNs = xTS::ExtendedClockFrequency_Hz / 1e9;
+  for (const xStream &Stream : m_Streams)
+  {
+    fprintf(File, "PCR analysis: PID=%u PCRs=%" PRIu64 " Discontinuities=%" PRIu64 "\n", Stream.m_PID, Stream.m_NumPCRs, Stream.m_NumDiscontinuities);
+    if (Stream.m_NumIntervals == 0)
+    {
+      continue;
+    }
+    fprintf(File, "  Interval: Min=%.3fms Avg=%.3fms Max=%.3fms\n",
+            Stream.m_MinInterval / TicksPerMs, (double)Stream.m_SumInterval / Stream.m_NumIntervals / TicksPerMs, Stream.m_MaxInterval / TicksPerMs);
+    fprintf(File, "  Bitrate: Min=%" PRIu64 " Max=%" PRIu64 " Window=%" PRIu64 " Average=%" PRIu64 " bps\n",
+            Stream.m_MinBitrate, Stream.m_MaxBitrate, Stream.m_WindowBitrate, Stream.getAverageBitrate());
+    if (Stream.m_NumJitterSamples > 0)
+    {
+      fprintf(File, "  Jitter: Min=%.0fns Max=%.0fns RMS=%.0fns AccuracyErrors=%" PRIu64 "\n",
+              Stream.m_MinJitter / TicksPerNs, Stream.m_MaxJitter / TicksPerNs, Stream.getRMSJitter() / TicksPerNs, Stream.m_NumAccuracyErrors);
+    }
+    fprintf(File, "  Drift: Last=%.3fppm Max=%.3fppm\n", Stream.m_Drift, Stream.m_MaxDrift);
+  }
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,103 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include "tsFields.h"
+#include <vector>
+
+/*
+PCR timing analysis:
+  Byte position in input is the only time base a recorded stream has, so every measure relates PCR to bytes:
+    interval      - PCR distance between consecutive PCRs of PID
+    bitrate       - bytes between PCRs / PCR distance, instantaneous (consecutive PCRs), windowed (last WindowSize
+                    PCRs) and average (all intervals, discontinuities excluded)
+    jitter        - PCR distance minus distance expected from windowed bitrate of preceding PCRs (i.e. how much PCR
+                    deviates from constant bitrate delivery), samples beyond +-500 ns are counted as accuracy errors
+    drift         - windowed bitrate relative to average bitrate (ppm)
+  All clock and byte distances are exact 64-bit integers in 27 MHz ticks and bytes, only ratios are floating point.
+  Memory is constant - per PID state with fixed window, no per sample storage.
+  Discontinuity indicator, PCR going back or gap longer than MaxPCRGap restart measurement of PID.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_PCRAnalyzer
+{
+public:
+  static constexpr uint32_t WindowSize = 32;                                          // PCRs
+  static constexpr uint64_t PCRModulus = (1ULL << 33) * xTS::BaseToExtendedClockMultiplier;
+  static constexpr uint64_t MaxPCRGap = xTS::ExtendedClockFrequency_Hz;             // 1 s
+  static constexpr int64_t AccuracyLimit_Hz = 2000000;                                // 1 / 500 ns (13.5 ticks, not integer)
+
+  struct xSample
+  {
+    uint64_t Offset;
+    uint64_t PCR;
+  };
+
+  class xStream
+  {
+  public:
+    uint16_t m_PID;
+    // window of last PCRs
+    xSample m_Window[WindowSize];
+    uint32_t m_WindowBegin;
+    uint32_t m_WindowCount;
+    // all intervals
+    uint64_t m_SpanBytes;
+    uint64_t m_SpanTicks;
+    // statistics
+    uint64_t m_NumPCRs;
+    uint64_t m_NumDiscontinuities;
+    uint64_t m_NumIntervals;
+    uint64_t m_MinInterval;
+    uint64_t m_MaxInterval;
+    uint64_t m_SumInterval;
+    uint64_t m_MinBitrate; // instantaneous
+    uint64_t m_MaxBitrate;
+    uint64_t m_WindowBitrate;
+    uint64_t m_NumJitterSamples;
+    int64_t m_MinJitter; // ticks
+    int64_t m_MaxJitter;
+    double m_SumJitterSquared;
+    uint64_t m_NumAccuracyErrors;
+    double m_Drift; // ppm
+    double m_MaxDrift;
+
+  public:
+    void Reset(uint16_t PID);
+    void AddSample(uint64_t Offset, uint64_t PCR, bool Discontinuity);
+
+    uint64_t getAverageBitrate() const { return m_SpanTicks > 0 ? xBitrate(m_SpanBytes, m_SpanTicks) : 0; }
+    double getRMSJitter() const;
+
+  protected:
+    static uint64_t xBitrate(uint64_t Bytes, uint64_t Ticks) { return (uint64_t)((double)Bytes * 8 * xTS::ExtendedClockFrequency_Hz / (double)Ticks + 0.5); }
+  };
+
+protected:
+  int32_t m_StreamIdx[xTS_PID_Router::NumPIDs];
+  std::vector<xStream> m_Streams;
+
+public:
+  xTS_PCRAnalyzer();
+
+  void Reset();
+  // packet is whole TS packet (sync byte first), only packets carrying PCR are used
+  void AddPacket(uint64_t StreamOffset, const uint8_t *Packet, uint16_t PID)
+  {
+    uint64_t PCR;
+    if (xTS_AdaptationField::PeekPCR(Packet, PCR))
+    {
+      AddSample(PID, StreamOffset, PCR, xTS_AdaptationFieldLayout::DiscontinuityIndicator::Get(Packet + xTS::TS_HeaderLength) != 0);
+    }
+  }
+  void AddSample(uint16_t PID, uint64_t Offset, uint64_t PCR, bool Discontinuity);
+  void Print(FILE *File) const;
+
+public:
+  uint32_t getNumStreams() const { return (uint32_t)m_Streams.size(); }
+  const xStream &getStream(uint32_t StreamIdx) const { return m_Streams[StreamIdx]; }
+};
+
+//=============================================================================================================================================================================
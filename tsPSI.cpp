@@ -0,0 +1,551 @@
+#include "tsPSI.h"
+#include "tsFields.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+//=============================================================================================================================================================================
+// xPSI
+//=============================================================================================================================================================================
+
+struct xCRC32Table
+{
+  uint32_t Table[256];
+  xCRC32Table()
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t CRC = i << 24;
+      for (int Bit = 0; Bit < 8; Bit++)
+      {
+        CRC = (CRC & 0x80000000) ? (CRC << 1) ^ 0x04C11DB7 : (CRC << 1);
+      }
+      Table[i] = CRC;
+    }
+  }
+};
+
+/**
+  @brief MPEG-2 CRC32 (polynomial 0x04C11DB7, no reflection, initial value 0xFFFFFFFF)
+  @return CRC of data, 0 when data already ends with valid CRC
+*/
+uint32_t xPSI::CRC32(const uint8_t *Data, uint32_t Length)
+{
+  static const xCRC32Table CRCTable;
+  uint32_t CRC = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < Length; i++)
+  {
+    CRC = (CRC << 8) ^ CRCTable.Table[(CRC >> 24) ^ Data[i]];
+  }
+  return CRC;
+}
+
+//=============================================================================================================================================================================
+// xPSI_SectionAssembler
+//=============================================================================================================================================================================
+
+void xPSI_SectionAssembler::Init(uint16_t PID)
+{
+  this->m_PID = PID;
+  this->m_LastContinuityCounter = -1;
+  xSectionReset();
+}
+
+/**
+  @brief Absorb TS packet carrying PSI sections
+  @param Payload is pointer to TS packet payload
+  @param PayloadLength is number of payload bytes
+  @param PacketHeader is parsed header of TS packet
+  @param Handler receives every completed section
+  @return Number of consumed payload bytes (-1 on failure)
+*/
+int32_t xPSI_SectionAssembler::AbsorbPacket(const uint8_t *Payload, uint32_t PayloadLength, const xTS_PacketHeader *PacketHeader, xPSI_SectionHandler *Handler)
+{
+  if (PacketHeader->getPID() != m_PID)
+  {
+    return NOT_VALID;
+  }
+
+  int8_t ContinuityCounter = (int8_t)PacketHeader->getContinuityCounter();
+  if (m_LastContinuityCounter >= 0)
+  {
+    if (ContinuityCounter == m_LastContinuityCounter)
+    {
+      return 0; // duplicate packet
+    }
+    if (ContinuityCounter != ((m_LastContinuityCounter + 1) & 0xF))
+    {
+      xSectionReset(); // partial section is lost
+    }
+  }
+  this->m_LastContinuityCounter = ContinuityCounter;
+
+  if (PayloadLength == 0)
+  {
+    return 0;
+  }
+
+  if (!PacketHeader->getStart())
+  {
+    if (m_Started)
+    {
+      xAppend(Payload, PayloadLength, Handler);
+    }
+    return (int32_t)PayloadLength;
+  }
+
+  // pointer_field - bytes before it finish previous section
+  uint32_t PointerField = Payload[0];
+  const uint8_t *Data = Payload + 1;
+  uint32_t Size = PayloadLength - 1;
+  if (PointerField > Size)
+  {
+    xSectionReset();
+    return NOT_VALID;
+  }
+  if (m_Started)
+  {
+    xAppend(Data, PointerField, Handler);
+  }
+  xSectionReset();
+  Data += PointerField;
+  Size -= PointerField;
+
+  // new sections follow back to back until stuffing
+  while (Size >= xPSI::SectionHeaderLength && Data[0] != xPSI::eTableId_Stuffing)
+  {
+    uint32_t SectionLength = xPSI::SectionHeaderLength + xPSI_SectionLayout::SectionLength::Get(Data);
+    if (SectionLength <= Size)
+    {
+      // whole section inside packet - no copy needed
+      Handler->OnSection(m_PID, Data, SectionLength);
+      Data += SectionLength;
+      Size -= SectionLength;
+      continue;
+    }
+    this->m_Started = true;
+    xAppend(Data, Size, Handler);
+    return (int32_t)PayloadLength;
+  }
+  if (Size > 0 && Data[0] != xPSI::eTableId_Stuffing)
+  {
+    // section header itself is split between packets
+    this->m_Started = true;
+    xAppend(Data, Size, Handler);
+  }
+  return (int32_t)PayloadLength;
+}
+
+uint32_t xPSI_SectionAssembler::xAppend(const uint8_t *Data, uint32_t Size, xPSI_SectionHandler *Handler)
+{
+  uint32_t Used = 0;
+  if (m_SectionLength == 0)
+  {
+    uint32_t Num = std::min(xPSI::SectionHeaderLength - m_DataOffset, Size);
+    std::memcpy(m_Buffer + m_DataOffset, Data, Num);
+    this->m_DataOffset += Num;
+    Used += Num;
+    if (m_DataOffset < xPSI::SectionHeaderLength)
+    {
+      return Used;
+    }
+    this->m_SectionLength = xPSI::SectionHeaderLength + xPSI_SectionLayout::SectionLength::Get(m_Buffer);
+  }
+
+  uint32_t Num = std::min(m_SectionLength - m_DataOffset, Size - Used);
+  std::memcpy(m_Buffer + m_DataOffset, Data + Used, Num);
+  this->m_DataOffset += Num;
+  Used += Num;
+
+  if (m_DataOffset == m_SectionLength)
+  {
+    Handler->OnSection(m_PID, m_Buffer, m_SectionLength);
+    xSectionReset();
+  }
+  return Used;
+}
+
+//=============================================================================================================================================================================
+// xPSI_TableVersion
+//=============================================================================================================================================================================
+
+static inline uint32_t xReadSectionCRC(const uint8_t *Section, uint32_t Length)
+{
+  const uint8_t *CRC = Section + Length - xPSI::CRCLength;
+  return (uint32_t)CRC[0] << 24 | (uint32_t)CRC[1] << 16 | (uint32_t)CRC[2] << 8 | (uint32_t)CRC[3];
+}
+
+bool xPSI_TableVersion::isUnchanged(const uint8_t *Section, uint32_t Length) const
+{
+  if (!m_Valid || Length < xPSI::LongSectionHeaderLength + xPSI::CRCLength)
+  {
+    return false;
+  }
+  return m_TableIdExtension == xPSI_SectionLayout::TableIdExtension::Get(Section) &&
+         m_VersionByte == Section[xPSI_SectionLayout::VersionNumber::Offset] &&
+         m_SectionNumber == xPSI_SectionLayout::SectionNumber::Get(Section) &&
+         m_CRC == xReadSectionCRC(Section, Length);
+}
+
+void xPSI_TableVersion::Update(const uint8_t *Section, uint32_t Length)
+{
+  this->m_Valid = true;
+  this->m_TableIdExtension = xPSI_SectionLayout::TableIdExtension::Get(Section);
+  this->m_VersionByte = Section[xPSI_SectionLayout::VersionNumber::Offset]; // version and current_next_indicator
+  this->m_SectionNumber = xPSI_SectionLayout::SectionNumber::Get(Section);
+  this->m_CRC = xReadSectionCRC(Section, Length);
+}
+
+//=============================================================================================================================================================================
+// xPSI_PAT
+//=============================================================================================================================================================================
+
+void xPSI_PAT::Reset()
+{
+  this->m_TransportStreamId = 0;
+  this->m_VersionNumber = 0;
+  m_Programs.clear();
+}
+
+/**
+  @brief Parse program association section
+  @param Section is pointer to section (starting with table_id)
+  @param Length is section length including header and CRC
+  @return Number of programs (-1 on failure)
+*/
+int32_t xPSI_PAT::Parse(const uint8_t *Section, uint32_t Length)
+{
+  if (Section == nullptr || Length < xPSI::LongSectionHeaderLength + xPSI::CRCLength || Section[0] != xPSI::eTableId_PAT)
+  {
+    return NOT_VALID;
+  }
+
+  this->m_TransportStreamId = xPSI_SectionLayout::TableIdExtension::Get(Section);
+  this->m_VersionNumber = xPSI_SectionLayout::VersionNumber::Get(Section);
+  m_Programs.clear();
+
+  const uint8_t *Entry = Section + xPSI::LongSectionHeaderLength;
+  const uint8_t *End = Section + Length - xPSI::CRCLength;
+  for (; Entry + xPSI_PAT_EntryLayout::Length <= End; Entry += xPSI_PAT_EntryLayout::Length)
+  {
+    xProgram Program;
+    Program.ProgramNumber = xPSI_PAT_EntryLayout::ProgramNumber::Get(Entry);
+    Program.PID = xPSI_PAT_EntryLayout::PID::Get(Entry);
+    m_Programs.push_back(Program);
+  }
+  return (int32_t)m_Programs.size();
+}
+
+void xPSI_PAT::Print() const
+{
+  std::cout << "PAT:" << '\n';
+  std::cout << "  Transport stream id: " << (int)m_TransportStreamId << '\n';
+  std::cout << "  Version number: " << (int)m_VersionNumber << '\n';
+  for (const xProgram &Program : m_Programs)
+  {
+    std::cout << "  Program " << (int)Program.ProgramNumber << (Program.ProgramNumber == 0 ? ": NIT PID " : ": PMT PID ") << (int)Program.PID << '\n';
+  }
+}
+
+//=============================================================================================================================================================================
+// xPSI_PMT
+//=============================================================================================================================================================================
+
+void xPSI_PMT::Reset()
+{
+  this->m_ProgramNumber = 0;
+  this->m_VersionNumber = 0;
+  this->m_PCR_PID = 0;
+  m_Streams.clear();
+}
+
+/**
+  @brief Parse program map section
+  @param Section is pointer to section (starting with table_id)
+  @param Length is section length including header and CRC
+  @return Number of elementary streams (-1 on failure)
+*/
+int32_t xPSI_PMT::Parse(const uint8_t *Section, uint32_t Length)
+{
+  if (Section == nullptr || Length < xPSI_PMT_Layout::ProgramInfoLength::EndOffset + xPSI::CRCLength || Section[0] != xPSI::eTableId_PMT)
+  {
+    return NOT_VALID;
+  }
+
+  this->m_ProgramNumber = xPSI_SectionLayout::TableIdExtension::Get(Section);
+  this->m_VersionNumber = xPSI_SectionLayout::VersionNumber::Get(Section);
+  this->m_PCR_PID = xPSI_PMT_Layout::PCR_PID::Get(Section);
+  uint32_t ProgramInfoLength = xPSI_PMT_Layout::ProgramInfoLength::Get(Section);
+  m_Streams.clear();
+
+  const uint8_t *Entry = Section + xPSI_PMT_Layout::ProgramInfoLength::EndOffset + ProgramInfoLength;
+  const uint8_t *End = Section + Length - xPSI::CRCLength;
+  while (Entry + xPSI_PMT_EntryLayout::Length <= End)
+  {
+    xElementaryStream Stream;
+    Stream.StreamType = xPSI_PMT_EntryLayout::StreamType::Get(Entry);
+    Stream.PID = xPSI_PMT_EntryLayout::ElementaryPID::Get(Entry);
+    Stream.DescribedType = Stream.StreamType;
+    uint32_t ESInfoLength = xPSI_PMT_EntryLayout::ESInfoLength::Get(Entry);
+
+    // private PES - identify DVB audio by its descriptor
+    const uint8_t *Descriptor = Entry + xPSI_PMT_EntryLayout::Length;
+    const uint8_t *DescriptorEnd = std::min(Descriptor + ESInfoLength, End);
+    for (; Descriptor + 2 <= DescriptorEnd; Descriptor += 2 + Descriptor[1])
+    {
+      if (Stream.StreamType == eStreamType_PrivatePES && Descriptor[0] == eDescriptorTag_AC3)
+      {
+        Stream.DescribedType = eStreamType_AC3;
+      }
+      else if (Stream.StreamType == eStreamType_PrivatePES && Descriptor[0] == eDescriptorTag_EAC3)
+      {
+        Stream.DescribedType = eStreamType_EAC3;
+      }
+    }
+
+    m_Streams.push_back(Stream);
+    Entry += xPSI_PMT_EntryLayout::Length + ESInfoLength;
+  }
+  return (int32_t)m_Streams.size();
+}
+
+void xPSI_PMT::Print() const
+{
+  std::cout << "PMT:" << '\n';
+  std::cout << "  Program number: " << (int)m_ProgramNumber << '\n';
+  std::cout << "  Version number: " << (int)m_VersionNumber << '\n';
+  std::cout << "  PCR PID: " << (int)m_PCR_PID << '\n';
+  for (const xElementaryStream &Stream : m_Streams)
+  {
+    std::cout << "  Stream type " << (int)Stream.StreamType << ": PID " << (int)Stream.PID << '\n';
+  }
+}
+
+bool xPSI_PMT::isPESStreamType(uint8_t StreamType)
+{
+  return StreamType != eStreamType_PrivateSections && StreamType != 0x00;
+}
+
+const char *xPSI_PMT::getFileExtension(uint8_t StreamType)
+{
+  switch (StreamType)
+  {
+  case eStreamType_MPEG1_Video:
+  case eStreamType_MPEG2_Video:
+    return "m2v";
+  case eStreamType_MPEG1_Audio:
+  case eStreamType_MPEG2_Audio:
+    return "mp2";
+  case eStreamType_AAC_ADTS:
+    return "aac";
+  case eStreamType_AAC_LATM:
+    return "latm";
+  case eStreamType_H264:
+    return "264";
+  case eStreamType_H265:
+    return "265";
+  case eStreamType_AC3:
+    return "ac3";
+  case eStreamType_EAC3:
+    return "eac3";
+  default:
+    return "es";
+  }
+}
+
+//=============================================================================================================================================================================
+// xPSI_Scanner
+//=============================================================================================================================================================================
+
+xPSI_Scanner::xPSI_Scanner()
+{
+  this->m_Router = nullptr;
+  this->m_ProgramFilter = -1;
+  this->m_Verbose = false;
+  std::fill(m_Table, m_Table + xTS_PID_Router::NumPIDs, nullptr);
+}
+
+/**
+  @brief Start following PAT
+  @param Router receives discovered elementary streams
+  @param SinkFactory creates output sink for every discovered stream
+  @param ProgramFilter is program number to demultiplex (-1 for all programs)
+*/
+void xPSI_Scanner::Init(xTS_PID_Router *Router, tSinkFactory SinkFactory, int32_t ProgramFilter)
+{
+  Reset();
+  this->m_Router = Router;
+  this->m_SinkFactory = SinkFactory;
+  this->m_ProgramFilter = ProgramFilter;
+  xAddSectionPID((uint16_t)xTS_PacketHeader::ePID::PAT);
+}
+
+/// @brief Forget all tables and section PIDs, so scanner can follow another stream after Init()
+void xPSI_Scanner::Reset()
+{
+  std::fill(m_Table, m_Table + xTS_PID_Router::NumPIDs, nullptr);
+  m_Assemblers.clear();
+  m_PATVersion.Reset();
+  m_PAT.Reset();
+  m_Programs.clear();
+}
+
+int32_t xPSI_Scanner::AbsorbPacket(const uint8_t *Packet, const xTS_PacketHeader *PacketHeader)
+{
+  xPSI_SectionAssembler *Assembler = m_Table[PacketHeader->getPID() & xTS_PID_Router::PIDMask];
+  if (Assembler == nullptr || !PacketHeader->hasPayload())
+  {
+    return NOT_VALID;
+  }
+
+  uint32_t Offset = xTS::TS_HeaderLength;
+  if (PacketHeader->hasAdaptationField())
+  {
+    Offset += Packet[xTS::TS_HeaderLength] + 1;
+  }
+  if (Offset >= xTS::TS_PacketLength)
+  {
+    return NOT_VALID;
+  }
+  return Assembler->AbsorbPacket(Packet + Offset, xTS::TS_PacketLength - Offset, PacketHeader, this);
+}
+
+int32_t xPSI_Scanner::AbsorbInput(xTS_InputSource &Input, uint64_t EndOffset)
+{
+  xTS_PacketBatch Batch;
+  xTS_PacketHeader PacketHeader;
+  while (Input.ReadBatch(Batch) > 0)
+  {
+    for (uint32_t PacketIdx = 0; PacketIdx < Batch.getNumPackets(); PacketIdx++)
+    {
+      if (Batch.getPacketOffset(PacketIdx) >= EndOffset)
+      {
+        xRestartSections();
+        return 0;
+      }
+      const uint8_t *Packet = Batch.getPacket(PacketIdx);
+      if (isPSIPID(xTS_HeaderLayout::PID::Get(Packet)) && PacketHeader.Parse(Packet) != NOT_VALID)
+      {
+        AbsorbPacket(Packet, &PacketHeader);
+      }
+    }
+  }
+  xRestartSections();
+  return Input.getStreamOffset() >= EndOffset ? 0 : NOT_VALID;
+}
+
+void xPSI_Scanner::xRestartSections()
+{
+  // input continues elsewhere - continuity counters and partial sections do not carry over
+  for (std::unique_ptr<xPSI_SectionAssembler> &Assembler : m_Assemblers)
+  {
+    Assembler->Init(Assembler->getPID());
+  }
+}
+
+void xPSI_Scanner::OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length)
+{
+  if (PID == (uint16_t)xTS_PacketHeader::ePID::PAT && Section[0] == xPSI::eTableId_PAT)
+  {
+    xOnPAT(Section, Length);
+    return;
+  }
+  if (Section[0] != xPSI::eTableId_PMT || Length < xPSI::LongSectionHeaderLength)
+  {
+    return;
+  }
+  uint16_t ProgramNumber = xPSI_SectionLayout::TableIdExtension::Get(Section);
+  for (std::unique_ptr<xProgramInfo> &Program : m_Programs)
+  {
+    if (Program->PMT_PID == PID && Program->ProgramNumber == ProgramNumber)
+    {
+      xOnPMT(*Program, Section, Length);
+    }
+  }
+}
+
+void xPSI_Scanner::xAddSectionPID(uint16_t PID)
+{
+  if (m_Table[PID] != nullptr)
+  {
+    return;
+  }
+  m_Assemblers.emplace_back(new xPSI_SectionAssembler());
+  m_Assemblers.back()->Init(PID);
+  this->m_Table[PID] = m_Assemblers.back().get();
+}
+
+void xPSI_Scanner::xOnPAT(const uint8_t *Section, uint32_t Length)
+{
+  // repetitions of current table are dropped before CRC is even computed
+  if (m_PATVersion.isUnchanged(Section, Length))
+  {
+    return;
+  }
+  bool CurrentNext = xPSI_SectionLayout::CurrentNextIndicator::Get(Section) != 0;
+  if (!CurrentNext || xPSI::CRC32(Section, Length) != 0 || m_PAT.Parse(Section, Length) == NOT_VALID)
+  {
+    return;
+  }
+  m_PATVersion.Update(Section, Length);
+  if (m_Verbose)
+  {
+    m_PAT.Print();
+  }
+
+  for (const xPSI_PAT::xProgram &Entry : m_PAT.getPrograms())
+  {
+    if (Entry.ProgramNumber == 0 || (m_ProgramFilter >= 0 && Entry.ProgramNumber != m_ProgramFilter))
+    {
+      continue;
+    }
+    bool Known = false;
+    for (std::unique_ptr<xProgramInfo> &Program : m_Programs)
+    {
+      Known |= Program->PMT_PID == Entry.PID && Program->ProgramNumber == Entry.ProgramNumber;
+    }
+    if (Known)
+    {
+      continue;
+    }
+    m_Programs.emplace_back(new xProgramInfo());
+    xProgramInfo &Program = *m_Programs.back();
+    Program.ProgramNumber = Entry.ProgramNumber;
+    Program.PMT_PID = Entry.PID;
+    Program.PMT.Reset();
+    xAddSectionPID(Entry.PID);
+  }
+}
+
+void xPSI_Scanner::xOnPMT(xProgramInfo &Program, const uint8_t *Section, uint32_t Length)
+{
+  if (Program.Version.isUnchanged(Section, Length))
+  {
+    return;
+  }
+  bool CurrentNext = xPSI_SectionLayout::CurrentNextIndicator::Get(Section) != 0;
+  if (!CurrentNext || xPSI::CRC32(Section, Length) != 0 || Program.PMT.Parse(Section, Length) == NOT_VALID)
+  {
+    return;
+  }
+  Program.Version.Update(Section, Length);
+  if (m_Verbose)
+  {
+    Program.PMT.Print();
+  }
+
+  for (const xPSI_PMT::xElementaryStream &Stream : Program.PMT.getStreams())
+  {
+    if (!xPSI_PMT::isPESStreamType(Stream.StreamType) || m_Router->Lookup(Stream.PID) != nullptr)
+    {
+      continue;
+    }
+    xTS_DemuxStream *DemuxStream = m_Router->Register(Stream.PID, m_SinkFactory ? m_SinkFactory(Stream.PID, Stream.DescribedType) : nullptr);
+    if (m_StreamCallback)
+    {
+      m_StreamCallback(DemuxStream, Stream.DescribedType);
+    }
+  }
+}
+
+//=============================================================================================================================================================================
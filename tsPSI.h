@@ -0,0 +1,249 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include "tsInput.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+/*
+PSI section (long form, as used by PAT and PMT):
+`        3                   2                   1                   0  `
+`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   0 |    TableId    |S|0|RR |    SectionLength      |   TableIdExt..| `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   4 |..TableIdExt   |RR | Version |C| SectionNumber |LastSectionNumb| `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   8 |                  table data ... CRC32                         | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+
+Section is carried in TS payload, packet with payload unit start indicator begins with pointer_field - number of bytes
+that still belong to previous section.
+*/
+
+//=============================================================================================================================================================================
+
+class xPSI
+{
+public:
+  static constexpr uint32_t SectionHeaderLength = 3;    // table_id + section_length
+  static constexpr uint32_t LongSectionHeaderLength = 8; // up to last_section_number
+  static constexpr uint32_t CRCLength = 4;
+  static constexpr uint32_t MaxSectionLength = 4096 + SectionHeaderLength;
+
+  enum eTableId : uint8_t
+  {
+    eTableId_PAT = 0x00,
+    eTableId_CAT = 0x01,
+    eTableId_PMT = 0x02,
+    eTableId_Stuffing = 0xFF,
+  };
+
+  static uint32_t CRC32(const uint8_t *Data, uint32_t Length);
+};
+
+//=============================================================================================================================================================================
+
+class xPSI_SectionHandler
+{
+public:
+  virtual ~xPSI_SectionHandler() {}
+  virtual void OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length) = 0;
+};
+
+//=============================================================================================================================================================================
+
+class xPSI_SectionAssembler
+{
+protected:
+  // setup
+  uint16_t m_PID;
+  // buffer
+  uint8_t m_Buffer[xPSI::MaxSectionLength];
+  uint32_t m_DataOffset;
+  uint32_t m_SectionLength; // total length including 3 byte header, 0 when not known yet
+  // operation
+  int8_t m_LastContinuityCounter;
+  bool m_Started;
+
+public:
+  void Init(uint16_t PID);
+  int32_t AbsorbPacket(const uint8_t *Payload, uint32_t PayloadLength, const xTS_PacketHeader *PacketHeader, xPSI_SectionHandler *Handler);
+
+public:
+  uint16_t getPID() const { return m_PID; }
+
+protected:
+  uint32_t xAppend(const uint8_t *Data, uint32_t Size, xPSI_SectionHandler *Handler);
+  void xSectionReset()
+  {
+    m_DataOffset = 0;
+    m_SectionLength = 0;
+    m_Started = false;
+  }
+};
+
+//=============================================================================================================================================================================
+
+// version of last accepted section, so unchanged repetitions are rejected with a few compares
+class xPSI_TableVersion
+{
+protected:
+  bool m_Valid;
+  uint16_t m_TableIdExtension;
+  uint8_t m_VersionByte; // version + current_next_indicator
+  uint8_t m_SectionNumber;
+  uint32_t m_CRC;
+
+public:
+  xPSI_TableVersion() { Reset(); }
+  void Reset() { m_Valid = false; }
+  bool isUnchanged(const uint8_t *Section, uint32_t Length) const;
+  void Update(const uint8_t *Section, uint32_t Length);
+};
+
+//=============================================================================================================================================================================
+
+class xPSI_PAT
+{
+public:
+  struct xProgram
+  {
+    uint16_t ProgramNumber;
+    uint16_t PID; // PMT PID (network PID for program 0)
+  };
+
+protected:
+  uint16_t m_TransportStreamId;
+  uint8_t m_VersionNumber;
+  std::vector<xProgram> m_Programs;
+
+public:
+  void Reset();
+  int32_t Parse(const uint8_t *Section, uint32_t Length);
+  void Print() const;
+
+public:
+  uint16_t getTransportStreamId() const { return m_TransportStreamId; }
+  uint8_t getVersionNumber() const { return m_VersionNumber; }
+  const std::vector<xProgram> &getPrograms() const { return m_Programs; }
+};
+
+//=============================================================================================================================================================================
+
+class xPSI_PMT
+{
+public:
+  enum eStreamType : uint8_t
+  {
+    eStreamType_MPEG1_Video = 0x01,
+    eStreamType_MPEG2_Video = 0x02,
+    eStreamType_MPEG1_Audio = 0x03,
+    eStreamType_MPEG2_Audio = 0x04,
+    eStreamType_PrivateSections = 0x05,
+    eStreamType_PrivatePES = 0x06,
+    eStreamType_AAC_ADTS = 0x0F,
+    eStreamType_AAC_LATM = 0x11,
+    eStreamType_H264 = 0x1B,
+    eStreamType_H265 = 0x24,
+    eStreamType_AC3 = 0x81,
+    eStreamType_EAC3 = 0x87,
+  };
+
+  enum eDescriptorTag : uint8_t
+  {
+    eDescriptorTag_AC3 = 0x6A,
+    eDescriptorTag_EAC3 = 0x7A,
+  };
+
+  struct xElementaryStream
+  {
+    uint8_t StreamType;
+    uint16_t PID;
+    uint8_t DescribedType; // stream type implied by descriptors for private PES, StreamType otherwise
+  };
+
+protected:
+  uint16_t m_ProgramNumber;
+  uint8_t m_VersionNumber;
+  uint16_t m_PCR_PID;
+  std::vector<xElementaryStream> m_Streams;
+
+public:
+  void Reset();
+  int32_t Parse(const uint8_t *Section, uint32_t Length);
+  void Print() const;
+
+public:
+  uint16_t getProgramNumber() const { return m_ProgramNumber; }
+  uint8_t getVersionNumber() const { return m_VersionNumber; }
+  uint16_t getPCR_PID() const { return m_PCR_PID; }
+  const std::vector<xElementaryStream> &getStreams() const { return m_Streams; }
+
+  static bool isPESStreamType(uint8_t StreamType);
+  static const char *getFileExtension(uint8_t StreamType);
+};
+
+//=============================================================================================================================================================================
+
+/*
+Program scanner - follows PAT and PMTs and registers elementary streams in router as they are discovered.
+*/
+class xPSI_Scanner : public xPSI_SectionHandler
+{
+public:
+  typedef std::function<std::unique_ptr<xTS_StreamSink>(uint16_t PID, uint8_t StreamType)> tSinkFactory;
+  typedef std::function<void(xTS_DemuxStream *Stream, uint8_t StreamType)> tStreamCallback;
+
+  struct xProgramInfo
+  {
+    uint16_t ProgramNumber;
+    uint16_t PMT_PID;
+    xPSI_TableVersion Version;
+    xPSI_PMT PMT;
+  };
+
+protected:
+  // setup
+  xTS_PID_Router *m_Router;
+  int32_t m_ProgramFilter; // program number to demultiplex, -1 for all programs
+  tSinkFactory m_SinkFactory;
+  tStreamCallback m_StreamCallback; // called for every registered stream
+  bool m_Verbose;
+  // state
+  xPSI_SectionAssembler *m_Table[xTS_PID_Router::NumPIDs];
+  std::vector<std::unique_ptr<xPSI_SectionAssembler>> m_Assemblers;
+  xPSI_TableVersion m_PATVersion;
+  xPSI_PAT m_PAT;
+  std::vector<std::unique_ptr<xProgramInfo>> m_Programs;
+
+public:
+  xPSI_Scanner();
+
+  void Init(xTS_PID_Router *Router, tSinkFactory SinkFactory, int32_t ProgramFilter = -1);
+  void Reset();
+  void setVerbose(bool Verbose) { m_Verbose = Verbose; }
+  void setStreamCallback(tStreamCallback StreamCallback) { m_StreamCallback = StreamCallback; }
+
+  bool isPSIPID(uint16_t PID) const { return m_Table[PID & xTS_PID_Router::PIDMask] != nullptr; }
+  int32_t AbsorbPacket(const uint8_t *Packet, const xTS_PacketHeader *PacketHeader);
+  // follow PAT/PMT of input from its current position up to EndOffset (other packets are skipped), -1 if input ends before EndOffset
+  int32_t AbsorbInput(xTS_InputSource &Input, uint64_t EndOffset);
+
+  void OnSection(uint16_t PID, const uint8_t *Section, uint32_t Length) override;
+
+public:
+  const xPSI_PAT &getPAT() const { return m_PAT; }
+  uint32_t getNumPrograms() const { return (uint32_t)m_Programs.size(); }
+  const xProgramInfo &getProgram(uint32_t ProgramIdx) const { return *m_Programs[ProgramIdx]; }
+
+protected:
+  void xAddSectionPID(uint16_t PID);
+  void xRestartSections();
+  void xOnPAT(const uint8_t *Section, uint32_t Length);
+  void xOnPMT(xProgramInfo &Program, const uint8_t *Section, uint32_t Length);
+};
+
+//=============================================================================================================================================================================
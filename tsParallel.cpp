@@ -0,0 +1,385 @@
+#include "tsParallel.h"
+#include "tsPipeline.h"
+#include <algorithm>
+#include <thread>
+
+//=============================================================================================================================================================================
+// xTS_ParallelParser
+//=============================================================================================================================================================================
+
+xTS_ParallelParser::xTS_ParallelParser()
+{
+  this->m_NumWorkers = 1;
+  this->m_ChunkSize = DefaultChunkSize;
+  this->m_Data = nullptr;
+  this->m_Size = 0;
+  this->m_AutoDiscovery = false;
+  this->m_NumKnownStreams = 0;
+  this->m_NumPackets = 0;
+  this->m_NumDroppedBytes = 0;
+  this->m_PacketStride = xTS::TS_PacketLength;
+  m_NextChunk.store(0);
+  m_NumMerged.store(0);
+  m_Abort.store(false);
+}
+
+/**
+  @brief Configure parser
+  @param NumWorkers is number of worker threads parsing chunks (merge runs on calling thread)
+  @param ChunkSize is approximate number of input bytes per chunk (rounded to whole packets)
+*/
+void xTS_ParallelParser::Init(uint32_t NumWorkers, size_t ChunkSize)
+{
+  this->m_NumWorkers = NumWorkers > 0 ? NumWorkers : 1;
+  this->m_ChunkSize = ChunkSize > 0 ? ChunkSize : 1;
+}
+
+bool xTS_ParallelParser::getLastPCR(uint16_t PID, uint64_t &PCR) const
+{
+  PCR = m_LastPCR[PID & xTS_PID_Router::PIDMask];
+  return PCR != (uint64_t)NOT_VALID;
+}
+
+/**
+  @brief Demultiplex whole input
+  @param Data is pointer to whole input (has to stay valid until output sinks are flushed)
+  @param Size is number of input bytes
+  @param Router holds explicitly requested streams, streams discovered by Scanner are added to it
+  @param Scanner is PSI scanner for automatic discovery (nullptr when only streams registered in Router are demultiplexed)
+  @param ProgramFilter is program number given to Scanner (-1 for all programs)
+  @return 0 on success, -1 when output would differ from sequential run (nothing is guaranteed about sinks then)
+*/
+int32_t xTS_ParallelParser::Run(const uint8_t *Data, size_t Size, xTS_PID_Router &Router, xPSI_Scanner *Scanner, int32_t ProgramFilter)
+{
+  this->m_Data = Data;
+  this->m_Size = Size;
+  this->m_AutoDiscovery = Scanner != nullptr;
+  this->m_NumKnownStreams = Router.getNumStreams();
+  this->m_NumPackets = 0;
+  this->m_NumDroppedBytes = 0;
+  std::fill(m_LastPCR, m_LastPCR + xTS_PID_Router::NumPIDs, (uint64_t)NOT_VALID);
+  std::fill(m_Registered, m_Registered + xTS_PID_Router::NumPIDs, (int64_t)NOT_VALID);
+  std::fill(m_PSICandidate, m_PSICandidate + xTS_PID_Router::NumPIDs, false);
+  m_Chunks.clear();
+  if (Size == 0)
+  {
+    return 0;
+  }
+
+  const uint8_t *FirstPacket = nullptr;
+  if (xPrepass(ProgramFilter, FirstPacket) == NOT_VALID)
+  {
+    return NOT_VALID;
+  }
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    this->m_Tracked[PID] = m_AutoDiscovery ? (!m_PSICandidate[PID] && PID != (uint32_t)xTS_PacketHeader::ePID::NuLL) : Router.Lookup((uint16_t)PID) != nullptr;
+  }
+
+  // chunk borders lie on packet lattice found at the beginning, so in a clean stream every chunk starts in sync
+  const uint8_t *End = Data + Size;
+  size_t ChunkBytes = std::max<size_t>(m_ChunkSize / m_PacketStride, 1) * m_PacketStride;
+  const uint8_t *Begin = Data;
+  const uint8_t *Border = FirstPacket + ChunkBytes;
+  while (Begin < End)
+  {
+    m_Chunks.emplace_back(new xChunk());
+    xChunk &Chunk = *m_Chunks.back();
+    Chunk.Begin = Begin;
+    Chunk.End = (size_t)(End - Begin) > (size_t)(Border - Begin) ? Border : End;
+    Chunk.Done.store(false);
+    Begin = Chunk.End;
+    Border += ChunkBytes;
+  }
+
+  m_NextChunk.store(0);
+  m_NumMerged.store(0);
+  m_Abort.store(false);
+  std::vector<std::thread> Workers;
+  for (uint32_t WorkerIdx = 0; WorkerIdx < m_NumWorkers; WorkerIdx++)
+  {
+    Workers.emplace_back(&xTS_ParallelParser::xWorker, this);
+  }
+
+  int32_t Result = 0;
+  const uint8_t *ExpectedBegin = nullptr;
+  for (std::unique_ptr<xChunk> &Chunk : m_Chunks)
+  {
+    uint32_t NumSpins = 0;
+    while (!Chunk->Done.load(std::memory_order_acquire))
+    {
+      xPipelineWait(NumSpins);
+    }
+    Result = xMergeChunk(*Chunk, ExpectedBegin, Router, Scanner);
+    // merged chunk is not needed anymore
+    Chunk->PSIPackets = std::vector<const uint8_t *>();
+    Chunk->Streams = std::vector<std::unique_ptr<xStreamChunk>>();
+    Chunk->LastPCR = std::vector<uint64_t>();
+    if (Result == NOT_VALID)
+    {
+      m_Abort.store(true);
+      break;
+    }
+    m_NumMerged.fetch_add(1, std::memory_order_release);
+  }
+
+  for (std::thread &Worker : Workers)
+  {
+    Worker.join();
+  }
+  return Result;
+}
+
+// finds packet lattice and (for automatic discovery) PIDs carrying PSI
+int32_t xTS_ParallelParser::xPrepass(int32_t ProgramFilter, const uint8_t *&FirstPacket)
+{
+  xTS_MemoryReader Reader;
+  Reader.Attach(m_Data, m_AutoDiscovery ? std::min(m_Size, PrepassSize) : std::min(m_Size, (size_t)xTS_SyncScanner::LockLookahead * 4), 0);
+  xTS_PacketBatch Batch;
+  if (Reader.ReadBatch(Batch) <= 0)
+  {
+    return NOT_VALID;
+  }
+  FirstPacket = Batch.getData();
+  this->m_PacketStride = Batch.getPacketStride();
+  if (!m_AutoDiscovery)
+  {
+    return 0;
+  }
+
+  std::unique_ptr<xTS_PID_Router> Router(new xTS_PID_Router());
+  std::unique_ptr<xPSI_Scanner> Scanner(new xPSI_Scanner());
+  Scanner->Init(Router.get(), nullptr, ProgramFilter);
+  Scanner->setVerbose(false);
+  xTS_PacketHeader PacketHeader;
+  do
+  {
+    for (uint32_t PacketIdx = 0; PacketIdx < Batch.getNumPackets(); PacketIdx++)
+    {
+      PacketHeader.Parse(Batch.getPacket(PacketIdx));
+      if (Scanner->isPSIPID(PacketHeader.getPID()))
+      {
+        Scanner->AbsorbPacket(Batch.getPacket(PacketIdx), &PacketHeader);
+      }
+    }
+  } while (Reader.ReadBatch(Batch) > 0);
+
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    this->m_PSICandidate[PID] = Scanner->isPSIPID((uint16_t)PID);
+  }
+  return 0;
+}
+
+void xTS_ParallelParser::xWorker()
+{
+  // chunks are merged in order - do not run too far ahead of merge, so memory held by parsed chunks stays bounded
+  const uint32_t MaxChunksAhead = 2 * m_NumWorkers;
+  while (!m_Abort.load(std::memory_order_relaxed))
+  {
+    uint32_t ChunkIdx = m_NextChunk.fetch_add(1);
+    if (ChunkIdx >= m_Chunks.size())
+    {
+      return;
+    }
+    uint32_t NumSpins = 0;
+    while (ChunkIdx >= m_NumMerged.load(std::memory_order_acquire) + MaxChunksAhead && !m_Abort.load(std::memory_order_relaxed))
+    {
+      xPipelineWait(NumSpins);
+    }
+    xParseChunk(*m_Chunks[ChunkIdx]);
+    m_Chunks[ChunkIdx]->Done.store(true, std::memory_order_release);
+  }
+}
+
+void xTS_ParallelParser::xParseChunk(xChunk &Chunk)
+{
+  Chunk.FirstPacket = nullptr;
+  Chunk.EndOfLastPacket = nullptr;
+  Chunk.NumPackets = 0;
+  Chunk.Streams.resize(xTS_PID_Router::NumPIDs);
+  Chunk.LastPCR.assign(xTS_PID_Router::NumPIDs, (uint64_t)NOT_VALID);
+
+  xTS_MemoryReader Reader;
+  Reader.Attach(Chunk.Begin, (size_t)(m_Data + m_Size - Chunk.Begin), (uint64_t)(Chunk.Begin - m_Data));
+  xTS_PacketBatch Batch;
+  xTS_PacketHeaderBatch PacketHeaderBatch;
+  xTS_PacketHeader PacketHeader;
+  xTS_AdaptationField AdaptationField;
+
+  bool ChunkEnd = false;
+  while (!ChunkEnd && Reader.ReadBatch(Batch) > 0)
+  {
+    for (uint32_t PacketIdx = 0; PacketIdx < Batch.getNumPackets(); PacketIdx++)
+    {
+      const uint8_t *Packet = Batch.getPacket(PacketIdx);
+      if (Packet >= Chunk.End)
+      {
+        ChunkEnd = true;
+        break;
+      }
+      if (Chunk.FirstPacket == nullptr)
+      {
+        Chunk.FirstPacket = Packet;
+      }
+      Chunk.EndOfLastPacket = Packet + Batch.getPacketStride();
+      Chunk.NumPackets++;
+
+      uint32_t GroupIdx = PacketIdx % xTS_PacketHeaderBatch::MaxPackets;
+      if (GroupIdx == 0)
+      {
+        PacketHeaderBatch.Parse(Packet, Batch.getNumPackets() - PacketIdx, Batch.getPacketStride());
+      }
+      PacketHeader.Load(PacketHeaderBatch, GroupIdx);
+      uint16_t PID = PacketHeader.getPID();
+
+      if (m_PSICandidate[PID])
+      {
+        Chunk.PSIPackets.push_back(Packet);
+      }
+      if (PacketHeader.getSyncByte() != xTS_SyncScanner::SyncByte)
+      {
+        continue;
+      }
+
+      int32_t Offset = AdaptationField.ParsePacket(Packet, PacketHeader.getAdaptationFieldControl());
+      if (PacketHeader.hasAdaptationField() && AdaptationField.getPCRFlag())
+      {
+        Chunk.LastPCR[PID] = AdaptationField.getProgramClockReference();
+      }
+      if (!m_Tracked[PID])
+      {
+        continue;
+      }
+
+      std::unique_ptr<xStreamChunk> &Stream = Chunk.Streams[PID];
+      if (!Stream)
+      {
+        Stream.reset(new xStreamChunk());
+        Stream->SeenStart = false;
+        Stream->Assembler.Init(PID);
+      }
+      if (!PacketHeader.getStart() && !Stream->SeenStart)
+      {
+        Stream->Prefix.push_back(Packet); // result depends on previous chunk
+        continue;
+      }
+      if (PacketHeader.getStart())
+      {
+        Stream->SeenStart = true;
+        Stream->Units.push_back({Packet, (uint32_t)Stream->Slices.size()});
+      }
+
+      xPES_Assembler::eResult Result = Stream->Assembler.AbsorbPacket(Packet + Offset, &PacketHeader, &AdaptationField);
+      bool Accepted = Result == xPES_Assembler::eResult::AssemblingStarted || Result == xPES_Assembler::eResult::AssemblingContinue || Result == xPES_Assembler::eResult::AssemblingFinished;
+      if (Accepted && Offset < (int32_t)xTS::TS_PacketLength)
+      {
+        Stream->Slices.push_back({Packet + Offset, (size_t)(uint32_t)(xTS::TS_PacketLength - Offset)});
+      }
+    }
+  }
+  Chunk.NumDroppedBytes = Reader.getSyncScanner().getNumDroppedBytes();
+}
+
+int32_t xTS_ParallelParser::xMergeChunk(xChunk &Chunk, const uint8_t *&ExpectedBegin, xTS_PID_Router &Router, xPSI_Scanner *Scanner)
+{
+  if (Chunk.NumPackets != 0)
+  {
+    if (ExpectedBegin != nullptr && Chunk.FirstPacket != ExpectedBegin)
+    {
+      return NOT_VALID; // framing changed near chunk border
+    }
+    ExpectedBegin = Chunk.EndOfLastPacket;
+  }
+  this->m_NumPackets += Chunk.NumPackets;
+  this->m_NumDroppedBytes += Chunk.NumDroppedBytes;
+
+  xTS_PacketHeader PacketHeader;
+  xTS_AdaptationField AdaptationField;
+
+  // streams are registered at the same packet as in sequential run
+  if (Scanner != nullptr)
+  {
+    for (const uint8_t *Packet : Chunk.PSIPackets)
+    {
+      PacketHeader.Parse(Packet);
+      Scanner->AbsorbPacket(Packet, &PacketHeader);
+      for (; m_NumKnownStreams < Router.getNumStreams(); m_NumKnownStreams++)
+      {
+        uint16_t PID = Router.getStream(m_NumKnownStreams)->getPID();
+        if (!m_Tracked[PID])
+        {
+          return NOT_VALID;
+        }
+        this->m_Registered[PID] = (int64_t)(Packet - m_Data);
+      }
+    }
+    for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+    {
+      if (Scanner->isPSIPID((uint16_t)PID) && !m_PSICandidate[PID])
+      {
+        return NOT_VALID; // PSI moved to PID that was not collected by workers
+      }
+    }
+  }
+
+  for (uint32_t StreamIdx = 0; StreamIdx < Router.getNumStreams(); StreamIdx++)
+  {
+    xTS_DemuxStream *Stream = Router.getStream(StreamIdx);
+    const xStreamChunk *StreamChunk = Chunk.Streams[Stream->getPID()].get();
+    if (StreamChunk == nullptr)
+    {
+      continue;
+    }
+    const int64_t Registered = m_Registered[Stream->getPID()];
+
+    // packets preceding first unit start continue PES packet from previous chunk
+    for (const uint8_t *Packet : StreamChunk->Prefix)
+    {
+      if ((int64_t)(Packet - m_Data) <= Registered)
+      {
+        continue;
+      }
+      PacketHeader.Parse(Packet);
+      int32_t Offset = AdaptationField.ParsePacket(Packet, PacketHeader.getAdaptationFieldControl());
+      Stream->AbsorbPacket(Packet + Offset, xTS::TS_PacketLength - Offset, &PacketHeader, &AdaptationField);
+    }
+
+    // PES units do not depend on anything before them
+    std::vector<xUnit>::const_iterator Unit = std::find_if(StreamChunk->Units.begin(), StreamChunk->Units.end(), [this, Registered](const xUnit &U) { return (int64_t)(U.Packet - m_Data) > Registered; });
+    if (Unit == StreamChunk->Units.end())
+    {
+      continue;
+    }
+    // worker could not check first unit start against previous chunk - repeated packet is dropped as in sequential run
+    size_t FirstSlice = Unit->FirstSlice;
+    if (Unit == StreamChunk->Units.begin())
+    {
+      PacketHeader.Parse(Unit->Packet);
+      int32_t Offset = AdaptationField.ParsePacket(Unit->Packet, PacketHeader.getAdaptationFieldControl());
+      if (Offset < (int32_t)xTS::TS_PacketLength && Stream->getAssembler().isRepeatedPacket(&PacketHeader, &AdaptationField))
+      {
+        FirstSlice++;
+      }
+    }
+    if (Stream->getSink() != nullptr)
+    {
+      for (size_t SliceIdx = FirstSlice; SliceIdx < StreamChunk->Slices.size(); SliceIdx++)
+      {
+        Stream->getSink()->Write(StreamChunk->Slices[SliceIdx].Data, (uint32_t)StreamChunk->Slices[SliceIdx].Size);
+      }
+    }
+    Stream->getAssembler().setSeamState(StreamChunk->Assembler.getSeamState());
+  }
+
+  for (uint32_t PID = 0; PID < xTS_PID_Router::NumPIDs; PID++)
+  {
+    if (Chunk.LastPCR[PID] != (uint64_t)NOT_VALID)
+    {
+      this->m_LastPCR[PID] = Chunk.LastPCR[PID];
+    }
+  }
+  return 0;
+}
+
+//=============================================================================================================================================================================
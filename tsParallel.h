@@ -0,0 +1,111 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include "tsPSI.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*
+Parallel chunked parser (whole input must be in memory, i.e. mapped file):
+  Input is split into packet aligned chunks which are demultiplexed concurrently by worker threads. Since PES assembling
+  starts over at every payload unit start, only packets of a PID preceding its first unit start in a chunk depend on
+  previous chunks. Workers keep those packets aside (prefix) and for everything else record output slices (pointing
+  into input) split per PES unit together with assembler state at chunk end.
+  Merge runs on calling thread, chunk after chunk in stream order:
+    - PSI packets are replayed through the real scanner, so streams are registered at the same packet as in sequential run
+    - prefix packets are replayed through stream's assembler, which continues from state left by previous chunk
+      (continuity counter, partially assembled PES packet)
+    - output slices of PES units starting after stream registration are written, assembler takes over chunk end state
+    - last PCR of every PID is carried over chunks
+  When seam cannot be reproduced exactly (framing changes at chunk border, PAT points to PID not known in advance), Run()
+  fails and caller is expected to parse sequentially.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_ParallelParser
+{
+public:
+  static constexpr size_t DefaultChunkSize = 64 * 1024 * 1024; // bytes
+  static constexpr size_t PrepassSize = 4 * 1024 * 1024;       // bytes scanned for PAT before chunks are started
+
+protected:
+  struct xUnit
+  {
+    const uint8_t *Packet; // packet with payload unit start
+    uint32_t FirstSlice;
+  };
+
+  struct xStreamChunk
+  {
+    bool SeenStart;
+    std::vector<const uint8_t *> Prefix; // packets before first payload unit start
+    std::vector<xUnit> Units;
+    std::vector<xTS_FileSink::xSlice> Slices;
+    xPES_Assembler Assembler;
+  };
+
+  struct xChunk
+  {
+    // range
+    const uint8_t *Begin;
+    const uint8_t *End; // packets starting at or after End belong to next chunk
+    // result
+    const uint8_t *FirstPacket;
+    const uint8_t *EndOfLastPacket;
+    uint64_t NumPackets;
+    uint64_t NumDroppedBytes;
+    std::vector<const uint8_t *> PSIPackets;
+    std::vector<std::unique_ptr<xStreamChunk>> Streams; // indexed by PID
+    std::vector<uint64_t> LastPCR;                      // indexed by PID, NOT_VALID when chunk has no PCR of PID
+    std::atomic<bool> Done;
+  };
+
+  // setup
+  uint32_t m_NumWorkers;
+  size_t m_ChunkSize;
+  // input
+  const uint8_t *m_Data;
+  size_t m_Size;
+  bool m_AutoDiscovery;
+  bool m_Tracked[xTS_PID_Router::NumPIDs];
+  bool m_PSICandidate[xTS_PID_Router::NumPIDs];
+  // chunks
+  std::vector<std::unique_ptr<xChunk>> m_Chunks;
+  std::atomic<uint32_t> m_NextChunk;
+  std::atomic<uint32_t> m_NumMerged;
+  std::atomic<bool> m_Abort;
+  // merge state
+  uint64_t m_LastPCR[xTS_PID_Router::NumPIDs];
+  int64_t m_Registered[xTS_PID_Router::NumPIDs]; // offset of packet at which stream was registered (NOT_VALID for explicit streams)
+  uint32_t m_NumKnownStreams;
+  // statistics
+  uint64_t m_NumPackets;
+  uint64_t m_NumDroppedBytes;
+  uint32_t m_PacketStride;
+
+public:
+  xTS_ParallelParser();
+
+  void Init(uint32_t NumWorkers, size_t ChunkSize = DefaultChunkSize);
+  int32_t Run(const uint8_t *Data, size_t Size, xTS_PID_Router &Router, xPSI_Scanner *Scanner, int32_t ProgramFilter = -1);
+
+public:
+  uint32_t getNumWorkers() const { return m_NumWorkers; }
+  uint32_t getNumChunks() const { return (uint32_t)m_Chunks.size(); }
+  uint64_t getNumPackets() const { return m_NumPackets; }
+  uint64_t getNumDroppedBytes() const { return m_NumDroppedBytes; }
+  uint32_t getPacketStride() const { return m_PacketStride; }
+  bool getLastPCR(uint16_t PID, uint64_t &PCR) const;
+
+protected:
+  int32_t xPrepass(int32_t ProgramFilter, const uint8_t *&FirstPacket);
+  void xWorker();
+  void xParseChunk(xChunk &Chunk);
+  int32_t xMergeChunk(xChunk &Chunk, const uint8_t *&ExpectedBegin, xTS_PID_Router &Router, xPSI_Scanner *Scanner);
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,384 @@
+#include "tsPipeline.h"
+#include <chrono>
+#include <cstring>
+
+//=============================================================================================================================================================================
+
+void xPipelineWait(uint32_t &NumSpins)
+{
+  static constexpr uint32_t NumBusySpins = 64;
+  static constexpr uint32_t NumYields = 1024;
+
+  if (NumSpins < NumBusySpins)
+  {
+#if X_SIMD_X86
+    _mm_pause();
+#endif
+  }
+  else if (NumSpins < NumYields)
+  {
+    std::this_thread::yield();
+  }
+  else
+  {
+    // stage is starved for long time (e.g. waiting for disk) - do not burn core other stages may need
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  NumSpins++;
+}
+
+//=============================================================================================================================================================================
+// xTS_WriterThread
+//=============================================================================================================================================================================
+
+xTS_WriterThread::xTS_WriterThread(uint32_t MaxChunks, size_t ChunkSize)
+{
+  this->m_MaxChunks = MaxChunks > 0 ? MaxChunks : 1;
+  this->m_ChunkSize = ChunkSize > 0 ? ChunkSize : 1;
+  this->m_NumStalls = 0;
+  // every chunk is in one of queues or held by producer, so pushes never have to wait
+  m_Filled.Init(m_MaxChunks);
+  m_Free.Init(m_MaxChunks);
+}
+
+void xTS_WriterThread::Start()
+{
+  if (!m_Thread.joinable())
+  {
+    m_Thread = std::thread(&xTS_WriterThread::xRun, this);
+  }
+}
+
+void xTS_WriterThread::Stop()
+{
+  if (!m_Thread.joinable())
+  {
+    return;
+  }
+  xTS_OutputChunk *Chunk = AcquireChunk(nullptr);
+  Chunk->m_Stop = true;
+  Submit(Chunk);
+  m_Thread.join();
+}
+
+/**
+  @brief Get empty chunk, waits for writer when all chunks are in flight
+  @param Sink is destination the chunk will be written to
+  @return Cleared chunk
+*/
+xTS_OutputChunk *xTS_WriterThread::AcquireChunk(xTS_StreamSink *Sink)
+{
+  xTS_OutputChunk *Chunk = nullptr;
+  if (!m_Free.TryPop(Chunk))
+  {
+    if (m_Chunks.size() < m_MaxChunks)
+    {
+      m_Chunks.emplace_back(new xTS_OutputChunk());
+      Chunk = m_Chunks.back().get();
+    }
+    else
+    {
+      m_Free.Pop(Chunk);
+      this->m_NumStalls++;
+    }
+  }
+  Chunk->Clear();
+  Chunk->m_Sink = Sink;
+  return Chunk;
+}
+
+void xTS_WriterThread::Submit(xTS_OutputChunk *Chunk)
+{
+  m_Filled.Push(Chunk);
+}
+
+void xTS_WriterThread::xRun()
+{
+  while (true)
+  {
+    xTS_OutputChunk *Chunk = nullptr;
+    m_Filled.Pop(Chunk);
+    if (Chunk->m_Stop)
+    {
+      m_Free.Push(Chunk);
+      return;
+    }
+
+    if (!Chunk->m_Slices.empty())
+    {
+      for (const xTS_FileSink::xSlice &Slice : Chunk->m_Slices)
+      {
+        Chunk->m_Sink->Write(Slice.Data, (uint32_t)Slice.Size);
+      }
+    }
+    else if (Chunk->m_Size > 0)
+    {
+      Chunk->m_Sink->Write(Chunk->m_Data.get(), (uint32_t)Chunk->m_Size);
+    }
+    // copied payload must reach the file before chunk is reused
+    if (Chunk->m_Flush || (Chunk->m_Size > 0 && Chunk->m_Slices.empty()))
+    {
+      Chunk->m_Sink->Flush();
+    }
+    m_Free.Push(Chunk);
+  }
+}
+
+//=============================================================================================================================================================================
+// xTS_QueuedSink
+//=============================================================================================================================================================================
+
+xTS_QueuedSink::xTS_QueuedSink(std::unique_ptr<xTS_StreamSink> Sink, xTS_WriterThread *Writer, bool ReferenceInput)
+{
+  this->m_Sink = std::move(Sink);
+  this->m_Writer = Writer;
+  this->m_ReferenceInput = ReferenceInput;
+  this->m_Chunk = nullptr;
+}
+
+xTS_QueuedSink::~xTS_QueuedSink()
+{
+  // pending chunk stays owned by writer - Flush() has to be called while writer is running
+  this->m_Chunk = nullptr;
+}
+
+int32_t xTS_QueuedSink::Write(const uint8_t *Data, uint32_t Size)
+{
+  const size_t ChunkSize = m_Writer->getChunkSize();
+
+  if (m_ReferenceInput)
+  {
+    if (m_Chunk == nullptr)
+    {
+      this->m_Chunk = m_Writer->AcquireChunk(m_Sink.get());
+    }
+    std::vector<xTS_FileSink::xSlice> &Slices = m_Chunk->m_Slices;
+    if (!Slices.empty() && Slices.back().Data + Slices.back().Size == Data)
+    {
+      Slices.back().Size += Size; // continues previous slice
+    }
+    else
+    {
+      Slices.push_back({Data, Size});
+    }
+    m_Chunk->m_Size += Size;
+    if (m_Chunk->m_Size >= ChunkSize || Slices.size() >= xTS_FileSink::MaxSlices)
+    {
+      xSubmit(false);
+    }
+    return (int32_t)Size;
+  }
+
+  uint32_t Remaining = Size;
+  while (Remaining > 0)
+  {
+    if (m_Chunk == nullptr)
+    {
+      this->m_Chunk = m_Writer->AcquireChunk(m_Sink.get());
+      if (!m_Chunk->m_Data)
+      {
+        m_Chunk->m_Data.reset(new uint8_t[ChunkSize]);
+      }
+    }
+    size_t NumCopy = ChunkSize - m_Chunk->m_Size;
+    if (NumCopy > Remaining)
+    {
+      NumCopy = Remaining;
+    }
+    std::memcpy(m_Chunk->m_Data.get() + m_Chunk->m_Size, Data, NumCopy);
+    m_Chunk->m_Size += NumCopy;
+    Data += NumCopy;
+    Remaining -= (uint32_t)NumCopy;
+    if (m_Chunk->m_Size == ChunkSize)
+    {
+      xSubmit(false);
+    }
+  }
+  return (int32_t)Size;
+}
+
+void xTS_QueuedSink::Flush()
+{
+  if (m_Chunk == nullptr)
+  {
+    this->m_Chunk = m_Writer->AcquireChunk(m_Sink.get());
+  }
+  xSubmit(true);
+}
+
+void xTS_QueuedSink::xSubmit(bool Flush)
+{
+  m_Chunk->m_Flush = Flush;
+  m_Writer->Submit(m_Chunk);
+  this->m_Chunk = nullptr;
+}
+
+//=============================================================================================================================================================================
+// xTS_Pipeline
+//=============================================================================================================================================================================
+
+xTS_Pipeline::xTS_Pipeline()
+{
+  this->m_NumThreads = 1;
+  this->m_QueueDepth = DefaultQueueDepth;
+  this->m_ChunkSize = xTS_FileSink::DefaultFlushThreshold;
+  this->m_BlockSize = 0;
+  this->m_NextWriter = 0;
+  this->m_NumReaderStalls = 0;
+  this->m_NumParserStalls = 0;
+}
+
+/**
+  @brief Configure stages and start writer threads
+  @param NumThreads is total number of threads: 1 - everything on calling thread, 2 - separate reader,
+         3 and more - separate reader and NumThreads-2 writers (streams are assigned round robin)
+  @param ChunkSize is number of output bytes handed to writer at once
+  @param QueueDepth is number of batches that reader may run ahead of parser
+*/
+void xTS_Pipeline::Init(uint32_t NumThreads, size_t ChunkSize, uint32_t QueueDepth)
+{
+  StopWriters();
+  m_Writers.clear();
+  this->m_NumThreads = NumThreads > 0 ? NumThreads : 1;
+  this->m_ChunkSize = ChunkSize > 0 ? ChunkSize : 1;
+  this->m_QueueDepth = QueueDepth > 0 ? QueueDepth : 1;
+  this->m_NextWriter = 0;
+
+  for (uint32_t WriterIdx = 2; WriterIdx < m_NumThreads; WriterIdx++)
+  {
+    m_Writers.emplace_back(new xTS_WriterThread(DefaultWriterChunks, m_ChunkSize));
+    m_Writers.back()->Start();
+  }
+}
+
+/**
+  @brief Route output of one stream through writer thread
+  @param Sink is real output, written on writer thread from now on
+  @param ReferenceInput tells that written payload stays valid until end of run, so only slices are queued
+  @return Sink to be registered in router (Sink itself when there are no writer threads)
+*/
+std::unique_ptr<xTS_StreamSink> xTS_Pipeline::WrapSink(std::unique_ptr<xTS_StreamSink> Sink, bool ReferenceInput)
+{
+  if (m_Writers.empty() || !Sink)
+  {
+    return Sink;
+  }
+  xTS_WriterThread *Writer = m_Writers[m_NextWriter].get();
+  this->m_NextWriter = (m_NextWriter + 1) % (uint32_t)m_Writers.size();
+  return std::unique_ptr<xTS_StreamSink>(new xTS_QueuedSink(std::move(Sink), Writer, ReferenceInput));
+}
+
+void xTS_Pipeline::StopWriters()
+{
+  for (std::unique_ptr<xTS_WriterThread> &Writer : m_Writers)
+  {
+    Writer->Stop();
+  }
+}
+
+uint64_t xTS_Pipeline::getNumWriterStalls() const
+{
+  uint64_t NumStalls = 0;
+  for (const std::unique_ptr<xTS_WriterThread> &Writer : m_Writers)
+  {
+    NumStalls += Writer->getNumStalls();
+  }
+  return NumStalls;
+}
+
+/**
+  @brief Read whole input and pass every batch to Handler on calling thread
+  @param Input is opened input source, it is used only by reader thread until Run() returns
+  @param Handler is parse/demux stage
+*/
+void xTS_Pipeline::Run(xTS_InputSource &Input, const tBatchHandler &Handler)
+{
+  xTS_PacketBatch Batch;
+  if (m_NumThreads < 2)
+  {
+    while (Input.ReadBatch(Batch) > 0)
+    {
+      Handler(Batch);
+    }
+    return;
+  }
+
+  m_Filled.Init(m_QueueDepth + 1); // + end of stream marker
+  m_Free.Init(m_QueueDepth);
+  m_Blocks.clear();
+  if (!Input.hasStableBuffers())
+  {
+    this->m_BlockSize = (size_t)Input.getBatchSize() * xTS_SyncScanner::PacketLength_RS;
+    for (uint32_t BlockIdx = 0; BlockIdx < m_QueueDepth; BlockIdx++)
+    {
+      m_Blocks.emplace_back(new uint8_t[m_BlockSize]);
+      m_Free.Push((int32_t)BlockIdx);
+    }
+  }
+
+  std::thread Reader(&xTS_Pipeline::xReader, this, std::ref(Input));
+  while (true)
+  {
+    xBatchItem Item;
+    if (m_Filled.Pop(Item))
+    {
+      this->m_NumParserStalls++;
+    }
+    if (Item.Batch.getNumPackets() == 0)
+    {
+      break;
+    }
+    Handler(Item.Batch);
+    if (Item.BlockIdx != NOT_VALID)
+    {
+      m_Free.Push(Item.BlockIdx);
+    }
+  }
+  Reader.join();
+}
+
+void xTS_Pipeline::xReader(xTS_InputSource &Input)
+{
+  static constexpr size_t PageSize = 4096;
+
+  const bool StableBuffers = Input.hasStableBuffers();
+  xTS_PacketBatch Batch;
+  while (Input.ReadBatch(Batch) > 0)
+  {
+    xBatchItem Item;
+    size_t NumBytes = (size_t)(Batch.getNumPackets() - 1) * Batch.getPacketStride() + xTS::TS_PacketLength;
+    if (StableBuffers)
+    {
+      // fault mapped pages in here, so parser does not stall on disk
+      const volatile uint8_t *Data = Batch.getData();
+      for (size_t Offset = 0; Offset < NumBytes; Offset += PageSize)
+      {
+        (void)Data[Offset];
+      }
+      Item.Batch = Batch;
+      Item.BlockIdx = NOT_VALID;
+    }
+    else
+    {
+      int32_t BlockIdx = NOT_VALID;
+      if (m_Free.Pop(BlockIdx))
+      {
+        this->m_NumReaderStalls++;
+      }
+      std::memcpy(m_Blocks[BlockIdx].get(), Batch.getData(), NumBytes);
+      Item.Batch.Set(m_Blocks[BlockIdx].get(), Batch.getNumPackets(), Batch.getPacketStride(), Batch.getStreamOffset());
+      Item.BlockIdx = BlockIdx;
+    }
+    if (m_Filled.Push(Item))
+    {
+      this->m_NumReaderStalls++;
+    }
+  }
+
+  xBatchItem EndItem;
+  EndItem.Batch.Reset();
+  EndItem.BlockIdx = NOT_VALID;
+  m_Filled.Push(EndItem);
+}
+
+//=============================================================================================================================================================================
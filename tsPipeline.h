@@ -0,0 +1,240 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsInput.h"
+#include "tsDemux.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+Pipelined processing:
+  reader thread  --[filled batches]-->  parse/demux (calling thread)  --[output chunks]-->  writer thread(s)
+                 <--[free blocks]----                                  <--[free chunks]---
+
+  Stages are connected by bounded single-producer/single-consumer rings. Buffers circulate between two stages in a
+  closed loop (filled ring forward, free ring back), so a stage that runs ahead simply waits for a free buffer -
+  memory stays bounded and the slowest stage sets the pace (backpressure).
+
+  Batches of mapped input are passed by pointer (reader only touches pages ahead of parser), batches of block input
+  are copied into pipeline owned blocks, because block reader reuses its buffer on next ReadBatch().
+  Output of each stream is collected by xTS_QueuedSink in chunks which are written to the real sink on writer thread.
+*/
+
+//=============================================================================================================================================================================
+
+// blocks calling thread while queue is empty/full - spins briefly, then yields core to other stages
+void xPipelineWait(uint32_t &NumSpins);
+
+template <typename T>
+class xSPSC_Queue
+{
+protected:
+  std::unique_ptr<T[]> m_Items;
+  uint32_t m_Capacity;
+  uint32_t m_Mask;
+  alignas(64) std::atomic<uint32_t> m_Head; // next item to pop, written by consumer only
+  alignas(64) std::atomic<uint32_t> m_Tail; // next slot to push, written by producer only
+
+public:
+  xSPSC_Queue() { Init(2); }
+
+  // capacity is rounded up to power of two, must not be called while queue is in use
+  void Init(uint32_t Capacity)
+  {
+    uint32_t RoundedCapacity = 2;
+    while (RoundedCapacity < Capacity)
+    {
+      RoundedCapacity <<= 1;
+    }
+    m_Items.reset(new T[RoundedCapacity]);
+    m_Capacity = RoundedCapacity;
+    m_Mask = RoundedCapacity - 1;
+    m_Head.store(0, std::memory_order_relaxed);
+    m_Tail.store(0, std::memory_order_relaxed);
+  }
+
+  bool TryPush(const T &Item)
+  {
+    uint32_t Tail = m_Tail.load(std::memory_order_relaxed);
+    if (Tail - m_Head.load(std::memory_order_acquire) == m_Capacity)
+    {
+      return false;
+    }
+    m_Items[Tail & m_Mask] = Item;
+    m_Tail.store(Tail + 1, std::memory_order_release);
+    return true;
+  }
+  bool TryPop(T &Item)
+  {
+    uint32_t Head = m_Head.load(std::memory_order_relaxed);
+    if (Head == m_Tail.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+    Item = m_Items[Head & m_Mask];
+    m_Head.store(Head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // blocking variants, return true when caller had to wait
+  bool Push(const T &Item)
+  {
+    uint32_t NumSpins = 0;
+    while (!TryPush(Item))
+    {
+      xPipelineWait(NumSpins);
+    }
+    return NumSpins != 0;
+  }
+  bool Pop(T &Item)
+  {
+    uint32_t NumSpins = 0;
+    while (!TryPop(Item))
+    {
+      xPipelineWait(NumSpins);
+    }
+    return NumSpins != 0;
+  }
+
+public:
+  uint32_t getCapacity() const { return m_Capacity; }
+};
+
+//=============================================================================================================================================================================
+
+class xTS_OutputChunk
+{
+public:
+  xTS_StreamSink *m_Sink;                    // destination, owned by xTS_QueuedSink
+  std::vector<xTS_FileSink::xSlice> m_Slices; // referenced input memory (stable input)
+  std::unique_ptr<uint8_t[]> m_Data;          // copied payload (unstable input)
+  size_t m_Size;
+  bool m_Flush;                               // flush destination after this chunk
+  bool m_Stop;                                // terminates writer thread
+
+public:
+  void Clear()
+  {
+    m_Slices.clear();
+    m_Size = 0;
+    m_Flush = false;
+    m_Stop = false;
+  }
+};
+
+//=============================================================================================================================================================================
+
+class xTS_WriterThread
+{
+protected:
+  xSPSC_Queue<xTS_OutputChunk *> m_Filled;
+  xSPSC_Queue<xTS_OutputChunk *> m_Free;
+  std::vector<std::unique_ptr<xTS_OutputChunk>> m_Chunks;
+  uint32_t m_MaxChunks;
+  size_t m_ChunkSize;
+  std::thread m_Thread;
+  // statistics (producer side)
+  uint64_t m_NumStalls;
+
+public:
+  xTS_WriterThread(uint32_t MaxChunks, size_t ChunkSize);
+  ~xTS_WriterThread() { Stop(); }
+
+  void Start();
+  void Stop();
+
+  xTS_OutputChunk *AcquireChunk(xTS_StreamSink *Sink);
+  void Submit(xTS_OutputChunk *Chunk);
+
+public:
+  size_t getChunkSize() const { return m_ChunkSize; }
+  uint64_t getNumStalls() const { return m_NumStalls; }
+
+protected:
+  void xRun();
+};
+
+//=============================================================================================================================================================================
+
+/*
+Parser side proxy of a sink served by writer thread - owns the real sink, so it is released only after writer has
+been stopped.
+*/
+class xTS_QueuedSink : public xTS_StreamSink
+{
+protected:
+  std::unique_ptr<xTS_StreamSink> m_Sink;
+  xTS_WriterThread *m_Writer;
+  bool m_ReferenceInput;
+  xTS_OutputChunk *m_Chunk;
+
+public:
+  xTS_QueuedSink(std::unique_ptr<xTS_StreamSink> Sink, xTS_WriterThread *Writer, bool ReferenceInput);
+  ~xTS_QueuedSink() override;
+
+  int32_t Write(const uint8_t *Data, uint32_t Size) override;
+  void Flush() override;
+
+public:
+  xTS_StreamSink *getSink() { return m_Sink.get(); }
+
+protected:
+  void xSubmit(bool Flush);
+};
+
+//=============================================================================================================================================================================
+
+class xTS_Pipeline
+{
+public:
+  static constexpr uint32_t DefaultQueueDepth = 64; // batches in flight between reader and parser
+  static constexpr uint32_t DefaultWriterChunks = 8; // chunks in flight per writer thread
+
+  typedef std::function<void(const xTS_PacketBatch &Batch)> tBatchHandler;
+
+protected:
+  struct xBatchItem
+  {
+    xTS_PacketBatch Batch;
+    int32_t BlockIdx; // pipeline owned copy, NOT_VALID when batch points into stable input
+  };
+
+  // setup
+  uint32_t m_NumThreads;
+  uint32_t m_QueueDepth;
+  size_t m_ChunkSize;
+  // reader -> parser
+  xSPSC_Queue<xBatchItem> m_Filled;
+  xSPSC_Queue<int32_t> m_Free;
+  std::vector<std::unique_ptr<uint8_t[]>> m_Blocks;
+  size_t m_BlockSize;
+  // parser -> writers
+  std::vector<std::unique_ptr<xTS_WriterThread>> m_Writers;
+  uint32_t m_NextWriter;
+  // statistics
+  uint64_t m_NumReaderStalls; // reader waited for free block or free slot
+  uint64_t m_NumParserStalls; // parser waited for filled batch
+
+public:
+  xTS_Pipeline();
+  ~xTS_Pipeline() { StopWriters(); }
+
+  void Init(uint32_t NumThreads, size_t ChunkSize, uint32_t QueueDepth = DefaultQueueDepth);
+  std::unique_ptr<xTS_StreamSink> WrapSink(std::unique_ptr<xTS_StreamSink> Sink, bool ReferenceInput);
+  void Run(xTS_InputSource &Input, const tBatchHandler &Handler);
+  void StopWriters();
+
+public:
+  uint32_t getNumThreads() const { return m_NumThreads; }
+  uint32_t getNumWriters() const { return (uint32_t)m_Writers.size(); }
+  uint64_t getNumReaderStalls() const { return m_NumReaderStalls; }
+  uint64_t getNumParserStalls() const { return m_NumParserStalls; }
+  uint64_t getNumWriterStalls() const;
+
+protected:
+  void xReader(xTS_InputSource &Input);
+};
+
+//=============================================================================================================================================================================
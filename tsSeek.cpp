@@ -0,0 +1,248 @@
+#include "tsSeek.h"
+#include "tsFields.h"
+#include "tsSyncScanner.h"
+#include <algorithm>
+#include <cstdlib>
+
+//=============================================================================================================================================================================
+// xTS_SeekEngine
+//=============================================================================================================================================================================
+
+xTS_SeekEngine::xTS_SeekEngine()
+{
+  this->m_Data = nullptr;
+  this->m_Size = 0;
+  this->m_PacketStride = xTS::TS_PacketLength;
+  this->m_PCR_PID = 0;
+  this->m_FirstPCR = 0;
+  this->m_First = {0, 0};
+  this->m_Last = {0, 0};
+  this->m_NumProbes = 0;
+  this->m_Landing = {0, 0};
+}
+
+/**
+  @brief Prepare seeking in input
+  @param Data is pointer to whole input (e.g. mapped file), it has to stay valid while engine is used
+  @param Size is input size in bytes
+  @param PCR_PID is PID carrying PCR, -1 to use PID of first packet with PCR
+  @return 0 on success, -1 when input has no PCR
+*/
+int32_t xTS_SeekEngine::Init(const uint8_t *Data, uint64_t Size, int32_t PCR_PID)
+{
+  this->m_Data = Data;
+  this->m_Size = Size;
+  this->m_NumProbes = 0;
+
+  xTS_SyncScanner SyncScanner;
+  SyncScanner.Lock(Data, (size_t)Size, true);
+  if (!SyncScanner.isLocked())
+  {
+    return NOT_VALID;
+  }
+  this->m_PacketStride = SyncScanner.getPacketStride();
+
+  // first PCR defines time 0
+  for (uint64_t Offset = xFindLattice(0); Offset + xTS::TS_PacketLength <= m_Size; Offset += m_PacketStride)
+  {
+    const uint8_t *Packet = m_Data + Offset;
+    if (Packet[0] != xTS_SyncScanner::SyncByte)
+    {
+      Offset = xFindLattice(Offset + 1) - m_PacketStride;
+      continue;
+    }
+    uint16_t PID = xTS_HeaderLayout::PID::Get(Packet);
+    uint64_t PCR = 0;
+    if ((PCR_PID == NOT_VALID || PID == PCR_PID) && xTS_AdaptationField::PeekPCR(Packet, PCR))
+    {
+      this->m_PCR_PID = PID;
+      this->m_FirstPCR = PCR;
+      this->m_First = {Offset, 0};
+      return xFindLastPCR(m_Last) ? 0 : NOT_VALID;
+    }
+  }
+  return NOT_VALID;
+}
+
+/**
+  @brief Find position to start demultiplexing at given time
+  @param Time is 27 MHz ticks since first PCR of input
+  @param PIDs are PIDs whose random access point is searched for, any PID when empty
+  @return Offset of first packet with random access indicator after last PCR not later than Time, -1 if there is none
+*/
+int64_t xTS_SeekEngine::Seek(uint64_t Time, const std::vector<uint16_t> &PIDs)
+{
+  this->m_NumProbes = 0;
+
+  // answer (last PCR not later than Time) is always in [Low.Offset, High.Offset)
+  xPCRPoint Low = m_First;
+  xPCRPoint High = {m_Last.Offset + m_PacketStride, m_Last.Delta};
+  if (Time >= m_Last.Delta)
+  {
+    Low = m_Last;
+    High = Low;
+  }
+  while (High.Offset > Low.Offset + LinearScanSize && m_NumProbes < MaxProbes)
+  {
+    uint64_t Span = High.Offset - Low.Offset;
+    uint64_t Probe = Low.Offset + Span / 2;
+    // interpolate by average bitrate of interval, every third probe bisects to bound worst case
+    if (m_NumProbes % 3 != 2 && High.Delta > Low.Delta)
+    {
+      Probe = Low.Offset + (uint64_t)((double)(Time - Low.Delta) / (double)(High.Delta - Low.Delta) * (double)Span);
+    }
+    if (Probe <= Low.Offset)
+    {
+      Probe = Low.Offset + m_PacketStride;
+    }
+    if (Probe >= High.Offset - m_PacketStride)
+    {
+      Probe = High.Offset - m_PacketStride;
+    }
+
+    xPCRPoint Point;
+    this->m_NumProbes++;
+    if (!xFindPCR(Probe, High.Offset, Point))
+    {
+      // no PCR between probe and upper bound
+      High.Offset = Probe;
+    }
+    else if (Point.Delta <= Time)
+    {
+      Low = Point;
+    }
+    else
+    {
+      High = Point;
+    }
+  }
+
+  // narrowed down - walk remaining PCRs
+  xPCRPoint Point;
+  while (Low.Offset < High.Offset && xFindPCR(Low.Offset + m_PacketStride, High.Offset, Point) && Point.Delta <= Time)
+  {
+    Low = Point;
+  }
+  this->m_Landing = Low;
+
+  return xRollForward(Low.Offset, PIDs);
+}
+
+/**
+  @brief Parse time
+  @param Text is [[HH:]MM:]SS[.fraction]
+  @param Time receives 27 MHz ticks
+  @return 0 on success, -1 on syntax error
+*/
+int32_t xTS_SeekEngine::ParseTime(const char *Text, uint64_t &Time)
+{
+  double Seconds = 0;
+  const char *Ptr = Text;
+  for (uint32_t FieldIdx = 0; FieldIdx < 3; FieldIdx++)
+  {
+    char *End = nullptr;
+    double Value = strtod(Ptr, &End);
+    if (End == Ptr || Value < 0)
+    {
+      return NOT_VALID;
+    }
+    Seconds = Seconds * 60 + Value;
+    if (*End == '\0')
+    {
+      Time = (uint64_t)(Seconds * xTS::ExtendedClockFrequency_Hz + 0.5);
+      return 0;
+    }
+    if (*End != ':')
+    {
+      return NOT_VALID;
+    }
+    Ptr = End + 1;
+  }
+  return NOT_VALID;
+}
+
+// offset of first sync byte of packet lattice at or after From (input size if there is none)
+uint64_t xTS_SeekEngine::xFindLattice(uint64_t From) const
+{
+  if (From >= m_Size)
+  {
+    return m_Size;
+  }
+  xTS_SyncScanner SyncScanner;
+  size_t NumSkipped = SyncScanner.Lock(m_Data + From, (size_t)(m_Size - From), true);
+  return SyncScanner.isLocked() ? From + NumSkipped : m_Size;
+}
+
+// first PCR of PCR PID in packets starting at or after From and before Limit
+bool xTS_SeekEngine::xFindPCR(uint64_t From, uint64_t Limit, xPCRPoint &Point) const
+{
+  for (uint64_t Offset = xFindLattice(From); Offset < Limit && Offset + xTS::TS_PacketLength <= m_Size; Offset += m_PacketStride)
+  {
+    const uint8_t *Packet = m_Data + Offset;
+    if (Packet[0] != xTS_SyncScanner::SyncByte)
+    {
+      Offset = xFindLattice(Offset + 1) - m_PacketStride;
+      continue;
+    }
+    uint64_t PCR = 0;
+    if (xTS_HeaderLayout::PID::Get(Packet) == m_PCR_PID && xTS_AdaptationField::PeekPCR(Packet, PCR))
+    {
+      Point.Offset = Offset;
+      Point.Delta = (PCR + PCRModulus - m_FirstPCR) % PCRModulus;
+      return true;
+    }
+  }
+  return false;
+}
+
+// last PCR of input - windows growing backwards from end are scanned until one contains PCR
+bool xTS_SeekEngine::xFindLastPCR(xPCRPoint &Point) const
+{
+  uint64_t Limit = m_Size;
+  for (uint64_t WindowSize = TailScanSize;; WindowSize *= 2)
+  {
+    uint64_t From = Limit > WindowSize ? Limit - WindowSize : 0;
+    if (xFindPCR(From, Limit, Point))
+    {
+      xPCRPoint Next;
+      while (xFindPCR(Point.Offset + m_PacketStride, Limit, Next))
+      {
+        Point = Next;
+      }
+      return true;
+    }
+    if (From == 0)
+    {
+      return false;
+    }
+    Limit = From + m_PacketStride; // packet may straddle window boundary
+  }
+}
+
+int64_t xTS_SeekEngine::xRollForward(uint64_t From, const std::vector<uint16_t> &PIDs) const
+{
+  for (uint64_t Offset = xFindLattice(From); Offset + xTS::TS_PacketLength <= m_Size; Offset += m_PacketStride)
+  {
+    const uint8_t *Packet = m_Data + Offset;
+    if (Packet[0] != xTS_SyncScanner::SyncByte)
+    {
+      Offset = xFindLattice(Offset + 1) - m_PacketStride;
+      continue;
+    }
+    // adaptation field present, not empty, random_access_indicator set
+    const uint8_t *AdaptationField = Packet + xTS::TS_HeaderLength;
+    if ((xTS_HeaderLayout::AFC::Get(Packet) & 0x2) == 0 || xTS_AdaptationFieldLayout::Length::Get(AdaptationField) == 0 ||
+        !xTS_AdaptationFieldLayout::RandomAccessIndicator::Get(AdaptationField))
+    {
+      continue;
+    }
+    uint16_t PID = xTS_HeaderLayout::PID::Get(Packet);
+    if (PIDs.empty() || std::find(PIDs.begin(), PIDs.end(), PID) != PIDs.end())
+    {
+      return (int64_t)Offset;
+    }
+  }
+  return NOT_VALID;
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,71 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <vector>
+
+/*
+Time based seek:
+  Time is measured from first PCR of input (PCR PID is given or taken from first packet carrying PCR).
+  Last PCR of input is found by scanning backwards from end, then the interval which has to contain target is
+  narrowed by interpolation (position estimated from PCR distance, i.e. from average bitrate of interval) and, if
+  interpolation does not shrink interval enough, by bisection. Every probe only scans forward from probed position
+  to next PCR packet, so even multi-hour input is seeked with a few hundred kilobytes read.
+  Finally position is rolled forward to next packet with random access indicator, where PES assembling can start.
+
+  PCR wraps around (33 bit base) are handled by measuring every PCR relative to first one modulo PCR period,
+  so inputs shorter than 26.5 hours are seeked correctly.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_SeekEngine
+{
+public:
+  static constexpr uint64_t PCRModulus = (1ULL << 33) * xTS::BaseToExtendedClockMultiplier;
+  static constexpr uint64_t LinearScanSize = 256 * 1024; // interval searched linearly when narrowed down to it
+  static constexpr uint64_t TailScanSize = 1024 * 1024;  // initial window searched for last PCR
+  static constexpr uint32_t MaxProbes = 64;
+
+  struct xPCRPoint
+  {
+    uint64_t Offset; // position of packet carrying PCR
+    uint64_t Delta;  // 27 MHz ticks since first PCR
+  };
+
+protected:
+  // input
+  const uint8_t *m_Data;
+  uint64_t m_Size;
+  uint32_t m_PacketStride;
+  // PCR range
+  uint16_t m_PCR_PID;
+  uint64_t m_FirstPCR;
+  xPCRPoint m_First;
+  xPCRPoint m_Last;
+  // last seek
+  uint32_t m_NumProbes;
+  xPCRPoint m_Landing;
+
+public:
+  xTS_SeekEngine();
+
+  int32_t Init(const uint8_t *Data, uint64_t Size, int32_t PCR_PID = NOT_VALID);
+  int64_t Seek(uint64_t Time, const std::vector<uint16_t> &PIDs);
+
+  static int32_t ParseTime(const char *Text, uint64_t &Time);
+
+public:
+  uint16_t getPCR_PID() const { return m_PCR_PID; }
+  uint32_t getPacketStride() const { return m_PacketStride; }
+  uint64_t getDuration() const { return m_Last.Delta; }
+  uint32_t getNumProbes() const { return m_NumProbes; }
+  const xPCRPoint &getLanding() const { return m_Landing; }
+
+protected:
+  uint64_t xFindLattice(uint64_t From) const;
+  bool xFindPCR(uint64_t From, uint64_t Limit, xPCRPoint &Point) const;
+  bool xFindLastPCR(xPCRPoint &Point) const;
+  int64_t xRollForward(uint64_t From, const std::vector<uint16_t> &PIDs) const;
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,182 @@
+#include "tsSyncScanner.h"
+#include <cstring>
+
+//=============================================================================================================================================================================
+// SIMD kernels
+//=============================================================================================================================================================================
+
+#if X_SIMD_X86
+static const uint8_t *xFindSyncByteSSE2(const uint8_t *Begin, const uint8_t *End)
+{
+  const __m128i Sync = _mm_set1_epi8((char)xTS_SyncScanner::SyncByte);
+  const uint8_t *Ptr = Begin;
+  for (; Ptr + 16 <= End; Ptr += 16)
+  {
+    __m128i Data = _mm_loadu_si128((const __m128i *)Ptr);
+    uint32_t Mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(Data, Sync));
+    if (Mask)
+    {
+      return Ptr + xCountTrailingZeros32(Mask);
+    }
+  }
+  for (; Ptr < End; Ptr++)
+  {
+    if (*Ptr == xTS_SyncScanner::SyncByte)
+    {
+      return Ptr;
+    }
+  }
+  return End;
+}
+
+X_TARGET_AVX2 static const uint8_t *xFindSyncByteAVX2(const uint8_t *Begin, const uint8_t *End)
+{
+  const __m256i Sync = _mm256_set1_epi8((char)xTS_SyncScanner::SyncByte);
+  const uint8_t *Ptr = Begin;
+  for (; Ptr + 32 <= End; Ptr += 32)
+  {
+    __m256i Data = _mm256_loadu_si256((const __m256i *)Ptr);
+    uint32_t Mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(Data, Sync));
+    if (Mask)
+    {
+      return Ptr + xCountTrailingZeros32(Mask);
+    }
+  }
+  return xFindSyncByteSSE2(Ptr, End);
+}
+
+// gathers first dword of 8 packets at once, stops at first packet with broken sync byte
+X_TARGET_AVX2 static uint32_t xCountLockedPacketsAVX2(const uint8_t *Data, uint32_t Stride, uint32_t NumPackets)
+{
+  const __m256i Offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)Stride));
+  const __m256i ByteMask = _mm256_set1_epi32(0xFF);
+  const __m256i Sync = _mm256_set1_epi32(xTS_SyncScanner::SyncByte);
+  uint32_t PacketIdx = 0;
+  for (; PacketIdx + 8 <= NumPackets; PacketIdx += 8)
+  {
+    const int *Base = (const int *)(Data + (size_t)PacketIdx * Stride);
+    __m256i Words = _mm256_i32gather_epi32(Base, Offsets, 1);
+    __m256i Match = _mm256_cmpeq_epi32(_mm256_and_si256(Words, ByteMask), Sync);
+    uint32_t Mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(Match));
+    if (Mask != 0xFF)
+    {
+      return PacketIdx + xCountTrailingZeros32(~Mask);
+    }
+  }
+  return PacketIdx;
+}
+#endif
+
+//=============================================================================================================================================================================
+// xTS_SyncScanner
+//=============================================================================================================================================================================
+
+xTS_SyncScanner::xTS_SyncScanner()
+{
+  this->m_UseAVX2 = xCpuSupportsAVX2();
+  Reset();
+}
+
+void xTS_SyncScanner::Reset()
+{
+  this->m_Locked = false;
+  this->m_PacketStride = PacketLength_TS;
+  this->m_NumDroppedBytes = 0;
+  this->m_NumResyncs = 0;
+}
+
+const uint8_t *xTS_SyncScanner::FindSyncByte(const uint8_t *Begin, const uint8_t *End)
+{
+#if X_SIMD_X86
+  static const bool UseAVX2 = xCpuSupportsAVX2();
+  return UseAVX2 ? xFindSyncByteAVX2(Begin, End) : xFindSyncByteSSE2(Begin, End);
+#else
+  const void *Found = std::memchr(Begin, SyncByte, End - Begin);
+  return Found ? (const uint8_t *)Found : End;
+#endif
+}
+
+/**
+  @brief Search for lattice of sync bytes and detect packet stride
+  @param Data is pointer to unconsumed input
+  @param Size is number of available bytes
+  @param EndOfStream tells that no more data will follow, so shorter lattice at the very end is accepted
+  @return Number of bytes preceding the lattice (or bytes that can be dropped when lattice was not found)
+*/
+size_t xTS_SyncScanner::Lock(const uint8_t *Data, size_t Size, bool EndOfStream)
+{
+  static constexpr uint32_t Strides[] = {PacketLength_TS, PacketLength_M2TS, PacketLength_RS};
+
+  const uint8_t *End = Data + Size;
+  const uint8_t *Ptr = Data;
+  while (true)
+  {
+    Ptr = FindSyncByte(Ptr, End);
+    if (Ptr == End)
+    {
+      return Size;
+    }
+
+    size_t Available = End - Ptr;
+    if (Available < LockLookahead && !EndOfStream)
+    {
+      // candidate cannot be verified yet - keep it for next call
+      return Ptr - Data;
+    }
+    if (Available < xTS::TS_PacketLength)
+    {
+      return Size;
+    }
+
+    for (uint32_t Stride : Strides)
+    {
+      uint32_t NumFit = (uint32_t)((Available - xTS::TS_PacketLength) / Stride + 1);
+      uint32_t NumCheck = NumFit < NumLockPackets ? NumFit : NumLockPackets;
+      if ((NumCheck >= 2 || NumFit == 1) && xCheckLattice(Ptr, End, Stride, NumCheck))
+      {
+        this->m_Locked = true;
+        this->m_PacketStride = Stride;
+        return Ptr - Data;
+      }
+    }
+    Ptr++;
+  }
+}
+
+bool xTS_SyncScanner::xCheckLattice(const uint8_t *Data, const uint8_t *End, uint32_t Stride, uint32_t NumPackets) const
+{
+  for (uint32_t PacketIdx = 0; PacketIdx < NumPackets; PacketIdx++)
+  {
+    const uint8_t *Packet = Data + (size_t)PacketIdx * Stride;
+    if (Packet >= End || *Packet != SyncByte)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t xTS_SyncScanner::CountLockedPackets(const uint8_t *Data, uint32_t NumPackets) const
+{
+  uint32_t PacketIdx = 0;
+#if X_SIMD_X86
+  if (m_UseAVX2)
+  {
+    PacketIdx = xCountLockedPacketsAVX2(Data, m_PacketStride, NumPackets);
+    if (PacketIdx + 8 <= NumPackets)
+    {
+      return PacketIdx; // stopped on broken sync byte
+    }
+  }
+#endif
+  for (; PacketIdx < NumPackets; PacketIdx++)
+  {
+    if (Data[(size_t)PacketIdx * m_PacketStride] != SyncByte)
+    {
+      break;
+    }
+  }
+  return PacketIdx;
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,66 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+
+/*
+Sync scanner:
+  Locates the lattice of 0x47 sync bytes in raw input and detects packet framing:
+    188 - plain TS
+    192 - M2TS / BDAV (4 byte TP_extra_header in front of each TS packet)
+    204 - TS with 16 bytes of Reed-Solomon parity after each TS packet
+  Packets are always addressed by their sync byte, the stride tells the distance to the next one.
+  Once locked, whole runs of packets are verified with strided (gathered) compares; on mismatch the
+  scanner drops bytes until a new lattice is found and accounts for every dropped byte.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_SyncScanner
+{
+public:
+  static constexpr uint8_t SyncByte = 0x47;
+  static constexpr uint32_t PacketLength_TS = 188;
+  static constexpr uint32_t PacketLength_M2TS = 192;
+  static constexpr uint32_t PacketLength_RS = 204;
+  static constexpr uint32_t MaxPacketStride = PacketLength_RS;
+  static constexpr uint32_t NumLockPackets = 5; // consecutive sync bytes required to (re)acquire lock
+  static constexpr uint32_t LockLookahead = (NumLockPackets - 1) * MaxPacketStride + xTS::TS_PacketLength;
+
+protected:
+  // state
+  bool m_Locked;
+  uint32_t m_PacketStride;
+  // statistics
+  uint64_t m_NumDroppedBytes;
+  uint64_t m_NumResyncs;
+  // dispatch
+  bool m_UseAVX2;
+
+public:
+  xTS_SyncScanner();
+
+  void Reset();
+
+  // try to acquire lock on lattice inside buffer, returns number of leading bytes to drop (lock state tells if lattice was found)
+  size_t Lock(const uint8_t *Data, size_t Size, bool EndOfStream);
+
+  // number of consecutive packets (starting at Data) whose sync byte is in place, max NumPackets
+  uint32_t CountLockedPackets(const uint8_t *Data, uint32_t NumPackets) const;
+
+  void LoseLock() { m_Locked = false; m_NumResyncs++; }
+  void AccountDropped(size_t NumBytes) { m_NumDroppedBytes += NumBytes; }
+
+public:
+  bool isLocked() const { return m_Locked; }
+  uint32_t getPacketStride() const { return m_PacketStride; }
+  uint64_t getNumDroppedBytes() const { return m_NumDroppedBytes; }
+  uint64_t getNumResyncs() const { return m_NumResyncs; }
+
+public:
+  static const uint8_t *FindSyncByte(const uint8_t *Begin, const uint8_t *End);
+
+protected:
+  bool xCheckLattice(const uint8_t *Data, const uint8_t *End, uint32_t Stride, uint32_t NumPackets) const;
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,365 @@
+#include "tsSynthetic.h"
+#include "tsPSI.h"
+#include "tsSyncScanner.h"
+#include <cstdlib>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// xTS_SyntheticGenerator
+//=============================================================================================================================================================================
+
+xTS_SyntheticGenerator::xConfig xTS_SyntheticGenerator::DefaultConfig()
+{
+  xConfig Config;
+  Config.Seed = 1;
+  Config.NumPackets = 200000;
+  Config.Streams = {
+      {256, eStreamKind::Video, 8, 20000, 80000, true},
+      {257, eStreamKind::Audio, 1, 400, 1500, false},
+      {258, eStreamKind::Audio, 1, 400, 1500, false},
+      {(uint16_t)xTS_PacketHeader::ePID::NuLL, eStreamKind::Null, 1, 0, 0, false},
+  };
+  Config.AFDensity = 0.05;
+  Config.PCRInterval = 20;
+  Config.CCErrorRate = 0.0;
+  Config.PSIInterval = 2000;
+  Config.KeyInterval = 25;
+  Config.Bitrate = 20000000;
+  return Config;
+}
+
+/**
+  @brief Parse stream description
+  @param Text is "<PID>:<kind>:<weight>:<min PES size>:<max PES size>[:pcr]", kind is v (video), a (audio) or n (null)
+  @param Stream receives parsed description
+  @return 0 on success, -1 on syntax error
+*/
+int32_t xTS_SyntheticGenerator::ParseStreamConfig(const char *Text, xStreamConfig &Stream)
+{
+  char *End = nullptr;
+  Stream.PID = (uint16_t)(strtoul(Text, &End, 0) & 0x1FFF);
+  if (*End != ':')
+  {
+    return NOT_VALID;
+  }
+  switch (End[1])
+  {
+  case 'v':
+    Stream.Kind = eStreamKind::Video;
+    break;
+  case 'a':
+    Stream.Kind = eStreamKind::Audio;
+    break;
+  case 'n':
+    Stream.Kind = eStreamKind::Null;
+    break;
+  default:
+    return NOT_VALID;
+  }
+  if (End[2] != ':')
+  {
+    return NOT_VALID;
+  }
+  Stream.Weight = (uint32_t)strtoul(End + 3, &End, 0);
+  Stream.MinPESSize = *End == ':' ? (uint32_t)strtoul(End + 1, &End, 0) : 0;
+  Stream.MaxPESSize = *End == ':' ? (uint32_t)strtoul(End + 1, &End, 0) : Stream.MinPESSize;
+  Stream.CarriesPCR = strcmp(End, ":pcr") == 0;
+  if (Stream.MaxPESSize < Stream.MinPESSize || (*End != '\0' && !Stream.CarriesPCR))
+  {
+    return NOT_VALID;
+  }
+  return 0;
+}
+
+// xorshift64*
+uint64_t xTS_SyntheticGenerator::xRandom()
+{
+  m_RandomState ^= m_RandomState >> 12;
+  m_RandomState ^= m_RandomState << 25;
+  m_RandomState ^= m_RandomState >> 27;
+  return m_RandomState * 0x2545F4914F6CDD1DULL;
+}
+
+// arrival time of packet, split to avoid overflow of Bits * Frequency
+uint64_t xTS_SyntheticGenerator::xClockAt(uint64_t PacketIdx, uint32_t Frequency) const
+{
+  uint64_t Bits = PacketIdx * xTS::TS_PacketLength * 8;
+  return Bits / m_Config.Bitrate * Frequency + Bits % m_Config.Bitrate * Frequency / m_Config.Bitrate;
+}
+
+uint8_t xTS_SyntheticGenerator::xNextCC(uint8_t &CC)
+{
+  CC = (CC + 1) & 0xF;
+  if (m_Config.CCErrorRate > 0 && xRandomUnit() < m_Config.CCErrorRate)
+  {
+    CC = (CC + xRandomRange(1, 14)) & 0xF; // as if some packets were lost
+    this->m_NumCCErrors++;
+  }
+  return CC;
+}
+
+/**
+  @brief Generate stream
+  @param Config is stream description
+  @param Output receives Config.NumPackets packets of 188 bytes
+*/
+void xTS_SyntheticGenerator::Generate(const xConfig &Config, std::vector<uint8_t> &Output)
+{
+  this->m_Config = Config;
+  if (m_Config.Bitrate == 0)
+  {
+    m_Config.Bitrate = DefaultConfig().Bitrate;
+  }
+  this->m_RandomState = Config.Seed != 0 ? Config.Seed : 0x9E3779B97F4A7C15ULL;
+  this->m_NumPESPackets = 0;
+  this->m_NumCCErrors = 0;
+  this->m_NumAFPackets = 0;
+  this->m_PSI_CC[0] = 0x0F;
+  this->m_PSI_CC[1] = 0x0F;
+  this->m_TotalWeight = 0;
+  m_States.assign(Config.Streams.size(), xStreamState());
+  for (uint32_t StreamIdx = 0; StreamIdx < Config.Streams.size(); StreamIdx++)
+  {
+    this->m_TotalWeight += Config.Streams[StreamIdx].Weight;
+    m_States[StreamIdx].PESOffset = 0;
+    m_States[StreamIdx].CC = 0x0F;
+    m_States[StreamIdx].NumPES = 0;
+    m_States[StreamIdx].NumPacketsSincePCR = Config.PCRInterval; // first packet carries PCR
+  }
+
+  std::vector<uint8_t> PAT;
+  std::vector<uint8_t> PMT;
+  xBuildPAT(PAT);
+  xBuildPMT(PMT);
+
+  Output.resize((size_t)Config.NumPackets * xTS::TS_PacketLength);
+  uint32_t PendingPSI = 0; // 2 - PAT and PMT, 1 - PMT
+  for (uint32_t PacketIdx = 0; PacketIdx < Config.NumPackets; PacketIdx++)
+  {
+    uint8_t *Packet = Output.data() + (size_t)PacketIdx * xTS::TS_PacketLength;
+    if (Config.PSIInterval != 0 && PacketIdx % Config.PSIInterval == 0)
+    {
+      PendingPSI = 2;
+    }
+    if (PendingPSI > 0)
+    {
+      if (PendingPSI == 2)
+      {
+        xWritePSIPacket((uint16_t)xTS_PacketHeader::ePID::PAT, PAT, Packet);
+      }
+      else
+      {
+        xWritePSIPacket(PMT_PID, PMT, Packet);
+      }
+      PendingPSI--;
+      continue;
+    }
+
+    uint32_t StreamIdx = 0;
+    if (m_TotalWeight > 0)
+    {
+      uint32_t Pick = xRandomRange(0, m_TotalWeight - 1);
+      while (Pick >= Config.Streams[StreamIdx].Weight)
+      {
+        Pick -= Config.Streams[StreamIdx].Weight;
+        StreamIdx++;
+      }
+    }
+    xWriteStreamPacket(StreamIdx, PacketIdx, Packet);
+  }
+}
+
+void xTS_SyntheticGenerator::xStartPES(uint32_t StreamIdx, uint64_t PacketIdx)
+{
+  const xStreamConfig &Stream = m_Config.Streams[StreamIdx];
+  xStreamState &State = m_States[StreamIdx];
+  const bool Video = Stream.Kind == eStreamKind::Video;
+  const bool Key = Video && (m_Config.KeyInterval == 0 || State.NumPES % m_Config.KeyInterval == 0);
+
+  uint32_t ESSize = xRandomRange(Stream.MinPESSize, Stream.MaxPESSize);
+  uint32_t HeaderDataLength = Video ? 10 : 5;
+  if (!Video && ESSize > 0xFFFF - 3 - HeaderDataLength)
+  {
+    ESSize = 0xFFFF - 3 - HeaderDataLength;
+  }
+
+  // presentation 0.5 s after arrival
+  uint64_t DTS = (xClockAt(PacketIdx, xTS::BaseClockFrequency_Hz) + xTS::BaseClockFrequency_Hz / 2) & 0x1FFFFFFFFULL;
+  uint64_t PTS = Video ? ((DTS + 3600) & 0x1FFFFFFFFULL) : DTS;
+
+  std::vector<uint8_t> &PES = State.PES;
+  PES.clear();
+  uint8_t StreamId = (uint8_t)((Video ? 0xE0 : 0xC0) + (StreamIdx & 0x0F));
+  uint32_t PacketLength = Video ? 0 : 3 + HeaderDataLength + ESSize;
+  PES.insert(PES.end(), {0x00, 0x00, 0x01, StreamId, (uint8_t)(PacketLength >> 8), (uint8_t)PacketLength, 0x80, (uint8_t)(Video ? 0xC0 : 0x80), (uint8_t)HeaderDataLength});
+  auto AppendTimestamp = [&PES](uint8_t Prefix, uint64_t Timestamp)
+  {
+    PES.push_back((uint8_t)((Prefix << 4) | ((Timestamp >> 29) & 0x0E) | 1));
+    PES.push_back((uint8_t)(Timestamp >> 22));
+    PES.push_back((uint8_t)(((Timestamp >> 14) & 0xFE) | 1));
+    PES.push_back((uint8_t)(Timestamp >> 7));
+    PES.push_back((uint8_t)(((Timestamp << 1) & 0xFE) | 1));
+  };
+  AppendTimestamp(Video ? 0x3 : 0x2, PTS);
+  if (Video)
+  {
+    AppendTimestamp(0x1, DTS);
+  }
+
+  size_t ESBegin = PES.size();
+  PES.resize(ESBegin + ESSize);
+  uint8_t *ES = PES.data() + ESBegin;
+  size_t Offset = 0;
+  if (Video && ESSize >= 11)
+  {
+    // access unit delimiter + slice NAL unit header
+    static const uint8_t AUD[] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0, 0x00, 0x00, 0x00, 0x01};
+    std::memcpy(ES, AUD, sizeof(AUD));
+    ES[sizeof(AUD)] = Key ? 0x65 : 0x41;
+    Offset = sizeof(AUD) + 1;
+  }
+  // nonzero filler, so no start code emulation
+  for (; Offset < ESSize; Offset += 8)
+  {
+    uint64_t Value = xRandom() | 0x0101010101010101ULL;
+    size_t NumBytes = ESSize - Offset < 8 ? ESSize - Offset : 8;
+    std::memcpy(ES + Offset, &Value, NumBytes);
+  }
+
+  State.PESOffset = 0;
+  State.NumPES++;
+  this->m_NumPESPackets++;
+}
+
+void xTS_SyntheticGenerator::xWriteStreamPacket(uint32_t StreamIdx, uint64_t PacketIdx, uint8_t *Packet)
+{
+  const xStreamConfig &Stream = m_Config.Streams[StreamIdx];
+  xStreamState &State = m_States[StreamIdx];
+
+  if (Stream.Kind == eStreamKind::Null)
+  {
+    Packet[0] = xTS_SyncScanner::SyncByte;
+    Packet[1] = (uint8_t)(Stream.PID >> 8);
+    Packet[2] = (uint8_t)Stream.PID;
+    Packet[3] = 0x10;
+    std::memset(Packet + xTS::TS_HeaderLength, 0xFF, xTS::TS_PacketLength - xTS::TS_HeaderLength);
+    return;
+  }
+
+  bool Start = State.PESOffset >= State.PES.size();
+  if (Start)
+  {
+    xStartPES(StreamIdx, PacketIdx);
+  }
+  const bool Key = Start && Stream.Kind == eStreamKind::Video && (m_Config.KeyInterval == 0 || (State.NumPES - 1) % m_Config.KeyInterval == 0);
+
+  // adaptation field: length byte + flags + optional PCR + stuffing
+  State.NumPacketsSincePCR++;
+  bool PCR = Stream.CarriesPCR && m_Config.PCRInterval != 0 && State.NumPacketsSincePCR >= m_Config.PCRInterval;
+  uint32_t AFBytes = 0;
+  if (PCR || Key)
+  {
+    AFBytes = 2 + (PCR ? 6 : 0);
+  }
+  else if (m_Config.AFDensity > 0 && xRandomUnit() < m_Config.AFDensity)
+  {
+    AFBytes = 2 + xRandomRange(0, 16);
+  }
+  size_t Remaining = State.PES.size() - State.PESOffset;
+  uint32_t PayloadSize = xTS::TS_PacketLength - xTS::TS_HeaderLength - AFBytes;
+  if (Remaining < PayloadSize)
+  {
+    AFBytes += PayloadSize - (uint32_t)Remaining; // last packet of PES is padded
+    PayloadSize = (uint32_t)Remaining;
+  }
+
+  Packet[0] = xTS_SyncScanner::SyncByte;
+  Packet[1] = (uint8_t)((Start ? 0x40 : 0x00) | (Stream.PID >> 8));
+  Packet[2] = (uint8_t)Stream.PID;
+  Packet[3] = (uint8_t)((AFBytes > 0 ? 0x30 : 0x10) | xNextCC(State.CC));
+
+  uint8_t *Ptr = Packet + xTS::TS_HeaderLength;
+  if (AFBytes > 0)
+  {
+    this->m_NumAFPackets++;
+    Ptr[0] = (uint8_t)(AFBytes - 1);
+    if (AFBytes > 1)
+    {
+      Ptr[1] = (uint8_t)((Key ? 0x40 : 0x00) | (PCR ? 0x10 : 0x00));
+      uint32_t Used = 2;
+      if (PCR)
+      {
+        uint64_t Clock = xClockAt(PacketIdx, xTS::ExtendedClockFrequency_Hz);
+        uint64_t Base = (Clock / xTS::BaseToExtendedClockMultiplier) & 0x1FFFFFFFFULL;
+        uint32_t Extension = (uint32_t)(Clock % xTS::BaseToExtendedClockMultiplier);
+        Ptr[2] = (uint8_t)(Base >> 25);
+        Ptr[3] = (uint8_t)(Base >> 17);
+        Ptr[4] = (uint8_t)(Base >> 9);
+        Ptr[5] = (uint8_t)(Base >> 1);
+        Ptr[6] = (uint8_t)(((Base & 1) << 7) | 0x7E | (Extension >> 8));
+        Ptr[7] = (uint8_t)Extension;
+        Used += 6;
+        State.NumPacketsSincePCR = 0;
+      }
+      std::memset(Ptr + Used, 0xFF, AFBytes - Used);
+    }
+    Ptr += AFBytes;
+  }
+  std::memcpy(Ptr, State.PES.data() + State.PESOffset, PayloadSize);
+  State.PESOffset += PayloadSize;
+}
+
+void xTS_SyntheticGenerator::xWritePSIPacket(uint16_t PID, const std::vector<uint8_t> &Section, uint8_t *Packet)
+{
+  Packet[0] = xTS_SyncScanner::SyncByte;
+  Packet[1] = (uint8_t)(0x40 | (PID >> 8));
+  Packet[2] = (uint8_t)PID;
+  Packet[3] = (uint8_t)(0x10 | xNextCC(m_PSI_CC[PID == PMT_PID ? 1 : 0]));
+  Packet[4] = 0; // pointer_field
+  std::memcpy(Packet + 5, Section.data(), Section.size());
+  std::memset(Packet + 5 + Section.size(), 0xFF, xTS::TS_PacketLength - 5 - Section.size());
+}
+
+// appends section_length and CRC to section starting with table_id
+static void xFinishSection(std::vector<uint8_t> &Section)
+{
+  uint32_t SectionLength = (uint32_t)Section.size() - xPSI::SectionHeaderLength + xPSI::CRCLength;
+  Section[1] = (uint8_t)(0xB0 | (SectionLength >> 8));
+  Section[2] = (uint8_t)SectionLength;
+  uint32_t CRC = xPSI::CRC32(Section.data(), (uint32_t)Section.size());
+  Section.insert(Section.end(), {(uint8_t)(CRC >> 24), (uint8_t)(CRC >> 16), (uint8_t)(CRC >> 8), (uint8_t)CRC});
+}
+
+void xTS_SyntheticGenerator::xBuildPAT(std::vector<uint8_t> &Section) const
+{
+  Section = {xPSI::eTableId_PAT, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+             (uint8_t)(ProgramNumber >> 8), (uint8_t)ProgramNumber, (uint8_t)(0xE0 | (PMT_PID >> 8)), (uint8_t)PMT_PID};
+  xFinishSection(Section);
+}
+
+void xTS_SyntheticGenerator::xBuildPMT(std::vector<uint8_t> &Section) const
+{
+  uint16_t PCR_PID = (uint16_t)xTS_PacketHeader::ePID::NuLL;
+  for (const xStreamConfig &Stream : m_Config.Streams)
+  {
+    if (Stream.CarriesPCR)
+    {
+      PCR_PID = Stream.PID;
+      break;
+    }
+  }
+  Section = {xPSI::eTableId_PMT, 0, 0, (uint8_t)(ProgramNumber >> 8), (uint8_t)ProgramNumber, 0xC1, 0x00, 0x00,
+             (uint8_t)(0xE0 | (PCR_PID >> 8)), (uint8_t)PCR_PID, 0xF0, 0x00};
+  for (const xStreamConfig &Stream : m_Config.Streams)
+  {
+    if (Stream.Kind == eStreamKind::Null)
+    {
+      continue;
+    }
+    uint8_t StreamType = Stream.Kind == eStreamKind::Video ? xPSI_PMT::eStreamType_H264 : xPSI_PMT::eStreamType_MPEG1_Audio;
+    Section.insert(Section.end(), {StreamType, (uint8_t)(0xE0 | (Stream.PID >> 8)), (uint8_t)Stream.PID, 0xF0, 0x00});
+  }
+  xFinishSection(Section);
+}
+
+//=============================================================================================================================================================================
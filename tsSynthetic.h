@@ -0,0 +1,101 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include <string>
+#include <vector>
+
+/*
+Deterministic synthetic transport stream:
+  Same configuration (including seed) always produces the same bytes on every platform - own PRNG is used instead of
+  <random> distributions, whose results are implementation defined.
+
+  Stream mix is given as list of elementary streams, each picked for next packet with probability proportional to its
+  weight. PES packets of random size (within configured range) are split into TS packets, last packet of PES is padded
+  with adaptation field stuffing. Optional extras: PCR every PCRInterval packets of PCR stream, adaptation field with
+  random stuffing on other packets (AFDensity), continuity counter jumps (CCErrorRate), PAT/PMT every PSIInterval packets.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_SyntheticGenerator
+{
+public:
+  enum class eStreamKind : int32_t
+  {
+    Video, // unbounded PES (PES_packet_length = 0), random access indicator on key PES packets
+    Audio, // bounded PES
+    Null,  // null packets, no PES
+  };
+
+  struct xStreamConfig
+  {
+    uint16_t PID;
+    eStreamKind Kind;
+    uint32_t Weight;
+    uint32_t MinPESSize; // elementary stream bytes per PES packet
+    uint32_t MaxPESSize;
+    bool CarriesPCR;
+  };
+
+  struct xConfig
+  {
+    uint64_t Seed;
+    uint32_t NumPackets;
+    std::vector<xStreamConfig> Streams;
+    double AFDensity;      // probability of stuffing adaptation field on packet without PCR
+    uint32_t PCRInterval;  // packets of PCR stream between PCRs (0 - no PCR)
+    double CCErrorRate;    // probability of continuity counter jump
+    uint32_t PSIInterval;  // packets between PAT/PMT repetitions (0 - no PSI)
+    uint32_t KeyInterval;  // video PES packets between random access points
+    uint32_t Bitrate;      // bits per second, used to derive PCR and PTS values
+  };
+
+  static constexpr uint16_t PMT_PID = 0x0020;
+  static constexpr uint16_t ProgramNumber = 1;
+
+protected:
+  struct xStreamState
+  {
+    std::vector<uint8_t> PES; // PES packet being packetized
+    size_t PESOffset;
+    uint8_t CC;
+    uint32_t NumPES;
+    uint32_t NumPacketsSincePCR;
+  };
+
+  xConfig m_Config;
+  uint64_t m_RandomState;
+  std::vector<xStreamState> m_States;
+  uint32_t m_TotalWeight;
+  uint8_t m_PSI_CC[2];
+  // statistics
+  uint64_t m_NumPESPackets;
+  uint64_t m_NumCCErrors;
+  uint64_t m_NumAFPackets;
+
+public:
+  static xConfig DefaultConfig();
+  static int32_t ParseStreamConfig(const char *Text, xStreamConfig &Stream);
+
+  void Generate(const xConfig &Config, std::vector<uint8_t> &Output);
+
+public:
+  uint64_t getNumPESPackets() const { return m_NumPESPackets; }
+  uint64_t getNumCCErrors() const { return m_NumCCErrors; }
+  uint64_t getNumAFPackets() const { return m_NumAFPackets; }
+
+protected:
+  uint64_t xRandom();
+  uint32_t xRandomRange(uint32_t Min, uint32_t Max) { return Min + (uint32_t)(xRandom() % ((uint64_t)Max - Min + 1)); }
+  double xRandomUnit() { return (double)(xRandom() >> 11) * (1.0 / 9007199254740992.0); }
+
+  void xStartPES(uint32_t StreamIdx, uint64_t PacketIdx);
+  void xWriteStreamPacket(uint32_t StreamIdx, uint64_t PacketIdx, uint8_t *Packet);
+  void xWritePSIPacket(uint16_t PID, const std::vector<uint8_t> &Section, uint8_t *Packet);
+  void xBuildPAT(std::vector<uint8_t> &Section) const;
+  void xBuildPMT(std::vector<uint8_t> &Section) const;
+  uint8_t xNextCC(uint8_t &CC);
+  uint64_t xClockAt(uint64_t PacketIdx, uint32_t Frequency) const;
+};
+
+//=============================================================================================================================================================================
@@ -1,6 +1,9 @@
 #include "tsTransportStream.h"
+#include "tsFields.h"
 #include <iostream>
 #include <iomanip>
+#include <cstring>
+#include <algorithm>
 
 //=============================================================================================================================================================================
 // xTS_PacketHeader
@@ -28,16 +31,14 @@ int32_t xTS_PacketHeader::Parse(const uint8_t *Input)
 {
   if (Input != NULL)
   {
-    const uint32_t *HeaderPtr = (const uint32_t *)Input;
-    uint32_t HeaderData = xSwapBytes32(*HeaderPtr);
-    this->m_SB = (uint32_t)((HeaderData & 0b11111111000000000000000000000000) >> 24);
-    this->m_E = (uint32_t)((HeaderData & 0b00000000100000000000000000000000) >> 23);
-    this->m_S = (uint32_t)((HeaderData & 0b00000000010000000000000000000000) >> 22);
-    this->m_T = (uint32_t)((HeaderData & 0b00000000001000000000000000000000) >> 21);
-    this->m_PID = (uint32_t)((HeaderData & 0b00000000000111111111111100000000) >> 8);
-    this->m_TSC = (uint32_t)((HeaderData & 0b00000000000000000000000011000000) >> 6);
-    this->m_AFC = (uint32_t)((HeaderData & 0b00000000000000000000000000110000) >> 4);
-    this->m_CC = (uint32_t)((HeaderData & 0b00000000000000000000000000001111));
+    this->m_SB = xTS_HeaderLayout::SB::Get(Input);
+    this->m_E = xTS_HeaderLayout::E::Get(Input);
+    this->m_S = xTS_HeaderLayout::S::Get(Input);
+    this->m_T = xTS_HeaderLayout::T::Get(Input);
+    this->m_PID = xTS_HeaderLayout::PID::Get(Input);
+    this->m_TSC = xTS_HeaderLayout::TSC::Get(Input);
+    this->m_AFC = xTS_HeaderLayout::AFC::Get(Input);
+    this->m_CC = xTS_HeaderLayout::CC::Get(Input);
 
     return 4;
   }
@@ -47,21 +48,186 @@ int32_t xTS_PacketHeader::Parse(const uint8_t *Input)
   }
 }
 
+/**
+  @brief Load header fields of one packet from batch decoded by xTS_PacketHeaderBatch
+  @param Batch is decoded header batch
+  @param PacketIdx is index of packet within batch
+ */
+void xTS_PacketHeader::Load(const xTS_PacketHeaderBatch &Batch, uint32_t PacketIdx)
+{
+  uint8_t Flags = Batch.getFlags(PacketIdx);
+  this->m_SB = Batch.getSyncByte(PacketIdx);
+  this->m_E = (Flags & xTS_PacketHeaderBatch::eFlags_TransportError) >> 7;
+  this->m_S = (Flags & xTS_PacketHeaderBatch::eFlags_PayloadUnitStart) >> 6;
+  this->m_T = (Flags & xTS_PacketHeaderBatch::eFlags_TransportPriority) >> 5;
+  this->m_PID = Batch.getPID(PacketIdx);
+  this->m_TSC = Batch.getTransportScramblingControl(PacketIdx);
+  this->m_AFC = Batch.getAdaptationFieldControl(PacketIdx);
+  this->m_CC = Batch.getContinuityCounter(PacketIdx);
+}
+
 /// @brief Print all TS packet header fields
 void xTS_PacketHeader::Print() const
 {
   // Print the TS packet header fields | done
-  std::cout << "\nTS:" << std::endl;
-  // std::cout << "\nSync byte: " << std::hex << std::setw(2) << std::setfill('0') << (int)m_SB << std::endl;
-  std::cout << "  Sync byte: " << (int)m_SB << std::endl;
-  std::cout << "  Transport error indicator: " << (int)m_E << std::endl;
-  std::cout << "  Payload unit start indicator: " << (int)m_S << std::endl;
-  std::cout << "  Transport priority: " << (int)m_T << std::endl;
-  // std::cout << "PID: " << std::hex << std::setw(4) << std::setfill('0') << (int)m_PID << std::endl;
-  std::cout << "  PID: " << (int)m_PID << std::endl;
-  std::cout << "  Transport scrambling control: " << (int)m_TSC << std::endl;
-  std::cout << "  Adaptation field control: " << (int)m_AFC << std::endl;
-  std::cout << "  Continuity counter: " << (int)m_CC << std::endl;
+  std::cout << "\nTS:" << '\n';
+  // std::cout << "\nSync byte: " << std::hex << std::setw(2) << std::setfill('0') << (int)m_SB << '\n';
+  std::cout << "  Sync byte: " << (int)m_SB << '\n';
+  std::cout << "  Transport error indicator: " << (int)m_E << '\n';
+  std::cout << "  Payload unit start indicator: " << (int)m_S << '\n';
+  std::cout << "  Transport priority: " << (int)m_T << '\n';
+  // std::cout << "PID: " << std::hex << std::setw(4) << std::setfill('0') << (int)m_PID << '\n';
+  std::cout << "  PID: " << (int)m_PID << '\n';
+  std::cout << "  Transport scrambling control: " << (int)m_TSC << '\n';
+  std::cout << "  Adaptation field control: " << (int)m_AFC << '\n';
+  std::cout << "  Continuity counter: " << (int)m_CC << '\n';
+}
+
+//=============================================================================================================================================================================
+// xTS_PacketHeaderBatch
+//=============================================================================================================================================================================
+
+static inline uint32_t xLoadHeaderWord(const uint8_t *Packet)
+{
+  uint32_t Word;
+  std::memcpy(&Word, Packet, sizeof(Word));
+  return Word;
+}
+
+#if X_SIMD_X86
+// splits 2x4 little-endian header words into fields and stores 8 entries of each array
+static inline void xStoreHeaderFieldsSSE2(__m128i W0, __m128i W1, uint16_t *PID, uint8_t *SB, uint8_t *Flags, uint8_t *TSC, uint8_t *AFC, uint8_t *CC)
+{
+  const __m128i Mask_FF = _mm_set1_epi32(0xFF);
+  const __m128i Mask_PIDHi = _mm_set1_epi32(0x1F00);
+  const __m128i Mask_Flags = _mm_set1_epi32(0xE0);
+  const __m128i Mask_3 = _mm_set1_epi32(0x3);
+  const __m128i Mask_F = _mm_set1_epi32(0xF);
+
+  __m128i PID0 = _mm_or_si128(_mm_and_si128(W0, Mask_PIDHi), _mm_and_si128(_mm_srli_epi32(W0, 16), Mask_FF));
+  __m128i PID1 = _mm_or_si128(_mm_and_si128(W1, Mask_PIDHi), _mm_and_si128(_mm_srli_epi32(W1, 16), Mask_FF));
+  _mm_storeu_si128((__m128i *)PID, _mm_packs_epi32(PID0, PID1));
+
+  __m128i SB16 = _mm_packs_epi32(_mm_and_si128(W0, Mask_FF), _mm_and_si128(W1, Mask_FF));
+  __m128i Flags16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(W0, 8), Mask_Flags), _mm_and_si128(_mm_srli_epi32(W1, 8), Mask_Flags));
+  __m128i TSC16 = _mm_packs_epi32(_mm_srli_epi32(W0, 30), _mm_srli_epi32(W1, 30));
+  __m128i AFC16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(W0, 28), Mask_3), _mm_and_si128(_mm_srli_epi32(W1, 28), Mask_3));
+  __m128i CC16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(W0, 24), Mask_F), _mm_and_si128(_mm_srli_epi32(W1, 24), Mask_F));
+
+  _mm_storel_epi64((__m128i *)SB, _mm_packus_epi16(SB16, SB16));
+  _mm_storel_epi64((__m128i *)Flags, _mm_packus_epi16(Flags16, Flags16));
+  _mm_storel_epi64((__m128i *)TSC, _mm_packus_epi16(TSC16, TSC16));
+  _mm_storel_epi64((__m128i *)AFC, _mm_packus_epi16(AFC16, AFC16));
+  _mm_storel_epi64((__m128i *)CC, _mm_packus_epi16(CC16, CC16));
+}
+
+X_TARGET_AVX2 static uint32_t xGatherHeaderWordsAVX2(const uint8_t *FirstPacket, uint32_t NumPackets, uint32_t PacketStride, uint16_t *PID, uint8_t *SB, uint8_t *Flags, uint8_t *TSC, uint8_t *AFC, uint8_t *CC)
+{
+  const __m256i Offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32((int)PacketStride));
+  uint32_t PacketIdx = 0;
+  for (; PacketIdx + 8 <= NumPackets; PacketIdx += 8)
+  {
+    __m256i W = _mm256_i32gather_epi32((const int *)(FirstPacket + (size_t)PacketIdx * PacketStride), Offsets, 1);
+    xStoreHeaderFieldsSSE2(_mm256_castsi256_si128(W), _mm256_extracti128_si256(W, 1), PID + PacketIdx, SB + PacketIdx, Flags + PacketIdx, TSC + PacketIdx, AFC + PacketIdx, CC + PacketIdx);
+  }
+  return PacketIdx;
+}
+#endif
+
+/**
+  @brief Decode headers of consecutive packets into structure-of-arrays
+  @param FirstPacket is pointer to sync byte of first packet
+  @param NumPackets is number of packets to decode (clamped to MaxPackets)
+  @param PacketStride is distance between sync bytes of consecutive packets
+  @return Number of decoded headers (-1 on failure)
+*/
+int32_t xTS_PacketHeaderBatch::Parse(const uint8_t *FirstPacket, uint32_t NumPackets, uint32_t PacketStride)
+{
+  if (FirstPacket == nullptr)
+  {
+    this->m_NumPackets = 0;
+    return NOT_VALID;
+  }
+  if (NumPackets > MaxPackets)
+  {
+    NumPackets = MaxPackets;
+  }
+  this->m_NumPackets = NumPackets;
+
+  uint32_t PacketIdx = 0;
+#if X_SIMD_X86
+  static const bool UseAVX2 = xCpuSupportsAVX2();
+  if (UseAVX2)
+  {
+    PacketIdx = xGatherHeaderWordsAVX2(FirstPacket, NumPackets, PacketStride, m_PID, m_SB, m_Flags, m_TSC, m_AFC, m_CC);
+  }
+  else
+  {
+    for (; PacketIdx + 8 <= NumPackets; PacketIdx += 8)
+    {
+      const uint8_t *Packet = FirstPacket + (size_t)PacketIdx * PacketStride;
+      __m128i W0 = _mm_setr_epi32((int)xLoadHeaderWord(Packet), (int)xLoadHeaderWord(Packet + PacketStride), (int)xLoadHeaderWord(Packet + 2 * PacketStride), (int)xLoadHeaderWord(Packet + 3 * PacketStride));
+      Packet += 4 * PacketStride;
+      __m128i W1 = _mm_setr_epi32((int)xLoadHeaderWord(Packet), (int)xLoadHeaderWord(Packet + PacketStride), (int)xLoadHeaderWord(Packet + 2 * PacketStride), (int)xLoadHeaderWord(Packet + 3 * PacketStride));
+      xStoreHeaderFieldsSSE2(W0, W1, m_PID + PacketIdx, m_SB + PacketIdx, m_Flags + PacketIdx, m_TSC + PacketIdx, m_AFC + PacketIdx, m_CC + PacketIdx);
+    }
+  }
+#endif
+  xParseScalar(FirstPacket, PacketIdx, NumPackets, PacketStride);
+  return (int32_t)NumPackets;
+}
+
+void xTS_PacketHeaderBatch::xParseScalar(const uint8_t *FirstPacket, uint32_t Begin, uint32_t End, uint32_t PacketStride)
+{
+  for (uint32_t PacketIdx = Begin; PacketIdx < End; PacketIdx++)
+  {
+    uint32_t W = xLoadHeaderWord(FirstPacket + (size_t)PacketIdx * PacketStride);
+    this->m_SB[PacketIdx] = (uint8_t)(W & 0xFF);
+    this->m_Flags[PacketIdx] = (uint8_t)((W >> 8) & 0xE0);
+    this->m_PID[PacketIdx] = (uint16_t)((W & 0x1F00) | ((W >> 16) & 0xFF));
+    this->m_TSC[PacketIdx] = (uint8_t)(W >> 30);
+    this->m_AFC[PacketIdx] = (uint8_t)((W >> 28) & 0x3);
+    this->m_CC[PacketIdx] = (uint8_t)((W >> 24) & 0xF);
+  }
+}
+
+uint64_t xTS_PacketHeaderBatch::getPIDMask(uint16_t PID) const
+{
+  uint64_t Mask = 0;
+  uint32_t PacketIdx = 0;
+#if X_SIMD_X86
+  const __m128i Value = _mm_set1_epi16((short)PID);
+  for (; PacketIdx + 16 <= m_NumPackets; PacketIdx += 16)
+  {
+    __m128i Eq0 = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *)(m_PID + PacketIdx)), Value);
+    __m128i Eq1 = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *)(m_PID + PacketIdx + 8)), Value);
+    Mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(Eq0, Eq1)) << PacketIdx;
+  }
+#endif
+  for (; PacketIdx < m_NumPackets; PacketIdx++)
+  {
+    Mask |= (uint64_t)(m_PID[PacketIdx] == PID) << PacketIdx;
+  }
+  return Mask;
+}
+
+uint64_t xTS_PacketHeaderBatch::getStartMask() const
+{
+  uint64_t Mask = 0;
+  uint32_t PacketIdx = 0;
+#if X_SIMD_X86
+  for (; PacketIdx + 16 <= m_NumPackets; PacketIdx += 16)
+  {
+    // move payload unit start bit (bit 6) into sign bit
+    __m128i Flags = _mm_load_si128((const __m128i *)(m_Flags + PacketIdx));
+    Mask |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_add_epi8(Flags, Flags)) << PacketIdx;
+  }
+#endif
+  for (; PacketIdx < m_NumPackets; PacketIdx++)
+  {
+    Mask |= (uint64_t)((m_Flags[PacketIdx] & eFlags_PayloadUnitStart) != 0) << PacketIdx;
+  }
+  return Mask;
 }
 
 //=============================================================================================================================================================================
@@ -99,6 +265,20 @@ void xTS_AdaptationField::Reset()
   this->m_NumStuffingBytes = 0;
 }
 
+bool xTS_AdaptationField::PeekPCR(const uint8_t *Packet, uint64_t &PCR)
+{
+  const uint8_t *AdaptationField = Packet + xTS::TS_HeaderLength;
+  // adaptation field present, long enough for PCR, PCR_flag set
+  if ((xTS_HeaderLayout::AFC::Get(Packet) & 0x2) == 0 || xTS_AdaptationFieldLayout::Length::Get(AdaptationField) < 1 + xTS_AdaptationFieldLayout::ClockReferenceLength ||
+      !xTS_AdaptationFieldLayout::PCRFlag::Get(AdaptationField))
+  {
+    return false;
+  }
+  const uint8_t *ClockReference = AdaptationField + xTS_AdaptationFieldLayout::ClockReferencesOffset;
+  PCR = xTS_ClockReferenceLayout::Base::Get(ClockReference) * xTS::BaseToExtendedClockMultiplier + xTS_ClockReferenceLayout::Extension::Get(ClockReference);
+  return true;
+}
+
 /**
   @brief Parse adaptation field
   @param PacketBuffer is pointer to buffer containing TS packet
@@ -113,56 +293,56 @@ int32_t xTS_AdaptationField::Parse(const uint8_t *PacketBuffer, uint8_t Adaptati
     // setup | DONE
     this->m_AdaptationFieldControl = AdaptationFieldControl;
 
-    // mandatory fields | DONE
-    this->m_AdaptationFieldLength = PacketBuffer[0];
-    this->m_DiscontinuityIndicator = (PacketBuffer[1] & 0b10000000) >> 7;
-    this->m_RandomAccessIndicator = (PacketBuffer[1] & 0b01000000) >> 6;
-    this->m_ElementaryStreamPriorityIndicator = (PacketBuffer[1] & 0b00100000) >> 5;
-    this->m_PCRFlag = (PacketBuffer[1] & 0b00010000) >> 4;
-    this->m_OPCRFlag = (PacketBuffer[1] & 0b00001000) >> 3;
-    this->m_SplicingPointFlag = (PacketBuffer[1] & 0b00000100) >> 2;
-    this->m_TransportPrivateDataFlag = (PacketBuffer[1] & 0b00000010) >> 1;
-    this->m_AdaptationFieldExtensionFlag = (PacketBuffer[1] & 0b00000001);
-
-    xTS packet;
-
-    // optional fields - PCR | DONE
+    // mandatory fields - flags byte is present only in non-empty adaptation field | DONE
+    this->m_AdaptationFieldLength = xTS_AdaptationFieldLayout::Length::Get(PacketBuffer);
+    const uint8_t Present = m_AdaptationFieldLength > 0;
+    this->m_DiscontinuityIndicator = xTS_AdaptationFieldLayout::DiscontinuityIndicator::Get(PacketBuffer) & Present;
+    this->m_RandomAccessIndicator = xTS_AdaptationFieldLayout::RandomAccessIndicator::Get(PacketBuffer) & Present;
+    this->m_ElementaryStreamPriorityIndicator = xTS_AdaptationFieldLayout::ElementaryStreamPriorityIndicator::Get(PacketBuffer) & Present;
+    this->m_PCRFlag = xTS_AdaptationFieldLayout::PCRFlag::Get(PacketBuffer) & Present;
+    this->m_OPCRFlag = xTS_AdaptationFieldLayout::OPCRFlag::Get(PacketBuffer) & Present;
+    this->m_SplicingPointFlag = xTS_AdaptationFieldLayout::SplicingPointFlag::Get(PacketBuffer) & Present;
+    this->m_TransportPrivateDataFlag = xTS_AdaptationFieldLayout::TransportPrivateDataFlag::Get(PacketBuffer) & Present;
+    this->m_AdaptationFieldExtensionFlag = xTS_AdaptationFieldLayout::AdaptationFieldExtensionFlag::Get(PacketBuffer) & Present;
+
+    // optional fields - PCR, then OPCR (right after flags when there is no PCR) | DONE
+    const uint8_t *ClockReference = PacketBuffer + xTS_AdaptationFieldLayout::ClockReferencesOffset;
     if (this->m_PCRFlag)
     {
-      this->m_ProgramClockReferenceBase = (uint64_t)(PacketBuffer[2] << 25) |
-                                          (uint64_t)(PacketBuffer[3] << 17) | (uint64_t)(PacketBuffer[4] << 9) |
-                                          (uint64_t)(PacketBuffer[5] << 1) | (uint64_t)(PacketBuffer[6] >> 7);
-      this->m_ProgramClockReferenceExtension = (uint16_t)((PacketBuffer[6] & 0b00000001) << 8) | (uint16_t)(PacketBuffer[7]);
-      this->m_ProgramClockReference = (m_ProgramClockReferenceBase * 300 + m_ProgramClockReferenceExtension); // PCR(i) = PCR _ base(i) * 300 + PCR _ ext(i) | strona 31 dokumentacja
-      this->m_ProgramClockReferenceTime = (float)m_ProgramClockReference / packet.ExtendedClockFrequency_Hz;
+      this->m_ProgramClockReferenceBase = xTS_ClockReferenceLayout::Base::Get(ClockReference);
+      this->m_ProgramClockReferenceExtension = xTS_ClockReferenceLayout::Extension::Get(ClockReference);
+      this->m_ProgramClockReference = m_ProgramClockReferenceBase * xTS::BaseToExtendedClockMultiplier + m_ProgramClockReferenceExtension; // PCR(i) = PCR_base(i) * 300 + PCR_ext(i)
+      this->m_ProgramClockReferenceTime = (float)m_ProgramClockReference / xTS::ExtendedClockFrequency_Hz;
+      ClockReference += xTS_AdaptationFieldLayout::ClockReferenceLength;
+    }
+    else
+    {
+      this->m_ProgramClockReferenceBase = 0;
+      this->m_ProgramClockReferenceExtension = 0;
+      this->m_ProgramClockReference = 0;
+      this->m_ProgramClockReferenceTime = 0;
     }
 
-    // optional fields - OPCR | DONE
     if (this->m_OPCRFlag)
     {
-      this->m_OriginalProgramClockReferenceBase = (uint64_t)(PacketBuffer[8] << 25) |
-                                                  (uint64_t)(PacketBuffer[9] << 17) | (uint64_t)(PacketBuffer[10] << 9) |
-                                                  (uint64_t)(PacketBuffer[11] << 1) | (uint64_t)(PacketBuffer[12] >> 7);
-      this->m_OriginalProgramClockReferenceExtension = (uint16_t)((PacketBuffer[12] & 0b00000001) << 8) | (uint16_t)(PacketBuffer[13]);
-      this->m_OriginalProgramClockReference = (m_OriginalProgramClockReferenceBase * 300 + m_OriginalProgramClockReferenceExtension);
-      this->m_OriginalProgramClockReferenceTime = (float)m_OriginalProgramClockReference / packet.ExtendedClockFrequency_Hz;
+      this->m_OriginalProgramClockReferenceBase = xTS_ClockReferenceLayout::Base::Get(ClockReference);
+      this->m_OriginalProgramClockReferenceExtension = xTS_ClockReferenceLayout::Extension::Get(ClockReference);
+      this->m_OriginalProgramClockReference = m_OriginalProgramClockReferenceBase * xTS::BaseToExtendedClockMultiplier + m_OriginalProgramClockReferenceExtension;
+      this->m_OriginalProgramClockReferenceTime = (float)m_OriginalProgramClockReference / xTS::ExtendedClockFrequency_Hz;
+    }
+    else
+    {
+      this->m_OriginalProgramClockReferenceBase = 0;
+      this->m_OriginalProgramClockReferenceExtension = 0;
+      this->m_OriginalProgramClockReference = 0;
+      this->m_OriginalProgramClockReferenceTime = 0;
     }
 
     // calculate stuffing bytes | DONE
+    this->m_NumStuffingBytes = 0;
     if (this->m_AdaptationFieldLength > 0)
     {
-      int numBytes = getNumBytes();
-      if (this->m_PCRFlag)
-      {
-        // subtract PCR bytes
-        numBytes -= 6;
-      }
-      if (this->m_OPCRFlag)
-      {
-        // subtract OPCR bytes
-        numBytes -= 6;
-      }
-      this->m_NumStuffingBytes = numBytes;
+      this->m_NumStuffingBytes = (uint8_t)(getNumBytes() - (m_PCRFlag + m_OPCRFlag) * xTS_AdaptationFieldLayout::ClockReferenceLength);
     }
     return m_AdaptationFieldLength + 1;
   }
@@ -172,48 +352,104 @@ int32_t xTS_AdaptationField::Parse(const uint8_t *PacketBuffer, uint8_t Adaptati
   }
 }
 
+/*
+Packet shapes - adaptation_field_control selects layout of packet, every layout has its own path:
+  01 payload only       - nothing to parse, payload right after header (most of packets of every elementary stream)
+  11 AF + payload       - adaptation field parsed, payload after it (PCR carriers, random access points, stuffing)
+  10 AF only            - adaptation field parsed, no payload (PCR-only PIDs)
+  00 reserved           - no adaptation field, no payload (decoders discard such packets)
+*/
+template <uint8_t AdaptationFieldControl>
+int32_t xTS_AdaptationField::xParseShape(const uint8_t *Packet)
+{
+  if constexpr (AdaptationFieldControl == 0x1)
+  {
+    // remaining fields are meaningful only for packets with adaptation field
+    this->m_AdaptationFieldControl = AdaptationFieldControl;
+    this->m_AdaptationFieldLength = 0;
+    return xTS::TS_HeaderLength;
+  }
+  else if constexpr (AdaptationFieldControl == 0x3)
+  {
+    uint32_t PayloadOffset = xTS::TS_HeaderLength + Parse(Packet + xTS::TS_HeaderLength, AdaptationFieldControl);
+    return PayloadOffset < xTS::TS_PacketLength ? PayloadOffset : xTS::TS_PacketLength;
+  }
+  else if constexpr (AdaptationFieldControl == 0x2)
+  {
+    Parse(Packet + xTS::TS_HeaderLength, AdaptationFieldControl);
+    return xTS::TS_PacketLength;
+  }
+  else
+  {
+    this->m_AdaptationFieldControl = AdaptationFieldControl;
+    this->m_AdaptationFieldLength = 0;
+    return xTS::TS_PacketLength;
+  }
+}
+
+/**
+  @brief Parse adaptation field of whole TS packet (if it has one) on path specialised for packet shape
+  @param Packet is pointer to TS packet (sync byte first)
+  @param AdaptationFieldControl is value of Adaptation Field Control field of packet header
+  @return Offset of payload within packet (TS_PacketLength when packet has no payload)
+*/
+int32_t xTS_AdaptationField::ParsePacket(const uint8_t *Packet, uint8_t AdaptationFieldControl)
+{
+  switch (AdaptationFieldControl & 0x3)
+  {
+  case 0x1:
+    return xParseShape<0x1>(Packet);
+  case 0x3:
+    return xParseShape<0x3>(Packet);
+  case 0x2:
+    return xParseShape<0x2>(Packet);
+  default:
+    return xParseShape<0x0>(Packet);
+  }
+}
+
 /// @brief Print all TS packet header fields | DONE
 void xTS_AdaptationField::Print() const
 {
-  std::cout << "AF:" << std::endl;
-  std::cout << "  Adaptation field length: " << (int)m_AdaptationFieldLength << std::endl;
-  std::cout << "  Discontinuity indicator: " << (int)m_DiscontinuityIndicator << std::endl;
-  std::cout << "  Random Access indicator: " << (int)m_RandomAccessIndicator << std::endl;
-  std::cout << "  Elementary stream priority indicator: " << (int)m_ElementaryStreamPriorityIndicator << std::endl;
-  std::cout << "  PCR flag: " << (int)m_PCRFlag << std::endl;
-  std::cout << "  OPCR flag: " << (int)m_OPCRFlag << std::endl;
-  std::cout << "  Splicing point flag: " << (int)m_SplicingPointFlag << std::endl;
-  std::cout << "  Transport private data flag: " << (int)m_TransportPrivateDataFlag << std::endl;
-  std::cout << "  Adaptation field extension flag: " << (int)m_AdaptationFieldExtensionFlag << std::endl;
+  std::cout << "AF:" << '\n';
+  std::cout << "  Adaptation field length: " << (int)m_AdaptationFieldLength << '\n';
+  std::cout << "  Discontinuity indicator: " << (int)m_DiscontinuityIndicator << '\n';
+  std::cout << "  Random Access indicator: " << (int)m_RandomAccessIndicator << '\n';
+  std::cout << "  Elementary stream priority indicator: " << (int)m_ElementaryStreamPriorityIndicator << '\n';
+  std::cout << "  PCR flag: " << (int)m_PCRFlag << '\n';
+  std::cout << "  OPCR flag: " << (int)m_OPCRFlag << '\n';
+  std::cout << "  Splicing point flag: " << (int)m_SplicingPointFlag << '\n';
+  std::cout << "  Transport private data flag: " << (int)m_TransportPrivateDataFlag << '\n';
+  std::cout << "  Adaptation field extension flag: " << (int)m_AdaptationFieldExtensionFlag << '\n';
 
   if ((int)m_ProgramClockReferenceBase != 0)
   {
-    std::cout << "  Program clock reference base: " << (int)m_ProgramClockReferenceBase << std::endl;
+    std::cout << "  Program clock reference base: " << (int)m_ProgramClockReferenceBase << '\n';
   }
 
   if ((int)m_ProgramClockReferenceExtension != 0)
   {
-    std::cout << "  Program clock reference extension: " << (int)m_ProgramClockReferenceExtension << std::endl;
+    std::cout << "  Program clock reference extension: " << (int)m_ProgramClockReferenceExtension << '\n';
   }
 
   if ((int)m_ProgramClockReference != 0)
   {
-    std::cout << "  Program clock reference: " << (int)m_ProgramClockReference << " (Time=" << (float)m_ProgramClockReferenceTime << "s)" << std::endl;
+    std::cout << "  Program clock reference: " << (int)m_ProgramClockReference << " (Time=" << (float)m_ProgramClockReferenceTime << "s)" << '\n';
   }
 
   if ((int)m_OriginalProgramClockReferenceBase != 0)
   {
-    std::cout << "  Original program clock reference base: " << (int)m_OriginalProgramClockReferenceBase << std::endl;
+    std::cout << "  Original program clock reference base: " << (int)m_OriginalProgramClockReferenceBase << '\n';
   }
 
   if ((unsigned int)m_OriginalProgramClockReferenceExtension != 0)
   {
-    std::cout << "  Original program clock reference extension: " << (unsigned int)m_OriginalProgramClockReferenceExtension << " (Time=" << (float)m_OriginalProgramClockReferenceTime << "s)" << std::endl;
+    std::cout << "  Original program clock reference extension: " << (unsigned int)m_OriginalProgramClockReferenceExtension << " (Time=" << (float)m_OriginalProgramClockReferenceTime << "s)" << '\n';
   }
 
   if ((int)m_NumStuffingBytes != 0)
   {
-    std::cout << "  Stuffing bytes: " << (int)m_NumStuffingBytes << std::endl;
+    std::cout << "  Stuffing bytes: " << (int)m_NumStuffingBytes << '\n';
   }
 }
 
@@ -225,334 +461,631 @@ void xPES_PacketHeader::Reset()
   this->m_PacketStartCodePrefix = 0;
   this->m_StreamId = 0;
   this->m_PacketLength = 0;
+  this->m_PTS_DTS_Flags = ePTS_DTS_Flags_None;
+  this->m_NumHeaderBytes = 0;
+  std::fill(m_FieldOffsets, m_FieldOffsets + eOptionalField_Num, (uint16_t)OptionalFieldsOffset);
+  std::memset(m_Header, 0, OptionalFieldsOffset);
+}
+
+/// @brief Stream ids listed in ISO/IEC 13818-1 Table 2-21 without optional PES header
+bool xPES_PacketHeader::hasOptionalHeader() const
+{
+  return m_PacketStartCodePrefix == 0x000001 &&
+         m_StreamId != eStreamId_program_stream_map &&
+         m_StreamId != eStreamId_padding_stream &&
+         m_StreamId != eStreamId_private_stream_2 &&
+         m_StreamId != eStreamId_ECM &&
+         m_StreamId != eStreamId_EMM &&
+         m_StreamId != eStreamId_program_stream_directory &&
+         m_StreamId != eStreamId_DSMCC_stream &&
+         m_StreamId != eStreamId_ITUT_H222_1_type_E;
 }
 
-int32_t xPES_PacketHeader::Parse(const uint8_t *PacketBuffer)
+/**
+  @brief Parse fixed PES header and copy optional header (its fields are decoded by getters)
+  @param PacketBuffer is pointer to first byte of PES packet
+  @param Length is number of available bytes of PES packet
+  @return PES_packet_length (-1 on failure)
+*/
+int32_t xPES_PacketHeader::Parse(const uint8_t *PacketBuffer, uint32_t Length)
 {
-  this->m_PacketStartCodePrefix = PacketBuffer[0] << 16 | PacketBuffer[1] << 8 | PacketBuffer[2];
-  this->m_StreamId = PacketBuffer[3];
-  this->m_PacketLength = PacketBuffer[4] << 8 | PacketBuffer[5];
+  if (PacketBuffer == nullptr || Length < xTS::PES_HeaderLength)
+  {
+    Reset();
+    return NOT_VALID;
+  }
+
+  this->m_PacketStartCodePrefix = xPES_HeaderLayout::PacketStartCodePrefix::Get(PacketBuffer);
+  this->m_StreamId = xPES_HeaderLayout::StreamId::Get(PacketBuffer);
+  this->m_PacketLength = xPES_HeaderLayout::PacketLength::Get(PacketBuffer);
+
+  // flag bytes stay zero unless whole fixed part of optional header is present - getters need no other check
+  std::memset(m_Header, 0, OptionalFieldsOffset);
+  uint32_t NumHeaderBytes = xTS::PES_HeaderLength;
+  if (hasOptionalHeader() && Length >= OptionalFieldsOffset)
+  {
+    NumHeaderBytes = std::min(Length, OptionalFieldsOffset + xPES_HeaderLayout::HeaderDataLength::Get(PacketBuffer));
+  }
+  std::memcpy(m_Header, PacketBuffer, NumHeaderBytes);
+  this->m_NumHeaderBytes = (uint16_t)NumHeaderBytes;
+
+  this->m_PTS_DTS_Flags = xPES_HeaderLayout::PTS_DTS_Flags::Get(m_Header);
+  uint32_t Offset = OptionalFieldsOffset;
+  Offset += (m_PTS_DTS_Flags >> 1) * xPES_HeaderLayout::PTS::Length;
+  Offset += (m_PTS_DTS_Flags == ePTS_DTS_Flags_PTS_DTS) * xPES_HeaderLayout::DTS::Length;
+  this->m_FieldOffsets[eOptionalField_ESCR] = (uint16_t)Offset;
+  Offset += xPES_HeaderLayout::ESCRFlag::Get(m_Header) * xPES_ESCRLayout::Length;
+  this->m_FieldOffsets[eOptionalField_ESRate] = (uint16_t)Offset;
+  Offset += xPES_HeaderLayout::ESRateFlag::Get(m_Header) * xPES_ESRateLayout::Length;
+  this->m_FieldOffsets[eOptionalField_DSMTrickMode] = (uint16_t)Offset;
+  Offset += xPES_HeaderLayout::DSMTrickModeFlag::Get(m_Header) * xPES_TrickModeLayout::Length;
+  this->m_FieldOffsets[eOptionalField_AdditionalCopyInfo] = (uint16_t)Offset;
+  Offset += xPES_HeaderLayout::AdditionalCopyInfoFlag::Get(m_Header) * xPES_AdditionalCopyInfoLayout::Length;
+  this->m_FieldOffsets[eOptionalField_PreviousPacketCRC] = (uint16_t)Offset;
+  Offset += xPES_HeaderLayout::CRCFlag::Get(m_Header) * xPES_CRCLayout::Length;
+  this->m_FieldOffsets[eOptionalField_Extension] = (uint16_t)Offset;
 
   return m_PacketLength;
 }
 
-void xPES_PacketHeader::Print() const
+uint8_t xPES_PacketHeader::getScramblingControl() const { return xPES_HeaderLayout::ScramblingControl::Get(m_Header); }
+uint8_t xPES_PacketHeader::getPriority() const { return xPES_HeaderLayout::Priority::Get(m_Header); }
+uint8_t xPES_PacketHeader::getDataAlignmentIndicator() const { return xPES_HeaderLayout::DataAlignmentIndicator::Get(m_Header); }
+uint8_t xPES_PacketHeader::getCopyright() const { return xPES_HeaderLayout::Copyright::Get(m_Header); }
+uint8_t xPES_PacketHeader::getOriginalOrCopy() const { return xPES_HeaderLayout::OriginalOrCopy::Get(m_Header); }
+uint8_t xPES_PacketHeader::getHeaderDataLength() const { return xPES_HeaderLayout::HeaderDataLength::Get(m_Header); }
+
+uint32_t xPES_PacketHeader::getHeaderLength() const
 {
-  std::cout << "PES:" << std::endl;
-  std::cout << "  Packet Start Code Prefix: " << (int)m_PacketStartCodePrefix << std::endl;
-  std::cout << "  Stream ID: " << (int)m_StreamId << std::endl;
-  std::cout << "  Packet Length: " << (int)m_PacketLength << std::endl;
+  return hasOptionalHeader() ? OptionalFieldsOffset + getHeaderDataLength() : xTS::PES_HeaderLength;
 }
 
-//=============================================================================================================================================================================
+uint64_t xPES_PacketHeader::getPTS() const
+{
+  if ((m_PTS_DTS_Flags & ePTS_DTS_Flags_PTS) == 0 || m_NumHeaderBytes < xPES_HeaderLayout::PTS::EndOffset)
+  {
+    return 0;
+  }
+  return xPES_HeaderLayout::PTS::Get(m_Header);
+}
 
-void xPES_Assembler::xBufferReset()
+uint64_t xPES_PacketHeader::getDTS() const
 {
-  this->m_Buffer = 0;
-  this->m_BufferSize = 0;
-  this->m_DataOffset = 0;
+  if (m_PTS_DTS_Flags != ePTS_DTS_Flags_PTS_DTS || m_NumHeaderBytes < xPES_HeaderLayout::DTS::EndOffset)
+  {
+    return 0;
+  }
+  return xPES_HeaderLayout::DTS::Get(m_Header);
 }
 
-xPES_Assembler::eResult xPES_Assembler::AbsorbPacket(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField)
+// optional field is present (flag checked by caller) and lies within copied header
+bool xPES_PacketHeader::xHasField(eOptionalField Field, uint32_t Length) const
 {
-  uint8_t temp_BufferSize = 0;
+  return m_FieldOffsets[Field] + Length <= m_NumHeaderBytes;
+}
 
-  if (PacketHeader->getPID() == 136)
+bool xPES_PacketHeader::getESCR(uint64_t &ESCR) const
+{
+  if (!xPES_HeaderLayout::ESCRFlag::Get(m_Header) || !xHasField(eOptionalField_ESCR, xPES_ESCRLayout::Length))
   {
-    if (PacketHeader->getStart())
-    {
-      xBufferReset();
-      this->m_Started = true;
-      m_PESH.Reset();
-      m_PESH.Parse(TransportStreamPacket);
-      this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+    return false;
+  }
+  const uint8_t *Field = m_Header + m_FieldOffsets[eOptionalField_ESCR];
+  uint64_t Base = (uint64_t)xPES_ESCRLayout::BaseHigh::Get(Field) << 30 | (uint64_t)xPES_ESCRLayout::BaseMiddle::Get(Field) << 15 | (uint64_t)xPES_ESCRLayout::BaseLow::Get(Field);
+  ESCR = Base * xTS::BaseToExtendedClockMultiplier + xPES_ESCRLayout::Extension::Get(Field);
+  return true;
+}
 
-      if (m_PESH.getPacketStartCodePrefix() == 0x000001)
-      {
-        if (m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_program_stream_map &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_padding_stream &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_private_stream_2 &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_ECM &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_EMM &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_program_stream_directory &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_DSMCC_stream &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_ITUT_H222_1_type_E)
-        {
-
-          int a = (TransportStreamPacket[7] & 0b11000000) >> 6;
-
-          if (a == 2)
-          {
-            uint64_t pts = 0;
-
-            uint64_t pts1 = ((TransportStreamPacket[9] & 0b00001110) >> 1);
-            uint64_t pts2 = (TransportStreamPacket[10]);
-            uint64_t pts3 = ((TransportStreamPacket[11] & 0b11111110) >> 1);
-            uint64_t pts4 = (TransportStreamPacket[12]);
-            uint64_t pts5 = ((TransportStreamPacket[13] & 0b11111110) >> 1);
-
-            pts = pts1 << 30 | pts2 << 22 | pts3 << 15 | pts4 << 7 | pts5;
-            double timePTS = pts / 90000.0;
-
-            std::cout << std::endl;
-            std::cout << "PTS:" << std::endl;
-            std::cout << "  PTS value: " << pts << std::endl;
-            std::cout << "  (Time=" << timePTS << "s)" << std::endl;
-          }
-          else if (a == 3)
-          {
-            uint64_t pts = 0;
-            uint64_t dts = 0;
-
-            uint64_t pts1 = ((TransportStreamPacket[9] & 0b00001110) >> 1);
-            uint64_t pts2 = (TransportStreamPacket[10]);
-            uint64_t pts3 = ((TransportStreamPacket[11] & 0b11111110) >> 1);
-            uint64_t pts4 = (TransportStreamPacket[12]);
-            uint64_t pts5 = ((TransportStreamPacket[13] & 0b11111110) >> 1);
-
-            pts = pts1 << 30 | pts2 << 22 | pts3 << 15 | pts4 << 7 | pts5;
-
-            uint64_t dts1 = ((TransportStreamPacket[14] & 0b00001110) >> 1);
-            uint64_t dts2 = (TransportStreamPacket[15]);
-            uint64_t dts3 = ((TransportStreamPacket[16] & 0b11111110) >> 1);
-            uint64_t dts4 = (TransportStreamPacket[17]);
-            uint64_t dts5 = ((TransportStreamPacket[18] & 0b11111110) >> 1);
-
-            dts = dts1 << 30 | dts2 << 22 | dts3 << 15 | dts4 << 7 | dts5;
-
-            double timePTS = pts / 90000.0;
-            double timeDTS = dts / 90000.0;
-
-            uint64_t ptsDiffDts = pts - dts;
-            double timePtsDiffDts = ptsDiffDts / 90000.0;
-
-            std::cout << std::endl;
-            std::cout << "PTS and DTS:" << std::endl;
-            std::cout << "  PTS value: " << pts << std::endl;
-            std::cout << "  (Time=" << timePTS << "s)" << std::endl;
-            std::cout << "  DTS value: " << dts << std::endl;
-            std::cout << "  (Time=" << timeDTS << "s)" << std::endl;
-            std::cout << "  PTS-DTS value: " << ptsDiffDts << std::endl;
-            std::cout << "  (Time=" << timePtsDiffDts << "s)\n"
-                      << std::endl;
-          }
-
-          if (PacketHeader->hasAdaptationField())
-          {
-            temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-          }
-          else
-          {
-            temp_BufferSize = 4;
-          }
-          this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-        }
-        else
-        {
-          if (PacketHeader->hasAdaptationField())
-          {
-            temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-          }
-          else
-          {
-            temp_BufferSize = 4;
-          }
-
-          this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-        }
-      }
+bool xPES_PacketHeader::getESRate(uint32_t &ESRate) const
+{
+  if (!xPES_HeaderLayout::ESRateFlag::Get(m_Header) || !xHasField(eOptionalField_ESRate, xPES_ESRateLayout::Length))
+  {
+    return false;
+  }
+  ESRate = xPES_ESRateLayout::Rate::Get(m_Header + m_FieldOffsets[eOptionalField_ESRate]);
+  return true;
+}
 
-      this->m_BufferSize = 188 - temp_BufferSize;
-      this->m_DataOffset += m_BufferSize;
+bool xPES_PacketHeader::getTrickMode(uint8_t &Control, uint8_t &Mode) const
+{
+  if (!xPES_HeaderLayout::DSMTrickModeFlag::Get(m_Header) || !xHasField(eOptionalField_DSMTrickMode, xPES_TrickModeLayout::Length))
+  {
+    return false;
+  }
+  const uint8_t *Field = m_Header + m_FieldOffsets[eOptionalField_DSMTrickMode];
+  Control = xPES_TrickModeLayout::Control::Get(Field);
+  Mode = xPES_TrickModeLayout::Mode::Get(Field);
+  return true;
+}
 
-      return eResult::AssemblingStarted;
+bool xPES_PacketHeader::getAdditionalCopyInfo(uint8_t &Info) const
+{
+  if (!xPES_HeaderLayout::AdditionalCopyInfoFlag::Get(m_Header) || !xHasField(eOptionalField_AdditionalCopyInfo, xPES_AdditionalCopyInfoLayout::Length))
+  {
+    return false;
+  }
+  Info = xPES_AdditionalCopyInfoLayout::Info::Get(m_Header + m_FieldOffsets[eOptionalField_AdditionalCopyInfo]);
+  return true;
+}
+
+bool xPES_PacketHeader::getPreviousPacketCRC(uint16_t &CRC) const
+{
+  if (!xPES_HeaderLayout::CRCFlag::Get(m_Header) || !xHasField(eOptionalField_PreviousPacketCRC, xPES_CRCLayout::Length))
+  {
+    return false;
+  }
+  CRC = xPES_CRCLayout::PreviousPacketCRC::Get(m_Header + m_FieldOffsets[eOptionalField_PreviousPacketCRC]);
+  return true;
+}
+
+// length of PES extension, -1 when it is not present or does not fit in copied header
+int32_t xPES_PacketHeader::xGetExtensionLength() const
+{
+  if (!xPES_HeaderLayout::ExtensionFlag::Get(m_Header) || !xHasField(eOptionalField_Extension, xPES_ExtensionLayout::Length))
+  {
+    return NOT_VALID;
+  }
+  const uint8_t *Field = m_Header + m_FieldOffsets[eOptionalField_Extension];
+  uint32_t Length = xPES_ExtensionLayout::Length;
+  Length += xPES_ExtensionLayout::PrivateDataFlag::Get(Field) * xPES_ExtensionLayout::PrivateDataLength;
+  if (xPES_ExtensionLayout::PackHeaderFieldFlag::Get(Field))
+  {
+    if (!xHasField(eOptionalField_Extension, Length + 1))
+    {
+      return NOT_VALID;
     }
+    Length += 1 + xPES_ExtensionLayout::PackFieldLength::Get(Field + Length);
+  }
+  Length += xPES_ExtensionLayout::SequenceCounterFlag::Get(Field) * xPES_ExtensionLayout::SequenceCounterLength;
+  Length += xPES_ExtensionLayout::P_STD_BufferFlag::Get(Field) * xPES_ExtensionLayout::P_STD_BufferLength;
+  if (xPES_ExtensionLayout::Extension2Flag::Get(Field))
+  {
+    if (!xHasField(eOptionalField_Extension, Length + 1))
+    {
+      return NOT_VALID;
+    }
+    Length += 1 + xPES_ExtensionLayout::Extension2FieldLength::Get(Field + Length);
+  }
+  return xHasField(eOptionalField_Extension, Length) ? (int32_t)Length : NOT_VALID;
+}
 
-    if (this->m_Started)
+bool xPES_PacketHeader::getExtension(xExtension &Extension) const
+{
+  if (xGetExtensionLength() == NOT_VALID)
+  {
+    return false;
+  }
+  Extension = {};
+  const uint8_t *Field = m_Header + m_FieldOffsets[eOptionalField_Extension];
+  Extension.PrivateDataFlag = xPES_ExtensionLayout::PrivateDataFlag::Get(Field);
+  Extension.PackHeaderFieldFlag = xPES_ExtensionLayout::PackHeaderFieldFlag::Get(Field);
+  Extension.SequenceCounterFlag = xPES_ExtensionLayout::SequenceCounterFlag::Get(Field);
+  Extension.P_STD_BufferFlag = xPES_ExtensionLayout::P_STD_BufferFlag::Get(Field);
+  Extension.Extension2Flag = xPES_ExtensionLayout::Extension2Flag::Get(Field);
+
+  const uint8_t *Part = Field + xPES_ExtensionLayout::Length;
+  if (Extension.PrivateDataFlag)
+  {
+    Extension.PrivateData = Part;
+    Part += xPES_ExtensionLayout::PrivateDataLength;
+  }
+  if (Extension.PackHeaderFieldFlag)
+  {
+    Extension.PackFieldLength = xPES_ExtensionLayout::PackFieldLength::Get(Part);
+    Extension.PackHeader = Part + 1;
+    Part += 1 + Extension.PackFieldLength;
+  }
+  if (Extension.SequenceCounterFlag)
+  {
+    Extension.ProgramPacketSequenceCounter = xPES_ExtensionLayout::SequenceCounter::Get(Part);
+    Extension.MPEG1_MPEG2_Identifier = xPES_ExtensionLayout::MPEG1_MPEG2_Identifier::Get(Part);
+    Extension.OriginalStuffLength = xPES_ExtensionLayout::OriginalStuffLength::Get(Part);
+    Part += xPES_ExtensionLayout::SequenceCounterLength;
+  }
+  if (Extension.P_STD_BufferFlag)
+  {
+    Extension.P_STD_BufferScale = xPES_ExtensionLayout::P_STD_BufferScale::Get(Part);
+    Extension.P_STD_BufferSize = xPES_ExtensionLayout::P_STD_BufferSize::Get(Part);
+    Part += xPES_ExtensionLayout::P_STD_BufferLength;
+  }
+  if (Extension.Extension2Flag)
+  {
+    Extension.Extension2FieldLength = xPES_ExtensionLayout::Extension2FieldLength::Get(Part);
+    if (Extension.Extension2FieldLength > 0)
     {
-      if (PacketHeader->hasAdaptationField())
-      {
-        temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-      }
-      else
-      {
-        temp_BufferSize = 4;
-      }
+      Extension.StreamIdExtensionFlag = xPES_ExtensionLayout::StreamIdExtensionFlag::Get(Part);
+      Extension.StreamIdExtension = Extension.StreamIdExtensionFlag ? 0 : xPES_ExtensionLayout::StreamIdExtension::Get(Part);
+    }
+  }
+  return true;
+}
 
-      this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-      this->m_BufferSize = 188 - temp_BufferSize;
-      this->m_DataOffset += m_BufferSize;
+int32_t xPES_PacketHeader::getNumStuffingBytes() const
+{
+  if (!hasOptionalHeader())
+  {
+    return 0;
+  }
+  int32_t FieldsEnd = m_FieldOffsets[eOptionalField_Extension];
+  if (xPES_HeaderLayout::ExtensionFlag::Get(m_Header))
+  {
+    int32_t ExtensionLength = xGetExtensionLength();
+    if (ExtensionLength == NOT_VALID)
+    {
+      return NOT_VALID;
+    }
+    FieldsEnd += ExtensionLength;
+  }
+  int32_t NumStuffingBytes = (int32_t)getHeaderLength() - FieldsEnd;
+  return NumStuffingBytes >= 0 ? NumStuffingBytes : NOT_VALID;
+}
 
-      if ((PacketHeader->getContinuityCounter() != this->m_LastContinuityCounter + 1) && (PacketHeader->getContinuityCounter() != 0 && this->m_LastContinuityCounter != 15))
-      {
-        this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+void xPES_PacketHeader::Print() const
+{
+  std::cout << "PES:" << '\n';
+  std::cout << "  Packet Start Code Prefix: " << (int)m_PacketStartCodePrefix << '\n';
+  std::cout << "  Stream ID: " << (int)m_StreamId << '\n';
+  std::cout << "  Packet Length: " << (int)m_PacketLength << '\n';
+}
 
-        return eResult::StreamPackedLost;
-      }
+/// @brief Print PTS (and DTS) carried in optional PES header
+void xPES_PacketHeader::PrintTimestamps() const
+{
+  if (!hasOptionalHeader())
+  {
+    return;
+  }
 
-      this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+  const uint64_t PTS = getPTS();
+  const uint64_t DTS = getDTS();
+  if (m_PTS_DTS_Flags == ePTS_DTS_Flags_PTS)
+  {
+    double timePTS = PTS / 90000.0;
 
-      if (this->m_DataOffset >= m_PESH.getPacketLength())
-      {
-        this->m_Started = false;
+    std::cout << '\n';
+    std::cout << "PTS:" << '\n';
+    std::cout << "  PTS value: " << PTS << '\n';
+    std::cout << "  (Time=" << timePTS << "s)" << '\n';
+  }
+  else if (m_PTS_DTS_Flags == ePTS_DTS_Flags_PTS_DTS)
+  {
+    double timePTS = PTS / 90000.0;
+    double timeDTS = DTS / 90000.0;
+
+    uint64_t ptsDiffDts = PTS - DTS;
+    double timePtsDiffDts = ptsDiffDts / 90000.0;
+
+    std::cout << '\n';
+    std::cout << "PTS and DTS:" << '\n';
+    std::cout << "  PTS value: " << PTS << '\n';
+    std::cout << "  (Time=" << timePTS << "s)" << '\n';
+    std::cout << "  DTS value: " << DTS << '\n';
+    std::cout << "  (Time=" << timeDTS << "s)" << '\n';
+    std::cout << "  PTS-DTS value: " << ptsDiffDts << '\n';
+    std::cout << "  (Time=" << timePtsDiffDts << "s)\n"
+              << '\n';
+  }
+}
 
-        return eResult::AssemblingFinished;
-      }
-      else
+//=============================================================================================================================================================================
+
+void xPES_Buffer::Reserve(uint32_t Capacity)
+{
+  if (Capacity <= m_Capacity)
+  {
+    return;
+  }
+  std::unique_ptr<uint8_t[]> Data(new uint8_t[Capacity]);
+  if (m_Size > 0)
+  {
+    std::memcpy(Data.get(), m_Data.get(), m_Size);
+  }
+  this->m_Data = std::move(Data);
+  this->m_Capacity = Capacity;
+}
+
+void xPES_Buffer::Append(const uint8_t *Data, uint32_t Size)
+{
+  if (m_Size + Size > m_Capacity)
+  {
+    Reserve(std::max(m_Size + Size, m_Capacity * 2));
+  }
+  std::memcpy(m_Data.get() + m_Size, Data, Size);
+  this->m_Size += Size;
+}
+
+//=============================================================================================================================================================================
+
+/**
+  @brief Take buffer from pool (recycled one if available)
+  @param Capacity is expected size of PES packet (0 when unknown)
+  @return Empty buffer owned by caller until Release()
+*/
+xPES_Buffer *xPES_BufferPool::Acquire(uint32_t Capacity)
+{
+  xPES_Buffer *Buffer;
+  if (!m_Free.empty())
+  {
+    Buffer = m_Free.back();
+    m_Free.pop_back();
+  }
+  else
+  {
+    m_Buffers.emplace_back(new xPES_Buffer());
+    Buffer = m_Buffers.back().get();
+    Buffer->m_Pool = this;
+  }
+  Buffer->Clear();
+  Buffer->Reserve(Capacity);
+  return Buffer;
+}
+
+void xPES_BufferPool::Release(xPES_Buffer *Buffer)
+{
+  Buffer->Clear();
+  m_Free.push_back(Buffer);
+}
+
+void xPES_PacketRef::Reset()
+{
+  if (m_Buffer != nullptr && --m_Buffer->m_RefCount == 0)
+  {
+    m_Buffer->m_Pool->Release(m_Buffer);
+  }
+  this->m_Buffer = nullptr;
+}
+
+//=============================================================================================================================================================================
+
+xPES_Assembler::xPES_Assembler()
+{
+  this->m_PID = NOT_VALID;
+  this->m_Buffer = nullptr;
+  this->m_DataOffset = 0;
+  this->m_NumStreamBytes = 0;
+  this->m_PacketStreamOffset = 0;
+  this->m_LastContinuityCounter = -1;
+  this->m_Started = false;
+  this->m_Damaged = false;
+  this->m_NumCompletedPackets = 0;
+  this->m_NumDroppedPackets = 0;
+}
+
+xPES_Assembler::~xPES_Assembler()
+{
+  xBufferReset();
+}
+
+void xPES_Assembler::xBufferReset()
+{
+  if (m_Buffer != nullptr)
+  {
+    m_BufferPool.Release(m_Buffer);
+  }
+  this->m_Buffer = nullptr;
+  this->m_DataOffset = 0;
+}
+
+/**
+  @brief Append payload to PES packet being assembled
+  @param Data is pointer to payload bytes
+  @param Size is number of payload bytes
+*/
+void xPES_Assembler::xBufferAppend(const uint8_t *Data, int32_t Size)
+{
+  this->m_DataOffset += Size;
+  if (m_Consumers.empty() || Size <= 0)
+  {
+    return; // nobody needs whole packets - do not copy at all
+  }
+
+  uint32_t ExpectedSize = m_PESH.getPacketLength() != 0 ? xTS::PES_HeaderLength + m_PESH.getPacketLength() : 0;
+  if (m_Buffer == nullptr)
+  {
+    this->m_Buffer = m_BufferPool.Acquire(ExpectedSize);
+  }
+  if (ExpectedSize != 0 && m_Buffer->getSize() + Size > ExpectedSize)
+  {
+    Size = ExpectedSize - m_Buffer->getSize(); // bytes past announced length do not belong to PES packet
+  }
+  m_Buffer->Append(Data, Size);
+}
+
+/// @brief Hand completed PES packet to consumers and recycle its buffer
+void xPES_Assembler::xBufferComplete()
+{
+  if (m_Damaged)
+  {
+    xBufferDrop();
+  }
+  else
+  {
+    this->m_NumCompletedPackets++;
+    if (m_Buffer != nullptr)
+    {
+      m_Buffer->setStreamOffset(m_PacketStreamOffset);
+      xPES_PacketRef Packet(m_Buffer);
+      this->m_Buffer = nullptr;
+      for (xPES_Consumer *Consumer : m_Consumers)
       {
-        return eResult::AssemblingContinue;
+        Consumer->OnPESPacket((uint16_t)m_PID, Packet);
       }
     }
   }
-  else if (PacketHeader->getPID() == 174)
+  if (m_Buffer != nullptr)
   {
-    if (PacketHeader->getStart())
-    {
-      xBufferReset();
-      this->m_Started = true;
-      m_PESH.Reset();
-      m_PESH.Parse(TransportStreamPacket);
-      this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+    m_BufferPool.Release(m_Buffer);
+    this->m_Buffer = nullptr;
+  }
+  this->m_Started = false;
+}
 
-      if (m_PESH.getPacketStartCodePrefix() == 0x000001)
-      {
-        if (m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_program_stream_map &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_padding_stream &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_private_stream_2 &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_ECM &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_EMM &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_program_stream_directory &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_DSMCC_stream &&
-            m_PESH.getStreamId() != xPES_PacketHeader::eStreamId_ITUT_H222_1_type_E)
-        {
-
-          int a = (TransportStreamPacket[7] & 0b11000000) >> 6;
-
-          if (a == 2)
-          {
-            uint64_t pts = 0;
-
-            uint64_t pts1 = ((TransportStreamPacket[9] & 0b00001110) >> 1);
-            uint64_t pts2 = (TransportStreamPacket[10]);
-            uint64_t pts3 = ((TransportStreamPacket[11] & 0b11111110) >> 1);
-            uint64_t pts4 = (TransportStreamPacket[12]);
-            uint64_t pts5 = ((TransportStreamPacket[13] & 0b11111110) >> 1);
-
-            pts = pts1 << 30 | pts2 << 22 | pts3 << 15 | pts4 << 7 | pts5;
-            double timePTS = pts / 90000.0;
-
-            std::cout << std::endl;
-            std::cout << "PTS:" << std::endl;
-            std::cout << "  PTS value: " << pts << std::endl;
-            std::cout << "  (Time=" << timePTS << "s)" << std::endl;
-          }
-          else if (a == 3)
-          {
-            uint64_t pts = 0;
-            uint64_t dts = 0;
-
-            uint64_t pts1 = ((TransportStreamPacket[9] & 0b00001110) >> 1);
-            uint64_t pts2 = (TransportStreamPacket[10]);
-            uint64_t pts3 = ((TransportStreamPacket[11] & 0b11111110) >> 1);
-            uint64_t pts4 = (TransportStreamPacket[12]);
-            uint64_t pts5 = ((TransportStreamPacket[13] & 0b11111110) >> 1);
-
-            pts = pts1 << 30 | pts2 << 22 | pts3 << 15 | pts4 << 7 | pts5;
-
-            uint64_t dts1 = ((TransportStreamPacket[14] & 0b00001110) >> 1);
-            uint64_t dts2 = (TransportStreamPacket[15]);
-            uint64_t dts3 = ((TransportStreamPacket[16] & 0b11111110) >> 1);
-            uint64_t dts4 = (TransportStreamPacket[17]);
-            uint64_t dts5 = ((TransportStreamPacket[18] & 0b11111110) >> 1);
-
-            dts = dts1 << 30 | dts2 << 22 | dts3 << 15 | dts4 << 7 | dts5;
-
-            double timePTS = pts / 90000.0;
-            double timeDTS = dts / 90000.0;
-
-            uint64_t ptsDiffDts = pts - dts;
-            double timePtsDiffDts = ptsDiffDts / 90000.0;
-
-            std::cout << std::endl;
-            std::cout << "PTS and DTS:" << std::endl;
-            std::cout << "  PTS value: " << pts << std::endl;
-            std::cout << "  (Time=" << timePTS << "s)" << std::endl;
-            std::cout << "  DTS value: " << dts << std::endl;
-            std::cout << "  (Time=" << timeDTS << "s)" << std::endl;
-            std::cout << "  PTS-DTS value: " << ptsDiffDts << std::endl;
-            std::cout << "  (Time=" << timePtsDiffDts << "s)\n"
-                      << std::endl;
-          }
-
-          if (PacketHeader->hasAdaptationField())
-          {
-            temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-          }
-          else
-          {
-            temp_BufferSize = 4;
-          }
-
-          this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-        }
-        else
-        {
-          if (PacketHeader->hasAdaptationField())
-          {
-            temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-          }
-          else
-          {
-            temp_BufferSize = 4;
-          }
-
-          this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-        }
-      }
+/// @brief Count PES packet as dropped, consumers are told that stream does not continue seamlessly
+void xPES_Assembler::xBufferDrop()
+{
+  this->m_NumDroppedPackets++;
+  for (xPES_Consumer *Consumer : m_Consumers)
+  {
+    Consumer->OnDiscontinuity((uint16_t)m_PID);
+  }
+}
 
-      this->m_BufferSize = 188 - temp_BufferSize;
-      this->m_DataOffset += m_BufferSize;
+/**
+  @brief Prepare assembler for new stream, consumers of previous stream are removed
+  @param PID is packet identifier of elementary stream carried in PES packets
+*/
+void xPES_Assembler::Init(int32_t PID)
+{
+  this->m_PID = PID;
+  m_Consumers.clear();
+  xBufferReset();
+  this->m_NumStreamBytes = 0;
+  this->m_PacketStreamOffset = 0;
+  this->m_LastContinuityCounter = -1;
+  this->m_Started = false;
+  this->m_Damaged = false;
+  m_PESH.Reset();
+}
 
-      return eResult::AssemblingStarted;
+/// @brief End of stream - PES packet of unbounded length is complete
+void xPES_Assembler::Flush()
+{
+  if (m_Started && m_PESH.getPacketLength() == 0)
+  {
+    xBufferComplete();
+  }
+  for (xPES_Consumer *Consumer : m_Consumers)
+  {
+    Consumer->OnEndOfStream((uint16_t)m_PID, m_NumStreamBytes);
+  }
+}
+
+xPES_Assembler::xSeamState xPES_Assembler::getSeamState() const
+{
+  xSeamState State;
+  State.Started = m_Started;
+  State.Damaged = m_Damaged;
+  State.LastContinuityCounter = m_LastContinuityCounter;
+  State.DataOffset = m_DataOffset;
+  State.PESH = m_PESH;
+  return State;
+}
+
+/// @brief Continue assembling from state exported by other assembler of the same PID
+void xPES_Assembler::setSeamState(const xSeamState &State)
+{
+  xBufferReset();
+  this->m_Started = State.Started;
+  this->m_Damaged = State.Damaged;
+  this->m_LastContinuityCounter = State.LastContinuityCounter;
+  this->m_DataOffset = State.DataOffset;
+  this->m_PESH = State.PESH;
+}
+
+/**
+  @brief Check if TS packet repeats last absorbed one (same continuity counter, no discontinuity indicated)
+  @param PacketHeader is parsed header of TS packet
+  @param AdaptationField is parsed adaptation field of TS packet (used only when packet has one)
+  @return true if packet would be dropped as duplicate by AbsorbPacket()
+*/
+bool xPES_Assembler::isRepeatedPacket(const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField) const
+{
+  bool Discontinuity = PacketHeader->hasAdaptationField() && AdaptationField->getAdaptationFieldLength() > 0 && AdaptationField->getDiscontinuityIndicator();
+  return m_Started && PacketHeader->hasPayload() && PacketHeader->getContinuityCounter() == this->m_LastContinuityCounter && !Discontinuity;
+}
+
+/**
+  @brief Absorb TS packet of assembler PID
+  @param TransportStreamPacket is pointer to TS packet payload
+  @param PacketHeader is parsed header of TS packet
+  @param AdaptationField is parsed adaptation field of TS packet (used only when packet has one)
+  @return Assembling state after this packet
+*/
+xPES_Assembler::eResult xPES_Assembler::AbsorbPacket(const uint8_t *TransportStreamPacket, const xTS_PacketHeader *PacketHeader, const xTS_AdaptationField *AdaptationField)
+{
+  if (PacketHeader->getPID() != m_PID)
+  {
+    return eResult::UnexpectedPID;
+  }
+
+  uint32_t temp_BufferSize = xTS::TS_HeaderLength;
+  if (PacketHeader->hasAdaptationField())
+  {
+    temp_BufferSize += AdaptationField->getAdaptationFieldLength() + 1;
+  }
+
+  uint32_t PayloadSize = temp_BufferSize < xTS::TS_PacketLength ? xTS::TS_PacketLength - temp_BufferSize : 0;
+
+  uint8_t ContinuityCounter = PacketHeader->getContinuityCounter();
+  bool Discontinuity = PacketHeader->hasAdaptationField() && AdaptationField->getAdaptationFieldLength() > 0 && AdaptationField->getDiscontinuityIndicator();
+  if (isRepeatedPacket(PacketHeader, AdaptationField))
+  {
+    // repeated packet - payload was already received (checked before unit start, so repeated first packet does not restart PES packet)
+    return eResult::DuplicatePacket;
+  }
+
+  if (PacketHeader->getStart())
+  {
+    if (m_Started && m_PESH.getPacketLength() == 0)
+    {
+      // unbounded PES packet (video) ends where next one begins
+      xBufferComplete();
     }
-    else
+    else if (m_Started)
     {
-      if (PacketHeader->hasAdaptationField())
-      {
-        temp_BufferSize = 4 + AdaptationField->getAdaptationFieldLength() + 1;
-      }
-      else
-      {
-        temp_BufferSize = 4;
-      }
+      // bounded PES packet never reached its announced length
+      xBufferDrop();
+    }
+    xBufferReset();
+    this->m_Started = true;
+    this->m_Damaged = false;
+    m_PESH.Reset();
+    m_PESH.Parse(TransportStreamPacket, PayloadSize);
+    this->m_LastContinuityCounter = ContinuityCounter;
+    this->m_PacketStreamOffset = m_NumStreamBytes;
+
+    xBufferAppend(TransportStreamPacket, PayloadSize);
+    this->m_NumStreamBytes += PayloadSize;
+    if (m_PESH.getPacketLength() != 0 && m_DataOffset >= xTS::PES_HeaderLength + m_PESH.getPacketLength())
+    {
+      // whole PES packet fits in single TS packet
+      xBufferComplete();
+    }
 
-      this->m_Buffer = const_cast<uint8_t *>(TransportStreamPacket);
-      this->m_BufferSize = 188 - temp_BufferSize;
-      this->m_DataOffset += m_BufferSize;
+    return eResult::AssemblingStarted;
+  }
 
-      if ((PacketHeader->getContinuityCounter() != this->m_LastContinuityCounter + 1) && (PacketHeader->getContinuityCounter() != 0 && this->m_LastContinuityCounter != 15))
-      {
-        this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+  if (!this->m_Started)
+  {
+    return eResult::StreamNotStarted;
+  }
 
-        return eResult::StreamPackedLost;
-      }
+  if (!PacketHeader->hasPayload())
+  {
+    // continuity counter is not incremented by packets without payload
+    return eResult::AssemblingContinue;
+  }
 
-      this->m_LastContinuityCounter = PacketHeader->getContinuityCounter();
+  bool Lost = ContinuityCounter != ((this->m_LastContinuityCounter + 1) & 0xF) && !Discontinuity;
+  this->m_LastContinuityCounter = ContinuityCounter;
 
-      if (PacketHeader->hasAdaptationField())
-      {
-        this->m_Started = false;
+  xBufferAppend(TransportStreamPacket, PayloadSize);
 
-        return eResult::AssemblingFinished;
-      }
-      else
-      {
-        return eResult::AssemblingContinue;
-      }
-    }
+  if (Lost)
+  {
+    this->m_Damaged = true;
+
+    return eResult::StreamPackedLost;
   }
-  else
+  this->m_NumStreamBytes += PayloadSize;
+
+  if (m_PESH.getPacketLength() != 0 && this->m_DataOffset >= xTS::PES_HeaderLength + m_PESH.getPacketLength())
   {
-    return eResult::UnexpectedPID;
+    // bounded PES packet - finished when all announced bytes were received
+    xBufferComplete();
+
+    return eResult::AssemblingFinished;
   }
-}
\ No newline at end of file
+
+  return eResult::AssemblingContinue;
+}
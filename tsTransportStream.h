@@ -1,6 +1,8 @@
 #pragma once
 #include "tsCommon.h"
 #include <string>
+#include <memory>
+#include <vector>
 
 /*
 MPEG-TS packet:
@@ -79,6 +81,7 @@ protected:
 public:
   void Reset();
   int32_t Parse(const uint8_t *Input);
+  void Load(const class xTS_PacketHeaderBatch &Batch, uint32_t PacketIdx);
   void Print() const;
 
 public:
@@ -106,6 +109,61 @@ public:
 
 //=============================================================================================================================================================================
 
+/*
+Batch of TS packet headers decoded at once into structure-of-arrays form.
+Header dword is loaded little-endian (b0 | b1<<8 | b2<<16 | b3<<24), so every field is a plain mask/shift of one 32-bit lane:
+  SB  = w & 0xFF            E|S|T = (w >> 8) & 0xE0      PID = (w & 0x1F00) | ((w >> 16) & 0xFF)
+  TSC = (w >> 30) & 0x3     AFC   = (w >> 28) & 0x3      CC  = (w >> 24) & 0xF
+*/
+class xTS_PacketHeaderBatch
+{
+public:
+  static constexpr uint32_t MaxPackets = 64;
+
+  enum eFlags : uint8_t
+  {
+    eFlags_TransportError = 0x80,
+    eFlags_PayloadUnitStart = 0x40,
+    eFlags_TransportPriority = 0x20,
+  };
+
+protected:
+  uint32_t m_NumPackets;
+  alignas(32) uint16_t m_PID[MaxPackets];
+  alignas(32) uint8_t m_SB[MaxPackets];
+  alignas(32) uint8_t m_Flags[MaxPackets];
+  alignas(32) uint8_t m_TSC[MaxPackets];
+  alignas(32) uint8_t m_AFC[MaxPackets];
+  alignas(32) uint8_t m_CC[MaxPackets];
+
+public:
+  xTS_PacketHeaderBatch() : m_NumPackets(0) {}
+
+  // decodes headers of up to MaxPackets packets placed PacketStride bytes apart, returns number of decoded headers
+  int32_t Parse(const uint8_t *FirstPacket, uint32_t NumPackets, uint32_t PacketStride);
+
+  // bitmask of packets (bit N = packet N) carrying given PID
+  uint64_t getPIDMask(uint16_t PID) const;
+  // bitmask of packets with payload unit start indicator set
+  uint64_t getStartMask() const;
+
+public:
+  uint32_t getNumPackets() const { return m_NumPackets; }
+  const uint16_t *getPIDs() const { return m_PID; }
+
+  uint8_t getSyncByte(uint32_t PacketIdx) const { return m_SB[PacketIdx]; }
+  uint8_t getFlags(uint32_t PacketIdx) const { return m_Flags[PacketIdx]; }
+  uint16_t getPID(uint32_t PacketIdx) const { return m_PID[PacketIdx]; }
+  uint8_t getTransportScramblingControl(uint32_t PacketIdx) const { return m_TSC[PacketIdx]; }
+  uint8_t getAdaptationFieldControl(uint32_t PacketIdx) const { return m_AFC[PacketIdx]; }
+  uint8_t getContinuityCounter(uint32_t PacketIdx) const { return m_CC[PacketIdx]; }
+
+protected:
+  void xParseScalar(const uint8_t *FirstPacket, uint32_t Begin, uint32_t End, uint32_t PacketStride);
+};
+
+//=============================================================================================================================================================================
+
 class xTS_AdaptationField
 {
 protected:
@@ -143,6 +201,12 @@ public:
   int32_t Parse(const uint8_t *PacketBuffer, uint8_t AdaptationFieldControl);
   void Print() const;
 
+  // parses adaptation field of whole TS packet (sync byte first) on path specialised for its shape, returns payload offset
+  int32_t ParsePacket(const uint8_t *Packet, uint8_t AdaptationFieldControl);
+
+  // reads PCR straight from whole TS packet (sync byte first) without parsing adaptation field, false if packet has no PCR
+  static bool PeekPCR(const uint8_t *Packet, uint64_t &PCR);
+
 public:
   // mandatory fields | DONE
   uint8_t getAdaptationFieldLength() const
@@ -155,15 +219,41 @@ public:
     return m_RandomAccessIndicator;
   }
 
+  uint8_t getDiscontinuityIndicator() const
+  {
+    return m_DiscontinuityIndicator;
+  }
+
+  uint8_t getPCRFlag() const
+  {
+    return m_PCRFlag;
+  }
+
+  // optional fields - PCR | DONE
+  uint64_t getProgramClockReference() const
+  {
+    return m_ProgramClockReference;
+  }
+
   // derived values | DONE
   uint32_t getNumBytes() const
   {
     return m_AdaptationFieldLength - 1; // subtract 1 for the adaptation field length byte itself
   }
+
+protected:
+  template <uint8_t AdaptationFieldControl> int32_t xParseShape(const uint8_t *Packet);
 };
 
 //=============================================================================================================================================================================
 
+/*
+PES packet header:
+  Parse() decodes fixed part (start code prefix, stream id, length) and copies optional header once - up to end of
+  PES_header_data_length, or of parsed data when header continues in next TS packet. Positions of optional fields are
+  derived from flags right away (plain sums of flag * field length), but no field is decoded - getters decode their
+  field from copied bytes on request, so caller which needs only PTS decodes only PTS.
+*/
 class xPES_PacketHeader
 {
 public:
@@ -179,22 +269,193 @@ public:
     eStreamId_ITUT_H222_1_type_E = 0xF8,
   };
 
+  enum ePTS_DTS_Flags : uint8_t
+  {
+    ePTS_DTS_Flags_None = 0,
+    ePTS_DTS_Flags_PTS = 2,
+    ePTS_DTS_Flags_PTS_DTS = 3,
+  };
+
+  enum eOptionalField : uint8_t
+  {
+    eOptionalField_ESCR,
+    eOptionalField_ESRate,
+    eOptionalField_DSMTrickMode,
+    eOptionalField_AdditionalCopyInfo,
+    eOptionalField_PreviousPacketCRC,
+    eOptionalField_Extension,
+    eOptionalField_Num,
+  };
+
+  // PES extension (optional parts are valid only when their flag is set)
+  struct xExtension
+  {
+    bool PrivateDataFlag;
+    bool PackHeaderFieldFlag;
+    bool SequenceCounterFlag;
+    bool P_STD_BufferFlag;
+    bool Extension2Flag;
+    const uint8_t *PrivateData; // 16 bytes, points into header (valid while header is)
+    uint8_t PackFieldLength;
+    const uint8_t *PackHeader;  // PackFieldLength bytes, points into header
+    uint8_t ProgramPacketSequenceCounter;
+    uint8_t MPEG1_MPEG2_Identifier;
+    uint8_t OriginalStuffLength;
+    uint8_t P_STD_BufferScale;
+    uint16_t P_STD_BufferSize;
+    uint8_t Extension2FieldLength;
+    uint8_t StreamIdExtensionFlag;
+    uint8_t StreamIdExtension;
+  };
+
+  static constexpr uint32_t OptionalFieldsOffset = 9;                     // prefix, stream id, length, 2 flag bytes, header data length
+  static constexpr uint32_t MaxHeaderLength = OptionalFieldsOffset + 255;
+
 protected:
   //PES packet header
   uint32_t m_PacketStartCodePrefix;
   uint8_t  m_StreamId;
   uint16_t m_PacketLength;
+  //optional PES header - copied once by Parse(), optional fields are decoded only by their getters
+  uint8_t  m_PTS_DTS_Flags;
+  uint16_t m_NumHeaderBytes;                         // copied header bytes, cut at end of header or of parsed data
+  uint16_t m_FieldOffsets[eOptionalField_Num];       // where optional fields following PTS/DTS would start
+  uint8_t  m_Header[MaxHeaderLength];
 
 public:
   void     Reset();
-  int32_t  Parse(const uint8_t* Input);
+  int32_t  Parse(const uint8_t* Input, uint32_t Length);
   void     Print() const;
+  void     PrintTimestamps() const;
 
 public:
   //PES packet header
   uint32_t getPacketStartCodePrefix() const { return m_PacketStartCodePrefix; }
   uint8_t  getStreamId ()             const { return m_StreamId; }
   uint16_t getPacketLength ()         const { return m_PacketLength; }
+  //optional PES header - flags
+  uint8_t  getScramblingControl()     const;
+  uint8_t  getPriority()              const;
+  uint8_t  getDataAlignmentIndicator() const;
+  uint8_t  getCopyright()             const;
+  uint8_t  getOriginalOrCopy()        const;
+  uint8_t  getHeaderDataLength()      const;
+  //optional PES header - timestamps (90 kHz), 0 when not present
+  uint8_t  getPTS_DTS_Flags()         const { return m_PTS_DTS_Flags; }
+  uint64_t getPTS ()                  const;
+  uint64_t getDTS ()                  const;
+  //optional PES header - other fields, false when field is not present (or lies beyond parsed data)
+  bool     getESCR              (uint64_t& ESCR) const; // 27 MHz
+  bool     getESRate            (uint32_t& ESRate) const; // units of 50 bytes/s
+  bool     getTrickMode         (uint8_t& Control, uint8_t& Mode) const;
+  bool     getAdditionalCopyInfo(uint8_t& Info) const;
+  bool     getPreviousPacketCRC (uint16_t& CRC) const;
+  bool     getExtension         (xExtension& Extension) const;
+  int32_t  getNumStuffingBytes  () const; // -1 when fields cannot be located
+
+public:
+  //derived informations
+  bool hasOptionalHeader() const;
+  // bytes preceding PES packet data (6, or 9 + PES_header_data_length with optional header)
+  uint32_t getHeaderLength() const;
+
+protected:
+  bool xHasField(eOptionalField Field, uint32_t Length) const;
+  int32_t xGetExtensionLength() const;
+};
+
+//=============================================================================================================================================================================
+
+/*
+PES reassembly buffers:
+  xPES_Buffer     - storage for one PES packet, owned by pool and recycled (its capacity is kept, so steady state does no allocation)
+  xPES_BufferPool - per assembler free list of buffers
+  xPES_PacketRef  - counted reference to completed PES packet, buffer returns to pool when last reference is dropped
+                    (references must be released before assembler owning the pool is destroyed)
+  Stream offset of PES packet is its position in demultiplexed stream (payload of accepted TS packets, PES headers
+  included), i.e. in file written by stream sink.
+*/
+class xPES_Buffer
+{
+  friend class xPES_BufferPool;
+  friend class xPES_PacketRef;
+
+protected:
+  std::unique_ptr<uint8_t[]> m_Data;
+  uint32_t m_Size;
+  uint32_t m_Capacity;
+  uint32_t m_RefCount;
+  uint64_t m_StreamOffset;
+  class xPES_BufferPool *m_Pool;
+
+public:
+  xPES_Buffer() : m_Size(0), m_Capacity(0), m_RefCount(0), m_StreamOffset(0), m_Pool(nullptr) {}
+
+  void Reserve(uint32_t Capacity);
+  void Append(const uint8_t *Data, uint32_t Size);
+  void Clear() { m_Size = 0; }
+
+public:
+  const uint8_t *getData() const { return m_Data.get(); }
+  uint32_t getSize() const { return m_Size; }
+  uint32_t getCapacity() const { return m_Capacity; }
+  uint64_t getStreamOffset() const { return m_StreamOffset; }
+  void setStreamOffset(uint64_t StreamOffset) { m_StreamOffset = StreamOffset; }
+};
+
+class xPES_BufferPool
+{
+protected:
+  std::vector<std::unique_ptr<xPES_Buffer>> m_Buffers;
+  std::vector<xPES_Buffer *> m_Free;
+
+public:
+  xPES_Buffer *Acquire(uint32_t Capacity);
+  void Release(xPES_Buffer *Buffer);
+
+public:
+  uint32_t getNumBuffers() const { return (uint32_t)m_Buffers.size(); }
+  uint32_t getNumFree() const { return (uint32_t)m_Free.size(); }
+};
+
+class xPES_PacketRef
+{
+protected:
+  xPES_Buffer *m_Buffer;
+
+public:
+  xPES_PacketRef() : m_Buffer(nullptr) {}
+  explicit xPES_PacketRef(xPES_Buffer *Buffer) : m_Buffer(Buffer) { if (m_Buffer) { m_Buffer->m_RefCount++; } }
+  xPES_PacketRef(const xPES_PacketRef &Other) : xPES_PacketRef(Other.m_Buffer) {}
+  xPES_PacketRef(xPES_PacketRef &&Other) noexcept : m_Buffer(Other.m_Buffer) { Other.m_Buffer = nullptr; }
+  ~xPES_PacketRef() { Reset(); }
+
+  xPES_PacketRef &operator=(xPES_PacketRef Other)
+  {
+    std::swap(m_Buffer, Other.m_Buffer);
+    return *this;
+  }
+  void Reset();
+
+public:
+  bool isValid() const { return m_Buffer != nullptr; }
+  const uint8_t *getData() const { return m_Buffer->getData(); }
+  uint32_t getSize() const { return m_Buffer->getSize(); }
+  uint64_t getStreamOffset() const { return m_Buffer->getStreamOffset(); }
+};
+
+//=============================================================================================================================================================================
+
+class xPES_Consumer
+{
+public:
+  virtual ~xPES_Consumer() {}
+  // called for every complete, undamaged PES packet - keep a copy of reference to hold packet longer than this call
+  virtual void OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet) = 0;
+  // damaged PES packet was dropped - packets before and after do not join
+  virtual void OnDiscontinuity(uint16_t PID) { (void)PID; }
+  // end of stream (last unbounded PES packet is already passed), StreamSize is size of demultiplexed stream
+  virtual void OnEndOfStream(uint16_t PID, uint64_t StreamSize) { (void)PID; (void)StreamSize; }
 };
 
 //=============================================================================================================================================================================
@@ -209,34 +470,67 @@ public:
   AssemblingStarted ,
   AssemblingContinue,
   AssemblingFinished,
+  StreamNotStarted  ,
+  DuplicatePacket   ,
+  };
+
+  // assembling state of PES packet in progress - lets parallel parser continue assembling in next chunk
+  // (meaningful only without consumers, since buffered data is not part of it)
+  struct xSeamState
+  {
+    bool Started;
+    bool Damaged;
+    int8_t LastContinuityCounter;
+    uint32_t DataOffset;
+    xPES_PacketHeader PESH;
   };
 
 protected:
   //setup
   int32_t m_PID;
+  std::vector<xPES_Consumer*> m_Consumers;
   //buffer
-  uint8_t* m_Buffer;
-  uint32_t m_BufferSize;
+  xPES_BufferPool m_BufferPool;
+  xPES_Buffer* m_Buffer;
   uint32_t m_DataOffset;
+  uint64_t m_NumStreamBytes;     // payload of accepted TS packets so far
+  uint64_t m_PacketStreamOffset; // stream offset of PES packet being assembled
   //operation
   int8_t m_LastContinuityCounter;
   bool m_Started;
+  bool m_Damaged;
   xPES_PacketHeader m_PESH;
+  //statistics
+  uint64_t m_NumCompletedPackets;
+  uint64_t m_NumDroppedPackets;
 
 public:
-  // xPES_Assembler ();
-  // ~xPES_Assembler();
+  xPES_Assembler ();
+  ~xPES_Assembler();
 
   void Init           (int32_t PID);
+  void AddConsumer    (xPES_Consumer* Consumer) { m_Consumers.push_back(Consumer); }
   eResult AbsorbPacket(const uint8_t* TransportStreamPacket, const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField);
+  bool isRepeatedPacket(const xTS_PacketHeader* PacketHeader, const xTS_AdaptationField* AdaptationField) const;
+  void Flush          ();
 
   void PrintPESH           () const { m_PESH.Print(); }
-  uint8_t* getPacket       ()       { return m_Buffer; }
+  const xPES_PacketHeader& getPESH() const { return m_PESH; }
+  const uint8_t* getPacket () const { return m_Buffer != nullptr ? m_Buffer->getData() : nullptr; }
   int32_t getNumPacketBytes() const { return m_DataOffset; }
+  uint64_t getNumCompletedPackets() const { return m_NumCompletedPackets; }
+  uint64_t getNumDroppedPackets  () const { return m_NumDroppedPackets; }
+  uint64_t getNumStreamBytes     () const { return m_NumStreamBytes; }
+  const xPES_BufferPool& getBufferPool() const { return m_BufferPool; }
+
+  xSeamState getSeamState() const;
+  void setSeamState      (const xSeamState& State);
 
 protected:
   void xBufferReset ();
   void xBufferAppend(const uint8_t* Data, int32_t Size);
+  void xBufferComplete();
+  void xBufferDrop    ();
 };
 
 //=============================================================================================================================================================================
@@ -0,0 +1,514 @@
+#include "tsUdpInput.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_UdpAddress
+//=============================================================================================================================================================================
+
+bool xTS_UdpAddress::isUdpAddress(const char *Text)
+{
+  return strncmp(Text, "udp://", 6) == 0 || strncmp(Text, "rtp://", 6) == 0;
+}
+
+/**
+  @brief Parse [udp://|rtp://]<host>:<port>
+  @param Text is address, host may be empty (any local address)
+  @return 0 on success, -1 when address is malformed or host cannot be resolved
+*/
+int32_t xTS_UdpAddress::Parse(const char *Text)
+{
+  if (isUdpAddress(Text))
+  {
+    Text += 6;
+  }
+  const char *Colon = strrchr(Text, ':');
+  if (Colon == nullptr)
+  {
+    return NOT_VALID;
+  }
+  char *End = nullptr;
+  unsigned long Port = strtoul(Colon + 1, &End, 10);
+  if (End == Colon + 1 || *End != '\0' || Port == 0 || Port > 0xFFFF)
+  {
+    return NOT_VALID;
+  }
+  this->m_Port = (uint16_t)Port;
+  this->m_Address = 0;
+
+  std::string Host(Text, Colon - Text);
+  if (Host.empty())
+  {
+    return 0;
+  }
+#if defined(__linux__)
+  addrinfo Hints;
+  memset(&Hints, 0, sizeof(Hints));
+  Hints.ai_family = AF_INET;
+  Hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *Result = nullptr;
+  if (getaddrinfo(Host.c_str(), nullptr, &Hints, &Result) != 0 || Result == nullptr)
+  {
+    return NOT_VALID;
+  }
+  this->m_Address = ntohl(((const sockaddr_in *)Result->ai_addr)->sin_addr.s_addr);
+  freeaddrinfo(Result);
+  return 0;
+#else
+  return NOT_VALID;
+#endif
+}
+
+//=============================================================================================================================================================================
+// xTS_RTP
+//=============================================================================================================================================================================
+
+/*
+RTP fixed header:
+`        3                   2                   1                   0  `
+`      1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0 9 8 7 6 5 4 3 2 1 0  `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   0 |V=2|P|X|  CC   |M|     PT      |       sequence number         | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   4 |                           timestamp                           | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+`   8 |                             SSRC                              | `
+`     +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+ `
+followed by CC x 4 B of CSRCs and, when X is set, extension (2 B profile, 2 B length in 32-bit words, data).
+*/
+bool xTS_RTP::Strip(const uint8_t *Datagram, uint32_t Length, uint32_t &PayloadOffset, uint32_t &PayloadLength, uint16_t &SequenceNumber)
+{
+  if (Length < HeaderLength || (Datagram[0] >> 6) != Version)
+  {
+    return false;
+  }
+  uint32_t Offset = HeaderLength + (Datagram[0] & 0x0F) * 4;
+  if (Datagram[0] & 0x10)
+  {
+    if (Offset + 4 > Length)
+    {
+      return false;
+    }
+    Offset += 4 + (uint32_t)(Datagram[Offset + 2] << 8 | Datagram[Offset + 3]) * 4;
+  }
+  uint32_t End = Length;
+  if (Datagram[0] & 0x20)
+  {
+    End -= Datagram[Length - 1];
+  }
+  if (Offset > End || End > Length)
+  {
+    return false;
+  }
+  PayloadOffset = Offset;
+  PayloadLength = End - Offset;
+  SequenceNumber = (uint16_t)(Datagram[2] << 8 | Datagram[3]);
+  return true;
+}
+
+//=============================================================================================================================================================================
+// xTS_UdpReader
+//=============================================================================================================================================================================
+
+#if defined(__linux__)
+struct xTS_UdpReader::xMessages
+{
+  mmsghdr Headers[DatagramsPerRead];
+  iovec Vectors[DatagramsPerRead];
+};
+#else
+struct xTS_UdpReader::xMessages
+{
+};
+#endif
+
+xTS_UdpReader::xTS_UdpReader()
+{
+  this->m_Socket = -1;
+  this->m_Timeout = DefaultTimeout;
+  this->m_Allocation = new uint8_t[MaxCarryBytes + (size_t)DatagramsPerRead * DatagramSlotSize];
+  this->m_Block = m_Allocation + MaxCarryBytes;
+  this->m_Messages.reset(new xMessages());
+  this->m_SequenceValid = false;
+  this->m_NextSequenceNumber = 0;
+  memset(&m_Statistics, 0, sizeof(m_Statistics));
+  this->m_Window = m_Block;
+  this->m_EndOfStream = true;
+}
+
+xTS_UdpReader::~xTS_UdpReader()
+{
+  Close();
+  delete[] m_Allocation;
+}
+
+/**
+  @brief Bind socket (and join multicast group) for receiving
+  @param Address is udp://<host>:<port> or rtp://<host>:<port>
+  @return 0 on success, -1 when address is malformed or socket cannot be bound
+*/
+int32_t xTS_UdpReader::Open(const char *Address)
+{
+  Close();
+#if defined(__linux__)
+  xTS_UdpAddress UdpAddress;
+  if (UdpAddress.Parse(Address) == NOT_VALID)
+  {
+    return NOT_VALID;
+  }
+  this->m_Socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (m_Socket < 0)
+  {
+    return NOT_VALID;
+  }
+  int ReuseAddress = 1;
+  setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, &ReuseAddress, sizeof(ReuseAddress));
+  // large kernel buffer absorbs bursts while parser is busy (limited by net.core.rmem_max)
+  int BufferSize = SocketBufferSize;
+  setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &BufferSize, sizeof(BufferSize));
+  if (m_Timeout > 0)
+  {
+    timeval Timeout = {(time_t)(m_Timeout / 1000), (suseconds_t)(m_Timeout % 1000) * 1000};
+    setsockopt(m_Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+  }
+
+  sockaddr_in LocalAddress;
+  memset(&LocalAddress, 0, sizeof(LocalAddress));
+  LocalAddress.sin_family = AF_INET;
+  LocalAddress.sin_port = htons(UdpAddress.m_Port);
+  LocalAddress.sin_addr.s_addr = htonl(UdpAddress.m_Address);
+  if (bind(m_Socket, (const sockaddr *)&LocalAddress, sizeof(LocalAddress)) != 0)
+  {
+    Close();
+    return NOT_VALID;
+  }
+  if (UdpAddress.isMulticast())
+  {
+    ip_mreq Membership;
+    Membership.imr_multiaddr.s_addr = htonl(UdpAddress.m_Address);
+    Membership.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(m_Socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &Membership, sizeof(Membership)) != 0)
+    {
+      Close();
+      return NOT_VALID;
+    }
+  }
+
+  for (uint32_t DatagramIdx = 0; DatagramIdx < DatagramsPerRead; DatagramIdx++)
+  {
+    iovec &Vector = m_Messages->Vectors[DatagramIdx];
+    Vector.iov_base = m_Block + (size_t)DatagramIdx * DatagramSlotSize;
+    Vector.iov_len = DatagramSlotSize;
+    mmsghdr &Header = m_Messages->Headers[DatagramIdx];
+    memset(&Header, 0, sizeof(Header));
+    Header.msg_hdr.msg_iov = &Vector;
+    Header.msg_hdr.msg_iovlen = 1;
+  }
+
+  this->m_Window = m_Block;
+  this->m_WindowSize = 0;
+  this->m_WindowOffset = 0;
+  this->m_EndOfStream = false;
+  this->m_SequenceValid = false;
+  memset(&m_Statistics, 0, sizeof(m_Statistics));
+  return 0;
+#else
+  (void)Address;
+  return NOT_VALID;
+#endif
+}
+
+void xTS_UdpReader::Close()
+{
+#if defined(__linux__)
+  if (m_Socket >= 0)
+  {
+    close(m_Socket);
+  }
+#endif
+  this->m_Socket = -1;
+  this->m_Window = m_Block;
+  this->m_WindowSize = 0;
+  this->m_EndOfStream = true;
+}
+
+void xTS_UdpReader::PrintStatistics(FILE *File) const
+{
+  fprintf(File, "UDP: Datagrams=%" PRIu64 " Bytes=%" PRIu64 " Reads=%" PRIu64 " RTP=%" PRIu64 " Lost=%" PRIu64 " Late=%" PRIu64 " Truncated=%" PRIu64 " Invalid=%" PRIu64 "\n",
+          m_Statistics.NumDatagrams, m_Statistics.NumBytes, m_Statistics.NumReads, m_Statistics.NumRTPDatagrams,
+          m_Statistics.NumLost, m_Statistics.NumLate, m_Statistics.NumTruncated, m_Statistics.NumInvalid);
+}
+
+size_t xTS_UdpReader::xRefill(size_t MinBytes)
+{
+#if defined(__linux__)
+  while (m_WindowSize < MinBytes && !m_EndOfStream)
+  {
+    // move unconsumed tail in front of block, so received packets follow it contiguously
+    size_t Carry = m_WindowSize;
+    if (Carry > MaxCarryBytes)
+    {
+      break;
+    }
+    std::memmove(m_Block - Carry, m_Window, Carry);
+    this->m_Window = m_Block - Carry;
+
+    int NumReceived = recvmmsg(m_Socket, m_Messages->Headers, DatagramsPerRead, MSG_WAITFORONE, nullptr);
+    if (NumReceived < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      // idle timeout (EAGAIN) or socket error - live stream is over
+      this->m_EndOfStream = true;
+      break;
+    }
+    this->m_Statistics.NumReads++;
+    this->m_WindowSize = Carry + xCompact((uint32_t)NumReceived);
+  }
+  return m_WindowSize;
+#else
+  (void)MinBytes;
+  return m_WindowSize;
+#endif
+}
+
+/**
+  @brief Strip RTP headers of received datagrams and move their TS packets together at start of block
+  @param NumDatagrams is number of datagrams received into slots
+  @return Number of TS bytes at start of block
+*/
+uint32_t xTS_UdpReader::xCompact(uint32_t NumDatagrams)
+{
+#if defined(__linux__)
+  uint32_t Size = 0;
+  for (uint32_t DatagramIdx = 0; DatagramIdx < NumDatagrams; DatagramIdx++)
+  {
+    const mmsghdr &Header = m_Messages->Headers[DatagramIdx];
+    const uint8_t *Datagram = m_Block + (size_t)DatagramIdx * DatagramSlotSize;
+    uint32_t Length = Header.msg_len;
+    this->m_Statistics.NumDatagrams++;
+    if (Header.msg_hdr.msg_flags & MSG_TRUNC)
+    {
+      this->m_Statistics.NumTruncated++;
+    }
+
+    uint32_t PayloadOffset = 0;
+    uint32_t PayloadLength = Length;
+    if (Length == 0 || Datagram[0] != xTS_SyncScanner::SyncByte)
+    {
+      uint16_t SequenceNumber;
+      if (!xTS_RTP::Strip(Datagram, Length, PayloadOffset, PayloadLength, SequenceNumber))
+      {
+        this->m_Statistics.NumInvalid++;
+        continue;
+      }
+      this->m_Statistics.NumRTPDatagrams++;
+      if (!xAcceptSequence(SequenceNumber))
+      {
+        continue;
+      }
+    }
+
+    // payload never moves forward - it starts at least at Size within its own slot
+    std::memmove(m_Block + Size, Datagram + PayloadOffset, PayloadLength);
+    Size += PayloadLength;
+  }
+  this->m_Statistics.NumBytes += Size;
+  return Size;
+#else
+  (void)NumDatagrams;
+  return 0;
+#endif
+}
+
+// RTP sequence check - gap counts lost datagrams, datagram behind expected number is dropped
+bool xTS_UdpReader::xAcceptSequence(uint16_t SequenceNumber)
+{
+  if (m_SequenceValid)
+  {
+    uint16_t Distance = (uint16_t)(SequenceNumber - m_NextSequenceNumber);
+    if (Distance >= 0x8000)
+    {
+      this->m_Statistics.NumLate++;
+      return false;
+    }
+    this->m_Statistics.NumLost += Distance;
+  }
+  this->m_SequenceValid = true;
+  this->m_NextSequenceNumber = (uint16_t)(SequenceNumber + 1);
+  return true;
+}
+
+//=============================================================================================================================================================================
+// xTS_UdpSender
+//=============================================================================================================================================================================
+
+xTS_UdpSender::xTS_UdpSender()
+{
+  this->m_Socket = -1;
+  this->m_RTP = false;
+  this->m_LossInterval = 0;
+  this->m_SequenceNumber = 0;
+  this->m_SSRC = 0x54534958;
+  this->m_NumDatagrams = 0;
+  this->m_NumDropped = 0;
+}
+
+/**
+  @brief Connect socket to destination
+  @param Address is udp://<host>:<port> or rtp://<host>:<port>, rtp:// enables RTP header
+  @return 0 on success, -1 when address is malformed or socket cannot be created
+*/
+int32_t xTS_UdpSender::Open(const char *Address)
+{
+  Close();
+#if defined(__linux__)
+  xTS_UdpAddress UdpAddress;
+  if (UdpAddress.Parse(Address) == NOT_VALID)
+  {
+    return NOT_VALID;
+  }
+  if (UdpAddress.m_Address == 0)
+  {
+    UdpAddress.m_Address = INADDR_LOOPBACK;
+  }
+  this->m_Socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (m_Socket < 0)
+  {
+    return NOT_VALID;
+  }
+  sockaddr_in RemoteAddress;
+  memset(&RemoteAddress, 0, sizeof(RemoteAddress));
+  RemoteAddress.sin_family = AF_INET;
+  RemoteAddress.sin_port = htons(UdpAddress.m_Port);
+  RemoteAddress.sin_addr.s_addr = htonl(UdpAddress.m_Address);
+  if (connect(m_Socket, (const sockaddr *)&RemoteAddress, sizeof(RemoteAddress)) != 0)
+  {
+    Close();
+    return NOT_VALID;
+  }
+  if (strncmp(Address, "rtp://", 6) == 0)
+  {
+    this->m_RTP = true;
+  }
+  return 0;
+#else
+  (void)Address;
+  return NOT_VALID;
+#endif
+}
+
+void xTS_UdpSender::Close()
+{
+#if defined(__linux__)
+  if (m_Socket >= 0)
+  {
+    close(m_Socket);
+  }
+#endif
+  this->m_Socket = -1;
+}
+
+/**
+  @brief Send TS packets, PacketsPerDatagram per datagram
+  @param Packets is pointer to first of consecutive 188 B packets
+  @param NumPackets is number of packets
+  @param Time is RTP timestamp of datagrams
+  @return 0 on success, -1 on socket error
+*/
+int32_t xTS_UdpSender::Send(const uint8_t *Packets, uint32_t NumPackets, uint32_t Time)
+{
+#if defined(__linux__)
+  uint8_t RTPHeaders[DatagramsPerSend][xTS_RTP::HeaderLength];
+  iovec Vectors[DatagramsPerSend][2];
+  mmsghdr Headers[DatagramsPerSend];
+
+  while (NumPackets > 0)
+  {
+    uint32_t NumDatagrams = 0;
+    while (NumPackets > 0 && NumDatagrams < DatagramsPerSend)
+    {
+      uint32_t NumDatagramPackets = NumPackets < PacketsPerDatagram ? NumPackets : PacketsPerDatagram;
+      uint16_t SequenceNumber = this->m_SequenceNumber++;
+      this->m_NumDatagrams++;
+      if (m_LossInterval > 0 && m_NumDatagrams % m_LossInterval == 0)
+      {
+        this->m_NumDropped++;
+      }
+      else
+      {
+        uint8_t *RTP = RTPHeaders[NumDatagrams];
+        RTP[0] = xTS_RTP::Version << 6;
+        RTP[1] = xTS_RTP::PayloadType_MP2T;
+        RTP[2] = (uint8_t)(SequenceNumber >> 8);
+        RTP[3] = (uint8_t)SequenceNumber;
+        RTP[4] = (uint8_t)(Time >> 24);
+        RTP[5] = (uint8_t)(Time >> 16);
+        RTP[6] = (uint8_t)(Time >> 8);
+        RTP[7] = (uint8_t)Time;
+        RTP[8] = (uint8_t)(m_SSRC >> 24);
+        RTP[9] = (uint8_t)(m_SSRC >> 16);
+        RTP[10] = (uint8_t)(m_SSRC >> 8);
+        RTP[11] = (uint8_t)m_SSRC;
+
+        iovec *Vector = Vectors[NumDatagrams];
+        uint32_t NumVectors = 0;
+        if (m_RTP)
+        {
+          Vector[NumVectors++] = {RTP, xTS_RTP::HeaderLength};
+        }
+        Vector[NumVectors++] = {(void *)Packets, (size_t)NumDatagramPackets * xTS::TS_PacketLength};
+        mmsghdr &Header = Headers[NumDatagrams];
+        memset(&Header, 0, sizeof(Header));
+        Header.msg_hdr.msg_iov = Vector;
+        Header.msg_hdr.msg_iovlen = NumVectors;
+        NumDatagrams++;
+      }
+      Packets += (size_t)NumDatagramPackets * xTS::TS_PacketLength;
+      NumPackets -= NumDatagramPackets;
+    }
+
+    uint32_t NumSent = 0;
+    while (NumSent < NumDatagrams)
+    {
+      int Result = sendmmsg(m_Socket, Headers + NumSent, NumDatagrams - NumSent, 0);
+      if (Result < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if (errno == ECONNREFUSED)
+        {
+          // nobody listens (yet) - datagram is lost like on the network
+          NumSent++;
+          continue;
+        }
+        return NOT_VALID;
+      }
+      NumSent += (uint32_t)Result;
+    }
+  }
+  return 0;
+#else
+  (void)Packets;
+  (void)NumPackets;
+  (void)Time;
+  return NOT_VALID;
+#endif
+}
+
+//=============================================================================================================================================================================
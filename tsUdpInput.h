@@ -0,0 +1,146 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsInput.h"
+#include <cstdio>
+#include <memory>
+
+/*
+Live UDP input:
+  TS over UDP carries whole packets in every datagram (usually 7 x 188 B), optionally preceded by RTP header
+  (RFC 3550 / RFC 2250). Datagrams are received with recvmmsg() - up to DatagramsPerRead datagrams per system call,
+  each one into its own slot of receive block - and then compacted in place into contiguous run of TS packets,
+  with RTP header (CSRCs, extension) and padding stripped. Compacted block is input window of xTS_InputSource, so
+  packets are parsed directly in receive buffer, like block input.
+
+  Latency is bounded - recvmmsg() returns as soon as at least one datagram is available (MSG_WAITFORONE) and
+  whatever was received is handed out as batch right away, parser never waits for block to fill up.
+  End of stream is idle timeout - no datagram for given time.
+
+  RTP sequence numbers reveal lost datagrams (gaps) and datagrams arriving late (reordered or duplicated, they
+  are dropped - their packets would break continuity counters). Plain UDP has no sequence, loss shows up only as
+  continuity counter errors of TS packets.
+
+  Addresses are udp://<host>:<port> or rtp://<host>:<port> (IPv4), multicast group is joined when host is one,
+  empty host binds any local address. RTP is detected per datagram, so both prefixes accept both formats.
+  Receiving is implemented for Linux only (recvmmsg/sendmmsg), Open() fails elsewhere.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_UdpAddress
+{
+public:
+  uint32_t m_Address; // host byte order, 0 - any
+  uint16_t m_Port;
+
+public:
+  int32_t Parse(const char *Text);
+  bool isMulticast() const { return (m_Address >> 28) == 0xE; }
+
+  static bool isUdpAddress(const char *Text);
+};
+
+//=============================================================================================================================================================================
+
+class xTS_RTP
+{
+public:
+  static constexpr uint32_t HeaderLength = 12;
+  static constexpr uint8_t Version = 2;
+  static constexpr uint8_t PayloadType_MP2T = 33;
+  static constexpr uint32_t ClockFrequency_Hz = 90000;
+
+  // payload of RTP datagram (header, CSRCs, extension and padding removed), false when datagram is not valid RTP
+  static bool Strip(const uint8_t *Datagram, uint32_t Length, uint32_t &PayloadOffset, uint32_t &PayloadLength, uint16_t &SequenceNumber);
+};
+
+//=============================================================================================================================================================================
+
+class xTS_UdpReader : public xTS_InputSource
+{
+public:
+  static constexpr uint32_t DatagramsPerRead = 64;
+  static constexpr uint32_t DatagramSlotSize = 2048; // larger datagrams are truncated (and counted)
+  static constexpr uint32_t DefaultTimeout = 5000;   // ms
+  static constexpr int32_t SocketBufferSize = 8 * 1024 * 1024;
+
+  struct xStatistics
+  {
+    uint64_t NumDatagrams;
+    uint64_t NumBytes;        // TS bytes passed to parser
+    uint64_t NumRTPDatagrams;
+    uint64_t NumLost;         // datagrams missing in RTP sequence
+    uint64_t NumLate;         // datagrams behind RTP sequence (reordered or duplicated), dropped
+    uint64_t NumTruncated;    // datagrams larger than slot
+    uint64_t NumInvalid;      // datagrams which are neither TS nor RTP carrying TS, dropped
+    uint64_t NumReads;        // recvmmsg calls
+  };
+
+protected:
+  int m_Socket;
+  uint32_t m_Timeout; // ms, 0 - wait forever
+  uint8_t *m_Allocation;
+  uint8_t *m_Block; // preceded by MaxCarryBytes of carry area
+  struct xMessages;
+  std::unique_ptr<xMessages> m_Messages;
+  // RTP sequence
+  bool m_SequenceValid;
+  uint16_t m_NextSequenceNumber;
+  xStatistics m_Statistics;
+
+public:
+  xTS_UdpReader();
+  ~xTS_UdpReader() override;
+
+  int32_t Open(const char *Address) override;
+  void Close() override;
+  bool hasStableBuffers() const override { return false; }
+  bool isLive() const override { return true; }
+
+  void setTimeout(uint32_t Timeout) { m_Timeout = Timeout; }
+  const xStatistics &getStatistics() const { return m_Statistics; }
+  void PrintStatistics(FILE *File) const;
+
+protected:
+  size_t xRefill(size_t MinBytes) override;
+  uint32_t xCompact(uint32_t NumDatagrams);
+  bool xAcceptSequence(uint16_t SequenceNumber);
+};
+
+//=============================================================================================================================================================================
+
+/*
+UDP sender - counterpart of xTS_UdpReader for testing and for feeding generated streams to other receivers.
+Packets are grouped PacketsPerDatagram to datagram (optionally with RTP header) and sent with sendmmsg().
+*/
+class xTS_UdpSender
+{
+public:
+  static constexpr uint32_t PacketsPerDatagram = 7;
+  static constexpr uint32_t DatagramsPerSend = 64;
+
+protected:
+  int m_Socket;
+  bool m_RTP;
+  uint32_t m_LossInterval; // every N-th datagram is dropped (sequence number still advances), 0 - none
+  uint16_t m_SequenceNumber;
+  uint32_t m_SSRC;
+  uint64_t m_NumDatagrams;
+  uint64_t m_NumDropped;
+
+public:
+  xTS_UdpSender();
+  ~xTS_UdpSender() { Close(); }
+
+  int32_t Open(const char *Address);
+  void Close();
+  // Time is send time of first packet in 90 kHz units (RTP timestamp)
+  int32_t Send(const uint8_t *Packets, uint32_t NumPackets, uint32_t Time);
+
+  void setRTP(bool RTP) { m_RTP = RTP; }
+  void setLossInterval(uint32_t LossInterval) { m_LossInterval = LossInterval; }
+  uint64_t getNumDatagrams() const { return m_NumDatagrams; }
+  uint64_t getNumDropped() const { return m_NumDropped; }
+};
+
+//=============================================================================================================================================================================
@@ -0,0 +1,450 @@
+#include "tsUringInput.h"
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+//=============================================================================================================================================================================
+// xTS_UringReader::xRing
+//=============================================================================================================================================================================
+
+#if defined(__linux__)
+// kernel shared submission/completion rings - producer index is published with release store and read with acquire load
+struct xTS_UringReader::xRing
+{
+  int Descriptor = -1;
+  // mappings
+  void *SQ_Map = MAP_FAILED;
+  size_t SQ_MapSize = 0;
+  void *CQ_Map = MAP_FAILED;
+  size_t CQ_MapSize = 0;
+  io_uring_sqe *SQEs = (io_uring_sqe *)MAP_FAILED;
+  size_t SQEs_MapSize = 0;
+  // submission queue
+  unsigned *SQ_Tail = nullptr;
+  unsigned *SQ_Mask = nullptr;
+  unsigned *SQ_Array = nullptr;
+  // completion queue
+  unsigned *CQ_Head = nullptr;
+  unsigned *CQ_Tail = nullptr;
+  unsigned *CQ_Mask = nullptr;
+  io_uring_cqe *CQEs = nullptr;
+};
+#else
+struct xTS_UringReader::xRing
+{
+};
+#endif
+
+//=============================================================================================================================================================================
+// xTS_UringReader
+//=============================================================================================================================================================================
+
+xTS_UringReader::xTS_UringReader(size_t BlockSize, uint32_t QueueDepth)
+{
+  if (BlockSize < MaxCarryBytes)
+  {
+    BlockSize = MaxCarryBytes;
+  }
+  this->m_BlockSize = (BlockSize + BlockAlignment - 1) & ~(BlockAlignment - 1);
+  // one block is parsed while the others are read
+  this->m_QueueDepth = QueueDepth >= 2 ? QueueDepth : 2;
+
+  // every block is preceded by carry area, which is rounded up so blocks stay aligned
+  size_t CarrySize = (MaxCarryBytes + BlockAlignment - 1) & ~(BlockAlignment - 1);
+  size_t Stride = CarrySize + m_BlockSize;
+  this->m_Allocation = new uint8_t[Stride * m_QueueDepth + BlockAlignment];
+  uintptr_t Base = ((uintptr_t)m_Allocation + BlockAlignment - 1) & ~(uintptr_t)(BlockAlignment - 1);
+  for (uint32_t BlockIdx = 0; BlockIdx < m_QueueDepth; BlockIdx++)
+  {
+    m_Blocks.push_back((uint8_t *)(Base + BlockIdx * Stride + CarrySize));
+  }
+  m_Requests.resize(m_QueueDepth);
+
+  this->m_File = -1;
+  this->m_FileSize = 0;
+  this->m_NextReadOffset = 0;
+  this->m_Ring.reset(new xRing());
+  this->m_FixedBuffers = false;
+  this->m_CurrentBlock = NOT_VALID;
+  this->m_NextBlock = 0;
+  this->m_ReadError = 0;
+  memset(&m_Statistics, 0, sizeof(m_Statistics));
+  this->m_Window = m_Blocks[0];
+  this->m_EndOfStream = true;
+}
+
+xTS_UringReader::~xTS_UringReader()
+{
+  Close();
+  delete[] m_Allocation;
+}
+
+/**
+  @brief Open regular file and start reading ahead
+  @param FileName is path to input file
+  @return 0 on success, -1 when file cannot be opened or io_uring is not available
+*/
+int32_t xTS_UringReader::Open(const char *FileName)
+{
+  Close();
+#if defined(__linux__)
+  this->m_File = open(FileName, O_RDONLY);
+  if (m_File < 0)
+  {
+    return NOT_VALID;
+  }
+  struct stat FileStat;
+  if (fstat(m_File, &FileStat) != 0 || !S_ISREG(FileStat.st_mode) || xSetupRing() == NOT_VALID)
+  {
+    Close();
+    return NOT_VALID;
+  }
+  this->m_FileSize = (uint64_t)FileStat.st_size;
+  posix_fadvise(m_File, 0, 0, POSIX_FADV_SEQUENTIAL);
+  memset(&m_Statistics, 0, sizeof(m_Statistics));
+  this->m_ReadError = 0;
+  xStart(0);
+  m_SyncScanner.Reset(); // reader may be reused for another file
+  return 0;
+#else
+  (void)FileName;
+  return NOT_VALID;
+#endif
+}
+
+void xTS_UringReader::Close()
+{
+#if defined(__linux__)
+  // kernel may still write into blocks - reads have to finish before blocks can be reused or freed
+  xDrain();
+  xTeardownRing();
+  if (m_File >= 0)
+  {
+    close(m_File);
+  }
+#endif
+  this->m_File = -1;
+  this->m_FileSize = 0;
+  this->m_Window = m_Blocks[0];
+  this->m_WindowSize = 0;
+  this->m_EndOfStream = true;
+}
+
+int32_t xTS_UringReader::Seek(uint64_t Offset)
+{
+  if (m_File < 0 || Offset > m_FileSize)
+  {
+    return NOT_VALID;
+  }
+  xDrain();
+  xStart(Offset);
+  m_SyncScanner.Reset();
+  return 0;
+}
+
+void xTS_UringReader::PrintStatistics(FILE *File) const
+{
+  fprintf(File, "Uring: QueueDepth=%u BlockSize=%zu FixedBuffers=%d Reads=%" PRIu64 " ShortReads=%" PRIu64 " Stalls=%" PRIu64 " BytesRead=%" PRIu64 "\n",
+          m_QueueDepth, m_BlockSize, m_FixedBuffers ? 1 : 0, m_Statistics.NumReads, m_Statistics.NumShortReads, m_Statistics.NumStalls, m_Statistics.NumBytesRead);
+}
+
+size_t xTS_UringReader::xRefill(size_t MinBytes)
+{
+  while (m_WindowSize < MinBytes && !m_EndOfStream)
+  {
+    size_t Carry = m_WindowSize;
+    if (Carry > MaxCarryBytes)
+    {
+      break;
+    }
+    uint32_t BlockIdx = m_NextBlock;
+    xRequest &Request = m_Requests[BlockIdx];
+    if ((!Request.InFlight && !Request.Done) || xWaitFor(BlockIdx) == NOT_VALID)
+    {
+      // whole file read (or read failed)
+      if (m_ReadError == 0)
+      {
+        this->m_ReadError = Request.Error;
+      }
+      this->m_EndOfStream = true;
+      break;
+    }
+
+    // move unconsumed tail in front of next block, then previous block is free for next read
+    uint8_t *Block = m_Blocks[BlockIdx];
+    std::memmove(Block - Carry, m_Window, Carry);
+    if (m_CurrentBlock != NOT_VALID)
+    {
+      xQueue((uint32_t)m_CurrentBlock);
+    }
+    this->m_CurrentBlock = (int32_t)BlockIdx;
+    this->m_NextBlock = (BlockIdx + 1) % m_QueueDepth;
+
+    this->m_Window = Block - Carry;
+    this->m_WindowSize = Carry + Request.Filled;
+    this->m_EndOfStream = Request.FileOffset + Request.Filled >= m_FileSize || Request.Filled < Request.Length;
+    Request.Done = false;
+  }
+  return m_WindowSize;
+}
+
+int32_t xTS_UringReader::xSetupRing()
+{
+#if defined(__linux__)
+  xRing &Ring = *m_Ring;
+  io_uring_params Params;
+  memset(&Params, 0, sizeof(Params));
+  Ring.Descriptor = (int)syscall(__NR_io_uring_setup, m_QueueDepth, &Params);
+  if (Ring.Descriptor < 0)
+  {
+    return NOT_VALID; // no io_uring in kernel, or forbidden (seccomp, io_uring_disabled)
+  }
+
+  Ring.SQ_MapSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+  Ring.CQ_MapSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+  if (Params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    Ring.SQ_MapSize = Ring.CQ_MapSize > Ring.SQ_MapSize ? Ring.CQ_MapSize : Ring.SQ_MapSize;
+  }
+  Ring.SQ_Map = mmap(nullptr, Ring.SQ_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring.Descriptor, IORING_OFF_SQ_RING);
+  if (Ring.SQ_Map == MAP_FAILED)
+  {
+    xTeardownRing();
+    return NOT_VALID;
+  }
+  if (Params.features & IORING_FEAT_SINGLE_MMAP)
+  {
+    Ring.CQ_Map = Ring.SQ_Map;
+  }
+  else
+  {
+    Ring.CQ_Map = mmap(nullptr, Ring.CQ_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring.Descriptor, IORING_OFF_CQ_RING);
+    if (Ring.CQ_Map == MAP_FAILED)
+    {
+      xTeardownRing();
+      return NOT_VALID;
+    }
+  }
+  Ring.SQEs_MapSize = Params.sq_entries * sizeof(io_uring_sqe);
+  Ring.SQEs = (io_uring_sqe *)mmap(nullptr, Ring.SQEs_MapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Ring.Descriptor, IORING_OFF_SQES);
+  if (Ring.SQEs == MAP_FAILED)
+  {
+    xTeardownRing();
+    return NOT_VALID;
+  }
+
+  uint8_t *SQ = (uint8_t *)Ring.SQ_Map;
+  Ring.SQ_Tail = (unsigned *)(SQ + Params.sq_off.tail);
+  Ring.SQ_Mask = (unsigned *)(SQ + Params.sq_off.ring_mask);
+  Ring.SQ_Array = (unsigned *)(SQ + Params.sq_off.array);
+  uint8_t *CQ = (uint8_t *)Ring.CQ_Map;
+  Ring.CQ_Head = (unsigned *)(CQ + Params.cq_off.head);
+  Ring.CQ_Tail = (unsigned *)(CQ + Params.cq_off.tail);
+  Ring.CQ_Mask = (unsigned *)(CQ + Params.cq_off.ring_mask);
+  Ring.CQEs = (io_uring_cqe *)(CQ + Params.cq_off.cqes);
+
+  // registered blocks are pinned once instead of on every read - may fail on memlock limit, plain reads work then
+  std::vector<iovec> Vectors(m_QueueDepth);
+  for (uint32_t BlockIdx = 0; BlockIdx < m_QueueDepth; BlockIdx++)
+  {
+    Vectors[BlockIdx].iov_base = m_Blocks[BlockIdx];
+    Vectors[BlockIdx].iov_len = m_BlockSize;
+  }
+  this->m_FixedBuffers = syscall(__NR_io_uring_register, Ring.Descriptor, IORING_REGISTER_BUFFERS, Vectors.data(), m_QueueDepth) == 0;
+  return 0;
+#else
+  return NOT_VALID;
+#endif
+}
+
+void xTS_UringReader::xTeardownRing()
+{
+#if defined(__linux__)
+  xRing &Ring = *m_Ring;
+  if (Ring.SQEs != MAP_FAILED)
+  {
+    munmap(Ring.SQEs, Ring.SQEs_MapSize);
+  }
+  if (Ring.CQ_Map != MAP_FAILED && Ring.CQ_Map != Ring.SQ_Map)
+  {
+    munmap(Ring.CQ_Map, Ring.CQ_MapSize);
+  }
+  if (Ring.SQ_Map != MAP_FAILED)
+  {
+    munmap(Ring.SQ_Map, Ring.SQ_MapSize);
+  }
+  if (Ring.Descriptor >= 0)
+  {
+    close(Ring.Descriptor); // registered buffers are released with ring
+  }
+  Ring = xRing();
+#endif
+  this->m_FixedBuffers = false;
+}
+
+// reads all blocks starting at file offset, in file order beginning with first block
+void xTS_UringReader::xStart(uint64_t Offset)
+{
+  this->m_NextReadOffset = Offset;
+  this->m_CurrentBlock = NOT_VALID;
+  this->m_NextBlock = 0;
+  for (uint32_t BlockIdx = 0; BlockIdx < m_QueueDepth; BlockIdx++)
+  {
+    m_Requests[BlockIdx] = xRequest{};
+    xQueue(BlockIdx);
+  }
+  this->m_Window = m_Blocks[0];
+  this->m_WindowSize = 0;
+  this->m_WindowOffset = Offset;
+  this->m_EndOfStream = false;
+}
+
+/// @brief Assign next unread part of file to block and submit read, false when whole file is already assigned
+bool xTS_UringReader::xQueue(uint32_t BlockIdx)
+{
+  xRequest &Request = m_Requests[BlockIdx];
+  Request = xRequest{};
+  if (m_NextReadOffset >= m_FileSize)
+  {
+    return false;
+  }
+  uint64_t Remaining = m_FileSize - m_NextReadOffset;
+  Request.FileOffset = m_NextReadOffset;
+  Request.Length = (uint32_t)(Remaining < m_BlockSize ? Remaining : m_BlockSize);
+  this->m_NextReadOffset += Request.Length;
+  xSubmit(BlockIdx);
+  return true;
+}
+
+// submits read of unfilled part of block
+void xTS_UringReader::xSubmit(uint32_t BlockIdx)
+{
+#if defined(__linux__)
+  xRing &Ring = *m_Ring;
+  xRequest &Request = m_Requests[BlockIdx];
+
+  unsigned Tail = *Ring.SQ_Tail; // only this thread produces submissions
+  unsigned Index = Tail & *Ring.SQ_Mask;
+  io_uring_sqe &SQE = Ring.SQEs[Index];
+  memset(&SQE, 0, sizeof(SQE));
+  SQE.opcode = m_FixedBuffers ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  SQE.fd = m_File;
+  SQE.addr = (uint64_t)(uintptr_t)(m_Blocks[BlockIdx] + Request.Filled);
+  SQE.len = Request.Length - Request.Filled;
+  SQE.off = Request.FileOffset + Request.Filled;
+  SQE.buf_index = (uint16_t)BlockIdx;
+  SQE.user_data = BlockIdx;
+  Ring.SQ_Array[Index] = Index;
+  __atomic_store_n(Ring.SQ_Tail, Tail + 1, __ATOMIC_RELEASE);
+
+  long Result;
+  do
+  {
+    Result = syscall(__NR_io_uring_enter, Ring.Descriptor, 1, 0, 0, nullptr, 0);
+  } while (Result < 0 && errno == EINTR);
+  if (Result < 0)
+  {
+    // kernel did not take submission - take it back and fail block, its completion would never arrive
+    Request.Error = -errno;
+    Request.Done = true;
+    __atomic_store_n(Ring.SQ_Tail, Tail, __ATOMIC_RELEASE);
+    return;
+  }
+  Request.InFlight = true;
+  this->m_Statistics.NumReads++;
+#else
+  (void)BlockIdx;
+#endif
+}
+
+/**
+  @brief Wait until block is read completely
+  @param BlockIdx is block to wait for
+  @return 0 when block is read, -1 when read failed
+*/
+int32_t xTS_UringReader::xWaitFor(uint32_t BlockIdx)
+{
+#if defined(__linux__)
+  xRing &Ring = *m_Ring;
+  xRequest &Request = m_Requests[BlockIdx];
+  bool Stalled = false;
+  while (!Request.Done)
+  {
+    unsigned Head = *Ring.CQ_Head; // only this thread consumes completions
+    unsigned Tail = __atomic_load_n(Ring.CQ_Tail, __ATOMIC_ACQUIRE);
+    if (Head == Tail)
+    {
+      Stalled = true;
+      if (syscall(__NR_io_uring_enter, Ring.Descriptor, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+      {
+        // completions cannot be waited for - fail block instead of waiting forever
+        Request.Error = -errno;
+        Request.Done = true;
+      }
+      continue;
+    }
+    const io_uring_cqe &CQE = Ring.CQEs[Head & *Ring.CQ_Mask];
+    uint32_t CompletedIdx = (uint32_t)CQE.user_data;
+    int32_t Result = CQE.res;
+    __atomic_store_n(Ring.CQ_Head, Head + 1, __ATOMIC_RELEASE);
+    xComplete(CompletedIdx, Result);
+  }
+  this->m_Statistics.NumStalls += Stalled ? 1 : 0;
+  return Request.Error == 0 ? 0 : NOT_VALID;
+#else
+  (void)BlockIdx;
+  return NOT_VALID;
+#endif
+}
+
+// account completion of block read, remainder of short read is submitted again
+void xTS_UringReader::xComplete(uint32_t BlockIdx, int32_t Result)
+{
+  xRequest &Request = m_Requests[BlockIdx];
+  Request.InFlight = false;
+  if (Result == -EINTR || Result == -EAGAIN)
+  {
+    xSubmit(BlockIdx);
+    return;
+  }
+  if (Result < 0)
+  {
+    Request.Error = Result;
+    Request.Done = true;
+    return;
+  }
+  Request.Filled += (uint32_t)Result;
+  this->m_Statistics.NumBytesRead += (uint32_t)Result;
+  if (Result > 0 && Request.Filled < Request.Length)
+  {
+    this->m_Statistics.NumShortReads++;
+    xSubmit(BlockIdx);
+    return;
+  }
+  // end of file (file shrank) leaves block partially filled
+  Request.Done = true;
+}
+
+// waits for all reads in flight, kernel must not write into blocks afterwards
+void xTS_UringReader::xDrain()
+{
+  for (uint32_t BlockIdx = 0; BlockIdx < m_Requests.size(); BlockIdx++)
+  {
+    if (m_Requests[BlockIdx].InFlight)
+    {
+      xWaitFor(BlockIdx);
+    }
+    m_Requests[BlockIdx] = xRequest{};
+  }
+}
+
+//=============================================================================================================================================================================
@@ -0,0 +1,101 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsInput.h"
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+/*
+io_uring read-ahead input (Linux):
+  Ring of QueueDepth blocks, each registered with kernel (IORING_REGISTER_BUFFERS) and read with IORING_OP_READ_FIXED,
+  so kernel does not have to map user pages on every read. All blocks but the one being parsed are in flight -
+  while batches of block N are parsed, blocks N+1..N+QueueDepth-1 are being read, and slow storage (network file
+  systems) stalls parser only when it is faster than storage on average, not on every read.
+
+  Blocks are consumed strictly in file order (completions may arrive in any order), block is submitted again for next
+  unread part of file as soon as parser moves to next block. Like in xTS_BlockReader every block is preceded by carry
+  area, so unconsumed tail of previous block is parsed contiguously with the next one.
+  Short reads are completed by resubmitting remainder of block. Failed read or io_uring_enter() fails its block,
+  stream ends there and getReadError() tells it was not end of file.
+
+  liburing is not used - ring is set up with raw system calls (io_uring_setup/io_uring_enter/io_uring_register),
+  only the kernel UAPI header is needed. When kernel has no io_uring (or it is disabled), Open() fails and caller
+  falls back to other reader.
+*/
+
+//=============================================================================================================================================================================
+
+class xTS_UringReader : public xTS_InputSource
+{
+public:
+  static constexpr size_t BlockAlignment = 4096;
+
+  struct xStatistics
+  {
+    uint64_t NumReads;      // submitted reads, including remainders of short reads
+    uint64_t NumShortReads;
+    uint64_t NumStalls;     // next block was not read yet when parser needed it
+    uint64_t NumBytesRead;
+  };
+
+protected:
+  struct xRing;
+  struct xRequest
+  {
+    uint64_t FileOffset; // position of block in file
+    uint32_t Length;     // bytes requested
+    uint32_t Filled;     // bytes read so far
+    bool InFlight;
+    bool Done;
+    int32_t Error;       // negative errno of failed read
+  };
+
+  // setup
+  size_t m_BlockSize;
+  uint32_t m_QueueDepth;
+  // file
+  int m_File;
+  uint64_t m_FileSize;
+  uint64_t m_NextReadOffset;
+  // ring and blocks
+  std::unique_ptr<xRing> m_Ring;
+  bool m_FixedBuffers; // blocks registered in kernel
+  uint8_t *m_Allocation;
+  std::vector<uint8_t *> m_Blocks; // aligned, each preceded by MaxCarryBytes of carry area
+  std::vector<xRequest> m_Requests;
+  int32_t m_CurrentBlock; // block holding window, NOT_VALID before first one
+  uint32_t m_NextBlock;   // next block in file order
+  int32_t m_ReadError;    // negative errno of first failed read, 0 when none
+  xStatistics m_Statistics;
+
+public:
+  xTS_UringReader(size_t BlockSize = DefaultBlockSize, uint32_t QueueDepth = DefaultReadAhead);
+  ~xTS_UringReader() override;
+
+  int32_t Open(const char *FileName) override;
+  void Close() override;
+  bool hasStableBuffers() const override { return false; }
+  int32_t Seek(uint64_t Offset) override;
+
+  void PrintStatistics(FILE *File) const;
+
+public:
+  size_t getBlockSize() const { return m_BlockSize; }
+  uint32_t getQueueDepth() const { return m_QueueDepth; }
+  bool hasFixedBuffers() const { return m_FixedBuffers; }
+  int32_t getReadError() const override { return m_ReadError; }
+  const xStatistics &getStatistics() const { return m_Statistics; }
+
+protected:
+  size_t xRefill(size_t MinBytes) override;
+  int32_t xSetupRing();
+  void xTeardownRing();
+  void xStart(uint64_t Offset);
+  bool xQueue(uint32_t BlockIdx);
+  void xSubmit(uint32_t BlockIdx);
+  int32_t xWaitFor(uint32_t BlockIdx);
+  void xDrain();
+  void xComplete(uint32_t BlockIdx, int32_t Result);
+};
+
+//=============================================================================================================================================================================
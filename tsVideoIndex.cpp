@@ -0,0 +1,333 @@
+#include "tsVideoIndex.h"
+#include "tsPSI.h"
+#include <cinttypes>
+#include <cstring>
+
+//=============================================================================================================================================================================
+// SIMD kernels
+//=============================================================================================================================================================================
+
+static const uint8_t *xFindStartCodeScalar(const uint8_t *Begin, const uint8_t *End)
+{
+  for (const uint8_t *Ptr = Begin; Ptr + 3 <= End; Ptr++)
+  {
+    if (Ptr[2] > 1)
+    {
+      Ptr += 2; // none of three positions ending at Ptr[2] can be start code
+    }
+    else if (Ptr[0] == 0 && Ptr[1] == 0 && Ptr[2] == 1)
+    {
+      return Ptr;
+    }
+  }
+  return End;
+}
+
+#if X_SIMD_X86
+static const uint8_t *xFindStartCodeSSE2(const uint8_t *Begin, const uint8_t *End)
+{
+  const __m128i Zero = _mm_setzero_si128();
+  const __m128i One = _mm_set1_epi8(1);
+  const uint8_t *Ptr = Begin;
+  for (; Ptr + 16 + 2 <= End; Ptr += 16)
+  {
+    __m128i Byte0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)Ptr), Zero);
+    __m128i Byte1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Ptr + 1)), Zero);
+    __m128i Byte2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(Ptr + 2)), One);
+    uint32_t Mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(Byte0, Byte1), Byte2));
+    if (Mask)
+    {
+      return Ptr + xCountTrailingZeros32(Mask);
+    }
+  }
+  return xFindStartCodeScalar(Ptr, End);
+}
+
+X_TARGET_AVX2 static const uint8_t *xFindStartCodeAVX2(const uint8_t *Begin, const uint8_t *End)
+{
+  const __m256i Zero = _mm256_setzero_si256();
+  const __m256i One = _mm256_set1_epi8(1);
+  const uint8_t *Ptr = Begin;
+  for (; Ptr + 32 + 2 <= End; Ptr += 32)
+  {
+    __m256i Byte0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)Ptr), Zero);
+    __m256i Byte1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Ptr + 1)), Zero);
+    __m256i Byte2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(Ptr + 2)), One);
+    uint32_t Mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(Byte0, Byte1), Byte2));
+    if (Mask)
+    {
+      return Ptr + xCountTrailingZeros32(Mask);
+    }
+  }
+  return xFindStartCodeSSE2(Ptr, End);
+}
+#endif
+
+//=============================================================================================================================================================================
+// xES_VideoIndexer
+//=============================================================================================================================================================================
+
+xES_VideoIndexer::xES_VideoIndexer(uint16_t PID, eCodec Codec)
+{
+  this->m_PID = PID;
+  this->m_Codec = Codec;
+  this->m_ZeroRun = 0;
+  this->m_EndOffset = 0;
+  this->m_NumPendingBytes = 0;
+  this->m_PendingOffset = 0;
+  this->m_Pending = false;
+  this->m_FrameOpen = false;
+  this->m_FrameHasVCL = false;
+  this->m_Frame = {};
+  this->m_PTSPending = false;
+  this->m_PTS = 0;
+  this->m_Statistics = {};
+}
+
+const uint8_t *xES_VideoIndexer::FindStartCode(const uint8_t *Begin, const uint8_t *End)
+{
+#if X_SIMD_X86
+  static const bool UseAVX2 = xCpuSupportsAVX2();
+  return UseAVX2 ? xFindStartCodeAVX2(Begin, End) : xFindStartCodeSSE2(Begin, End);
+#else
+  return xFindStartCodeScalar(Begin, End);
+#endif
+}
+
+bool xES_VideoIndexer::isVideoStreamType(uint8_t StreamType, eCodec &Codec)
+{
+  switch (StreamType)
+  {
+  case xPSI_PMT::eStreamType_H264:
+    Codec = eCodec::H264;
+    return true;
+  case xPSI_PMT::eStreamType_H265:
+    Codec = eCodec::HEVC;
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+  @brief Scan elementary stream data of complete PES packet for NAL units
+  @param PID is packet identifier of stream (indexer serves one PID)
+  @param Packet is PES packet, its stream offset is position in demultiplexed output
+*/
+void xES_VideoIndexer::OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet)
+{
+  (void)PID;
+  xPES_PacketHeader PESH;
+  PESH.Parse(Packet.getData(), Packet.getSize());
+  if (PESH.getPTS_DTS_Flags() & xPES_PacketHeader::ePTS_DTS_Flags_PTS)
+  {
+    this->m_PTSPending = true;
+    this->m_PTS = PESH.getPTS();
+  }
+  uint32_t HeaderLength = std::min(PESH.getHeaderLength(), Packet.getSize());
+  xScan(Packet.getData() + HeaderLength, Packet.getSize() - HeaderLength, Packet.getStreamOffset() + HeaderLength);
+}
+
+/**
+  @brief Scan elementary stream data for NAL units
+  @param Data is pointer to elementary stream bytes (PES header stripped)
+  @param Size is number of bytes
+  @param Offset is position of Data in demultiplexed output
+*/
+void xES_VideoIndexer::xScan(const uint8_t *Data, uint32_t Size, uint64_t Offset)
+{
+  if (Size == 0)
+  {
+    return;
+  }
+  const uint8_t *End = Data + Size;
+
+  // NAL unit found at end of previous data waits for its remaining header bytes
+  if (m_Pending)
+  {
+    uint32_t Num = std::min(NumNALBytes - m_NumPendingBytes, Size);
+    std::memcpy(m_PendingBytes + m_NumPendingBytes, Data, Num);
+    this->m_NumPendingBytes += Num;
+    if (m_NumPendingBytes == NumNALBytes)
+    {
+      this->m_Pending = false;
+      xOnNALUnit(m_PendingBytes, m_PendingOffset);
+    }
+  }
+
+  // start codes begun by zero bytes at end of previous data
+  if (m_ZeroRun >= 2 && Data[0] == 1)
+  {
+    xOnStartCode(Data + 1, End, m_EndOffset - 2 - (m_ZeroRun >= 3));
+  }
+  else if (m_ZeroRun >= 1 && Size >= 2 && Data[0] == 0 && Data[1] == 1)
+  {
+    xOnStartCode(Data + 2, End, m_EndOffset - 1 - (m_ZeroRun >= 2));
+  }
+
+  for (const uint8_t *StartCode = FindStartCode(Data, End); StartCode < End; StartCode = FindStartCode(StartCode + 3, End))
+  {
+    // zero_byte of 4 byte start code belongs to NAL unit
+    bool ZeroByte = StartCode > Data ? StartCode[-1] == 0 : m_ZeroRun >= 1;
+    xOnStartCode(StartCode + 3, End, Offset + (uint64_t)(StartCode - Data) - ZeroByte);
+  }
+
+  uint32_t NumTrailingZeros = 0;
+  while (NumTrailingZeros < 3 && NumTrailingZeros < Size && End[-1 - (int32_t)NumTrailingZeros] == 0)
+  {
+    NumTrailingZeros++;
+  }
+  this->m_ZeroRun = NumTrailingZeros == Size ? std::min(m_ZeroRun + Size, 3u) : NumTrailingZeros;
+  this->m_EndOffset = Offset + Size;
+}
+
+void xES_VideoIndexer::OnDiscontinuity(uint16_t PID)
+{
+  (void)PID;
+  // NAL unit split by lost packets cannot be classified, frame being collected keeps its start
+  this->m_Statistics.NumDiscontinuities++;
+  this->m_ZeroRun = 0;
+  this->m_Pending = false;
+}
+
+/// @brief Last access unit ends with stream, StreamSize is size of demultiplexed output
+void xES_VideoIndexer::OnEndOfStream(uint16_t PID, uint64_t StreamSize)
+{
+  (void)PID;
+  this->m_Pending = false;
+  if (m_FrameOpen)
+  {
+    xCloseFrame(StreamSize);
+  }
+}
+
+void xES_VideoIndexer::xOnStartCode(const uint8_t *NAL, const uint8_t *End, uint64_t Offset)
+{
+  if (End - NAL >= (ptrdiff_t)NumNALBytes)
+  {
+    xOnNALUnit(NAL, Offset);
+    return;
+  }
+  this->m_Pending = true;
+  this->m_NumPendingBytes = (uint32_t)(End - NAL);
+  std::memcpy(m_PendingBytes, NAL, m_NumPendingBytes);
+  this->m_PendingOffset = Offset;
+}
+
+// slice_type of H.264 slice starting picture (first_mb_in_slice = 0) is in next 15 bits, Exp-Golomb coded
+static bool xIsIntraSliceH264(const uint8_t *SliceHeader)
+{
+  uint32_t Bits = ((uint32_t)SliceHeader[0] << 8 | SliceHeader[1]) << 1 & 0xFFFF;
+  uint32_t NumLeadingZeros = 0;
+  while (NumLeadingZeros < 4 && (Bits & (0x8000 >> NumLeadingZeros)) == 0)
+  {
+    NumLeadingZeros++;
+  }
+  if (NumLeadingZeros > 3)
+  {
+    return false; // slice_type is at most 9
+  }
+  uint32_t SliceType = (Bits >> (16 - (2 * NumLeadingZeros + 1))) - 1;
+  return SliceType % 5 == 2 || SliceType % 5 == 4; // I or SI
+}
+
+void xES_VideoIndexer::xOnNALUnit(const uint8_t *NAL, uint64_t Offset)
+{
+  this->m_Statistics.NumNALUnits++;
+
+  bool Delimiter;
+  bool VCL;
+  bool FirstSlice;
+  uint8_t Flags = 0;
+  if (m_Codec == eCodec::H264)
+  {
+    uint8_t Type = NAL[0] & 0x1F;
+    VCL = Type >= 1 && Type <= 5;
+    Delimiter = (Type >= 6 && Type <= 9) || (Type >= 14 && Type <= 18);
+    FirstSlice = VCL && (NAL[1] & 0x80) != 0;
+    if (Type == 5)
+    {
+      Flags = eFlags_Keyframe | eFlags_IDR;
+    }
+    else if (FirstSlice && xIsIntraSliceH264(NAL + 1))
+    {
+      Flags = eFlags_Keyframe;
+    }
+  }
+  else
+  {
+    uint8_t Type = (NAL[0] >> 1) & 0x3F;
+    VCL = Type <= 31;
+    Delimiter = (Type >= 32 && Type <= 35) || Type == 39 || (Type >= 41 && Type <= 44) || (Type >= 48 && Type <= 55);
+    FirstSlice = VCL && (NAL[2] & 0x80) != 0;
+    if (Type >= 16 && Type <= 23)
+    {
+      Flags = (Type == 19 || Type == 20) ? (eFlags_Keyframe | eFlags_IDR) : eFlags_Keyframe;
+    }
+  }
+
+  if ((Delimiter || FirstSlice) && m_FrameHasVCL)
+  {
+    xCloseFrame(Offset);
+  }
+  if (!m_FrameOpen)
+  {
+    xOpenFrame(Offset);
+  }
+  if (VCL)
+  {
+    this->m_FrameHasVCL = true;
+    this->m_Frame.Flags |= Flags;
+  }
+}
+
+void xES_VideoIndexer::xOpenFrame(uint64_t Offset)
+{
+  this->m_FrameOpen = true;
+  this->m_FrameHasVCL = false;
+  this->m_Frame = {};
+  this->m_Frame.Offset = Offset;
+  if (m_PTSPending)
+  {
+    this->m_Frame.PTS = m_PTS;
+    this->m_Frame.Flags = eFlags_PTS;
+    this->m_PTSPending = false;
+  }
+}
+
+void xES_VideoIndexer::xCloseFrame(uint64_t EndOffset)
+{
+  this->m_FrameOpen = false;
+  this->m_Frame.Size = (uint32_t)(EndOffset - m_Frame.Offset);
+  m_Frames.push_back(m_Frame);
+  this->m_Statistics.NumFrames++;
+  this->m_Statistics.NumKeyframes += (m_Frame.Flags & eFlags_Keyframe) != 0;
+  this->m_Statistics.NumIDR += (m_Frame.Flags & eFlags_IDR) != 0;
+}
+
+void xES_VideoIndexer::WriteIndexHeader(FILE *File)
+{
+  fprintf(File, "pid,offset,size,pts,keyframe,idr\n");
+}
+
+void xES_VideoIndexer::WriteIndex(FILE *File) const
+{
+  for (const xFrame &Frame : m_Frames)
+  {
+    fprintf(File, "%u,%" PRIu64 ",%u,", m_PID, Frame.Offset, Frame.Size);
+    if (Frame.Flags & eFlags_PTS)
+    {
+      fprintf(File, "%" PRIu64, Frame.PTS);
+    }
+    fprintf(File, ",%u,%u\n", (Frame.Flags & eFlags_Keyframe) ? 1 : 0, (Frame.Flags & eFlags_IDR) ? 1 : 0);
+  }
+}
+
+void xES_VideoIndexer::PrintStatistics(FILE *File) const
+{
+  fprintf(File, "Frames: PID=%u Codec=%s NALUnits=%" PRIu64 " Frames=%" PRIu64 " Keyframes=%" PRIu64 " IDR=%" PRIu64 " Discontinuities=%" PRIu64 "\n",
+          m_PID, m_Codec == eCodec::H264 ? "H.264" : "HEVC", m_Statistics.NumNALUnits, m_Statistics.NumFrames, m_Statistics.NumKeyframes,
+          m_Statistics.NumIDR, m_Statistics.NumDiscontinuities);
+}
+
+//=============================================================================================================================================================================
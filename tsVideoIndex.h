@@ -0,0 +1,119 @@
+#pragma once
+#include "tsCommon.h"
+#include "tsTransportStream.h"
+#include "tsDemux.h"
+#include <cstdio>
+#include <vector>
+
+/*
+Video frame indexer (H.264 / HEVC):
+  Runs as PES consumer of demultiplexed video PID (registered with its assembler), so frame boundaries are found
+  while payload is written - no second pass over output file. Every complete PES packet is scanned in its pooled
+  buffer, no copy is made. Start codes (00 00 01) are searched with SIMD (three shifted loads compared at once, 32 or
+  16 positions per step), only bytes around found start codes are looked at individually. Search state (trailing
+  zero bytes, NAL header bytes still missing) is kept across PES packets, so start codes split between packets are
+  found too. Damaged PES packets are dropped by assembler, data before and after them is not joined.
+
+  NAL unit is classified by its header and first bits of slice header (NumNALBytes after start code):
+    H.264 (ISO/IEC 14496-10 7.4.1.2.3) - AUD, SEI, SPS, PPS and types 14..18 start access unit after slice,
+                                         slice with first_mb_in_slice = 0 starts new picture,
+                                         IDR slice (type 5) and I/SI slice_type make keyframe
+    HEVC  (ISO/IEC 23008-2 7.4.2.4.4)  - AUD, VPS, SPS, PPS, prefix SEI and types 41..44, 48..55 start access unit
+                                         after slice, slice with first_slice_segment_in_pic_flag starts new picture,
+                                         IRAP slices (types 16..23) make keyframe, IDR are types 19 and 20
+  Access unit spans from its first NAL unit (with zero_byte of 4 byte start code) to first NAL unit of next one.
+  PTS of PES packet belongs to first access unit starting in that PES packet.
+
+  Frame offsets and sizes are positions in demultiplexed output (PES headers included), i.e. in file written by
+  stream sink (PID<PID>.264). Index is written as CSV: pid,offset,size,pts,keyframe,idr (pts empty when unknown).
+*/
+
+//=============================================================================================================================================================================
+
+class xES_VideoIndexer : public xPES_Consumer
+{
+public:
+  enum class eCodec : uint8_t
+  {
+    H264,
+    HEVC,
+  };
+
+  enum eFlags : uint8_t
+  {
+    eFlags_Keyframe = 0x01,
+    eFlags_IDR = 0x02,
+    eFlags_PTS = 0x04,
+  };
+
+  static constexpr uint32_t NumNALBytes = 3; // bytes after start code needed to classify NAL unit
+
+  struct xFrame
+  {
+    uint64_t Offset;
+    uint64_t PTS; // 90 kHz, valid with eFlags_PTS
+    uint32_t Size;
+    uint8_t Flags;
+  };
+
+  struct xStatistics
+  {
+    uint64_t NumNALUnits;
+    uint64_t NumFrames;
+    uint64_t NumKeyframes;
+    uint64_t NumIDR;
+    uint64_t NumDiscontinuities;
+  };
+
+protected:
+  // setup
+  uint16_t m_PID;
+  eCodec m_Codec;
+  // start code search state
+  uint32_t m_ZeroRun;   // zero bytes at end of data scanned so far (counted up to 3)
+  uint64_t m_EndOffset; // offset right after last scanned byte
+  uint32_t m_NumPendingBytes;
+  uint8_t m_PendingBytes[NumNALBytes]; // NAL unit whose start code ended data, waits for remaining bytes
+  uint64_t m_PendingOffset;
+  bool m_Pending;
+  // access unit being collected
+  bool m_FrameOpen;
+  bool m_FrameHasVCL;
+  xFrame m_Frame;
+  // PTS of last PES packet, waits for first access unit starting in it
+  bool m_PTSPending;
+  uint64_t m_PTS;
+  // results
+  std::vector<xFrame> m_Frames;
+  xStatistics m_Statistics;
+
+public:
+  xES_VideoIndexer(uint16_t PID, eCodec Codec);
+
+  void OnPESPacket(uint16_t PID, const xPES_PacketRef &Packet) override;
+  void OnDiscontinuity(uint16_t PID) override;
+  void OnEndOfStream(uint16_t PID, uint64_t StreamSize) override;
+
+  void WriteIndex(FILE *File) const;
+  void PrintStatistics(FILE *File) const;
+  static void WriteIndexHeader(FILE *File);
+
+  // first 00 00 01 start code in [Begin, End) (End when there is none)
+  static const uint8_t *FindStartCode(const uint8_t *Begin, const uint8_t *End);
+  static bool isVideoStreamType(uint8_t StreamType, eCodec &Codec);
+
+public:
+  uint16_t getPID() const { return m_PID; }
+  eCodec getCodec() const { return m_Codec; }
+  const std::vector<xFrame> &getFrames() const { return m_Frames; }
+  const xStatistics &getStatistics() const { return m_Statistics; }
+
+protected:
+  void xScan(const uint8_t *Data, uint32_t Size, uint64_t Offset);
+  void xOnStartCode(const uint8_t *NAL, const uint8_t *End, uint64_t Offset);
+  void xOnNALUnit(const uint8_t *NAL, uint64_t Offset);
+  void xOpenFrame(uint64_t Offset);
+  void xCloseFrame(uint64_t EndOffset);
+};
+
+//=============================================================================================================================================================================